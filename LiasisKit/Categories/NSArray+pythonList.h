@@ -59,6 +59,10 @@
  *          If returning nil from the block or if an internal error occurs, the
  *          method will stop, create an error object, and return nil.
  *
+ *          The method holds the GIL through PyGILState_Ensure() while it
+ *          enumerates the sequence, so it may be called from any thread, and
+ *          the block is called with the GIL held.
+ *
  * \param pySequence A Python list or tuple.
  *
  * \param error On input, a pointer to a pointer for an error object. If an
@@ -43,6 +43,7 @@
         PyObject * pyItem = NULL;
         Py_ssize_t (*sequenceSize)(PyObject *);
         PyObject * (*sequenceGetItem)(PyObject *, Py_ssize_t);
+        PyGILState_STATE gilState = PyGILState_Ensure();
         
         if (PyList_Check(pySequence)) {
                 sequenceSize = PyList_Size;
@@ -72,6 +73,7 @@
         }
 
 exit:
+        PyGILState_Release(gilState);
         if (errorMessage && error) {
                 *error = [NSError errorWithDomain:PLLiasisErrorDomain
                                              code:PLErrorCodeLog
@@ -89,6 +89,10 @@
  *          If returning nil from the block or if an internal error occurs, the
  *          method will stop, create an error object, and return nil.
  *
+ *          The method holds the GIL through PyGILState_Ensure() while it
+ *          enumerates the dict, so it may be called from any thread, and the
+ *          block is called with the GIL held.
+ *
  * \param pyDict A Python dict.
  *
  * \param error On input, a pointer to a pointer for an error object. If an
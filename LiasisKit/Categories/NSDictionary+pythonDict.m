@@ -63,6 +63,7 @@
         PyObject * pyKeys = NULL;
         PyObject * pyKey = NULL;
         PyObject * pyValue = NULL;
+        PyGILState_STATE gilState = PyGILState_Ensure();
         
         if (PyDict_Check(pyDict) == 0) {
                 errorMessage = @"Input argument is not a python dict.";
@@ -100,6 +101,7 @@
         
 exit:
         Py_XDECREF(pyKeys);
+        PyGILState_Release(gilState);
         if (errorMessage && error) {
                 *error = [NSError errorWithDomain:PLLiasisErrorDomain
                                              code:PLErrorCodeLog
@@ -33,6 +33,8 @@
 #import <Foundation/Foundation.h>
 #import "PLDocument.h"
 
+@class PLTextStorage;
+
 /**
  * \class PLTextDocument \headerfile \headerfile
  *
@@ -81,5 +83,20 @@
  */
 -(NSString *)currentString;
 
+#pragma mark Displaying a document
+
+/**
+ * \brief Method that returns a new text storage with the string represented by
+ *        the document object, to be edited by a text view.
+ *
+ * \details The text storage is backed by a rope, so that typing stays fast
+ *          anywhere in large documents, and the snapshots read by the syntax
+ *          highlighter on a background thread are taken in O(1).
+ *
+ * \return A PLTextStorage instance with the rope backing store, owned by the
+ *         caller.
+ */
+-(PLTextStorage *)newTextStorage;
+
 
 @end
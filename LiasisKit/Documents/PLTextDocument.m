@@ -29,6 +29,7 @@
 
 #import "PLTextDocument.h"
 #import "PLDocumentManager.h"
+#import "PLTextStorage.h"
 
 @implementation PLTextDocument
 
@@ -82,6 +83,14 @@ exit:
         return areEqual;
 }
 
+#pragma mark Displaying a document
+
+-(PLTextStorage *)newTextStorage
+{
+        return [[PLTextStorage alloc] initWithString:[self currentString]
+                                        backingStore:PLTextStorageBackingStoreRope];
+}
+
 #pragma mark Modifying a document
 
 -(BOOL)editCharactersInRange:(NSRange)aRange withString:(NSString *)aString
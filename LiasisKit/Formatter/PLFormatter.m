@@ -28,6 +28,7 @@
  */
 
 #import "PLFormatter.h"
+#import "PLTextStorage.h"
 
 #pragma mark Formatter Strings and Patterns
 
@@ -165,6 +166,23 @@ static BOOL lineInTextMatchesPattern(NSString * pattern, NSString * text, NSRang
  */
 static BOOL isLineOnlyWhitespace(NSString * text, NSUInteger index);
 
+/**
+ * \brief Function to find the range of the lines containing a range of
+ *        characters in a text view.
+ *
+ * \details Function queries the line index of the text view's PLTextStorage,
+ *          which avoids scanning the text for line terminators. If the text
+ *          view does not use a PLTextStorage, the text view string is scanned
+ *          with the NSString lineRangeForRange: method.
+ *
+ * \param textView The NSTextView containing the characters.
+ *
+ * \param range The range of characters.
+ *
+ * \return The range of the lines containing the range of characters.
+ */
+static NSRange lineRangeInTextView(NSTextView * textView, NSRange range);
+
 #pragma mark Utility Functions (Implementation)
 
 static NSUInteger characterIndexForMatchingBracket(NSString * text, NSUInteger lineWithBracket)
@@ -281,6 +299,14 @@ static BOOL isLineOnlyWhitespace(NSString * text, NSUInteger index)
         return nonWhitespaceRange.location == NSNotFound;
 }
 
+static NSRange lineRangeInTextView(NSTextView * textView, NSRange range)
+{
+        NSTextStorage * textStorage = [textView textStorage];
+        if ([textStorage isKindOfClass:[PLTextStorage class]])
+                return [(PLTextStorage *)textStorage lineRangeForRange:range];
+        return [[textView string] lineRangeForRange:range];
+}
+
 #pragma mark -
 
 @implementation PLFormatter
@@ -381,7 +407,7 @@ static BOOL isLineOnlyWhitespace(NSString * text, NSUInteger index)
         selectedRange = [textView selectedRange];
         indentationPositions = [PLFormatter indentationLocationOfLines:[textView string] inRange:selectedRange];
         firstIndentationPosition = [[indentationPositions objectAtIndex:0] unsignedIntegerValue];
-        firstLineRange = [[textView string] lineRangeForRange:NSMakeRange(firstIndentationPosition, 0)];
+        firstLineRange = lineRangeInTextView(textView, NSMakeRange(firstIndentationPosition, 0));
         
         /* Increase indentation level of each line. */
         [[textView textStorage] beginEditing];
@@ -417,7 +443,7 @@ static BOOL isLineOnlyWhitespace(NSString * text, NSUInteger index)
         selectedRange = [textView selectedRange];
         indentationPositions = [PLFormatter indentationLocationOfLines:[textView string] inRange:selectedRange];
         firstIndentationPosition = [[indentationPositions objectAtIndex:0] unsignedIntegerValue];
-        firstLineRange = [[textView string] lineRangeForRange:NSMakeRange(firstIndentationPosition, 0)];
+        firstLineRange = lineRangeInTextView(textView, NSMakeRange(firstIndentationPosition, 0));
         totalDeletionLength = 0;
         firstLineDeletionLength = 0;
         
@@ -425,7 +451,7 @@ static BOOL isLineOnlyWhitespace(NSString * text, NSUInteger index)
         [[textView textStorage] beginEditing];
         for (NSNumber * indentationPosition in indentationPositions) {
                 modifiedPosition = [indentationPosition unsignedIntegerValue] - totalDeletionLength;
-                lineRange = [[textView string] lineRangeForRange:NSMakeRange(modifiedPosition, 0)];
+                lineRange = lineRangeInTextView(textView, NSMakeRange(modifiedPosition, 0));
                 
                 if (modifiedPosition - lineRange.location >= [PLFormatterIndentationString length])
                         deletionLength = [PLFormatterIndentationString length];
@@ -483,7 +509,7 @@ static BOOL isLineOnlyWhitespace(NSString * text, NSUInteger index)
         
         /* Find minimum indentation level */
         for (NSNumber * indentationPosition in indentationPositions) {
-                lineRange = [text lineRangeForRange:NSMakeRange([indentationPosition unsignedIntegerValue], 0)];
+                lineRange = lineRangeInTextView(textView, NSMakeRange([indentationPosition unsignedIntegerValue], 0));
                 indentationLevel = [indentationPosition unsignedIntegerValue] - lineRange.location;
                 
                 if (isLineOnlyWhitespace(text, lineRange.location) == NO &&
@@ -495,7 +521,7 @@ static BOOL isLineOnlyWhitespace(NSString * text, NSUInteger index)
         
         /* Determine which lines are commented and save the starting position to add/remove comment string */
         for (NSNumber * indentationPosition in indentationPositions) {
-                lineRange = [text lineRangeForRange:NSMakeRange([indentationPosition unsignedIntegerValue], 0)];
+                lineRange = lineRangeInTextView(textView, NSMakeRange([indentationPosition unsignedIntegerValue], 0));
                 lineString = [text substringWithRange:lineRange];
                 lineStartIndex = lineRange.location + minIndentationLevel;
                 
@@ -542,7 +568,7 @@ static BOOL isLineOnlyWhitespace(NSString * text, NSUInteger index)
                 } else
                         insertionPositions = uncommentedPositions;
                 [insertionPositions enumerateObjectsUsingBlock:^(NSNumber * position, NSUInteger index, BOOL * stop) {
-                        lineRange = [text lineRangeForRange:NSMakeRange([position unsignedIntegerValue], 0)];
+                        lineRange = lineRangeInTextView(textView, NSMakeRange([position unsignedIntegerValue], 0));
                         modifiedPosition = [position unsignedIntegerValue] + ([commentString length] * index);
                         [textStorage replaceCharactersInRange:NSMakeRange(modifiedPosition, 0) withString:commentString];
                         
@@ -629,7 +655,7 @@ exit:
  */
 -(BOOL)didFormatAfterTab:(NSTextView *)textView withReplacementString:(NSString *)replacementString inRange:(NSRange)affectedRange
 {
-        NSRange lineRange = [[textView string] lineRangeForRange:affectedRange];
+        NSRange lineRange = lineRangeInTextView(textView, affectedRange);
         NSUInteger properIndentationLocation;
         properIndentationLocation = [PLFormatter indentationLocationInText:[textView string] atIndex:affectedRange.location];
         
@@ -645,8 +671,8 @@ exit:
                 previousEntryRange = NSMakeRange([[textView string] length], 0);
         else
                 previousEntryRange = NSMakeRange(previousEntryLocation, 0);
-        NSRange previousEntryLine = [[textView string] lineRangeForRange:previousEntryRange];
-        NSRange affectedLine = [[textView string] lineRangeForRange:affectedRange];
+        NSRange previousEntryLine = lineRangeInTextView(textView, previousEntryRange);
+        NSRange affectedLine = lineRangeInTextView(textView, affectedRange);
         
         if ([previousEntry isEqualToString:@"\t"] &&
             affectedLine.location == previousEntryLine.location &&
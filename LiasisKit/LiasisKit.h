@@ -32,6 +32,14 @@
 #import "PLThemeManager.h"
 #import "PLThemeable.h"
 #import "PLSyntaxHighlighter.h"
+#import "PLLexerStates.h"
+#import "PLPythonTokenizer.h"
+#import "PLSourceBuffer.h"
+#import "PLStyleTable.h"
+#import "PLTokenCache.h"
+#import "PLSemanticOverlay.h"
+#import "PLSyntaxHighlightingMetrics.h"
+#import "PLSyntaxHighlightingPass.h"
 
 #import "PLDocumentManager.h"
 #import "PLDocument.h"
@@ -41,8 +49,16 @@
 #import "PLScroller.h"
 #import "PLAutocompleteViewController.h"
 #import "PLTextStorage.h"
+#import "PLLineIndex.h"
+#import "PLRopeString.h"
+#import "PLRopeAttributedString.h"
+#import "PLStyleRunArray.h"
+#import "PLEditJournal.h"
+#import "PLTextSnapshot.h"
 #import "PLFormatter.h"
 #import "PLLineNumberView.h"
+#import "PLMarkerIndex.h"
+#import "PLDigitAtlas.h"
 #import "PLNavigationPopUpButton.h"
 #import "PLNavigationItem.h"
 
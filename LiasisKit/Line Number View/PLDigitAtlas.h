@@ -0,0 +1,116 @@
+/**
+ * \file PLDigitAtlas.h
+ * \brief Liasis Python IDE digit atlas interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for an object
+ * drawing numbers from an image of pre-measured digits of a font.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <AppKit/AppKit.h>
+
+/**
+ * \class PLDigitAtlas \headerfile \headerfile
+ * \brief Draw numbers from an image of the ten digits of a font.
+ *
+ * \details The digits 0 to 9 are measured once and rendered side by side
+ *          into a single image, which AppKit rasterizes lazily for the
+ *          resolution of the destination. A number is drawn by compositing
+ *          the cell of each of its digits, so drawing does not create text
+ *          objects or lay out glyphs, and the memory used is independent of
+ *          how many numbers are drawn.
+ */
+@interface PLDigitAtlas : NSObject {
+        /**
+         * \brief The image with the digits 0 to 9, in order.
+         */
+        NSImage * atlas;
+
+        /**
+         * \brief The horizontal offset of each digit in the atlas. The last
+         *        element is the width of the atlas.
+         */
+        CGFloat digitOffsets[11];
+
+        /**
+         * \brief The height of the atlas.
+         */
+        CGFloat height;
+
+        /**
+         * \brief The font of the digits.
+         */
+        NSFont * font;
+
+        /**
+         * \brief The color of the digits.
+         */
+        NSColor * color;
+}
+
+/**
+ * \brief Initialize the atlas with the digits of a font in a color.
+ *
+ * \param aFont The font of the digits.
+ *
+ * \param aColor The color of the digits.
+ */
+-(id)initWithFont:(NSFont *)aFont color:(NSColor *)aColor;
+
+/**
+ * \brief The font of the digits.
+ */
+@property (readonly, retain) NSFont * font;
+
+/**
+ * \brief The color of the digits.
+ */
+@property (readonly, retain) NSColor * color;
+
+/**
+ * \brief The height of a drawn number.
+ */
+@property (readonly) CGFloat height;
+
+/**
+ * \brief Return the width of a number drawn in decimal digits.
+ */
+-(CGFloat)widthOfNumber:(NSUInteger)number;
+
+/**
+ * \brief Draw a number in decimal digits, right-aligned in a rect.
+ *
+ * \details The digits are drawn upright in the current graphics context,
+ *          starting at the minimum y of the rect, which is the top of the rect
+ *          in a flipped view such as a ruler view. Digits that do not fit in
+ *          the rect are not clipped.
+ *
+ * \param number The number to draw.
+ *
+ * \param rect The rect in which to right-align the number.
+ */
+-(void)drawNumber:(NSUInteger)number inRect:(NSRect)rect;
+
+@end
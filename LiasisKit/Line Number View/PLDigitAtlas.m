@@ -0,0 +1,130 @@
+/**
+ * \file PLDigitAtlas.m
+ * \brief Liasis Python IDE digit atlas implementation file.
+ *
+ * \details
+ * This file contains the method implementation for an object
+ * drawing numbers from an image of pre-measured digits of a font.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLDigitAtlas.h"
+
+/**
+ * \brief The decimal digits of the atlas, in order.
+ */
+static NSString * const digitStrings[10] = {@"0", @"1", @"2", @"3", @"4", @"5", @"6", @"7", @"8", @"9"};
+
+/**
+ * \brief Measure the offset of each digit in an atlas drawn with attributes.
+ *
+ * \param attributes The text attributes of the digits.
+ *
+ * \param offsets A C array of 11 elements set to the offset of each digit,
+ *                followed by the width of the atlas.
+ */
+static void measureDigitOffsets(NSDictionary * attributes, CGFloat * offsets)
+{
+        NSUInteger digit;
+        offsets[0] = 0.0f;
+        for (digit = 0; digit < 10; digit++)
+                offsets[digit + 1] = offsets[digit] + [digitStrings[digit] sizeWithAttributes:attributes].width;
+}
+
+@implementation PLDigitAtlas
+
+-(id)initWithFont:(NSFont *)aFont color:(NSColor *)aColor
+{
+        NSDictionary * attributes;
+        self = [super init];
+        if (self) {
+                font = [aFont retain];
+                color = [aColor retain];
+                attributes = [NSDictionary dictionaryWithObjectsAndKeys:
+                              font, NSFontAttributeName,
+                              color, NSForegroundColorAttributeName,
+                              nil];
+                measureDigitOffsets(attributes, digitOffsets);
+                height = [digitStrings[0] sizeWithAttributes:attributes].height;
+                atlas = [[NSImage imageWithSize:NSMakeSize(digitOffsets[10], height)
+                                        flipped:YES
+                                 drawingHandler:^BOOL(NSRect dstRect) {
+                                         CGFloat offsets[11];
+                                         NSUInteger digit;
+                                         measureDigitOffsets(attributes, offsets);
+                                         for (digit = 0; digit < 10; digit++)
+                                                 [digitStrings[digit] drawAtPoint:NSMakePoint(offsets[digit], 0.0f)
+                                                                   withAttributes:attributes];
+                                         return YES;
+                                 }] retain];
+        }
+        return self;
+}
+
+-(void)dealloc
+{
+        [atlas release];
+        [font release];
+        [color release];
+        [super dealloc];
+}
+
+@synthesize font;
+
+@synthesize color;
+
+@synthesize height;
+
+-(CGFloat)widthOfNumber:(NSUInteger)number
+{
+        CGFloat width = 0.0f;
+        NSUInteger digit;
+        do {
+                digit = number % 10;
+                width += digitOffsets[digit + 1] - digitOffsets[digit];
+                number /= 10;
+        } while (number > 0);
+        return width;
+}
+
+-(void)drawNumber:(NSUInteger)number inRect:(NSRect)rect
+{
+        CGFloat x, width;
+        NSUInteger digit;
+        x = NSMaxX(rect);
+        do {
+                digit = number % 10;
+                width = digitOffsets[digit + 1] - digitOffsets[digit];
+                x -= width;
+                [atlas drawInRect:NSMakeRect(x, NSMinY(rect), width, height)
+                         fromRect:NSMakeRect(digitOffsets[digit], 0.0f, width, height)
+                        operation:NSCompositeSourceOver
+                         fraction:1.0f
+                   respectFlipped:YES
+                            hints:nil];
+                number /= 10;
+        } while (number > 0);
+}
+
+@end
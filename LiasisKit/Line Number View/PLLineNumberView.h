@@ -33,72 +33,86 @@
  */
 
 #import <AppKit/AppKit.h>
+#import "PLMarkerIndex.h"
+#import "PLDigitAtlas.h"
+#import "PLTextStorage.h"
 
 /**
  * \class PLLineNumberView \headerfile \headerfile
  * \brief A NSRulerView subclass that displays the line number for each line of text
  *        in a text view within a NSScrollView.
  *
- * \details The PLLineNumberView overrides the NSRulerView functionality, and uses 
- *          NSTextFields for line number labels, which are used during layout and 
- *          display calculations. Line number labels are attached to specific
- *          y-coordinates that match the line number in the NSTextView. The line 
- *          number view's bounds change to move the labels during scrolling.
+ * \details The PLLineNumberView overrides the NSRulerView functionality, and
+ *          draws the line numbers at the y-coordinates of the lines in the
+ *          NSTextView. The line number view's bounds change to move the line
+ *          numbers during scrolling.
  *          Important note: for this to work, the scroll view's contentView
  *          associated with this ruler must have postsBoundsChangedNotification
  *          set to YES. This is done here, but it must not be set to NO
  *          elsewhere.
  *
  *          The line number view uses several features to optimize line number
- *          calculation and display. Line numbers are calculated based on the 
- *          current state of the text with relation to the future state of the 
- *          text. Because of this, the line number view is designed to be 
- *          compatible only with a text view using a PLTextStorage object by
- *          calculating changes during a PLTextStorageWillReplaceStringNotification.
- *
- *          The frame for the line number NSTextField objects are cached in a 
- *          mutable dictionary to avoid excessive line rect calculations within
- *          the NSTextView by the NSLayoutManager object during scrolling.
- *          Editing at a line removes all cached line numbers text fields following
- *          the line number of the edited range. Resizing the width of the
- *          NSScrollView removes all the cached line number text fields.
+ *          calculation and display. Line numbers are queried from the line
+ *          index maintained by the PLTextStorage of the client view, and the
+ *          markers are updated from the edited line range it reports. Because
+ *          of this, the line number view is designed to be compatible only
+ *          with a text view using a PLTextStorage object, and is one of its
+ *          observers of the edits of the characters. Edits of the attributes
+ *          alone, such as syntax highlighting, do not update the markers nor
+ *          redisplay the ruler.
+ *
+ *          The positions of the lines in the viewport are cached, to avoid
+ *          excessive line rect calculations within the NSTextView by the
+ *          NSLayoutManager object during scrolling. The cache is invalidated by
+ *          edits of the characters at or before the cached lines and by
+ *          resizing the client view. The line numbers themselves are drawn from
+ *          a PLDigitAtlas, so no object is created per line. The font metrics
+ *          and the rule thickness are cached until the font or the number of
+ *          digits of the last line number change. Scrolling copies the pixels
+ *          already drawn, and only the exposed strip of the ruler is redrawn.
  *
  *          Important note: the clientView associated with this ruler must have
  *          postsFrameChangedNotification set to YES. This is done here, but it
  *          must not be set to NO elsewhere.
  *
  * \see PLTextStorage
- * \see PLTextStorageWillReplaceStringNotification
+ * \see PLTextStorageObserver
  */
-@interface PLLineNumberView : NSRulerView {
+@interface PLLineNumberView : NSRulerView <PLTextStorageObserver> {
         /**
-         * \brief Dictionary relating the line number and the NSTextField
-         *        containing formatting and positional information for drawing
-         *        line numbers.
+         * \brief The digits used to draw the line numbers.
          *
-         * An NSMutableDictionary that stores the NSTextField's that have been
-         * used, in order to optimize scrolling efficiency. The dictionary
-         * is routinely cleared upon changing the text view frame size.
-         * Text fields for lines that are downstream of an edited line are also 
-         * removed, as this does not severely impact scrolling performance and 
-         * serves as a routine purge of excess memory usage.
+         * A PLDigitAtlas with the digits of the line number font in the text
+         * color. The atlas is created when first drawing, and recreated when
+         * the font or the text color change.
          */
-        NSMutableDictionary * lineNumberLabels;
+        PLDigitAtlas * digitAtlas;
         /**
-         * \brief Dictionary relating position in text with physical line number.
-         *
-         * An NSMutableDictionary relating a physical line in a string and the index 
-         * of the first character of that line. The keys are NSString objects and 
-         * the values are NSNumber objects.
+         * \brief The digits used to draw the line numbers of marked lines.
+         */
+        PLDigitAtlas * markedDigitAtlas;
+        /**
+         * \brief The font from which the font metrics and digit atlases were
+         *        computed.
+         */
+        NSFont * rulerFont;
+        /**
+         * \brief The width of a digit of the rulerFont, plus one point.
+         */
+        CGFloat digitWidth;
+        /**
+         * \brief The height of a line of the rulerFont.
          */
-        NSMutableDictionary * lineNumberIndex;
+        CGFloat lineHeight;
         /**
-         * \brief Set of line numbers with exact occurance of breakpoint string.
+         * \brief Markers at the lines with exact occurance of breakpoint string.
          *
-         * An NSMutableSet object with NSString objects containing the line 
-         * number at which a breakpoint string is found.
+         * A PLMarkerIndex with a marker anchored at the first character of
+         * each line at which a breakpoint string is found. The markers move
+         * with edits of the text without being visited, and are queried by
+         * the range of visible lines.
          */
-        NSMutableSet * markers;     
+        PLMarkerIndex * markers;
         /**
          * \brief The background color of the client view.
          *
@@ -119,6 +133,42 @@
          * \brief The width of the gutter between text view and the line numbering.
          */
         CGFloat gutterThickness;
+        /**
+         * \brief The cached lines of the viewport.
+         *
+         * A C array with the line number, character range, y-origin and height
+         * of each consecutive line in the rect last drawn. Scrolling drops and
+         * adds lines at either end of the array, and the array is only rebuilt
+         * when it is invalidated or no longer overlaps the drawn rect.
+         */
+        struct PLRulerLine * visibleLines;
+        /**
+         * \brief The number of lines in the visibleLines array.
+         */
+        NSUInteger numberOfVisibleLines;
+        /**
+         * \brief The number of lines the visibleLines array can hold.
+         */
+        NSUInteger visibleLinesCapacity;
+        /**
+         * \brief Counter incremented by layout changes and by edits touching the
+         *        cached lines of the viewport.
+         */
+        NSUInteger layoutGeneration;
+        /**
+         * \brief The layout generation in which the visibleLines were computed.
+         */
+        NSUInteger visibleLinesGeneration;
+        /**
+         * \brief Whether the positions of lines that are not laid out are
+         *        estimated.
+         */
+        BOOL usesEstimatedLineHeights;
+        /**
+         * \brief The height of a line of the client view font, used to
+         *        estimate the position of lines that are not laid out.
+         */
+        CGFloat estimatedLineHeight;
 }
 
 #pragma mark Setters and Getters
@@ -192,6 +242,20 @@
  */
 -(NSUInteger)numberOfLines;
 
+/**
+ * \brief Whether the line number view places lines that are not laid out yet
+ *        at estimated positions.
+ *
+ * \details The line number view switches to estimated line heights when the
+ *          text of the client view reaches 100,000 lines, if the owner of the
+ *          client view opted in to non-contiguous layout in its layout
+ *          manager; the ruler does not change that setting. The ruler then
+ *          never forces layout: lines that are not laid out are placed at the
+ *          estimated line height of the client view font from their neighbors,
+ *          and corrected once the text view lays them out.
+ */
+@property(readonly) BOOL usesEstimatedLineHeights;
+
 #pragma Overriding superclass method prototypes
 
 -(NSTextView *)clientView;
@@ -217,30 +281,4 @@
  */
 -(void)mouseDown:(NSEvent *)theEvent;
 
-#pragma Line number calculation
-
-/**
- * \brief Method that calculates the first character index for each new line.
- *
- * \details This method is an umbrella method that is used to calculate the
- *          changes in the character index for each physical line in the file
- *          based on comparing the old state of the corresponding text storage with
- *          what will be the new state. This method is designed to be called
- *          by an object responding to the PLTextStorageWillReplaceStringNotification.
- *          This method captures the effects of changes in length, and chenges 
- *          newline characters. Becuase the nine number calculation depends only
- *          on effective changes, the line number view is expected to calculate
- *          line numbers very efficiently.
- *
- * \param editedRange An NSRange value specifying the location and range of edited 
- *                    characters in the text storage object.
- *
- * \param string An NSString object with the replacement string.
- *
- * \see PLTextStorage
- */
--(void)updateLineNumbersForEditedRange:(NSRange)editedRange withReplacementString:(NSString *)string;
-
-
-
 @end
@@ -34,12 +34,45 @@
  */
 
 #import "PLLineNumberView.h"
+#import "PLTextStorage.h"
 #import "PLFormatter.h"
 #import "NSTextView+characterRangeInRect.h"
 #import "NSColor+hexToColor.h"
 
 #define MARKER_MARGIN      5.0f
 #define BREAKPOINT_STRING @"import pdb; pdb.set_trace()"
+#define ESTIMATED_LAYOUT_LINES 100000
+
+/**
+ * \brief A line of the viewport cached by the line number view.
+ */
+typedef struct PLRulerLine {
+        /**
+         * \brief The line number, starting at 1.
+         */
+        NSUInteger lineNumber;
+
+        /**
+         * \brief The range of characters in the line.
+         */
+        NSRange characterRange;
+
+        /**
+         * \brief The y-origin of the first line fragment of the line.
+         */
+        CGFloat y;
+
+        /**
+         * \brief The height of the first line fragment of the line.
+         */
+        CGFloat height;
+
+        /**
+         * \brief Whether the line was not laid out, and its position is
+         *        estimated from the estimated line height.
+         */
+        BOOL estimated;
+} PLRulerLine;
 
 @implementation PLLineNumberView
 
@@ -49,12 +82,10 @@
 {
         self = [super init];
         if (self) {
-                lineNumberIndex = [[NSMutableDictionary alloc] init];
-                markers = [[NSMutableSet alloc] init];
+                markers = [[PLMarkerIndex alloc] init];
                 textColor = [[NSColor colorWithCalibratedRed:0.5 green:0.5 blue:0.5 alpha:1.0] retain];
                 backgroundColor = [[NSColor colorWithCalibratedRed:0.9 green:0.9 blue:0.9 alpha:1.0] retain];
                 selectedColor = [[NSColor colorWithCalibratedRed:0.7 green:0.7 blue:0.7 alpha:1.0] retain];
-                lineNumberLabels = [[NSMutableDictionary alloc] init];
         }
         
         return self;
@@ -64,12 +95,10 @@
 {
         self = [super initWithScrollView:scrollView orientation:orientation];
         if (self) {
-                lineNumberIndex = [[NSMutableDictionary alloc] init];
-                markers = [[NSMutableSet alloc] init];
+                markers = [[PLMarkerIndex alloc] init];
                 backgroundColor = [[NSColor colorWithCalibratedRed:0.9 green:0.9 blue:0.9 alpha:1.0] retain];
                 textColor = [[NSColor colorWithCalibratedRed:0.5 green:0.5 blue:0.5 alpha:1.0] retain];
                 selectedColor = [[NSColor colorWithCalibratedRed:0.7 green:0.7 blue:0.7 alpha:1.0] retain];
-                lineNumberLabels = [[NSMutableDictionary alloc] init];
         }
         [[scrollView contentView] setPostsBoundsChangedNotifications:YES];
         [[NSNotificationCenter defaultCenter] addObserver:self
@@ -82,10 +111,14 @@
 
 -(void)dealloc
 {
+        [NSObject cancelPreviousPerformRequestsWithTarget:self];
         [[NSNotificationCenter defaultCenter] removeObserver:self];
+        [[self textStorage] removeEditObserver:self];
         [markers release];
-        [lineNumberIndex release];
-        [lineNumberLabels release];
+        free(visibleLines);
+        [digitAtlas release];
+        [markedDigitAtlas release];
+        [rulerFont release];
         [textColor release];
         [backgroundColor release];
         [selectedColor release];
@@ -110,9 +143,7 @@
                 goto exit;
         }
         notificationCenter = [NSNotificationCenter defaultCenter];
-        [notificationCenter removeObserver:self
-                                   name:NSTextStorageDidProcessEditingNotification
-                                 object:[[self clientView] textStorage]];
+        [[self textStorage] removeEditObserver:self];
         [notificationCenter removeObserver:self
                                    name:NSTextViewDidChangeSelectionNotification
                                  object:[self clientView]];
@@ -122,24 +153,22 @@
         
         [super setClientView:client];
         [client setPostsFrameChangedNotifications:YES];
-        [notificationCenter addObserver:self
-                               selector:@selector(textDidEndEditing:)
-                                   name:NSTextStorageDidProcessEditingNotification
-                                 object:[client textStorage]];
         [notificationCenter addObserver:self
                                selector:@selector(textDidChangeSelection:)
                                    name:NSTextViewDidChangeSelectionNotification
                                  object:client];
         [notificationCenter addObserver:self
-                               selector:@selector(removeAllLabels:)
+                               selector:@selector(clientViewFrameDidChange:)
                                    name:NSViewFrameDidChangeNotification
                                  object:client];
+        [(PLTextStorage *)[client textStorage] addEditObserver:self];
+        usesEstimatedLineHeights = NO;
+        [self updateLayoutMode];
         [self setRuleThickness:[self requiredThickness]];
-        [lineNumberIndex removeAllObjects];
-        [lineNumberIndex setObject:[NSNumber numberWithInteger:0]
-                            forKey:@"1"];
-        [self updateLineNumbersForEditedRange:NSMakeRange(0, 0)
-                        withReplacementString:[[self clientView] string]];
+        [self invalidateVisibleLines];
+        [markers release];
+        markers = [[PLMarkerIndex alloc] initWithLength:[[self textStorage] length]];
+        [self updateMarkersInLineRange:NSMakeRange(1, [self numberOfLines])];
         [self setNeedsDisplay:YES];
 exit:
         return;
@@ -165,6 +194,8 @@ exit:
         [aColor retain];
         [textColor release];
         textColor = aColor;
+        [digitAtlas release];
+        digitAtlas = nil;
         [self setNeedsDisplay:YES];
 }
 
@@ -180,31 +211,32 @@ exit:
 
 -(NSUInteger)numberOfLines
 {
-        return [lineNumberIndex count];
+        return [[self textStorage] numberOfLines];
 }
 
+@synthesize usesEstimatedLineHeights;
+
 #if defined(__APPLE__) && defined (__MACH__)
 #pragma mark Basic Ruler Properties
 #endif
 
 -(CGFloat)requiredThickness
 {
-        NSAttributedString *attrString;
-        NSFont * font;
-        CGFloat characterWidth, thickness;
-        NSUInteger lines;
-        font = [[NSFontManager sharedFontManager] selectedFont];
-        attrString = [[NSAttributedString alloc] initWithString:@"8" attributes:[NSDictionary dictionaryWithObject:font forKey:NSFontAttributeName]];
-        characterWidth = [attrString size].width+1.0f;
-        lines = [lineNumberIndex count];
-        thickness = 2.0f+characterWidth*[[NSString stringWithFormat:@"%ld", lines] length];
-        if (thickness < 3*characterWidth+2.0f)
-                thickness = 3*characterWidth+2.0f;
-        gutterThickness = characterWidth;
-        [attrString release];
+        CGFloat thickness;
+        NSUInteger lines, digits;
+        [self updateFontMetrics];
+        for (digits = 1, lines = [self numberOfLines]; lines >= 10; lines /= 10)
+                digits++;
+        thickness = 2.0f+digitWidth*MAX(digits, (NSUInteger)3);
+        gutterThickness = digitWidth;
         return ceil(thickness)+gutterThickness+MARKER_MARGIN;
 }
 
+-(BOOL)isOpaque
+{
+        return YES;
+}
+
 #if defined(__APPLE__) && defined (__MACH__)
 #pragma mark Drawing Methods
 #endif
@@ -236,204 +268,92 @@ exit:
 }
 
 
--(NSTextField *)labelForLineNumber:(NSString *)labelKey withLineHeight:(CGFloat)lineHeight withFont:(NSFont *)font
-{
-        NSRange lineRange, selectedRange;
-        NSRect *rects, labelRect, selectedRect;
-        NSUInteger position, numberOfRects;
-        NSString *text;
-        NSTextView *textView;
-        NSLayoutManager *layoutManager;
-        NSTextContainer *textContainer;
-        NSTextField * label;
-        textView = [self clientView];
-        text = [textView string];
-        layoutManager = [textView layoutManager];
-        textContainer = [textView textContainer];
-        label = [[NSTextField alloc] init];
-        [label setStringValue:labelKey];
-        [label setTextColor:textColor];
-        position = [(NSNumber *)[lineNumberIndex objectForKey:labelKey] integerValue];
-        lineRange = [text lineRangeForRange:NSMakeRange(position, 0)];
-        rects = [layoutManager rectArrayForCharacterRange:lineRange
-                             withinSelectedCharacterRange:NSMakeRange(NSNotFound, 0)
-                                          inTextContainer:textContainer 
-                                                rectCount:&numberOfRects];
-        if (numberOfRects == 0)
-                goto exit;
-        labelRect = rects[0];
-        labelRect = NSMakeRect(MARKER_MARGIN, 
-                               labelRect.origin.y,
-                               [self ruleThickness]-gutterThickness-MARKER_MARGIN-2.0f,
-                               lineHeight-1.0f);
-        selectedRange = [textView selectedRange];
-        [label setFrame:labelRect];
-        [label setAlignment:NSRightTextAlignment];
-        [label setFont:font];
-        if (NSIntersectionRange(lineRange, selectedRange).length != 0 ||
-            NSLocationInRange(selectedRange.location, lineRange) ||
-            (NSMaxRange(lineRange) == selectedRange.location && [labelKey integerValue] == [lineNumberIndex count])) {
-                selectedRect = labelRect;
-                selectedRect.origin.x = 0.0f;
-                selectedRect.size.width += MARKER_MARGIN+2.0f;
-                [selectedColor setFill];
-                NSRectFill(selectedRect);
-        }
-exit:
-        return [label autorelease];
-}
-
-
 -(void)drawLabelsInRect:(NSRect)dirtyRect
 {
-        NSUInteger lineNumber = 0, lineNumbers;
-        CGFloat lineHeight = 0, maxY;
+        NSUInteger i, first, last, lineNumbers;
         NSRange lineRange, selectedRange;
-        NSUInteger position = 0;
-        NSTextView *textView;
-        NSString * text;
-        NSMutableString * labelKey;
-        NSTextField * label;
-        NSFont *font = nil;
-        NSAttributedString * attrString;
-        NSRange characterRange;
-        NSRect frame, rectForCharacters, modifierRect;
+        NSIndexSet * markedLines;
+        NSRect frame, modifierRect;
+        PLRulerLine * line;
+        BOOL hasEstimatedLines = NO;
         NSGraphicsContext *gc = [NSGraphicsContext currentContext];
         [gc saveGraphicsState];
-        textView = (NSTextView *)[self clientView];
-        text = [textView string];
-        font = [[NSFontManager sharedFontManager] selectedFont];
-        if (font == nil) {
-                font = [NSFont fontWithName:@"Helvetica" size:12.0];
-        }
-        attrString = [[NSAttributedString alloc] initWithString:@"7" attributes:[NSDictionary dictionaryWithObject:font forKey:NSFontAttributeName]];
-        lineHeight = [attrString size].height;
-        labelKey = [[NSMutableString alloc] init];
-        [attrString release];
-        font = [NSFont fontWithName:[font fontName] size:[font pointSize]-2.0];
-        [font retain];
-        rectForCharacters = dirtyRect;
-        rectForCharacters.size.width = [textView visibleRect].size.width;
-        characterRange = [textView characterRangeInRect:rectForCharacters];
-        position = characterRange.location;
-        lineRange = [text lineRangeForRange:NSMakeRange(position, 0)];
-        lineNumber = [self lineNumberForRange:lineRange usingBinarySearch:YES];
-        lineNumbers = [lineNumberIndex count];
-        maxY = NSMaxY(dirtyRect);//[self bounds].origin.y + [self bounds].size.height;
+        [self updateVisibleLinesInRect:[self visibleRect]];
+        
+        /* only the lines intersecting the dirty rect are drawn */
+        for (first = 0; first < numberOfVisibleLines && visibleLines[first].y + lineHeight <= NSMinY(dirtyRect); first++);
+        for (last = first; last < numberOfVisibleLines && visibleLines[last].y < NSMaxY(dirtyRect); last++);
+        if (first == last)
+                goto exit;
+        lineNumbers = [self numberOfLines];
+        markedLines = [self lineNumbersWithMarkersInLineRange:NSMakeRange(visibleLines[first].lineNumber, last - first)];
         selectedRange = [[self clientView] selectedRange];
         if (selectedRange.length == 0)
                 selectedRange.length = 1;
-        do {
-                [labelKey setString:@""];
-                [labelKey appendFormat:@"%li", lineNumber];
-                lineRange = [text lineRangeForRange:NSMakeRange([[lineNumberIndex objectForKey:labelKey] integerValue], 0)];
+        for (i = first; i < last; i++) {
+                line = &visibleLines[i];
+                lineRange = line->characterRange;
                 if (lineRange.length == 0) {
                         lineRange.length = 1;
                 }
-                label = [lineNumberLabels objectForKey:labelKey];
-                if (label == nil) {
-                        label = [self labelForLineNumber:labelKey
-                                          withLineHeight:lineHeight
-                                                withFont:font];
-                        [lineNumberLabels setObject:label forKey:labelKey];
-                }
-                lineNumber++;
-                frame = [label frame];
-                if (NSEqualRects(NSIntersectionRect(frame, dirtyRect), NSZeroRect))
-                        continue;
+                frame = NSMakeRect(MARKER_MARGIN,
+                                   line->y,
+                                   [self ruleThickness]-gutterThickness-MARKER_MARGIN-2.0f,
+                                   lineHeight-1.0f);
                 if ((NSIntersectionRange(lineRange, selectedRange).length != 0) ||
-                    (NSMaxRange(lineRange) == selectedRange.location && [labelKey integerValue] == [lineNumberIndex count])) {
+                    (NSMaxRange(lineRange) == selectedRange.location && line->lineNumber == lineNumbers)) {
                         modifierRect = frame;
                         modifierRect.origin.x = 0.0f;
                         modifierRect.size.width += MARKER_MARGIN+2.0f;
                         [selectedColor setFill];
                         NSRectFill(modifierRect);
                 }
-                if ([markers member:labelKey]) {
+                if ([markedLines containsIndex:line->lineNumber]) {
                         modifierRect = frame;
                         modifierRect.origin.y += modifierRect.size.height/8.0f;
                         modifierRect.size.height -= 2*modifierRect.size.height/8.0f;
                         modifierRect.size.width += gutterThickness+1.0f;
                         [self drawMarkersInRect:modifierRect];
-                        [label setTextColor:[NSColor whiteColor]];
+                        [markedDigitAtlas drawNumber:line->lineNumber inRect:frame];
                 } else {
-                        [label setTextColor:textColor];
+                        [digitAtlas drawNumber:line->lineNumber inRect:frame];
                 }
-                [[label attributedStringValue] drawInRect:frame];
-        } while(frame.origin.y < maxY && lineNumber <= lineNumbers);
-        [gc flushGraphics];
+                if (line->estimated)
+                        hasEstimatedLines = YES;
+        }
+        if (hasEstimatedLines)
+                [self scheduleEstimatedLinesCorrection];
+exit:
         [gc restoreGraphicsState];
-        [font release];
-        [labelKey release];
 }
 
 -(void)drawHashMarksAndLabelsInRect:(NSRect)dirtyRect
 {
         NSGraphicsContext *gc = [NSGraphicsContext currentContext];
         NSRect line, rect;
+        CGFloat originY;
         [gc saveGraphicsState];
-        [self setRuleThickness:[self requiredThickness]];
-        NSRect bounds = [self bounds];
-        bounds.origin.y = [[[self scrollView] contentView] bounds].origin.y - [[self clientView] frame].origin.y;
-        [self setBoundsOrigin:bounds.origin];
+        [self updateRuleThickness];
+        originY = [self scrolledBoundsOriginY];
+        if ([self bounds].origin.y != originY) {
+                [self setBoundsOrigin:NSMakePoint([self bounds].origin.x, originY)];
+                dirtyRect = [self visibleRect];
+        }
         rect = [self visibleRect];
-        dirtyRect.origin.x = 0.0;
-        dirtyRect.origin.y = dirtyRect.origin.y - [[self clientView] frame].origin.y;
-        dirtyRect.size.width = [self bounds].size.width;
+        dirtyRect = NSIntersectionRect(dirtyRect, rect);
         [backgroundColor setFill];
-        NSRectFill(rect);
+        NSRectFill(dirtyRect);
         line = NSMakeRect(rect.size.width-gutterThickness,
                           rect.origin.y,
                           1.0f,
                           rect.size.height);
         [[NSColor grayColor] set];
-        NSRectFill(line);//NSIntersectionRect(line, dirtyRect));
-        [self drawLabelsInRect:rect];
+        NSRectFill(NSIntersectionRect(line, dirtyRect));
+        [self drawLabelsInRect:dirtyRect];
         [gc restoreGraphicsState];
         return;
 }
 
-#pragma mark Line Number Updating
-
--(void)updateLineNumbersForEditedRange:(NSRange)editedRange withReplacementString:(NSString *)string
-{
-        const char INSERTION = 1;
-        const char DELETION = 2;
-        const char REPLACEMENT = 4;
-        char flag = 0;
-        NSUInteger firstEditedLine;
-        if (editedRange.length == 0 && [string length] == 0)
-                goto exit;
-        if (string == nil)
-                goto exit;
-        if (editedRange.length == 0)
-                flag = INSERTION;
-        else if ([string length] == 0)
-                flag = DELETION;
-        else
-                flag = REPLACEMENT;
-        firstEditedLine = [self lineNumberForRange:[[[self clientView] string] lineRangeForRange:editedRange]
-                                 usingBinarySearch:YES];
-        [self removeLabelsFromLineNumber:firstEditedLine];
-        switch (flag) {
-                case DELETION:
-                        [self updateAfterDeletetion:editedRange];
-                        break;
-                case INSERTION:
-                        [self updateAfterInsertion:editedRange.location
-                             withReplacementString:string];
-                        break;
-                case REPLACEMENT:
-                        [self updateAfterDeletetion:editedRange];
-                        [self updateAfterInsertion:editedRange.location
-                             withReplacementString:string];
-                        break;
-        }
-        [self updateMarkersInEditedRange:editedRange withReplacementString:string];
-exit:
-        return;
-}
-
 #pragma mark Event Handling
 
 -(void)mouseDown:(NSEvent *)theEvent
@@ -448,9 +368,9 @@ exit:
         NSAttributedString * string;
         NSUInteger lineNumber;
         characterRange = [self characterRangeForLineAtHeight:location.y];
-        lineRange = [[textView string] lineRangeForRange:NSMakeRange(characterRange.location, 0)];
+        lineRange = [[self textStorage] lineRangeForRange:NSMakeRange(characterRange.location, 0)];
         selectedRange = [textView selectedRange];
-        lineNumber = [self lineNumberForRange:lineRange usingBinarySearch:YES];
+        lineNumber = [self lineNumberForRange:lineRange];
         if (characterRange.location == 0 && characterRange.length == 0 && [[textView string] length] != 0)
                 goto exit;
         if (location.x > [self bounds].size.width-gutterThickness) {
@@ -466,7 +386,7 @@ exit:
                         [storage setAttributes:attributes range:lineRange];
                 }
         } else {
-                if ([markers containsObject:[NSString stringWithFormat:@"%li", lineNumber]]) {
+                if ([markers containsMarkerAtIndex:lineRange.location]) {
                         [textView setSelectedRange:lineRange];
                         [textView insertText:@"" replacementRange:lineRange];
                 } else {
@@ -478,7 +398,7 @@ exit:
                             replacementRange:NSMakeRange(lineRange.location, 0)];
                         [textView setSelectedRange:NSMakeRange(lineRange.location,
                                                                [string length])];
-                        [markers addObject:[NSString stringWithFormat:@"%li", lineNumber]];
+                        [markers addMarkerAtIndex:lineRange.location];
                         [string release];
                 }
                 
@@ -494,83 +414,67 @@ exit:
 
 
 
--(NSUInteger)lineNumberForRange:(NSRange)characterRange
+/**
+ * \brief Return the text storage of the client view.
+ */
+-(PLTextStorage *)textStorage
 {
-        NSUInteger i, count, lineNumber = 0;
-        NSUInteger position;
-        NSMutableString * key;
-        count = [lineNumberIndex count];
-        key = [[NSMutableString alloc] init];
-        for (i = 0; i < count; i++) {
-                [key setString:@""];
-                [key appendFormat:@"%li", i+1];
-                position = [[lineNumberIndex objectForKey:key] integerValue];
-                if (position == characterRange.location) {
-                        lineNumber = i;
-                }
-        }
-        [key release];
-        return lineNumber+1;
+        return (PLTextStorage *)[[self clientView] textStorage];
 }
 
--(void)removeLabelsFromLineNumber:(NSUInteger)lineNumber
+/**
+ * \brief Return the line number containing the first character of a range.
+ */
+-(NSUInteger)lineNumberForRange:(NSRange)characterRange
 {
-        NSUInteger i;
-        NSMutableString *labelKey = [[NSMutableString alloc] init];
-        for (i = lineNumber; i <= [self numberOfLines]; i++) {
-                [labelKey setString:@""];
-                [labelKey appendFormat:@"%li", i];
-                [lineNumberLabels removeObjectForKey:labelKey];
-        }
-        [labelKey release];
+        return [[self textStorage] lineNumberForCharacterIndex:characterRange.location];
 }
 
--(void)removeAllLabels:(NSNotification *)aNotification
+/**
+ * \brief Invalidate the cached lines of the viewport when the client view is
+ *        resized, which changes the height of wrapped lines.
+ */
+-(void)clientViewFrameDidChange:(NSNotification *)aNotification
 {
-        [lineNumberLabels removeAllObjects];
+        [self invalidateVisibleLines];
 }
 
--(NSUInteger)lineNumberForRange:(NSRange)characterRange usingBinarySearch:(BOOL)isBinary
+/**
+ * \brief Update the cached font metrics and digit atlases if the selected
+ *        font changed, or the text color changed since they were created.
+ */
+-(void)updateFontMetrics
 {
-        NSUInteger count, lineNumber = 0;
-        NSUInteger position;
-        NSMutableString * key = nil;
-        NSRange searchRange;
-        if (isBinary == NO) {
-                lineNumber = [self lineNumberForRange:characterRange];
-                goto exit;
-        }
-        count = [lineNumberIndex count];
-        if (count == 0) {
+        NSFont * font = [[NSFontManager sharedFontManager] selectedFont];
+        NSDictionary * attributes;
+        if (font == nil)
+                font = [NSFont fontWithName:@"Helvetica" size:12.0];
+        if (digitAtlas != nil && [font isEqual:rulerFont])
                 goto exit;
-        }
-        searchRange = NSMakeRange(1, count);
-        key = [[NSMutableString alloc] init];
-        
-        while (searchRange.length > 0) {
-                lineNumber = searchRange.location+searchRange.length/2;
-                [key setString:@""];
-                [key appendFormat:@"%li", lineNumber];
-                position = [[lineNumberIndex objectForKey:key] integerValue];
-                searchRange.length /= 2;
-                if (position < characterRange.location) {
-                        searchRange.location = lineNumber;
-                } else if (position == characterRange.location) {
-                        break;
-                }
-        }
-        if (position != characterRange.location) {
-                lineNumber = [self lineNumberForRange:characterRange];
-        }
+        [font retain];
+        [rulerFont release];
+        rulerFont = font;
+        attributes = [NSDictionary dictionaryWithObject:font forKey:NSFontAttributeName];
+        digitWidth = [@"8" sizeWithAttributes:attributes].width+1.0f;
+        lineHeight = [@"7" sizeWithAttributes:attributes].height;
+        font = [NSFont fontWithName:[font fontName] size:[font pointSize]-2.0];
+        [digitAtlas release];
+        [markedDigitAtlas release];
+        digitAtlas = [[PLDigitAtlas alloc] initWithFont:font color:textColor];
+        markedDigitAtlas = [[PLDigitAtlas alloc] initWithFont:font color:[NSColor whiteColor]];
 exit:
-        [key release];
-        return lineNumber;
+        return;
 }
 
-
--(IBAction)textDidEndEditing:(id)sender
+/**
+ * \brief Set the rule thickness if the font or the number of digits of the
+ *        last line number changed.
+ */
+-(void)updateRuleThickness
 {
-        [self setNeedsDisplay:YES];
+        CGFloat thickness = [self requiredThickness];
+        if (thickness != [self ruleThickness])
+                [self setRuleThickness:thickness];
 }
 
 
@@ -579,194 +483,369 @@ exit:
         [self setNeedsDisplay:YES];
 }
 
+/**
+ * \brief Return the y-origin of the ruler view bounds matching the scroll
+ *        position of the scroll view's content view.
+ */
+-(CGFloat)scrolledBoundsOriginY
+{
+        return [[[self scrollView] contentView] bounds].origin.y - [[self clientView] frame].origin.y;
+}
+
 /**
  * \brief Update the bounds of the ruler view when the scroll view's content
  *        view bounds change.
  *
  * \details This method calculates and sets the new bound origin of the ruler
- *          view.
+ *          view. The pixels already drawn are copied by the scroll distance,
+ *          so that only the strip of the ruler exposed by the scroll is
+ *          redrawn. Scrolling by more than the visible height redraws the
+ *          whole ruler.
  */
 -(void)boundsDidChange:(NSNotification *)notification
 {
-        NSRect bounds = [self bounds];
-        bounds.origin.y = [[[self scrollView] contentView] bounds].origin.y - [[self clientView] frame].origin.y;
-        [self setBoundsOrigin:bounds.origin];
+        NSRect visibleRect, exposedRect;
+        NSPoint origin = [self bounds].origin;
+        CGFloat delta;
+        delta = [self scrolledBoundsOriginY] - origin.y;
+        if (delta == 0.0f)
+                goto exit;
+        origin.y += delta;
+        visibleRect = [self visibleRect];
+        if (fabs(delta) >= NSHeight(visibleRect)) {
+                [self setBoundsOrigin:origin];
+                [self setNeedsDisplay:YES];
+                goto exit;
+        }
+        [self scrollRect:visibleRect by:NSMakeSize(0.0f, -delta)];
+        [self translateRectsNeedingDisplayInRect:visibleRect by:NSMakeSize(0.0f, -delta)];
+        [self setBoundsOrigin:origin];
+        exposedRect = [self visibleRect];
+        if (delta > 0.0f)
+                exposedRect.origin.y = NSMaxY(exposedRect) - delta;
+        exposedRect.size.height = fabs(delta);
+        [self setNeedsDisplayInRect:exposedRect];
+exit:
+        return;
 }
 
--(void)updateAfterInsertion:(NSUInteger)insertionPoint withReplacementString:(NSString *)newString
+/**
+ * \brief Update the markers after a batch of edits of the text storage.
+ *
+ * \details The markers are anchored to the first character of their line, so
+ *          the markers following each edit move with the marker index without
+ *          being visited. Only the lines spanning the characters changed by
+ *          the batch are searched for the breakpoint string, once. The cached
+ *          lines of the viewport are invalidated if the batch touches them.
+ *          Edits of the attributes alone, such as syntax coloring, are not
+ *          observed, and a change of the height of lines they cause is caught
+ *          by the resizing of the client view.
+ */
+-(void)textStorage:(PLTextStorage *)textStorage didApplyEdits:(PLEditJournal *)journal
 {
-        NSString *text;
-        NSDictionary *newDict;
-        NSUInteger i, positionDifference, count;
-        NSRange lineRange;
-        NSUInteger lineNumber;
-        NSMutableString * key, * newKey;
-        NSNumber * value;
-        if ([newString length] == 0) {
-                goto exit;
-        }
-        text = [[self clientView] string];
-        lineRange = [text lineRangeForRange:NSMakeRange(insertionPoint, 0)];
-        lineNumber = [self lineNumberForRange:lineRange usingBinarySearch:YES];
-        newDict = [self calculateLineNumbersForString:newString];
-        count = [newDict count];
-        positionDifference = [newString length];
-        key = [[NSMutableString alloc] init];
-        newKey = [[NSMutableString alloc] init];
-        for (i = [lineNumberIndex count]; i > lineNumber; i--) {
-                [key setString:@""];
-                [newKey setString:@""];
-                [key appendFormat:@"%li", i];
-                value = [lineNumberIndex objectForKey:key];
-                [newKey appendFormat:@"%li", i+count-1];
-                value = [NSNumber numberWithInteger:[value integerValue]+positionDifference];
-                [lineNumberIndex setObject:value forKey:newKey];
-                if ([markers containsObject:key]) {
-                        [markers removeObject:key];
-                        [markers addObject:newKey];
-                }
+        const PLTextEdit * edits = [journal edits];
+        NSUInteger i, firstLine, lastLine;
+        NSRange editedRange;
+        for (i = 0; i < [journal count]; i++) {
+                [markers replaceCharactersInRange:edits[i].range
+                                       withLength:edits[i].range.length + edits[i].changeInLength];
         }
-        
-        for (i = 1; i < [newDict count]; i++) {
-                [key setString:@""];
-                [key appendFormat:@"%li", i];
-                value = [newDict objectForKey:key];
-                [key setString:@""];
-                [key appendFormat:@"%li", i+lineNumber];
-                value = [NSNumber numberWithInteger:[value integerValue]+insertionPoint];
-                [lineNumberIndex setObject:value forKey:key];
+        editedRange = [journal editedRange];
+        if (numberOfVisibleLines > 0 &&
+            editedRange.location <= NSMaxRange(visibleLines[numberOfVisibleLines - 1].characterRange))
+                [self invalidateVisibleLines];
+        firstLine = [textStorage lineNumberForCharacterIndex:editedRange.location];
+        lastLine = [textStorage lineNumberForCharacterIndex:NSMaxRange(editedRange)];
+        [self updateMarkersInLineRange:NSMakeRange(firstLine, lastLine - firstLine + 1)];
+        if ([journal changeInNumberOfLines] != 0) {
+                [self updateLayoutMode];
+                [self updateRuleThickness];
         }
-        [key release];
-        [newKey release];
-exit:
-        return;
+        [self setNeedsDisplay:YES];
 }
 
--(void)updateAfterDeletetion:(NSRange)editedRange
+/**
+ * \brief Add or remove the markers of a range of lines, depending on whether
+ *        the line consists of the breakpoint string.
+ */
+-(void)updateMarkersInLineRange:(NSRange)lineRange
 {
-        NSString *oldString, *text;
-        NSDictionary *oldDict;
-        NSUInteger i, count;
-        NSRange lineRange;
-        NSUInteger lineNumber;
-        NSString * key, *newKey;
-        NSNumber * value;
-        NSUInteger numberOfLines = 0, linesToRemove = 0;
+        PLTextStorage * textStorage = [self textStorage];
+        NSString * text;
+        NSRange characterRange;
+        NSUInteger lineNumber, start, end;
+        text = [textStorage string];
+        start = [textStorage characterIndexForLineNumber:lineRange.location];
+        end = NSMaxRange([textStorage rangeOfLineNumber:NSMaxRange(lineRange) - 1]);
         
-        text = [[self clientView] string];
-        lineRange = [text lineRangeForRange:editedRange];
-        lineNumber = [self lineNumberForRange:lineRange usingBinarySearch:YES];
-        oldString = [text substringWithRange:editedRange];
-        oldDict = [self calculateLineNumbersForString:oldString];
-        count = [oldDict count];
-        numberOfLines = [lineNumberIndex count];
-        linesToRemove = count-1;
-        lineNumber++;
-        for (i = lineNumber; i < 1+numberOfLines - linesToRemove; i++) {
-                key = [NSString stringWithFormat:@"%li", i+linesToRemove];
-                value = [lineNumberIndex objectForKey:key];
-                value = [NSNumber numberWithInteger:[value integerValue]-editedRange.length];
-                newKey = [NSString stringWithFormat:@"%li", i];
-                if ([newKey isEqualToString:key] == NO) {
-                        [markers removeObject:newKey];
-                        if ([markers containsObject:key]) {
-                                [markers removeObject:key];
-                                [markers addObject:newKey];
-                        }
+        /* include a marker at the end of the text, on an empty last line */
+        if (end == [text length])
+                end++;
+        [markers removeMarkersInRange:NSMakeRange(start, end - start)];
+        for (lineNumber = lineRange.location; lineNumber < NSMaxRange(lineRange); lineNumber++) {
+                characterRange = [textStorage rangeOfLineNumber:lineNumber];
+                if ([[[text substringWithRange:characterRange] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]] isEqualToString:BREAKPOINT_STRING]) {
+                        [markers addMarkerAtIndex:characterRange.location];
                 }
-                [lineNumberIndex setObject:value forKey:newKey];
-        }
-        for (i = numberOfLines; i > numberOfLines-linesToRemove; i--) {
-                key = [NSString stringWithFormat:@"%li", i];
-                [lineNumberIndex removeObjectForKey:key];
-                [markers removeObject:key];
         }
 }
 
--(void)updateMarkersInEditedRange:(NSRange)editedRange withReplacementString:(NSString *)aString
+/**
+ * \brief Return the line numbers with a marker within a range of lines.
+ */
+-(NSIndexSet *)lineNumbersWithMarkersInLineRange:(NSRange)lineRange
 {
-        NSString * text, * key;
-        NSString *originalString, * completeString;
-        NSRange characterRange;
-        NSUInteger i, lineNumber;
-        NSArray * lines;
-        text = [[self clientView] string];
-        if (NSMaxRange(editedRange) != [text length]) {
-                characterRange = [text lineRangeForRange:NSMakeRange(editedRange.location,
-                                                                     editedRange.length+1)];
+        PLTextStorage * textStorage = [self textStorage];
+        NSMutableIndexSet * lineNumbers = [NSMutableIndexSet indexSet];
+        NSUInteger start, end;
+        start = [textStorage characterIndexForLineNumber:lineRange.location];
+        end = NSMaxRange([textStorage rangeOfLineNumber:NSMaxRange(lineRange) - 1]);
+        [[markers markersInRange:NSMakeRange(start, end - start + 1)] enumerateIndexesUsingBlock:^(NSUInteger index, BOOL * stop) {
+                [lineNumbers addIndex:[textStorage lineNumberForCharacterIndex:index]];
+        }];
+        return lineNumbers;
+}
+
+#pragma mark Viewport Line Cache
+
+/**
+ * \brief Invalidate the cached lines of the viewport.
+ */
+-(void)invalidateVisibleLines
+{
+        layoutGeneration++;
+}
+
+/**
+ * \brief Return the line number, character range and position of a line.
+ *
+ * \details The position of the line is found from the line fragment of its
+ *          first glyph, and the character range from the text storage line
+ *          index, so that no string is scanned. When the ruler uses estimated
+ *          line heights, no layout is performed: a line that has not been laid
+ *          out yet is placed at an estimated y-origin and marked as estimated.
+ *
+ * \param lineNumber The line number, starting at 1.
+ *
+ * \param estimatedY The y-origin of the line if it has not been laid out,
+ *                   usually derived from a neighboring line.
+ */
+-(PLRulerLine)rulerLineForLineNumber:(NSUInteger)lineNumber estimatedY:(CGFloat)estimatedY
+{
+        NSLayoutManager * layoutManager = [[self clientView] layoutManager];
+        PLTextStorage * textStorage = [self textStorage];
+        PLRulerLine line;
+        NSRect fragment;
+        NSUInteger glyphIndex;
+        line.lineNumber = lineNumber;
+        line.characterRange = [textStorage rangeOfLineNumber:lineNumber];
+        if (line.characterRange.location == [textStorage length]) {
+                fragment = [layoutManager extraLineFragmentRect];
         } else {
-                characterRange = [text lineRangeForRange:NSMakeRange(editedRange.location,
-                                                                     editedRange.length)];
+                glyphIndex = [layoutManager glyphIndexForCharacterAtIndex:line.characterRange.location];
+                if (usesEstimatedLineHeights)
+                        fragment = [layoutManager lineFragmentRectForGlyphAtIndex:glyphIndex
+                                                                   effectiveRange:NULL
+                                                          withoutAdditionalLayout:YES];
+                else
+                        fragment = [layoutManager lineFragmentRectForGlyphAtIndex:glyphIndex
+                                                                   effectiveRange:NULL];
         }
-        
-        originalString = [text substringWithRange:characterRange];
-        completeString = [originalString stringByReplacingCharactersInRange:
-                          NSMakeRange(editedRange.location-characterRange.location,
-                                      editedRange.length)
-                                                                 withString:aString];
-        lines = [completeString componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]];
-        lineNumber = [self lineNumberForRange:characterRange usingBinarySearch:YES];
-        for (i = 0; i < [lines count]-1; i++) {
-                key = [NSString stringWithFormat:@"%li", lineNumber+i];
-                [markers removeObject:key];
-                if ([[[lines objectAtIndex:i] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]] isEqualToString:BREAKPOINT_STRING]) {
-                        [markers addObject:key];
+        line.estimated = (usesEstimatedLineHeights && NSEqualRects(fragment, NSZeroRect));
+        if (line.estimated) {
+                fragment = NSMakeRect(0.0f, estimatedY, 0.0f, estimatedLineHeight);
+        }
+        line.y = NSMinY(fragment);
+        line.height = NSHeight(fragment);
+        return line;
+}
+
+/**
+ * \brief Insert a line in the cached lines of the viewport.
+ */
+-(void)insertVisibleLine:(PLRulerLine)line atIndex:(NSUInteger)index
+{
+        if (numberOfVisibleLines == visibleLinesCapacity) {
+                visibleLinesCapacity = MAX(2 * visibleLinesCapacity, (NSUInteger)64);
+                visibleLines = realloc(visibleLines, visibleLinesCapacity * sizeof(PLRulerLine));
+        }
+        memmove(visibleLines + index + 1, visibleLines + index, (numberOfVisibleLines - index) * sizeof(PLRulerLine));
+        visibleLines[index] = line;
+        numberOfVisibleLines++;
+}
+
+/**
+ * \brief Update the cached lines of the viewport to span a rect.
+ *
+ * \details When the cached lines are valid and overlap the rect, as when
+ *          scrolling, the lines that left the rect are dropped and only the
+ *          newly exposed lines are laid out. Otherwise, the cache is rebuilt
+ *          from the first character in the rect.
+ *
+ * \param rect The rect of the ruler view to cover, in the coordinates of the
+ *             client view text container.
+ */
+-(void)updateVisibleLinesInRect:(NSRect)rect
+{
+        NSUInteger numberOfLines, dropped, lineNumber;
+        NSRect rectForCharacters;
+        PLRulerLine * last;
+        numberOfLines = [self numberOfLines];
+        [self updateLayoutMode];
+        if (visibleLinesGeneration != layoutGeneration ||
+            numberOfVisibleLines == 0 ||
+            visibleLines[0].y >= NSMaxY(rect) ||
+            visibleLines[numberOfVisibleLines - 1].y + visibleLines[numberOfVisibleLines - 1].height <= NSMinY(rect)) {
+                numberOfVisibleLines = 0;
+                rectForCharacters = rect;
+                rectForCharacters.size.width = [[self clientView] visibleRect].size.width;
+                if (usesEstimatedLineHeights) {
+                        estimatedLineHeight = MAX([[[self clientView] layoutManager] defaultLineHeightForFont:[[self clientView] font]], 1.0f);
+                        lineNumber = [self lineNumberForLaidOutRect:rectForCharacters];
+                } else {
+                        lineNumber = [[self textStorage] lineNumberForCharacterIndex:[[self clientView] characterRangeInRect:rectForCharacters].location];
                 }
+                [self insertVisibleLine:[self rulerLineForLineNumber:lineNumber estimatedY:(lineNumber - 1) * estimatedLineHeight]
+                                atIndex:0];
+                visibleLinesGeneration = layoutGeneration;
         }
         
+        /* drop the lines scrolled out of the rect */
+        for (dropped = 0; dropped + 1 < numberOfVisibleLines && visibleLines[dropped + 1].y <= NSMinY(rect); dropped++);
+        if (dropped > 0) {
+                numberOfVisibleLines -= dropped;
+                memmove(visibleLines, visibleLines + dropped, numberOfVisibleLines * sizeof(PLRulerLine));
+        }
+        while (numberOfVisibleLines > 1 && visibleLines[numberOfVisibleLines - 1].y >= NSMaxY(rect))
+                numberOfVisibleLines--;
         
+        /* lay out the lines scrolled into the rect */
+        while (visibleLines[0].lineNumber > 1 && visibleLines[0].y > NSMinY(rect))
+                [self insertVisibleLine:[self rulerLineForLineNumber:visibleLines[0].lineNumber - 1
+                                                          estimatedY:visibleLines[0].y - estimatedLineHeight]
+                                atIndex:0];
+        last = &visibleLines[numberOfVisibleLines - 1];
+        while (last->lineNumber < numberOfLines && last->y + last->height < NSMaxY(rect)) {
+                [self insertVisibleLine:[self rulerLineForLineNumber:last->lineNumber + 1
+                                                          estimatedY:last->y + last->height]
+                                atIndex:numberOfVisibleLines];
+                last = &visibleLines[numberOfVisibleLines - 1];
+        }
 }
 
+#pragma mark Estimated Line Heights
+
 /**
- * \brief Calculates the initial character for each of the line numbers for
- *        text in the NSTextView.
+ * \brief Switch the ruler to estimated line heights when the text has at least
+ *        ESTIMATED_LAYOUT_LINES lines and the layout manager of the client
+ *        view allows non-contiguous layout.
  *
- * \details This method retrieves the string content of the client NSTextView
- *          and finds the character position for each new line. This method
- *          stores linenumber character position pairs in an NSDictionary object
- *          where the key is the lineNumber, and the object is the index of the
- *          first character. This function only needs to run whenever the text
- *          within the client NSTextView changes.
+ * \details Non-contiguous layout is configured by the owner of the text view,
+ *          and is never changed by the ruler. The mode is not switched off when
+ *          lines are removed, as this would force the layout of the whole text,
+ *          but it is when the layout manager stops allowing non-contiguous
+ *          layout.
+ */
+-(void)updateLayoutMode
+{
+        BOOL estimated = [[[self clientView] layoutManager] allowsNonContiguousLayout] &&
+                         (usesEstimatedLineHeights || [self numberOfLines] >= ESTIMATED_LAYOUT_LINES);
+        if (estimated == usesEstimatedLineHeights)
+                goto exit;
+        usesEstimatedLineHeights = estimated;
+        [self invalidateVisibleLines];
+exit:
+        return;
+}
+
+/**
+ * \brief Return the number of the first line in a rect of the client view
+ *        without performing layout.
  *
+ * \details The first line is found from the laid out glyphs in the rect when
+ *          there are any, and otherwise estimated from the estimated line
+ *          height.
  */
--(NSDictionary *)calculateLineNumbersForString:(NSString *)aString
-{
-        NSUInteger lineNumber = 1, length;
-        NSNumber * index;
-        NSString *key;
-        NSRange lineRange;
-        NSUInteger position = 0;
-        NSMutableDictionary * lineNumberDictionary = nil;
-        length = [aString length];
-        lineNumber = 0;
-        lineNumberDictionary = [[NSMutableDictionary alloc] init];
-        while (position < length) {
-                index = [NSNumber numberWithInteger:position];
-                key = [NSString stringWithFormat:@"%li", lineNumber];
-                [lineNumberDictionary setObject:index forKey:key];
-                lineRange = [aString lineRangeForRange:NSMakeRange(position, 0)];
-                position = NSMaxRange(lineRange);
-                lineNumber++;
+-(NSUInteger)lineNumberForLaidOutRect:(NSRect)rect
+{
+        NSTextView * textView = [self clientView];
+        NSLayoutManager * layoutManager = [textView layoutManager];
+        NSRange glyphRange;
+        NSUInteger lineNumber;
+        glyphRange = [layoutManager glyphRangeForBoundingRectWithoutAdditionalLayout:rect
+                                                                     inTextContainer:[textView textContainer]];
+        if (glyphRange.length > 0) {
+                lineNumber = [[self textStorage] lineNumberForCharacterIndex:[layoutManager characterIndexForGlyphAtIndex:glyphRange.location]];
+        } else {
+                lineNumber = (estimatedLineHeight > 0.0f) ? (NSUInteger)MAX(NSMinY(rect) / estimatedLineHeight, 0.0f) + 1 : 1;
+                lineNumber = MIN(lineNumber, [self numberOfLines]);
         }
-        lineRange = [aString lineRangeForRange:NSMakeRange(position, 0)];
-        if (lineRange.length == 0) {
-                index = [NSNumber numberWithInteger:position];
-                key = [NSString stringWithFormat:@"%li", lineNumber];
-                [lineNumberDictionary setObject:index forKey:key];
-                lineNumber++;
+        return lineNumber;
+}
+
+/**
+ * \brief Schedule a correction of the estimated lines of the viewport once
+ *        the text view had the chance to lay them out.
+ */
+-(void)scheduleEstimatedLinesCorrection
+{
+        [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                                 selector:@selector(correctEstimatedLines)
+                                                   object:nil];
+        [self performSelector:@selector(correctEstimatedLines) withObject:nil afterDelay:0.1];
+}
+
+/**
+ * \brief Replace the estimated position of the cached lines of the viewport
+ *        that have since been laid out.
+ *
+ * \details Only the estimated lines are queried again. When any of them has
+ *          been laid out, the cache is invalidated so that the lines following
+ *          it are placed relative to its actual position, and the ruler is
+ *          redisplayed. Otherwise the correction is scheduled again, until
+ *          layout catches up with the viewport.
+ */
+-(void)correctEstimatedLines
+{
+        NSUInteger i;
+        BOOL estimated = NO, corrected = NO;
+        PLRulerLine line;
+        for (i = 0; i < numberOfVisibleLines; i++) {
+                if (visibleLines[i].estimated == NO)
+                        continue;
+                line = [self rulerLineForLineNumber:visibleLines[i].lineNumber estimatedY:visibleLines[i].y];
+                if (line.estimated) {
+                        estimated = YES;
+                } else {
+                        visibleLines[i] = line;
+                        corrected = YES;
+                }
+        }
+        if (corrected) {
+                [self invalidateVisibleLines];
+                [self setNeedsDisplay:YES];
+        } else if (estimated && [self window] != nil) {
+                [self scheduleEstimatedLinesCorrection];
         }
-exit:
-        return [lineNumberDictionary autorelease];
 }
 
 -(NSRange)characterRangeForLineAtHeight:(CGFloat)height
 {
+        NSUInteger i;
         NSTextView *textView;
         NSLayoutManager *layoutManager;
         NSTextContainer *textContainer;
         NSRect visibleRect;
         NSRange glyphRange, characterRange;
         NSPoint textContainerOrigin;
+        
+        /* the cached lines of the viewport avoid any layout, unless an edit invalidated them */
+        for (i = 0; visibleLinesGeneration == layoutGeneration && i < numberOfVisibleLines; i++) {
+                if (height >= visibleLines[i].y && height < visibleLines[i].y + visibleLines[i].height) {
+                        characterRange = visibleLines[i].characterRange;
+                        goto exit;
+                }
+        }
         textView = (NSTextView *)[[self clientView] retain];
         textContainer = [textView textContainer];
         layoutManager = [textView layoutManager];
@@ -782,13 +861,8 @@ exit:
                                               inTextContainer:textContainer];
         characterRange = [layoutManager characterRangeForGlyphRange:glyphRange
                                                    actualGlyphRange:nil];
+exit:
         return characterRange;
 }
 
-//
-//-(BOOL)isOpaque
-//{
-//        return YES;
-//}
-
 @end
@@ -0,0 +1,124 @@
+/**
+ * \file PLMarkerIndex.h
+ * \brief Liasis Python IDE marker index interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for an object
+ * storing markers anchored to character positions in a string, which move with
+ * the edits of the string.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+
+#import <Foundation/Foundation.h>
+#import "PLLineIndex.h"
+
+/**
+ * \class PLMarkerIndex \headerfile \headerfile
+ * \brief A sorted set of markers anchored to character positions in a string.
+ *
+ * \details Markers, such as breakpoints, are anchored to a character index
+ *          and move with the text surrounding them when the string is edited.
+ *          The marker index stores the distances between consecutive markers
+ *          as the segment lengths of a PLLineIndex, in which every segment
+ *          but the first starts at a marker. Adding, removing or finding a
+ *          marker, and shifting every marker following an edit, are therefore
+ *          O(log n) in the number of markers, and querying the k markers in a
+ *          range is O(k log n).
+ *
+ *          An edit keeps a marker at the location of the edit, removes the
+ *          markers inside the replaced characters and shifts the markers
+ *          following them. When deleting characters brings two markers
+ *          together, the first one is removed.
+ */
+@interface PLMarkerIndex : NSObject {
+        /**
+         * \brief The segments of the string between consecutive markers.
+         */
+        PLLineIndex * segments;
+}
+
+/**
+ * \brief Initialize an empty marker index for an empty string.
+ */
+-(id)init;
+
+/**
+ * \brief Initialize an empty marker index for a string of a given length.
+ *
+ * \param length The number of characters in the string.
+ */
+-(id)initWithLength:(NSUInteger)length;
+
+/**
+ * \brief The number of markers.
+ */
+@property (readonly) NSUInteger count;
+
+/**
+ * \brief The number of characters in the string.
+ */
+@property (readonly) NSUInteger length;
+
+/**
+ * \brief Add a marker at a character index, if there is none.
+ *
+ * \param index The character index, at most the length of the string.
+ */
+-(void)addMarkerAtIndex:(NSUInteger)index;
+
+/**
+ * \brief Remove the marker at a character index, if there is one.
+ */
+-(void)removeMarkerAtIndex:(NSUInteger)index;
+
+/**
+ * \brief Remove every marker within a range of characters.
+ *
+ * \param range The range of characters. A range extending beyond the end of the
+ *              string also removes a marker at the end of the string.
+ */
+-(void)removeMarkersInRange:(NSRange)range;
+
+/**
+ * \brief Return YES if there is a marker at a character index.
+ */
+-(BOOL)containsMarkerAtIndex:(NSUInteger)index;
+
+/**
+ * \brief Return the character indexes of the markers within a range of
+ *        characters.
+ */
+-(NSIndexSet *)markersInRange:(NSRange)range;
+
+/**
+ * \brief Move the markers for a replacement of characters in the string.
+ *
+ * \param range The range of replaced characters.
+ *
+ * \param length The length of the replacement string.
+ */
+-(void)replaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length;
+
+@end
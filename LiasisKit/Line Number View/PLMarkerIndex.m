@@ -0,0 +1,173 @@
+/**
+ * \file PLMarkerIndex.m
+ * \brief Liasis Python IDE marker index implementation file.
+ *
+ * \details
+ * This file contains the method implementation for an object
+ * storing markers anchored to character positions in a string, which move with
+ * the edits of the string.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLMarkerIndex.h"
+
+@implementation PLMarkerIndex
+
+-(id)init
+{
+        return [self initWithLength:0];
+}
+
+-(id)initWithLength:(NSUInteger)length
+{
+        self = [super init];
+        if (self) {
+                segments = [[PLLineIndex alloc] init];
+                [segments replaceLinesInRange:NSMakeRange(1, 1) withLineLengths:&length count:1];
+        }
+        return self;
+}
+
+-(void)dealloc
+{
+        [segments release];
+        [super dealloc];
+}
+
+#pragma mark - Querying Markers
+
+-(NSUInteger)count
+{
+        return [segments numberOfLines] - 1;
+}
+
+-(NSUInteger)length
+{
+        return [segments length];
+}
+
+-(BOOL)containsMarkerAtIndex:(NSUInteger)index
+{
+        NSUInteger segment = [self segmentAtOrAfterIndex:index];
+        return (segment <= [segments numberOfLines] &&
+                [segments characterIndexForLineNumber:segment] == index);
+}
+
+-(NSIndexSet *)markersInRange:(NSRange)range
+{
+        NSMutableIndexSet * markers = [NSMutableIndexSet indexSet];
+        NSUInteger segment, position;
+        segment = [self segmentAtOrAfterIndex:range.location];
+        if (segment > [segments numberOfLines])
+                goto exit;
+        position = [segments characterIndexForLineNumber:segment];
+        for (; segment <= [segments numberOfLines] && position < NSMaxRange(range); segment++) {
+                [markers addIndex:position];
+                position = NSMaxRange([segments rangeOfLineNumber:segment]);
+        }
+exit:
+        return markers;
+}
+
+#pragma mark - Editing Markers
+
+-(void)addMarkerAtIndex:(NSUInteger)index
+{
+        NSUInteger segment, lengths[2];
+        NSRange segmentRange;
+        if (index > [segments length])
+                goto exit;
+        segment = [segments lineNumberForCharacterIndex:index];
+        segmentRange = [segments rangeOfLineNumber:segment];
+        if (segmentRange.location == index && segment > 1)
+                goto exit;
+        lengths[0] = index - segmentRange.location;
+        lengths[1] = NSMaxRange(segmentRange) - index;
+        [segments replaceLinesInRange:NSMakeRange(segment, 1) withLineLengths:lengths count:2];
+exit:
+        return;
+}
+
+-(void)removeMarkerAtIndex:(NSUInteger)index
+{
+        if ([self containsMarkerAtIndex:index])
+                [self removeMarkersInRange:NSMakeRange(index, 1)];
+}
+
+-(void)removeMarkersInRange:(NSRange)range
+{
+        NSUInteger first, last, start, length;
+        if (range.length == 0)
+                goto exit;
+        first = [self segmentAtOrAfterIndex:range.location];
+        last = [self segmentAtOrAfterIndex:NSMaxRange(range)] - 1;
+        if (last < first)
+                goto exit;
+        
+        /* merge the segments starting at the removed markers with the preceding segment */
+        start = [segments characterIndexForLineNumber:first - 1];
+        length = NSMaxRange([segments rangeOfLineNumber:last]) - start;
+        [segments replaceLinesInRange:NSMakeRange(first - 1, last - first + 2) withLineLengths:&length count:1];
+exit:
+        return;
+}
+
+-(void)replaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length
+{
+        NSUInteger first, last, start, segmentLength;
+        first = [segments lineNumberForCharacterIndex:range.location];
+        last = [segments lineNumberForCharacterIndex:NSMaxRange(range)];
+        if (last > first && [segments characterIndexForLineNumber:last] == NSMaxRange(range))
+                last--;
+        
+        /* merge the segments spanned by the range, removing the markers inside it */
+        start = [segments characterIndexForLineNumber:first];
+        segmentLength = NSMaxRange([segments rangeOfLineNumber:last]) - start - range.length + length;
+        [segments replaceLinesInRange:NSMakeRange(first, last - first + 1) withLineLengths:&segmentLength count:1];
+        
+        /* the marker at the start of an emptied segment meets the following marker */
+        if (segmentLength == 0 && first > 1 && first < [segments numberOfLines]) {
+                segmentLength = [segments rangeOfLineNumber:first - 1].length;
+                [segments replaceLinesInRange:NSMakeRange(first - 1, 2) withLineLengths:&segmentLength count:1];
+        }
+}
+
+#pragma mark - Private Methods
+
+/**
+ * \brief Return the first segment starting at a marker at or after a character
+ *        index.
+ *
+ * \details Returns numberOfLines + 1 of the segments when there is no marker
+ *          at or after the index.
+ */
+-(NSUInteger)segmentAtOrAfterIndex:(NSUInteger)index
+{
+        NSUInteger segment = [segments lineNumberForCharacterIndex:index];
+        if (segment == 1 || [segments characterIndexForLineNumber:segment] < index)
+                segment++;
+        return segment;
+}
+
+@end
@@ -128,4 +128,33 @@
  */
 -(NSDictionary *)getNavigationAndReturnError:(NSError **)error;
 
+/**
+ * \brief Return the semantic ranges of a source code.
+ *
+ * \details This method finds the ranges of the names in the source code,
+ *          grouped by their meaning: local variables, global variables,
+ *          parameters and unresolved names, using the group names defined in
+ *          PLSemanticOverlay.h. The syntax highlighter colors these ranges
+ *          over the lexical syntax coloring with the theme colors of their
+ *          group.
+ *
+ *          This method is called on a background thread, while the other
+ *          methods of the plugin are called on the main thread. It must parse
+ *          the source it is given without using or changing the state set by
+ *          parseSource:error:, and must hold the GIL with PyGILState_Ensure()
+ *          and PyGILState_Release() around any call into Python.
+ *
+ * \param source An immutable snapshot of the source code.
+ *
+ * \param error On input, a pointer to a pointer for an error object. If an
+ *              error occurs while getting the semantic ranges, this parameter
+ *              contains an error object on output unless it was NULL on input.
+ *
+ * \return A dictionary mapping each group name to an array of `NSValue`
+ *         ranges. Return nil on error.
+ *
+ * \see PLSemanticOverlay
+ */
+-(NSDictionary *)semanticRangesOfSource:(NSString *)source error:(NSError **)error;
+
 @end
@@ -0,0 +1,175 @@
+/**
+ * \file PLLexerStates.h
+ * \brief Liasis Python IDE lexer states interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for an object
+ * storing the state of the syntax coloring lexer at the end of each line of a
+ * text, and the lines that were edited since they were last colored.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ * \brief The state of the syntax coloring lexer between two lines.
+ *
+ * \details The meaning of a state is defined by the syntax coloring script,
+ *          except for PLLexerStateDefault, the state at the start of a text,
+ *          and PLLexerStateUnknown, the state of a line that has not been
+ *          colored.
+ */
+typedef unsigned char PLLexerState;
+
+enum {
+        PLLexerStateDefault = 0,
+        PLLexerStateUnknown = 0xFF
+};
+
+/**
+ * \class PLLexerStates \headerfile \headerfile
+ * \brief Store the lexer state at the end of each line of a text, and the
+ *        range of lines edited since they were last colored.
+ *
+ * \details The syntax highlighter resumes coloring at the start of an edited
+ *          line with the state at the end of the previous line, and stops once
+ *          the state at the end of a colored line matches the state stored by
+ *          the previous pass. The lexer states are spliced along with the lines
+ *          of the text, so that the states of the lines following an edit are
+ *          kept. The edited lines are accumulated in a single damaged range
+ *          until they are repaired by the syntax highlighter.
+ *
+ *          Line numbers start at 1, as in the PLLineIndex.
+ */
+@interface PLLexerStates : NSObject {
+        /**
+         * \brief A C array with the lexer state at the end of each line.
+         */
+        PLLexerState * states;
+
+        /**
+         * \brief The number of lines.
+         */
+        NSUInteger numberOfLines;
+
+        /**
+         * \brief The number of lines the states array can hold.
+         */
+        NSUInteger capacity;
+
+        /**
+         * \brief The range of lines edited since they were last colored.
+         */
+        NSRange damagedLineRange;
+}
+
+/**
+ * \brief Initialize the lexer states of a text with a number of lines.
+ *
+ * \details The states of all lines are unknown, and all lines are damaged.
+ *
+ * \param count The number of lines in the text, at least 1.
+ */
+-(id)initWithNumberOfLines:(NSUInteger)count;
+
+/**
+ * \brief The number of lines in the text.
+ */
+@property (readonly) NSUInteger numberOfLines;
+
+/**
+ * \brief The range of lines edited since they were last colored. The length
+ *        is zero if no line is damaged.
+ */
+@property (readonly) NSRange damagedLineRange;
+
+/**
+ * \brief Return the lexer state at the end of a line.
+ *
+ * \param lineNumber The line number, starting at 1.
+ */
+-(PLLexerState)stateAtEndOfLine:(NSUInteger)lineNumber;
+
+/**
+ * \brief Set the lexer state at the end of a line.
+ *
+ * \param state The lexer state.
+ *
+ * \param lineNumber The line number, starting at 1.
+ */
+-(void)setState:(PLLexerState)state atEndOfLine:(NSUInteger)lineNumber;
+
+/**
+ * \brief Copy the lexer states at the end of a range of lines.
+ *
+ * \param buffer A C array of at least lineRange.length states, set to the
+ *               state at the end of each line. Lines beyond the last line are
+ *               set to PLLexerStateUnknown.
+ *
+ * \param lineRange The range of line numbers, starting at 1.
+ */
+-(void)getStates:(PLLexerState *)buffer inLineRange:(NSRange)lineRange;
+
+/**
+ * \brief Replace a range of lines with a number of new lines, and mark the new
+ *        lines as damaged.
+ *
+ * \details The states of the new lines are unknown, except for the last one,
+ *          which keeps the state at the end of the last replaced line. This
+ *          state is what the line following the edit was colored with, so the
+ *          syntax highlighter can stop after the edited lines when it is
+ *          unchanged.
+ *
+ * \param lineRange The range of line numbers to replace, as in the PLLineIndex.
+ *                  A range beyond the last line is ignored.
+ *
+ * \param count The number of new lines.
+ */
+-(void)replaceLinesInRange:(NSRange)lineRange withCount:(NSUInteger)count;
+
+/**
+ * \brief Mark a range of lines as colored.
+ *
+ * \details The damaged range is cleared when the repaired lines cover it, and
+ *          shortened when they cover its start or its end. Repairing lines in
+ *          the middle of the damaged range leaves it unchanged.
+ *
+ * \param lineRange The range of line numbers colored.
+ */
+-(void)repairLinesInRange:(NSRange)lineRange;
+
+/**
+ * \brief Mark a range of lines as damaged, without changing their states.
+ *
+ * \details The damaged range grows to cover the lines, along with the lines
+ *          between them and the damaged range. This is used when lines were
+ *          colored from a lexer state that may be wrong, or when a pass stopped
+ *          before the lexer states of the following lines were confirmed.
+ *
+ * \param lineRange The range of line numbers. Lines beyond the last line are
+ *                  ignored.
+ */
+-(void)damageLinesInRange:(NSRange)lineRange;
+
+@end
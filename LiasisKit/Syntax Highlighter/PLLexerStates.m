@@ -0,0 +1,170 @@
+/**
+ * \file PLLexerStates.m
+ * \brief Liasis Python IDE lexer states implementation file.
+ *
+ * \details
+ * This file contains the method implementation for an object
+ * storing the state of the syntax coloring lexer at the end of each line of a
+ * text, and the lines that were edited since they were last colored.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLLexerStates.h"
+
+@implementation PLLexerStates
+
+-(id)initWithNumberOfLines:(NSUInteger)count
+{
+        self = [super init];
+        if (self) {
+                numberOfLines = 0;
+                capacity = 0;
+                states = NULL;
+                damagedLineRange = NSMakeRange(1, 0);
+                [self replaceLinesInRange:NSMakeRange(1, 0) withCount:MAX(count, (NSUInteger)1)];
+        }
+        return self;
+}
+
+-(id)init
+{
+        return [self initWithNumberOfLines:1];
+}
+
+-(void)dealloc
+{
+        free(states);
+        [super dealloc];
+}
+
+@synthesize numberOfLines;
+
+@synthesize damagedLineRange;
+
+-(PLLexerState)stateAtEndOfLine:(NSUInteger)lineNumber
+{
+        PLLexerState state = PLLexerStateUnknown;
+        if (lineNumber < 1 || lineNumber > numberOfLines)
+                goto exit;
+        state = states[lineNumber - 1];
+exit:
+        return state;
+}
+
+-(void)setState:(PLLexerState)state atEndOfLine:(NSUInteger)lineNumber
+{
+        if (lineNumber < 1 || lineNumber > numberOfLines)
+                goto exit;
+        states[lineNumber - 1] = state;
+exit:
+        return;
+}
+
+-(void)getStates:(PLLexerState *)buffer inLineRange:(NSRange)lineRange
+{
+        NSUInteger count = 0;
+        if (lineRange.location >= 1 && lineRange.location <= numberOfLines) {
+                count = MIN(lineRange.length, numberOfLines + 1 - lineRange.location);
+                memcpy(buffer, states + lineRange.location - 1, count * sizeof(PLLexerState));
+        }
+        memset(buffer + count, PLLexerStateUnknown, (lineRange.length - count) * sizeof(PLLexerState));
+}
+
+-(void)replaceLinesInRange:(NSRange)lineRange withCount:(NSUInteger)count
+{
+        NSUInteger first, last, newNumberOfLines;
+        PLLexerState lastState;
+        if (lineRange.location < 1 || NSMaxRange(lineRange) > numberOfLines + 1)
+                goto exit;
+        lastState = (lineRange.length > 0) ? states[NSMaxRange(lineRange) - 2] : PLLexerStateUnknown;
+        newNumberOfLines = numberOfLines - lineRange.length + count;
+        if (newNumberOfLines > capacity) {
+                capacity = MAX(newNumberOfLines + newNumberOfLines / 2, (NSUInteger)64);
+                states = realloc(states, capacity * sizeof(PLLexerState));
+        }
+        memmove(states + lineRange.location - 1 + count,
+                states + NSMaxRange(lineRange) - 1,
+                (numberOfLines + 1 - NSMaxRange(lineRange)) * sizeof(PLLexerState));
+        if (count > 0) {
+                memset(states + lineRange.location - 1, PLLexerStateUnknown, count * sizeof(PLLexerState));
+                states[lineRange.location + count - 2] = lastState;
+        }
+        numberOfLines = newNumberOfLines;
+
+        /* shift the damaged lines following the edit, and add the edited lines */
+        first = lineRange.location;
+        last = lineRange.location + MAX(count, (NSUInteger)1) - 1;
+        if (damagedLineRange.length > 0) {
+                if (damagedLineRange.location < first)
+                        first = damagedLineRange.location;
+                else if (damagedLineRange.location >= NSMaxRange(lineRange))
+                        first = MIN(first, damagedLineRange.location + count - lineRange.length);
+                if (NSMaxRange(damagedLineRange) - 1 >= NSMaxRange(lineRange))
+                        last = MAX(last, NSMaxRange(damagedLineRange) - 1 + count - lineRange.length);
+                else if (NSMaxRange(damagedLineRange) - 1 < lineRange.location)
+                        last = MAX(last, NSMaxRange(damagedLineRange) - 1);
+        }
+        first = MAX(MIN(first, numberOfLines), (NSUInteger)1);
+        last = MAX(MIN(last, numberOfLines), first);
+        damagedLineRange = NSMakeRange(first, last - first + 1);
+exit:
+        return;
+}
+
+-(void)repairLinesInRange:(NSRange)lineRange
+{
+        NSUInteger first, last;
+        if (damagedLineRange.length == 0 || lineRange.length == 0)
+                goto exit;
+        first = damagedLineRange.location;
+        last = NSMaxRange(damagedLineRange) - 1;
+        if (lineRange.location <= first && NSMaxRange(lineRange) > first)
+                first = NSMaxRange(lineRange);
+        if (lineRange.location <= last && NSMaxRange(lineRange) > last)
+                last = lineRange.location - 1;
+        if (first > last || last == 0)
+                damagedLineRange = NSMakeRange(1, 0);
+        else
+                damagedLineRange = NSMakeRange(first, last - first + 1);
+exit:
+        return;
+}
+
+-(void)damageLinesInRange:(NSRange)lineRange
+{
+        NSUInteger first, last;
+        if (lineRange.length == 0 || lineRange.location < 1 || lineRange.location > numberOfLines)
+                goto exit;
+        first = lineRange.location;
+        last = MIN(NSMaxRange(lineRange) - 1, numberOfLines);
+        if (damagedLineRange.length > 0) {
+                first = MIN(first, damagedLineRange.location);
+                last = MAX(last, NSMaxRange(damagedLineRange) - 1);
+        }
+        damagedLineRange = NSMakeRange(first, last - first + 1);
+exit:
+        return;
+}
+
+@end
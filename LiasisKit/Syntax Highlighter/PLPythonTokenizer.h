@@ -0,0 +1,148 @@
+/**
+ * \file PLPythonTokenizer.h
+ * \brief Liasis Python IDE native Python tokenizer interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for an object
+ * splitting Python source into the groups colored by the syntax highlighter,
+ * without calling a Python script.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#import "PLLexerStates.h"
+
+/**
+ * \brief The groups of Python source colored by the syntax highlighter.
+ *
+ * \details The name of each group, as returned by
+ *          [PLPythonTokenizer nameOfGroup:], is the group of the theme property
+ *          list with its color.
+ */
+typedef enum {
+        PLPythonTokenDocstring = 0,
+        PLPythonTokenString,
+        PLPythonTokenNumber,
+        PLPythonTokenComment,
+        PLPythonTokenKeyword,
+        PLPythonTokenException,
+        PLPythonTokenFunctionName,
+        PLPythonTokenGroupCount
+} PLPythonTokenGroup;
+
+/**
+ * \brief The lexer states of the native Python tokenizer between two lines,
+ *        the same as the states of the python.py syntax coloring script.
+ */
+enum {
+        PLPythonLexerStateDoubleQuoteDocstring = 1,
+        PLPythonLexerStateSingleQuoteDocstring = 2
+};
+
+/**
+ * \brief A range of characters in a group.
+ */
+typedef struct {
+        NSRange range;
+        PLPythonTokenGroup group;
+} PLPythonToken;
+
+/**
+ * \class PLPythonTokenizer \headerfile \headerfile
+ * \brief Split Python source into the groups colored by the syntax highlighter.
+ *
+ * \details The tokenizer is a state machine over the UTF-16 code units of the
+ *          source, driven by a table of character classes, and matches exactly
+ *          the ranges found by the regular expressions of the python.py syntax
+ *          coloring script: docstrings, strings, numbers, comments, keywords,
+ *          and builtin exceptions and functions. The builtin names are those of
+ *          the Python 2.7 interpreter embedded by the syntax highlighter.
+ *
+ *          The tokens of the last source are kept in a buffer reused by the
+ *          next one, so that coloring does not allocate an object per token.
+ */
+@interface PLPythonTokenizer : NSObject {
+        /**
+         * \brief A C array with the tokens of the last source.
+         */
+        PLPythonToken * tokens;
+
+        /**
+         * \brief The number of tokens of the last source.
+         */
+        NSUInteger numberOfTokens;
+
+        /**
+         * \brief The number of tokens the tokens array can hold.
+         */
+        NSUInteger capacity;
+}
+
+/**
+ * \brief Return the name of a group, as used by the syntax coloring script and
+ *        the theme property lists (e.g. String or Function name).
+ */
++(NSString *)nameOfGroup:(PLPythonTokenGroup)group;
+
+/**
+ * \brief The tokens of the last source, in order of their location, valid
+ *        until the next source is tokenized.
+ */
+@property (readonly) const PLPythonToken * tokens;
+
+/**
+ * \brief The number of tokens of the last source.
+ */
+@property (readonly) NSUInteger numberOfTokens;
+
+/**
+ * \brief Split a span of lines of Python source into tokens, and find the
+ *        lexer state at the end of each line.
+ *
+ * \details This method is the native counterpart of get_line_coloring() in the
+ *          python.py script. The ranges of the tokens are relative to the start
+ *          of the characters.
+ *
+ * \param characters A C array with the UTF-16 code units of the source.
+ *
+ * \param length The number of code units.
+ *
+ * \param state The lexer state at the start of the source.
+ *
+ * \param lineEnds A C array with the offset of the end of each line in the
+ *                 source, in increasing order. May be NULL if count is 0.
+ *
+ * \param states A C array set to the lexer state at the end of each line. May
+ *               be NULL if count is 0.
+ *
+ * \param count The number of lines.
+ */
+-(void)tokenizeCharacters:(const unichar *)characters
+                   length:(NSUInteger)length
+               lexerState:(PLLexerState)state
+                 lineEnds:(const NSUInteger *)lineEnds
+              lexerStates:(PLLexerState *)states
+                    count:(NSUInteger)count;
+
+@end
@@ -0,0 +1,565 @@
+/**
+ * \file PLPythonTokenizer.m
+ * \brief Liasis Python IDE native Python tokenizer implementation file.
+ *
+ * \details
+ * This file contains the method implementation for an object
+ * splitting Python source into the groups colored by the syntax highlighter,
+ * without calling a Python script.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLPythonTokenizer.h"
+
+#pragma mark Character Classes
+
+/**
+ * \brief The classes of the characters that start or end a token.
+ *
+ * \details Word characters are the ASCII letters, digits and underscore, as
+ *          matched by \w in the regular expressions of the python.py script.
+ *          Every other character, including non-ASCII characters, is either a
+ *          delimiter of a token or PLCharacterOther.
+ */
+typedef enum {
+        PLCharacterOther = 0,
+        PLCharacterLetter,
+        PLCharacterDigit,
+        PLCharacterDot,
+        PLCharacterDoubleQuote,
+        PLCharacterSingleQuote,
+        PLCharacterHash,
+        PLCharacterNewline
+} PLCharacterClass;
+
+/**
+ * \brief The class of each ASCII character, filled in by +initialize.
+ */
+static unsigned char characterClasses[128];
+
+/**
+ * \brief Return the class of a UTF-16 code unit.
+ */
+static inline PLCharacterClass characterClass(unichar character)
+{
+        return (character < 128) ? characterClasses[character] : PLCharacterOther;
+}
+
+/**
+ * \brief Return whether a UTF-16 code unit is a word character.
+ */
+static inline BOOL isWordCharacter(unichar character)
+{
+        PLCharacterClass class = characterClass(character);
+        return class == PLCharacterLetter || class == PLCharacterDigit;
+}
+
+/**
+ * \brief Return the index following a run of ASCII digits.
+ */
+static inline NSUInteger skipDigits(const unichar * characters, NSUInteger length, NSUInteger index)
+{
+        while (index < length && characterClass(characters[index]) == PLCharacterDigit)
+                index++;
+        return index;
+}
+
+#pragma mark Builtin Names
+
+/**
+ * \brief A keyword or builtin name and its group.
+ */
+typedef struct {
+        const char * name;
+        PLPythonTokenGroup group;
+} PLPythonWord;
+
+/**
+ * \brief The keywords and builtin names of Python 2.7, sorted by name.
+ *
+ * \details The builtin names starting with an uppercase letter are
+ *          exceptions, and the others are functions, as in the python.py
+ *          script. A name in two groups, such as print, is in the group matched
+ *          first by the script.
+ */
+static const PLPythonWord pythonWords[] = {
+        {"ArithmeticError", PLPythonTokenException},
+        {"AssertionError", PLPythonTokenException},
+        {"AttributeError", PLPythonTokenException},
+        {"BaseException", PLPythonTokenException},
+        {"BufferError", PLPythonTokenException},
+        {"BytesWarning", PLPythonTokenException},
+        {"DeprecationWarning", PLPythonTokenException},
+        {"EOFError", PLPythonTokenException},
+        {"Ellipsis", PLPythonTokenException},
+        {"EnvironmentError", PLPythonTokenException},
+        {"Exception", PLPythonTokenException},
+        {"False", PLPythonTokenException},
+        {"FloatingPointError", PLPythonTokenException},
+        {"FutureWarning", PLPythonTokenException},
+        {"GeneratorExit", PLPythonTokenException},
+        {"IOError", PLPythonTokenException},
+        {"ImportError", PLPythonTokenException},
+        {"ImportWarning", PLPythonTokenException},
+        {"IndentationError", PLPythonTokenException},
+        {"IndexError", PLPythonTokenException},
+        {"KeyError", PLPythonTokenException},
+        {"KeyboardInterrupt", PLPythonTokenException},
+        {"LookupError", PLPythonTokenException},
+        {"MemoryError", PLPythonTokenException},
+        {"NameError", PLPythonTokenException},
+        {"None", PLPythonTokenException},
+        {"NotImplemented", PLPythonTokenException},
+        {"NotImplementedError", PLPythonTokenException},
+        {"OSError", PLPythonTokenException},
+        {"OverflowError", PLPythonTokenException},
+        {"PendingDeprecationWarning", PLPythonTokenException},
+        {"ReferenceError", PLPythonTokenException},
+        {"RuntimeError", PLPythonTokenException},
+        {"RuntimeWarning", PLPythonTokenException},
+        {"StandardError", PLPythonTokenException},
+        {"StopIteration", PLPythonTokenException},
+        {"SyntaxError", PLPythonTokenException},
+        {"SyntaxWarning", PLPythonTokenException},
+        {"SystemError", PLPythonTokenException},
+        {"SystemExit", PLPythonTokenException},
+        {"TabError", PLPythonTokenException},
+        {"True", PLPythonTokenException},
+        {"TypeError", PLPythonTokenException},
+        {"UnboundLocalError", PLPythonTokenException},
+        {"UnicodeDecodeError", PLPythonTokenException},
+        {"UnicodeEncodeError", PLPythonTokenException},
+        {"UnicodeError", PLPythonTokenException},
+        {"UnicodeTranslateError", PLPythonTokenException},
+        {"UnicodeWarning", PLPythonTokenException},
+        {"UserWarning", PLPythonTokenException},
+        {"ValueError", PLPythonTokenException},
+        {"Warning", PLPythonTokenException},
+        {"ZeroDivisionError", PLPythonTokenException},
+        {"abs", PLPythonTokenFunctionName},
+        {"all", PLPythonTokenFunctionName},
+        {"and", PLPythonTokenKeyword},
+        {"any", PLPythonTokenFunctionName},
+        {"apply", PLPythonTokenFunctionName},
+        {"as", PLPythonTokenKeyword},
+        {"assert", PLPythonTokenKeyword},
+        {"basestring", PLPythonTokenFunctionName},
+        {"bin", PLPythonTokenFunctionName},
+        {"bool", PLPythonTokenFunctionName},
+        {"break", PLPythonTokenKeyword},
+        {"buffer", PLPythonTokenFunctionName},
+        {"bytearray", PLPythonTokenFunctionName},
+        {"bytes", PLPythonTokenFunctionName},
+        {"callable", PLPythonTokenFunctionName},
+        {"chr", PLPythonTokenFunctionName},
+        {"class", PLPythonTokenKeyword},
+        {"classmethod", PLPythonTokenFunctionName},
+        {"cmp", PLPythonTokenFunctionName},
+        {"coerce", PLPythonTokenFunctionName},
+        {"compile", PLPythonTokenFunctionName},
+        {"complex", PLPythonTokenFunctionName},
+        {"continue", PLPythonTokenKeyword},
+        {"copyright", PLPythonTokenFunctionName},
+        {"credits", PLPythonTokenFunctionName},
+        {"def", PLPythonTokenKeyword},
+        {"del", PLPythonTokenKeyword},
+        {"delattr", PLPythonTokenFunctionName},
+        {"dict", PLPythonTokenFunctionName},
+        {"dir", PLPythonTokenFunctionName},
+        {"divmod", PLPythonTokenFunctionName},
+        {"elif", PLPythonTokenKeyword},
+        {"else", PLPythonTokenKeyword},
+        {"enumerate", PLPythonTokenFunctionName},
+        {"eval", PLPythonTokenFunctionName},
+        {"except", PLPythonTokenKeyword},
+        {"exec", PLPythonTokenKeyword},
+        {"execfile", PLPythonTokenFunctionName},
+        {"exit", PLPythonTokenFunctionName},
+        {"file", PLPythonTokenFunctionName},
+        {"filter", PLPythonTokenFunctionName},
+        {"finally", PLPythonTokenKeyword},
+        {"float", PLPythonTokenFunctionName},
+        {"for", PLPythonTokenKeyword},
+        {"format", PLPythonTokenFunctionName},
+        {"from", PLPythonTokenKeyword},
+        {"frozenset", PLPythonTokenFunctionName},
+        {"getattr", PLPythonTokenFunctionName},
+        {"global", PLPythonTokenKeyword},
+        {"globals", PLPythonTokenFunctionName},
+        {"hasattr", PLPythonTokenFunctionName},
+        {"hash", PLPythonTokenFunctionName},
+        {"help", PLPythonTokenFunctionName},
+        {"hex", PLPythonTokenFunctionName},
+        {"id", PLPythonTokenFunctionName},
+        {"if", PLPythonTokenKeyword},
+        {"import", PLPythonTokenKeyword},
+        {"in", PLPythonTokenKeyword},
+        {"input", PLPythonTokenFunctionName},
+        {"int", PLPythonTokenFunctionName},
+        {"intern", PLPythonTokenFunctionName},
+        {"is", PLPythonTokenKeyword},
+        {"isinstance", PLPythonTokenFunctionName},
+        {"issubclass", PLPythonTokenFunctionName},
+        {"iter", PLPythonTokenFunctionName},
+        {"lambda", PLPythonTokenKeyword},
+        {"len", PLPythonTokenFunctionName},
+        {"license", PLPythonTokenFunctionName},
+        {"list", PLPythonTokenFunctionName},
+        {"locals", PLPythonTokenFunctionName},
+        {"long", PLPythonTokenFunctionName},
+        {"map", PLPythonTokenFunctionName},
+        {"max", PLPythonTokenFunctionName},
+        {"memoryview", PLPythonTokenFunctionName},
+        {"min", PLPythonTokenFunctionName},
+        {"next", PLPythonTokenFunctionName},
+        {"not", PLPythonTokenKeyword},
+        {"object", PLPythonTokenFunctionName},
+        {"oct", PLPythonTokenFunctionName},
+        {"open", PLPythonTokenFunctionName},
+        {"or", PLPythonTokenKeyword},
+        {"ord", PLPythonTokenFunctionName},
+        {"pass", PLPythonTokenKeyword},
+        {"pow", PLPythonTokenFunctionName},
+        {"print", PLPythonTokenFunctionName},
+        {"property", PLPythonTokenFunctionName},
+        {"quit", PLPythonTokenFunctionName},
+        {"raise", PLPythonTokenKeyword},
+        {"range", PLPythonTokenFunctionName},
+        {"raw_input", PLPythonTokenFunctionName},
+        {"reduce", PLPythonTokenFunctionName},
+        {"reload", PLPythonTokenFunctionName},
+        {"repr", PLPythonTokenFunctionName},
+        {"return", PLPythonTokenKeyword},
+        {"reversed", PLPythonTokenFunctionName},
+        {"round", PLPythonTokenFunctionName},
+        {"set", PLPythonTokenFunctionName},
+        {"setattr", PLPythonTokenFunctionName},
+        {"slice", PLPythonTokenFunctionName},
+        {"sorted", PLPythonTokenFunctionName},
+        {"staticmethod", PLPythonTokenFunctionName},
+        {"str", PLPythonTokenFunctionName},
+        {"sum", PLPythonTokenFunctionName},
+        {"super", PLPythonTokenFunctionName},
+        {"try", PLPythonTokenKeyword},
+        {"tuple", PLPythonTokenFunctionName},
+        {"type", PLPythonTokenFunctionName},
+        {"unichr", PLPythonTokenFunctionName},
+        {"unicode", PLPythonTokenFunctionName},
+        {"vars", PLPythonTokenFunctionName},
+        {"while", PLPythonTokenKeyword},
+        {"with", PLPythonTokenKeyword},
+        {"xrange", PLPythonTokenFunctionName},
+        {"yield", PLPythonTokenKeyword},
+        {"zip", PLPythonTokenFunctionName},
+};
+
+/**
+ * \brief The length of the longest name of the pythonWords array.
+ */
+#define MAXIMUM_WORD_LENGTH 25
+
+/**
+ * \brief Compare a word of ASCII UTF-16 code units with a C string.
+ */
+static int compareWord(const unichar * word, NSUInteger length, const char * name)
+{
+        NSUInteger i;
+        for (i = 0; i < length; i++) {
+                if (name[i] == '\0')
+                        return 1;
+                if (word[i] != (unichar)name[i])
+                        return (word[i] < (unichar)name[i]) ? -1 : 1;
+        }
+        return (name[length] == '\0') ? 0 : -1;
+}
+
+/**
+ * \brief Find the group of a keyword or builtin name.
+ *
+ * \param word The UTF-16 code units of a whole word.
+ *
+ * \param length The number of code units of the word.
+ *
+ * \param group Set to the group of the word if it is found.
+ *
+ * \return Whether the word is a keyword or a builtin name.
+ */
+static BOOL findWordGroup(const unichar * word, NSUInteger length, PLPythonTokenGroup * group)
+{
+        BOOL found = NO;
+        NSUInteger low = 0, high = sizeof(pythonWords) / sizeof(PLPythonWord), middle;
+        int comparison;
+        if (length > MAXIMUM_WORD_LENGTH)
+                goto exit;
+        while (low < high) {
+                middle = (low + high) / 2;
+                comparison = compareWord(word, length, pythonWords[middle].name);
+                if (comparison == 0) {
+                        *group = pythonWords[middle].group;
+                        found = YES;
+                        goto exit;
+                }
+                if (comparison < 0)
+                        high = middle;
+                else
+                        low = middle + 1;
+        }
+exit:
+        return found;
+}
+
+#pragma mark Scanners
+
+/**
+ * \brief Find the end of a docstring.
+ *
+ * \param characters The UTF-16 code units of the source.
+ *
+ * \param length The number of code units.
+ *
+ * \param index The index following the opening delimiter.
+ *
+ * \param quote The quote of the delimiter.
+ *
+ * \param isOpen Set to YES if the docstring is not closed before the end of the
+ *               source.
+ *
+ * \return The index following the closing delimiter, or the length of the
+ *         source if the docstring is open.
+ */
+static NSUInteger scanDocstring(const unichar * characters, NSUInteger length, NSUInteger index, unichar quote, BOOL * isOpen)
+{
+        for (; index + 2 < length; index++) {
+                if (characters[index] == quote && characters[index + 1] == quote && characters[index + 2] == quote) {
+                        *isOpen = NO;
+                        return index + 3;
+                }
+        }
+        *isOpen = YES;
+        return length;
+}
+
+/**
+ * \brief Find the end of a string, at its closing quote or at the end of its
+ *        line.
+ */
+static NSUInteger scanString(const unichar * characters, NSUInteger length, NSUInteger index, unichar quote)
+{
+        for (index++; index < length && characters[index] != '\n'; index++) {
+                if (characters[index] == quote)
+                        return index + 1;
+        }
+        return index;
+}
+
+/**
+ * \brief Find the end of a number starting with a digit, with an optional
+ *        fraction and exponent.
+ */
+static NSUInteger scanNumber(const unichar * characters, NSUInteger length, NSUInteger index)
+{
+        index = skipDigits(characters, length, index);
+        if (index < length && characters[index] == '.')
+                index++;
+        index = skipDigits(characters, length, index);
+        if (index < length && (characters[index] == 'e' || characters[index] == 'E')) {
+                index++;
+                if (index < length && (characters[index] == '+' || characters[index] == '-'))
+                        index++;
+                index = skipDigits(characters, length, index);
+        }
+        return index;
+}
+
+/**
+ * \brief Find the end of a line.
+ */
+static NSUInteger scanLine(const unichar * characters, NSUInteger length, NSUInteger index)
+{
+        while (index < length && characters[index] != '\n')
+                index++;
+        return index;
+}
+
+/**
+ * \brief Find the end of a run of word characters.
+ */
+static NSUInteger scanWord(const unichar * characters, NSUInteger length, NSUInteger index)
+{
+        while (index < length && isWordCharacter(characters[index]))
+                index++;
+        return index;
+}
+
+#pragma mark -
+
+@implementation PLPythonTokenizer
+
++(void)initialize
+{
+        unichar character;
+        if (self != [PLPythonTokenizer class])
+                return;
+        for (character = 'a'; character <= 'z'; character++)
+                characterClasses[character] = PLCharacterLetter;
+        for (character = 'A'; character <= 'Z'; character++)
+                characterClasses[character] = PLCharacterLetter;
+        for (character = '0'; character <= '9'; character++)
+                characterClasses[character] = PLCharacterDigit;
+        characterClasses['_'] = PLCharacterLetter;
+        characterClasses['.'] = PLCharacterDot;
+        characterClasses['"'] = PLCharacterDoubleQuote;
+        characterClasses['\''] = PLCharacterSingleQuote;
+        characterClasses['#'] = PLCharacterHash;
+        characterClasses['\n'] = PLCharacterNewline;
+}
+
++(NSString *)nameOfGroup:(PLPythonTokenGroup)group
+{
+        static NSString * const names[PLPythonTokenGroupCount] = {
+                @"Docstring", @"String", @"Number", @"Comment", @"Keyword", @"Exception", @"Function name"
+        };
+        return (group < PLPythonTokenGroupCount) ? names[group] : nil;
+}
+
+-(id)init
+{
+        self = [super init];
+        if (self) {
+                tokens = NULL;
+                numberOfTokens = 0;
+                capacity = 0;
+        }
+        return self;
+}
+
+-(void)dealloc
+{
+        free(tokens);
+        [super dealloc];
+}
+
+@synthesize tokens;
+
+@synthesize numberOfTokens;
+
+-(void)tokenizeCharacters:(const unichar *)characters
+                   length:(NSUInteger)length
+               lexerState:(PLLexerState)state
+                 lineEnds:(const NSUInteger *)lineEnds
+              lexerStates:(PLLexerState *)states
+                    count:(NSUInteger)count
+{
+        NSUInteger index = 0, end, line = 0;
+        PLPythonTokenGroup group;
+        PLLexerState docstringState;
+        unichar character;
+        BOOL isOpen;
+        numberOfTokens = 0;
+        if (count > 0)
+                memset(states, PLLexerStateDefault, count * sizeof(PLLexerState));
+
+        /* finish the docstring open at the end of the previous line */
+        if (state == PLPythonLexerStateDoubleQuoteDocstring || state == PLPythonLexerStateSingleQuoteDocstring) {
+                index = scanDocstring(characters, length, 0, (state == PLPythonLexerStateDoubleQuoteDocstring) ? '"' : '\'', &isOpen);
+                [self addTokenWithRange:NSMakeRange(0, index) group:PLPythonTokenDocstring];
+                while (line < count && (lineEnds[line] < index || (isOpen && lineEnds[line] <= index)))
+                        states[line++] = state;
+        }
+
+        while (index < length) {
+                character = characters[index];
+                switch (characterClass(character)) {
+                case PLCharacterDoubleQuote:
+                case PLCharacterSingleQuote:
+                        if (index + 2 < length && characters[index + 1] == character && characters[index + 2] == character) {
+                                end = scanDocstring(characters, length, index + 3, character, &isOpen);
+                                [self addTokenWithRange:NSMakeRange(index, end - index) group:PLPythonTokenDocstring];
+                                docstringState = (character == '"') ? PLPythonLexerStateDoubleQuoteDocstring : PLPythonLexerStateSingleQuoteDocstring;
+                                while (line < count && lineEnds[line] <= index)
+                                        line++;
+                                while (line < count && (lineEnds[line] < end || (isOpen && lineEnds[line] <= end)))
+                                        states[line++] = docstringState;
+                        } else {
+                                end = scanString(characters, length, index, character);
+                                [self addTokenWithRange:NSMakeRange(index, end - index) group:PLPythonTokenString];
+                        }
+                        index = end;
+                        break;
+                case PLCharacterHash:
+                        end = scanLine(characters, length, index);
+                        [self addTokenWithRange:NSMakeRange(index, end - index) group:PLPythonTokenComment];
+                        index = end;
+                        break;
+                case PLCharacterDot:
+                        if (index + 1 < length && characterClass(characters[index + 1]) == PLCharacterDigit &&
+                            (index == 0 || isWordCharacter(characters[index - 1]) == NO)) {
+                                end = skipDigits(characters, length, index + 1);
+                                [self addTokenWithRange:NSMakeRange(index, end - index) group:PLPythonTokenNumber];
+                                index = end;
+                        } else {
+                                index++;
+                        }
+                        break;
+                case PLCharacterDigit:
+                        /* a number starts at a word boundary, otherwise the digit is part of a word */
+                        if (index > 0 && isWordCharacter(characters[index - 1])) {
+                                index = scanWord(characters, length, index);
+                        } else {
+                                end = scanNumber(characters, length, index);
+                                [self addTokenWithRange:NSMakeRange(index, end - index) group:PLPythonTokenNumber];
+                                index = end;
+                        }
+                        break;
+                case PLCharacterLetter:
+                        end = scanWord(characters, length, index);
+                        if ((index == 0 || isWordCharacter(characters[index - 1]) == NO) &&
+                            findWordGroup(characters + index, end - index, &group))
+                                [self addTokenWithRange:NSMakeRange(index, end - index) group:group];
+                        index = end;
+                        break;
+                default:
+                        index++;
+                        break;
+                }
+        }
+}
+
+#pragma mark - Private Methods
+
+/**
+ * \brief Append a token to the tokens array, growing it as needed.
+ */
+-(void)addTokenWithRange:(NSRange)range group:(PLPythonTokenGroup)group
+{
+        if (numberOfTokens == capacity) {
+                capacity = MAX(2 * capacity, (NSUInteger)256);
+                tokens = realloc(tokens, capacity * sizeof(PLPythonToken));
+        }
+        tokens[numberOfTokens].range = range;
+        tokens[numberOfTokens].group = group;
+        numberOfTokens++;
+}
+
+@end
@@ -0,0 +1,133 @@
+/**
+ * \file PLSemanticOverlay.h
+ * \brief Liasis Python IDE semantic overlay interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for an object
+ * keeping the semantic style runs of a text storage, such as the local and
+ * global variables found by an introspection plugin, which are applied over
+ * the lexical syntax coloring.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#import "PLStyleTable.h"
+
+/**
+ * \brief The theme groups of the semantic ranges returned by introspection
+ *        plugins.
+ */
+FOUNDATION_EXPORT NSString * const PLSemanticGroupLocalVariable;
+FOUNDATION_EXPORT NSString * const PLSemanticGroupGlobalVariable;
+FOUNDATION_EXPORT NSString * const PLSemanticGroupParameter;
+FOUNDATION_EXPORT NSString * const PLSemanticGroupUnresolvedName;
+
+@class PLTextStorage;
+
+/**
+ * \class PLSemanticOverlay \headerfile \headerfile
+ * \brief The semantic style runs of a text storage, applied over its lexical
+ *        syntax coloring.
+ *
+ * \details The runs are sorted and do not overlap. They are kept by the text
+ *          storage and follow its edits: runs after an edit are moved by the
+ *          change in length, and runs touching the replaced characters are
+ *          removed until the next semantic pass. Setting new runs returns the
+ *          lines whose runs changed, so that only these lines are colored
+ *          again rather than the whole text.
+ */
+@interface PLSemanticOverlay : NSObject {
+        /**
+         * \brief A C array of the runs, sorted by location.
+         */
+        PLStyleRun * runs;
+
+        /**
+         * \brief The number of runs.
+         */
+        NSUInteger numberOfRuns;
+
+        /**
+         * \brief The number of runs the runs array can hold.
+         */
+        NSUInteger capacity;
+}
+
+/**
+ * \brief The number of runs.
+ */
+@property (readonly) NSUInteger numberOfRuns;
+
+/**
+ * \brief The runs, sorted by location.
+ */
+@property (readonly) const PLStyleRun * runs;
+
+/**
+ * \brief Move the runs following a replacement of characters, and remove the
+ *        runs touching the replaced characters.
+ *
+ * \param range The range of characters replaced, before the replacement.
+ *
+ * \param length The length of the replacement string.
+ */
+-(void)replaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length;
+
+/**
+ * \brief Replace the runs, and return the lines whose runs changed.
+ *
+ * \details Runs overlapping a preceding run are clipped to the characters
+ *          past it. The runs are compared with the current runs, which follow
+ *          the edits of the text storage, so that lines only moved by an edit
+ *          are unchanged.
+ *
+ * \param newRuns A C array of runs, sorted in place.
+ *
+ * \param count The number of runs.
+ *
+ * \param textStorage The text storage of the overlay, whose line numbers are
+ *                    returned.
+ *
+ * \return The line numbers of the lines where a run was added, removed or
+ *         changed.
+ */
+-(NSIndexSet *)setRuns:(PLStyleRun *)newRuns count:(NSUInteger)count ofTextStorage:(PLTextStorage *)textStorage;
+
+/**
+ * \brief Apply the runs within a range of characters to a text storage.
+ *
+ * \details Runs whose style has no color in the theme are skipped, so that
+ *          they do not hide the lexical coloring. The runs are stored in the
+ *          style runs of a text storage whose style table is styleTable.
+ *
+ * \param range The range of characters to color, such as the range colored
+ *              by a syntax highlighting pass.
+ *
+ * \param textStorage The text storage to color.
+ *
+ * \param styleTable The style table of the styles of the runs.
+ */
+-(void)applyRunsInRange:(NSRange)range toTextStorage:(PLTextStorage *)textStorage styleTable:(PLStyleTable *)styleTable;
+
+@end
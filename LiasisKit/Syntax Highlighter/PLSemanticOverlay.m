@@ -0,0 +1,166 @@
+/**
+ * \file PLSemanticOverlay.m
+ * \brief Liasis Python IDE semantic overlay implementation file.
+ *
+ * \details
+ * This file contains the method implementation for an object keeping the
+ * semantic style runs of a text storage, such as the local and global variables
+ * found by an introspection plugin, which are applied over the lexical syntax
+ * coloring.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLSemanticOverlay.h"
+#import "PLTextStorage.h"
+
+NSString * const PLSemanticGroupLocalVariable = @"Local variable";
+NSString * const PLSemanticGroupGlobalVariable = @"Global variable";
+NSString * const PLSemanticGroupParameter = @"Parameter";
+NSString * const PLSemanticGroupUnresolvedName = @"Unresolved name";
+
+/**
+ * \brief Compare two style runs by location, for qsort().
+ */
+static int compareStyleRuns(const void * first, const void * second)
+{
+        NSUInteger firstLocation = ((const PLStyleRun *)first)->range.location;
+        NSUInteger secondLocation = ((const PLStyleRun *)second)->range.location;
+        return (firstLocation > secondLocation) - (firstLocation < secondLocation);
+}
+
+/**
+ * \brief Add the line numbers of a range of characters of a text storage to an
+ *        index set.
+ */
+static void addLinesOfRange(NSMutableIndexSet * lines, PLTextStorage * textStorage, NSRange range)
+{
+        NSUInteger first = [textStorage lineNumberForCharacterIndex:range.location];
+        NSUInteger last = [textStorage lineNumberForCharacterIndex:MAX(NSMaxRange(range), range.location + 1) - 1];
+        [lines addIndexesInRange:NSMakeRange(first, last - first + 1)];
+}
+
+@implementation PLSemanticOverlay
+
+-(id)init
+{
+        self = [super init];
+        if (self) {
+                runs = NULL;
+                numberOfRuns = 0;
+                capacity = 0;
+        }
+        return self;
+}
+
+-(void)dealloc
+{
+        free(runs);
+        [super dealloc];
+}
+
+@synthesize numberOfRuns;
+
+@synthesize runs;
+
+-(void)replaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length
+{
+        NSUInteger i, count = 0;
+        for (i = 0; i < numberOfRuns; i++) {
+                if (NSMaxRange(runs[i].range) < range.location) {
+                        runs[count++] = runs[i];
+                } else if (runs[i].range.location > NSMaxRange(range)) {
+                        runs[count] = runs[i];
+                        runs[count++].range.location = runs[i].range.location - range.length + length;
+                }
+        }
+        numberOfRuns = count;
+}
+
+-(NSIndexSet *)setRuns:(PLStyleRun *)newRuns count:(NSUInteger)count ofTextStorage:(PLTextStorage *)textStorage
+{
+        NSMutableIndexSet * lines = [NSMutableIndexSet indexSet];
+        NSUInteger i, j, numberOfNewRuns = 0, end = 0;
+        qsort(newRuns, count, sizeof(PLStyleRun), compareStyleRuns);
+
+        /* clip the runs overlapping a preceding run */
+        for (i = 0; i < count; i++) {
+                if (NSMaxRange(newRuns[i].range) <= end)
+                        continue;
+                if (newRuns[i].range.location < end) {
+                        newRuns[i].range.length = NSMaxRange(newRuns[i].range) - end;
+                        newRuns[i].range.location = end;
+                }
+                newRuns[numberOfNewRuns++] = newRuns[i];
+                end = NSMaxRange(newRuns[i].range);
+        }
+
+        /* both arrays are sorted, so equal runs are found side by side */
+        i = 0;
+        j = 0;
+        while (i < numberOfRuns || j < numberOfNewRuns) {
+                if (i < numberOfRuns && j < numberOfNewRuns && NSEqualRanges(runs[i].range, newRuns[j].range) && runs[i].style == newRuns[j].style) {
+                        i++;
+                        j++;
+                } else if (j == numberOfNewRuns || (i < numberOfRuns && runs[i].range.location <= newRuns[j].range.location)) {
+                        addLinesOfRange(lines, textStorage, runs[i++].range);
+                } else {
+                        addLinesOfRange(lines, textStorage, newRuns[j++].range);
+                }
+        }
+
+        if (numberOfNewRuns > capacity) {
+                capacity = MAX(numberOfNewRuns, 2 * capacity);
+                runs = realloc(runs, capacity * sizeof(PLStyleRun));
+        }
+        memcpy(runs, newRuns, numberOfNewRuns * sizeof(PLStyleRun));
+        numberOfRuns = numberOfNewRuns;
+        return lines;
+}
+
+-(void)applyRunsInRange:(NSRange)range toTextStorage:(PLTextStorage *)textStorage styleTable:(PLStyleTable *)styleTable
+{
+        NSUInteger low = 0, high = numberOfRuns, middle, i, start, end;
+
+        /* find the first run ending past the start of the range */
+        while (low < high) {
+                middle = low + (high - low) / 2;
+                if (NSMaxRange(runs[middle].range) <= range.location)
+                        low = middle + 1;
+                else
+                        high = middle;
+        }
+        for (i = low; i < numberOfRuns && runs[i].range.location < NSMaxRange(range); i++) {
+                start = MAX(runs[i].range.location, range.location);
+                end = MIN(NSMaxRange(runs[i].range), NSMaxRange(range));
+                if (end <= start || [styleTable hasColorForStyle:runs[i].style] == NO)
+                        continue;
+                if ([textStorage styleTable] == styleTable)
+                        [textStorage setStyle:runs[i].style range:NSMakeRange(start, end - start)];
+                else
+                        [textStorage addAttributesWithoutEditing:[styleTable attributesOfStyle:runs[i].style]
+                                                           range:NSMakeRange(start, end - start)];
+        }
+}
+
+@end
@@ -0,0 +1,205 @@
+/**
+ * \file PLSourceBuffer.h
+ * \brief Liasis Python IDE source buffer interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for an object
+ * holding the UTF-8 bytes of a range of a string for the syntax coloring
+ * scripts, and mapping byte and code point offsets back to the characters of
+ * the string.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ * \class PLSourceBuffer \headerfile \headerfile
+ * \brief Hold the UTF-8 bytes of a range of a string, and map offsets between
+ *        the bytes and the UTF-16 characters of the string.
+ *
+ * \details The syntax coloring scripts match the UTF-8 bytes of the source,
+ *          while the ranges of a text storage count UTF-16 code units. A
+ *          source buffer encodes a range of the string once, into memory
+ *          reused by the next range, along with a table of the character
+ *          offset of each byte, so that the ranges returned by a script are
+ *          mapped to the text exactly and in constant time.
+ *
+ *          When the range is ASCII the offsets are the same and no table is
+ *          built. If the string stores its characters as ASCII, the bytes are
+ *          read in place without being copied. Other strings, such as a
+ *          PLRopeString or a snapshot of one, are read in blocks of
+ *          characters, so that their chunks are copied in turn through a
+ *          small buffer and runs of ASCII characters are narrowed directly.
+ *
+ *          Scripts decoding the bytes count code points instead, which differ
+ *          from the characters only after a surrogate pair. The offsets of
+ *          the surrogate pairs are kept to map code point offsets as well.
+ */
+@interface PLSourceBuffer : NSObject {
+        /**
+         * \brief The string of the bytes, retained while they are read in
+         *        place.
+         */
+        NSString * string;
+
+        /**
+         * \brief The UTF-8 bytes of the range.
+         */
+        const char * bytes;
+
+        /**
+         * \brief The number of bytes.
+         */
+        NSUInteger length;
+
+        /**
+         * \brief The number of characters of the range.
+         */
+        NSUInteger numberOfCharacters;
+
+        /**
+         * \brief Whether the range is ASCII, so that byte offsets are
+         *        character offsets.
+         */
+        BOOL isASCII;
+
+        /**
+         * \brief A C array with the encoded bytes, unless they are read in
+         *        place.
+         */
+        char * encodedBytes;
+
+        /**
+         * \brief A C array with the block of characters being encoded.
+         */
+        unichar * characters;
+
+        /**
+         * \brief A C array with the character offset of each byte and of the
+         *        end of the bytes, built unless the range is ASCII.
+         */
+        NSUInteger * characterOffsets;
+
+        /**
+         * \brief The number of bytes the encodedBytes and characterOffsets
+         *        arrays can hold, not counting the end offset.
+         */
+        NSUInteger capacity;
+
+        /**
+         * \brief The number of offsets the surrogatePairOffsets array can
+         *        hold.
+         */
+        NSUInteger surrogatePairsCapacity;
+
+        /**
+         * \brief A C array with the character offset of each surrogate pair,
+         *        in increasing order.
+         */
+        NSUInteger * surrogatePairOffsets;
+
+        /**
+         * \brief The number of surrogate pairs of the range.
+         */
+        NSUInteger numberOfSurrogatePairs;
+}
+
+/**
+ * \brief The UTF-8 bytes of the range, valid until the next range is set. The
+ *        bytes are not null terminated.
+ */
+@property (readonly) const char * bytes;
+
+/**
+ * \brief The number of bytes.
+ */
+@property (readonly) NSUInteger length;
+
+/**
+ * \brief Whether the range is ASCII, so that byte offsets are character
+ *        offsets.
+ */
+@property (readonly) BOOL isASCII;
+
+/**
+ * \brief Encode a range of a string.
+ *
+ * \details Unpaired surrogates are encoded as the replacement character.
+ *
+ * \param aString The string to encode.
+ *
+ * \param range The range of characters to encode, starting at a character
+ *              and ending after one.
+ */
+-(void)setString:(NSString *)aString range:(NSRange)range;
+
+/**
+ * \brief Return the offset of the character of a byte, relative to the start
+ *        of the range.
+ *
+ * \param byteOffset The offset of the byte, up to the number of bytes.
+ */
+-(NSUInteger)characterOffsetOfByteOffset:(NSUInteger)byteOffset;
+
+/**
+ * \brief Return the range of characters of a range of bytes, relative to the
+ *        start of the range. The range of bytes is clipped to the bytes.
+ */
+-(NSRange)characterRangeOfByteRange:(NSRange)byteRange;
+
+/**
+ * \brief Return the offset of the first byte of a character, relative to the
+ *        start of the range.
+ *
+ * \param characterOffset The offset of the character, up to the number of
+ *                        characters.
+ */
+-(NSUInteger)byteOffsetOfCharacterOffset:(NSUInteger)characterOffset;
+
+/**
+ * \brief Return the offset of the character of a code point of the decoded
+ *        bytes, relative to the start of the range.
+ *
+ * \param codePointOffset The offset of the code point, up to the number of
+ *                        code points.
+ */
+-(NSUInteger)characterOffsetOfCodePointOffset:(NSUInteger)codePointOffset;
+
+/**
+ * \brief Return the range of characters of a range of code points of the
+ *        decoded bytes, relative to the start of the range. The range of code
+ *        points is clipped to the characters.
+ */
+-(NSRange)characterRangeOfCodePointRange:(NSRange)codePointRange;
+
+/**
+ * \brief Return the offset of the code point of a character in the decoded
+ *        bytes, relative to the start of the range.
+ *
+ * \param characterOffset The offset of the character, up to the number of
+ *                        characters.
+ */
+-(NSUInteger)codePointOffsetOfCharacterOffset:(NSUInteger)characterOffset;
+
+@end
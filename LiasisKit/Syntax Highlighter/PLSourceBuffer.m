@@ -0,0 +1,244 @@
+/**
+ * \file PLSourceBuffer.m
+ * \brief Liasis Python IDE source buffer implementation file.
+ *
+ * \details
+ * This file contains the method implementation for an object
+ * holding the UTF-8 bytes of a range of a string for the syntax coloring
+ * scripts, and mapping byte and code point offsets back to the characters of
+ * the string.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLSourceBuffer.h"
+
+/**
+ * \brief The number of characters read at once from a string whose bytes are
+ *        not stored as ASCII.
+ */
+#define PL_SOURCE_BUFFER_BLOCK_LENGTH 4096
+
+@implementation PLSourceBuffer
+
+-(id)init
+{
+        self = [super init];
+        if (self) {
+                string = nil;
+                bytes = "";
+                length = 0;
+                numberOfCharacters = 0;
+                isASCII = YES;
+                encodedBytes = NULL;
+                characters = NULL;
+                characterOffsets = NULL;
+                capacity = 0;
+                surrogatePairOffsets = NULL;
+                surrogatePairsCapacity = 0;
+                numberOfSurrogatePairs = 0;
+        }
+        return self;
+}
+
+-(void)dealloc
+{
+        [string release];
+        free(encodedBytes);
+        free(characters);
+        free(characterOffsets);
+        free(surrogatePairOffsets);
+        [super dealloc];
+}
+
+@synthesize bytes;
+
+@synthesize length;
+
+@synthesize isASCII;
+
+-(void)setString:(NSString *)aString range:(NSRange)range
+{
+        const char * asciiBytes;
+        NSUInteger block, blockLength, i, j, offset, byte = 0;
+        unichar character;
+        uint32_t codePoint;
+        [string release];
+        string = nil;
+        numberOfCharacters = range.length;
+        numberOfSurrogatePairs = 0;
+        isASCII = YES;
+
+        /* read the bytes in place if the string stores them as ASCII */
+        asciiBytes = CFStringGetCStringPtr((CFStringRef)aString, kCFStringEncodingASCII);
+        if (asciiBytes) {
+                string = [aString retain];
+                bytes = asciiBytes + range.location;
+                length = range.length;
+                goto exit;
+        }
+
+        /* a character takes at most 3 bytes, as a surrogate pair takes 4 */
+        if (3 * range.length > capacity) {
+                capacity = 3 * range.length;
+                encodedBytes = realloc(encodedBytes, capacity);
+                characterOffsets = realloc(characterOffsets, (capacity + 1) * sizeof(NSUInteger));
+        }
+        if (range.length / 2 + 1 > surrogatePairsCapacity) {
+                surrogatePairsCapacity = range.length / 2 + 1;
+                surrogatePairOffsets = realloc(surrogatePairOffsets, surrogatePairsCapacity * sizeof(NSUInteger));
+        }
+        if (characters == NULL)
+                characters = malloc(PL_SOURCE_BUFFER_BLOCK_LENGTH * sizeof(unichar));
+        for (block = 0; block < range.length; block += blockLength) {
+                blockLength = MIN(PL_SOURCE_BUFFER_BLOCK_LENGTH, range.length - block);
+                [aString getCharacters:characters range:NSMakeRange(range.location + block, blockLength)];
+                /* keep a surrogate pair within a block */
+                if (blockLength > 1 && block + blockLength < range.length
+                    && CFStringIsSurrogateHighCharacter(characters[blockLength - 1]))
+                        blockLength--;
+                i = 0;
+                /* narrow the leading ASCII characters, with no offsets to record */
+                if (isASCII) {
+                        while (i < blockLength && characters[i] < 0x80)
+                                encodedBytes[byte++] = (char)characters[i++];
+                        if (i == blockLength)
+                                continue;
+                        /* the preceding bytes are ASCII, at their character offsets */
+                        isASCII = NO;
+                        for (j = 0; j < byte; j++)
+                                characterOffsets[j] = j;
+                }
+                for (; i < blockLength; i++) {
+                        character = characters[i];
+                        offset = block + i;
+                        if (character < 0x80) {
+                                characterOffsets[byte] = offset;
+                                encodedBytes[byte++] = (char)character;
+                                continue;
+                        }
+                        if (character < 0x800) {
+                                characterOffsets[byte] = characterOffsets[byte + 1] = offset;
+                                encodedBytes[byte++] = (char)(0xC0 | (character >> 6));
+                                encodedBytes[byte++] = (char)(0x80 | (character & 0x3F));
+                                continue;
+                        }
+                        if (CFStringIsSurrogateHighCharacter(character) && i + 1 < blockLength
+                            && CFStringIsSurrogateLowCharacter(characters[i + 1])) {
+                                codePoint = CFStringGetLongCharacterForSurrogatePair(character, characters[i + 1]);
+                                surrogatePairOffsets[numberOfSurrogatePairs++] = offset;
+                                characterOffsets[byte] = characterOffsets[byte + 1] = offset;
+                                characterOffsets[byte + 2] = characterOffsets[byte + 3] = offset;
+                                encodedBytes[byte++] = (char)(0xF0 | (codePoint >> 18));
+                                encodedBytes[byte++] = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+                                encodedBytes[byte++] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+                                encodedBytes[byte++] = (char)(0x80 | (codePoint & 0x3F));
+                                i++;
+                                continue;
+                        }
+                        if (CFStringIsSurrogateHighCharacter(character) || CFStringIsSurrogateLowCharacter(character))
+                                character = 0xFFFD;
+                        characterOffsets[byte] = characterOffsets[byte + 1] = characterOffsets[byte + 2] = offset;
+                        encodedBytes[byte++] = (char)(0xE0 | (character >> 12));
+                        encodedBytes[byte++] = (char)(0x80 | ((character >> 6) & 0x3F));
+                        encodedBytes[byte++] = (char)(0x80 | (character & 0x3F));
+                }
+        }
+        if (isASCII == NO)
+                characterOffsets[byte] = range.length;
+        bytes = (encodedBytes) ? encodedBytes : "";
+        length = byte;
+
+exit:
+        return;
+}
+
+-(NSUInteger)characterOffsetOfByteOffset:(NSUInteger)byteOffset
+{
+        byteOffset = MIN(byteOffset, length);
+        return (isASCII) ? byteOffset : characterOffsets[byteOffset];
+}
+
+-(NSRange)characterRangeOfByteRange:(NSRange)byteRange
+{
+        NSUInteger start = [self characterOffsetOfByteOffset:byteRange.location];
+        NSUInteger end = [self characterOffsetOfByteOffset:NSMaxRange(byteRange)];
+        return NSMakeRange(start, end - start);
+}
+
+-(NSUInteger)byteOffsetOfCharacterOffset:(NSUInteger)characterOffset
+{
+        NSUInteger low = 0, high = length, middle;
+        if (isASCII)
+                return MIN(characterOffset, length);
+
+        /* the first byte whose character is at or past the offset */
+        while (low < high) {
+                middle = low + (high - low) / 2;
+                if (characterOffsets[middle] < characterOffset)
+                        low = middle + 1;
+                else
+                        high = middle;
+        }
+        return low;
+}
+
+-(NSUInteger)characterOffsetOfCodePointOffset:(NSUInteger)codePointOffset
+{
+        NSUInteger low = 0, high = numberOfSurrogatePairs, middle;
+
+        /* the number of surrogate pairs before the code point, the code point of a pair being its offset less the pairs before it */
+        while (low < high) {
+                middle = low + (high - low) / 2;
+                if (surrogatePairOffsets[middle] - middle < codePointOffset)
+                        low = middle + 1;
+                else
+                        high = middle;
+        }
+        return MIN(codePointOffset + low, numberOfCharacters);
+}
+
+-(NSRange)characterRangeOfCodePointRange:(NSRange)codePointRange
+{
+        NSUInteger start = [self characterOffsetOfCodePointOffset:codePointRange.location];
+        NSUInteger end = [self characterOffsetOfCodePointOffset:NSMaxRange(codePointRange)];
+        return NSMakeRange(start, end - start);
+}
+
+-(NSUInteger)codePointOffsetOfCharacterOffset:(NSUInteger)characterOffset
+{
+        NSUInteger low = 0, high = numberOfSurrogatePairs, middle;
+        characterOffset = MIN(characterOffset, numberOfCharacters);
+
+        /* the number of surrogate pairs starting before the character */
+        while (low < high) {
+                middle = low + (high - low) / 2;
+                if (surrogatePairOffsets[middle] < characterOffset)
+                        low = middle + 1;
+                else
+                        high = middle;
+        }
+        return characterOffset - low;
+}
+
+@end
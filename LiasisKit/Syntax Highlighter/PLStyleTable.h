@@ -0,0 +1,139 @@
+/**
+ * \file PLStyleTable.h
+ * \brief Liasis Python IDE style table interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for an object
+ * resolving the theme colors of the syntax coloring groups once into a table of
+ * small integer styles, and applying sorted runs of styles to a text storage.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#import "PLThemeManager.h"
+#import "PLStyleRunArray.h"
+
+@class PLTextStorage;
+
+/**
+ * \class PLStyleTable \headerfile \headerfile
+ * \brief Resolve the theme colors of syntax coloring groups once into a table
+ *        of styles, and apply runs of styles to a text storage.
+ *
+ * \details Each group (e.g. String or Keyword) is given a small integer style
+ *          the first time it is seen, and the attributes of the style are built
+ *          once from the theme manager, instead of parsing the hexadecimal
+ *          color of the theme for every colored range. The attributes are
+ *          rebuilt when a PLThemeManagerDidChange notification is posted.
+ *
+ *          Style PLStyleDefault is the foreground color of the theme settings.
+ *          The following styles are the groups of the PLPythonTokenizer, in
+ *          the order of PLPythonTokenGroup, so that the style of a token group
+ *          is the group plus one. A group without a color in the theme has the
+ *          attributes of the default style.
+ */
+@interface PLStyleTable : NSObject {
+        /**
+         * \brief The theme manager providing the colors of the groups.
+         */
+        PLThemeManager * themeManager;
+
+        /**
+         * \brief The name of the group of each style.
+         */
+        NSMutableArray * groups;
+
+        /**
+         * \brief The NSNumber of the style of each group name.
+         */
+        NSMutableDictionary * styles;
+
+        /**
+         * \brief The attributes dictionary of each style.
+         */
+        NSMutableArray * attributes;
+}
+
+/**
+ * \brief Initialize a style table with the groups of the PLPythonTokenizer.
+ *
+ * \param aThemeManager The theme manager providing the colors of the groups.
+ */
+-(id)initWithThemeManager:(PLThemeManager *)aThemeManager;
+
+/**
+ * \brief The number of styles in the table.
+ */
+@property (readonly) NSUInteger numberOfStyles;
+
+/**
+ * \brief Return the style of a group, adding it to the table if needed.
+ *
+ * \param group The name of the group, as in the theme property lists.
+ */
+-(PLStyle)styleOfGroup:(NSString *)group;
+
+/**
+ * \brief Return the attributes applied to the characters of a style.
+ *
+ * \param style A style of the table.
+ */
+-(NSDictionary *)attributesOfStyle:(PLStyle)style;
+
+/**
+ * \brief Return whether the theme has a color for the group of a style, other
+ *        than the default style.
+ *
+ * \param style A style of the table.
+ */
+-(BOOL)hasColorForStyle:(PLStyle)style;
+
+/**
+ * \brief Rebuild the attributes of every style from the theme manager.
+ */
+-(void)reloadAttributes;
+
+/**
+ * \brief Apply runs of styles to a range of characters of a text storage.
+ *
+ * \details The runs are sorted by location, and the characters of the range
+ *          not covered by a run get the default style. The range is then
+ *          colored in a single sweep, with one attribute change for each
+ *          sequence of adjacent runs having the same attributes. A run
+ *          overlapping a preceding run only colors the characters past it.
+ *
+ *          A PLTextStorage is not given attributes: it adopts the table as its
+ *          style table, and the runs are stored in its style runs.
+ *
+ * \param runs A C array of runs, sorted in place.
+ *
+ * \param count The number of runs.
+ *
+ * \param range The range of characters to color. Runs are clipped to it.
+ *
+ * \param textStorage The text storage to color.
+ */
+-(void)applyRuns:(PLStyleRun *)runs count:(NSUInteger)count inRange:(NSRange)range toTextStorage:(PLTextStorage *)textStorage;
+
+@end
@@ -0,0 +1,202 @@
+/**
+ * \file PLStyleTable.m
+ * \brief Liasis Python IDE style table implementation file.
+ *
+ * \details
+ * This file contains the method implementation for an object
+ * resolving the theme colors of the syntax coloring groups once into a table of
+ * small integer styles, and applying sorted runs of styles to a text storage.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLStyleTable.h"
+#import "PLTextStorage.h"
+#import "PLPythonTokenizer.h"
+
+/**
+ * \brief Compare two style runs by location, for qsort().
+ */
+static int compareStyleRuns(const void * first, const void * second)
+{
+        NSUInteger firstLocation = ((const PLStyleRun *)first)->range.location;
+        NSUInteger secondLocation = ((const PLStyleRun *)second)->range.location;
+        return (firstLocation > secondLocation) - (firstLocation < secondLocation);
+}
+
+/**
+ * \brief Add attributes to the characters of a text storage from a start index
+ *        to an end index, if the attributes are not nil and the range is not
+ *        empty.
+ */
+static void addAttributes(PLTextStorage * textStorage, NSDictionary * attributes, NSUInteger start, NSUInteger end)
+{
+        if (attributes && end > start)
+                [textStorage addAttributesWithoutEditing:attributes range:NSMakeRange(start, end - start)];
+}
+
+@implementation PLStyleTable
+
+-(id)initWithThemeManager:(PLThemeManager *)aThemeManager
+{
+        NSUInteger group;
+        self = [super init];
+        if (self) {
+                themeManager = [aThemeManager retain];
+                groups = [[NSMutableArray alloc] init];
+                styles = [[NSMutableDictionary alloc] init];
+                attributes = [[NSMutableArray alloc] init];
+                [self styleOfGroup:PLThemeManagerSettings];
+                for (group = 0; group < PLPythonTokenGroupCount; group++)
+                        [self styleOfGroup:[PLPythonTokenizer nameOfGroup:(PLPythonTokenGroup)group]];
+                [[NSNotificationCenter defaultCenter] addObserver:self
+                                                         selector:@selector(themeManagerDidChange:)
+                                                             name:PLThemeManagerDidChange
+                                                           object:nil];
+        }
+        return self;
+}
+
+-(id)init
+{
+        return [self initWithThemeManager:[PLThemeManager defaultThemeManager]];
+}
+
+-(void)dealloc
+{
+        [[NSNotificationCenter defaultCenter] removeObserver:self];
+        [themeManager release];
+        [groups release];
+        [styles release];
+        [attributes release];
+        [super dealloc];
+}
+
+-(NSUInteger)numberOfStyles
+{
+        return [groups count];
+}
+
+-(PLStyle)styleOfGroup:(NSString *)group
+{
+        NSNumber * style = [styles objectForKey:group];
+        if (style == nil) {
+                style = [NSNumber numberWithUnsignedShort:(PLStyle)[groups count]];
+                [styles setObject:style forKey:group];
+                [groups addObject:group];
+                [attributes addObject:[self attributesOfGroup:group]];
+        }
+        return [style unsignedShortValue];
+}
+
+-(NSDictionary *)attributesOfStyle:(PLStyle)style
+{
+        return [attributes objectAtIndex:style];
+}
+
+-(BOOL)hasColorForStyle:(PLStyle)style
+{
+        return style != PLStyleDefault && [attributes objectAtIndex:style] != [attributes objectAtIndex:PLStyleDefault];
+}
+
+-(void)reloadAttributes
+{
+        NSUInteger style;
+        for (style = 0; style < [groups count]; style++)
+                [attributes replaceObjectAtIndex:style withObject:[self attributesOfGroup:[groups objectAtIndex:style]]];
+}
+
+-(void)applyRuns:(PLStyleRun *)runs count:(NSUInteger)count inRange:(NSRange)range toTextStorage:(PLTextStorage *)textStorage
+{
+        NSDictionary * defaultAttributes = [attributes objectAtIndex:PLStyleDefault];
+        NSDictionary * currentAttributes = nil, * runAttributes = nil;
+        NSUInteger i, start, end, position = range.location, currentStart = range.location;
+        qsort(runs, count, sizeof(PLStyleRun), compareStyleRuns);
+
+        /* a PLTextStorage keeps the styles themselves rather than attributes */
+        if ([textStorage isKindOfClass:[PLTextStorage class]]) {
+                if ([textStorage styleTable] != self)
+                        [textStorage setStyleTable:self];
+                [textStorage setStyleRuns:runs count:count inRange:range];
+                goto exit;
+        }
+
+        for (i = 0; i <= count; i++) {
+                if (i < count) {
+                        start = MAX(runs[i].range.location, position);
+                        end = MIN(NSMaxRange(runs[i].range), NSMaxRange(range));
+                        if (end <= start)
+                                continue;
+                        runAttributes = [attributes objectAtIndex:runs[i].style];
+                } else {
+                        start = end = NSMaxRange(range);
+                }
+
+                /* the characters preceding the run have the default style */
+                if (start > position) {
+                        if (currentAttributes != defaultAttributes) {
+                                addAttributes(textStorage, currentAttributes, currentStart, position);
+                                currentAttributes = defaultAttributes;
+                                currentStart = position;
+                        }
+                        position = start;
+                }
+                if (i == count)
+                        break;
+                if (runAttributes != currentAttributes) {
+                        addAttributes(textStorage, currentAttributes, currentStart, start);
+                        currentAttributes = runAttributes;
+                        currentStart = start;
+                }
+                position = end;
+        }
+        addAttributes(textStorage, currentAttributes, currentStart, position);
+exit:
+        return;
+}
+
+#pragma mark - Private Methods
+
+/**
+ * \brief Return the attributes of a group from the theme manager, or those of
+ *        the default style if the theme has no color for the group.
+ */
+-(NSDictionary *)attributesOfGroup:(NSString *)group
+{
+        NSColor * color = [themeManager getThemeProperty:PLThemeManagerForeground fromGroup:group];
+        if (color)
+                return @{NSForegroundColorAttributeName: color};
+        if ([attributes count] > 0 && ![group isEqualToString:PLThemeManagerSettings])
+                return [attributes objectAtIndex:PLStyleDefault];
+        return @{};
+}
+
+/**
+ * \brief Rebuild the attributes of the styles when the theme changes.
+ */
+-(void)themeManagerDidChange:(NSNotification *)notification
+{
+        [self reloadAttributes];
+}
+
+@end
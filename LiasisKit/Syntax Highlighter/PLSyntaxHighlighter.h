@@ -30,10 +30,55 @@
 #import <Foundation/Foundation.h>
 #import <Python/Python.h>
 #import "PLTextStorage.h"
+#import "PLPythonTokenizer.h"
+#import "PLSourceBuffer.h"
+#import "PLStyleTable.h"
+#import "PLTokenCache.h"
+#import "PLSemanticOverlay.h"
+#import "PLAddOnPlugin.h"
+#import "PLSyntaxHighlightingPass.h"
+#import "PLSyntaxHighlightingMetrics.h"
 #import "PLThemeManager.h"
 #import "NSDictionary+pythonDict.h"
 #import "NSArray+pythonList.h"
 
+/**
+ * \brief The notification posted on the main thread when the syntax
+ *        highlighter applied a pass colored in the background.
+ *
+ * \details The object of the notification is the PLTextStorage colored. If an
+ *          error disabled coloring, the user info dictionary contains the error
+ *          for the PLSyntaxHighlighterErrorKey.
+ */
+FOUNDATION_EXPORT NSString * PLSyntaxHighlighterDidColorNotification;
+FOUNDATION_EXPORT NSString * PLSyntaxHighlighterErrorKey;
+
+/**
+ * \brief The notification posted when the syntax highlighter applied a pass to
+ *        a text storage, with the metrics of the pass.
+ *
+ * \details The object of the notification is the PLTextStorage colored, and
+ *          the user info dictionary contains the PLSyntaxHighlightingMetrics of
+ *          the pass for the PLSyntaxHighlighterMetricsKey. It is posted on the
+ *          thread applying the pass, the main thread for passes colored in the
+ *          background or progressively.
+ */
+FOUNDATION_EXPORT NSString * PLSyntaxHighlighterDidMeasurePassNotification;
+FOUNDATION_EXPORT NSString * PLSyntaxHighlighterMetricsKey;
+
+/**
+ * \brief The engines finding the ranges to color.
+ *
+ * \details PLSyntaxHighlighterEngineScript calls the active Python script, and
+ *          PLSyntaxHighlighterEngineNativeTokenizer uses the built-in
+ *          PLPythonTokenizer, which colors the same groups as the python.py
+ *          script without calling into the Python interpreter.
+ */
+typedef enum {
+        PLSyntaxHighlighterEngineScript = 0,
+        PLSyntaxHighlighterEngineNativeTokenizer
+} PLSyntaxHighlighterEngine;
+
 /**
  * \class PLSyntaxHighlighter \headerfile \headerfile
  * \brief Provide syntax coloring for the Liasis Text Editor view
@@ -43,6 +88,15 @@
  *          It parses for all properties in a Python document (i.e. builtin
  *          keywords, strings, and numbers). These tokens are then colored
  *          as defined by its PLThemeManager.
+ *
+ *          The syntax highlighter never releases the GIL of the host on its
+ *          own, so a host calling the Python C API on the thread that
+ *          initialized Python keeps working without PyGILState_Ensure().
+ *          Scripts then color on that thread. A host that wants them to color
+ *          in the background calls releaseGILOfCallingThread once, on that
+ *          thread, and from then on takes the GIL through PyGILState_Ensure()
+ *          and PyGILState_Release() for every call into Python, as the
+ *          NSArray (pythonList) and NSDictionary (pythonDict) categories do.
  */
 @interface PLSyntaxHighlighter : NSObject {        
         /**
@@ -60,31 +114,239 @@
          *          after successfully loading a new Python module.
          */
         BOOL isColoringEnabled;
+
+        /**
+         * \brief The tokenizer of the native Python engine.
+         */
+        PLPythonTokenizer * pythonTokenizer;
+
+        /**
+         * \brief The serial queue on which the passes of the focused text
+         *        storage are colored in the background, at a high priority.
+         */
+        dispatch_queue_t coloringQueue;
+
+        /**
+         * \brief A C array of the serial queues on which the passes of the
+         *        other text storages are colored, at a low priority.
+         */
+        dispatch_queue_t * backgroundQueues;
+
+        /**
+         * \brief The number of background queues, one less than the number
+         *        of processors, and at least one.
+         */
+        NSUInteger numberOfBackgroundQueues;
+
+        /**
+         * \brief The index of the background queue of the next pass.
+         */
+        NSUInteger nextBackgroundQueue;
+
+        /**
+         * \brief The serial queue on which introspection plugins find the
+         *        semantic ranges of text storages, at a low priority.
+         */
+        dispatch_queue_t semanticQueue;
+
+        /**
+         * \brief The text storage of the document the user is editing.
+         */
+        PLTextStorage * focusedTextStorage;
+
+        /**
+         * \brief The text storage objects with a pass on the coloring queue.
+         */
+        NSMutableArray * coloringTextStorages;
+
+        /**
+         * \brief The pass on the coloring queue of each text storage in
+         *        coloringTextStorages, at the same index.
+         */
+        NSMutableArray * coloringPasses;
+
+        /**
+         * \brief The text storage objects asked to be colored while their pass
+         *        was on the coloring queue.
+         */
+        NSMutableArray * pendingTextStorages;
+
+        /**
+         * \brief The text storage objects colored progressively in idle time.
+         */
+        NSMutableArray * progressiveTextStorages;
+
+        /**
+         * \brief The styles of the groups colored, resolved once from the
+         *        theme manager.
+         */
+        PLStyleTable * styleTable;
+
+        /**
+         * \brief The colored ranges of the lines colored before.
+         */
+        PLTokenCache * tokenCache;
+
+        /**
+         * \brief The metrics of the last pass applied.
+         */
+        PLSyntaxHighlightingMetrics * lastMetrics;
+
+        /**
+         * \brief The metrics of the last passes applied, oldest first.
+         */
+        NSMutableArray * metricsLog;
+
+        /**
+         * \brief The maximum number of metrics in the metrics log.
+         */
+        NSUInteger metricsLogCapacity;
+
+        /**
+         * \brief The number of background passes cancelled by a newer edit.
+         */
+        NSUInteger numberOfCancelledPasses;
 }
 
 @property (retain, readonly) NSString * activePythonScript;
 
+/**
+ * \brief The engine finding the ranges to color.
+ *
+ * \details The engine is PLSyntaxHighlighterEngineScript by default, and after
+ *          successfully setting a Python script with
+ *          setActivePythonScript:error:. Setting the engine enables coloring.
+ */
+@property (nonatomic) PLSyntaxHighlighterEngine activeEngine;
+
+/**
+ * \brief The cache of the colored lines of the text storage objects colored
+ *        incrementally.
+ *
+ * \details Lines colored before with the same lexer state at their start,
+ *          such as after an undo, a revert from disk, or reopening a file, are
+ *          colored from the cache rather than by the engine. Set its capacity
+ *          to bound its memory, or to zero to disable it, and use its hit and
+ *          miss counters to size it.
+ */
+@property (readonly) PLTokenCache * tokenCache;
+
+/**
+ * \brief The text storage of the document the user is editing, whose passes
+ *        are colored before those of the other documents.
+ *
+ * \details Passes of the focused text storage are colored on a high priority
+ *          queue, and passes of the other text storages, such as the documents
+ *          restored with a session, are spread over low priority queues on the
+ *          remaining processors. Set it when a document becomes the key
+ *          document; it is retained until it is replaced. A pass already
+ *          dispatched keeps its queue.
+ */
+@property (nonatomic, retain) PLTextStorage * focusedTextStorage;
+
+/**
+ * \brief The metrics of the last pass applied to a text storage, or nil.
+ *
+ * \details Passes are applied by colorTextStorage:error: for text storage
+ *          objects keeping lexer states, by colorTextStorageInBackground:, and
+ *          by the chunks of colorTextStorage:visibleRange:error:. The metrics
+ *          record the engine, the number of bytes sent to the Python script,
+ *          the time spent in the engine, converting its results and applying
+ *          the attributes, and the number of colored ranges, so that the files
+ *          slow to color can be found and their passes compared with a
+ *          latency budget.
+ */
+@property (readonly) PLSyntaxHighlightingMetrics * lastMetrics;
+
+/**
+ * \brief The maximum number of metrics kept in the metrics log.
+ *
+ * \details The log is disabled with the default capacity of zero. Lowering the
+ *          capacity discards the oldest metrics past it.
+ */
+@property (nonatomic) NSUInteger metricsLogCapacity;
+
+/**
+ * \brief Return the metrics of the last passes applied, oldest first, at most
+ *        metricsLogCapacity of them.
+ */
+-(NSArray *)metricsLog;
+
+/**
+ * \brief The number of background passes cancelled by a newer edit of their
+ *        text storage and dropped, since the syntax highlighter was
+ *        initialized.
+ */
+@property (readonly) NSUInteger numberOfCancelledPasses;
+
 /**
  * \brief Initialize the syntax highlighter.
  *
  * \details Add the path to this class bundle to the internal Python interpreter
  *          path in order to import Python scripts for syntax coloring. Return
  *          nil if there was an error interfacing with Python.
+ *
+ *          Scripts are called with the GIL held through PyGILState_Ensure().
+ *          Python threads are initialized if needed, and the thread state of
+ *          the host is left alone: while the calling thread keeps the GIL,
+ *          passes of scripts and introspection plugins are run on it rather
+ *          than in the background. Call releaseGILOfCallingThread to let them
+ *          run in the background.
  */
 -(id)init;
 
+/**
+ * \brief Release the GIL kept by the calling thread, so that scripts and
+ *        introspection plugins color in the background.
+ *
+ * \details The host opts into background coloring by calling this method once,
+ *          on the thread that initialized Python, such as the main thread after
+ *          Py_Initialize(). The thread state is kept until
+ *          restoreInitialThreadState. From then on every caller into Python,
+ *          on any thread, including the host, the plugins and the NSArray
+ *          (pythonList) and NSDictionary (pythonDict) categories, must hold
+ *          the GIL through PyGILState_Ensure() and PyGILState_Release(). It
+ *          does nothing if the calling thread does not keep the GIL, or if the
+ *          GIL was already released.
+ */
++(void)releaseGILOfCallingThread;
+
+/**
+ * \brief Give the GIL back to the thread state released by
+ *        releaseGILOfCallingThread, such as before finalizing Python.
+ *
+ * \details The calling thread must be the thread of that thread state, and
+ *          must not hold the GIL. It does nothing if no thread state was
+ *          released.
+ */
++(void)restoreInitialThreadState;
+
 /**
  * \brief Apply syntax coloring to a text storage object.
  *
- * \details First replace all text with the default font color. Then apply
- *          syntax coloring to the groups returned from the Python script
- *          responsible for parsing the text.
+ * \details Apply syntax coloring to the groups returned from the Python script
+ *          responsible for parsing the text, or found by the PLPythonTokenizer
+ *          when the active engine is PLSyntaxHighlighterEngineNativeTokenizer.
+ *          The ranges are applied as runs of the styles of a PLStyleTable,
+ *          sorted and coalesced, with the default style between runs.
  *
- *          All syntax coloring is done using the
- *          addAttributeWithoutEditing: method of the PLTextStorage object. The
- *          NSTextView calling this method is then responsible for redrawing
- *          its view (at least the visible rect) for the syntax coloring to be
- *          drawn.
+ *          When the text storage is a PLTextStorage and the engine is native
+ *          or the script implements get_line_coloring(), only the lines edited since the last pass are
+ *          colored. Coloring resumes at the first edited line with the lexer
+ *          state stored at the end of the previous line, and stops at the
+ *          first line past the edited lines whose lexer state is unchanged.
+ *          Only the attributes of the colored lines are replaced.
+ *
+ *          The group of each range is resolved once into a style of the
+ *          PLStyleTable, whose attributes are built from the theme before
+ *          coloring, and the runs of styles are applied in a single sweep
+ *          without editing the text storage. A PLTextStorage stores the runs
+ *          in its PLStyleRunArray, apart from its characters, rather than as
+ *          attributes, and its style table resolves them into attributes when
+ *          they are asked for; other text storages are given the attributes
+ *          of each sequence of runs with the same attributes. The NSTextView
+ *          calling this method is then responsible for redrawing its view (at
+ *          least the visible rect) for the syntax coloring to be drawn.
  *
  *          If an error occurs, coloring is disabled until using
  *          setActivePythonScript:error: with a new script.
@@ -101,6 +363,112 @@
  */
 -(BOOL)colorTextStorage:(NSTextStorage *)textStorage error:(NSError **)error;
 
+/**
+ * \brief Apply syntax coloring to the edited lines of a text storage object on
+ *        a background thread.
+ *
+ * \details The damaged lines, their lexer states and a copy of the string are
+ *          taken as a PLSyntaxHighlightingPass tagged with the edit generation
+ *          of the text storage, and colored on a serial queue with the active
+ *          engine, so that typing is not blocked by a long pass. The passes of
+ *          several text storages are colored concurrently, the focused text
+ *          storage first. The result is applied on the main thread in a
+ *          single batch, the layout managers of the text storage redraw the
+ *          colored characters, and a PLSyntaxHighlighterDidColorNotification
+ *          is posted.
+ *
+ *          If the text storage was edited while its pass was colored, the pass
+ *          is cancelled when this method is called again, so that it stops
+ *          within a chunk of lines rather than coloring stale text to its end.
+ *          Its result is dropped and a new pass is started from the current
+ *          text. A text storage has at most one pass in flight: calls made
+ *          meanwhile are coalesced into a single following pass.
+ *
+ *          Passes of a script are colored on the calling thread instead while
+ *          it keeps the GIL, until releaseGILOfCallingThread is called.
+ *
+ *          This method must be called on the main thread.
+ *
+ * \param textStorage The text storage object in which to apply syntax coloring.
+ */
+-(void)colorTextStorageInBackground:(PLTextStorage *)textStorage;
+
+/**
+ * \brief Apply syntax coloring to the visible lines of a text storage object
+ *        first, and to the rest of its edited lines progressively.
+ *
+ * \details The damaged lines within the visible range are colored before this
+ *          method returns, so that opening a file shows colored text after a
+ *          time independent of the size of the file. If the lines preceding
+ *          the visible range are not colored yet, the visible lines are colored
+ *          from the lexer state stored at the end of the preceding line, or
+ *          the default state, and stay damaged until they are colored again
+ *          from a known state.
+ *
+ *          The remaining damaged lines are then colored from the first damaged
+ *          line in chunks, when the run loop of the main thread is idle, with
+ *          at most a few milliseconds of coloring per slice. The layout
+ *          managers of the text storage redraw the colored characters after
+ *          each chunk, and a PLSyntaxHighlighterDidColorNotification is posted
+ *          once no line is damaged.
+ *
+ *          Call this method again when the visible range changes, such as
+ *          after scrolling, so that lines scrolled into view are colored before
+ *          the others. If the active engine colors the text as a whole, this
+ *          method is the same as colorTextStorage:error:.
+ *
+ *          This method must be called on the main thread.
+ *
+ * \param textStorage The text storage object in which to apply syntax coloring.
+ *
+ * \param visibleRange The range of characters visible in the text view.
+ *
+ * \param error On input, a pointer to a pointer for an error object. If an
+ *              error occurs while coloring the visible lines, this parameter
+ *              contains an error object on output unless it was NULL on input.
+ *
+ * \return A boolean flag indicating whether coloring the visible lines
+ *         succeeded.
+ */
+-(BOOL)colorTextStorage:(PLTextStorage *)textStorage visibleRange:(NSRange)visibleRange error:(NSError **)error;
+
+/**
+ * \brief Stop coloring a text storage object progressively, such as when its
+ *        document is closed.
+ *
+ * \details The text storage is released by the syntax highlighter. Its
+ *          damaged lines are left as they are.
+ */
+-(void)stopColoringTextStorageProgressively:(PLTextStorage *)textStorage;
+
+/**
+ * \brief Color the semantic ranges of a text storage found by an
+ *        introspection plugin over its syntax coloring.
+ *
+ * \details The plugin parses a snapshot of the string and returns the ranges of
+ *          local variables, global variables, parameters and unresolved names
+ *          on a background queue. If the text storage was not edited
+ *          meanwhile, the ranges become the runs of its PLSemanticOverlay on
+ *          the main thread, and only the lines whose runs changed are damaged
+ *          and colored again by colorTextStorageInBackground:, so that a new
+ *          semantic pass neither rewrites the attributes of the whole text
+ *          nor colors on the main thread. The runs are then applied after the
+ *          lexical ranges by every pass coloring their lines. A
+ *          PLSyntaxHighlighterDidColorNotification is posted once the runs
+ *          are applied. While the calling thread keeps the GIL, the plugin is
+ *          called on it instead, until releaseGILOfCallingThread is called.
+ *
+ *          Only groups with a color in the theme are colored.
+ *
+ *          This method must be called on the main thread.
+ *
+ * \param textStorage The text storage object to color.
+ *
+ * \param plugin The introspection plugin, which implements
+ *               semanticRangesOfSource:error:.
+ */
+-(void)colorSemanticRangesOfTextStorage:(PLTextStorage *)textStorage withPlugin:(id <PLAddOnPluginIntrospection>)plugin;
+
 /**
  * \brief Set the active Python script used for syntax coloring.
  *
@@ -113,6 +481,36 @@
  *          This function is called upon every edit, so it should be fast
  *          relative to user input.
  *
+ *          The text is passed as a string of UTF-8 bytes, which the script
+ *          decodes, and the offsets exchanged with get_coloring_dict() and
+ *          get_line_coloring() are offsets in the decoded text. The syntax
+ *          highlighter maps them to the characters of the text storage.
+ *
+ *          The script may also implement get_line_coloring(text, state,
+ *          line_ends) to color edited lines incrementally. The text is a span
+ *          of lines starting in the integer lexer state, line_ends is the list
+ *          of the offsets of the end of each line in the text, and the function
+ *          returns a tuple with the dict of ranges, relative to the start of
+ *          the text, and the list of the lexer state at each line end. Lexer
+ *          states are integers from 0, the state at the start of a file, to
+ *          254.
+ *
+ *          To avoid creating a Python object per range, the script may instead
+ *          implement get_coloring_buffer(text) and
+ *          get_line_coloring_buffer(text, state, line_ends), which return the
+ *          list of group names and a flat buffer of (group index, start,
+ *          length) triples of native 32 bit integers, such as an array('i'),
+ *          in place of the dict. The buffer is read in place through the
+ *          buffer protocol, and these functions are called when implemented.
+ *          Their text is a read-only buffer sharing the UTF-8 bytes of the
+ *          source, matched without being decoded, and their offsets count
+ *          bytes.
+ *
+ *          The syntax highlighter defines a should_cancel() function in the
+ *          module of the script, returning True once the pass being colored
+ *          is cancelled by a newer edit. Long calls may check it between
+ *          slices of the text and return early, as their result is dropped.
+ *
  *          If the script has already been loaded, this method does nothing and
  *          returns YES. On error, disable syntax coloring until this method is
  *          called again and is successful.
@@ -130,4 +528,16 @@
  */
 -(BOOL)setActivePythonScript:(NSString *)scriptName error:(NSError **)error;
 
+/**
+ * \brief Set the engine finding the ranges to color.
+ *
+ * \details Use PLSyntaxHighlighterEngineNativeTokenizer to color Python source
+ *          with the built-in tokenizer, or PLSyntaxHighlighterEngineScript to
+ *          return to the active Python script. Both engines color the lines of a
+ *          PLTextStorage incrementally, with the same lexer states.
+ *
+ * \param engine The engine to use on the next call to colorTextStorage:error:.
+ */
+-(void)setActiveEngine:(PLSyntaxHighlighterEngine)engine;
+
 @end
@@ -37,44 +37,273 @@
  */
 const char * PYTHON_METHOD = "get_coloring_dict";
 
+/**
+ * \brief The method called in python scripts to get the syntax highlighting
+ *        ranges of a span of lines and the lexer state at the end of each line.
+ *        Scripts that do not implement it are colored as a whole.
+ */
+const char * PYTHON_LINE_METHOD = "get_line_coloring";
+
+/**
+ * \brief The methods called in python scripts to get the syntax highlighting
+ *        ranges as a flat buffer of (group index, start, length) triples of 32
+ *        bit integers and a list of group names, read in place through the
+ *        buffer protocol. They are preferred to PYTHON_METHOD and
+ *        PYTHON_LINE_METHOD when a script implements them.
+ */
+const char * PYTHON_BUFFER_METHOD = "get_coloring_buffer";
+const char * PYTHON_LINE_BUFFER_METHOD = "get_line_coloring_buffer";
+
+/**
+ * \brief The minimum number of lines colored past the damaged lines when the
+ *        lexer state at their end changed. The number of lines doubles until
+ *        the lexer state matches the previous pass.
+ */
+#define MINIMUM_LINES_PER_PASS 64
+
+/**
+ * \brief The number of lines colored at a time when coloring progressively.
+ */
+#define LINES_PER_PROGRESSIVE_CHUNK 1024
+
+/**
+ * \brief The time in seconds after which a slice of progressive coloring
+ *        returns control to the run loop, checked after each chunk.
+ */
+#define PROGRESSIVE_SLICE_DURATION 0.008
+
+/**
+ * \brief The maximum number of lines colored by a single call to the engine,
+ *        after which a cancelled pass stops.
+ */
+#define LINES_PER_CANCELLATION_CHECK 2048
+
+/**
+ * \brief The function defined in the module of python scripts returning
+ *        whether the pass being colored was cancelled.
+ */
+const char * PYTHON_CANCEL_FUNCTION = "should_cancel";
+
 /**
  * \brief The exception thrown when interfacing with Python scripts.
  */
 NSString * PythonException = @"Exception with Python script";
 
+NSString * PLSyntaxHighlighterDidColorNotification = @"PLSyntaxHighlighterDidColor";
+NSString * PLSyntaxHighlighterErrorKey = @"PLSyntaxHighlighterError";
+NSString * PLSyntaxHighlighterDidMeasurePassNotification = @"PLSyntaxHighlighterDidMeasurePass";
+NSString * PLSyntaxHighlighterMetricsKey = @"PLSyntaxHighlighterMetrics";
+
+/**
+ * \brief The notification posted to a syntax highlighter through the
+ *        notification queue when the run loop is idle, to color a slice of the
+ *        text storage objects colored progressively.
+ */
+static NSString * PLSyntaxHighlighterIdleNotification = @"PLSyntaxHighlighterIdle";
+
+/**
+ * \brief The pass being colored by the current thread, checked by the
+ *        should_cancel() function of python scripts and recording the metrics
+ *        of the calls to the script.
+ */
+static __thread PLSyntaxHighlightingPass * currentPass = nil;
+
+/**
+ * \brief Return a Python bool indicating whether the pass being colored by the
+ *        current thread was cancelled. The GIL is held by the caller.
+ */
+static PyObject * shouldCancel(PyObject * self, PyObject * args)
+{
+        return PyBool_FromLong(currentPass != nil && [currentPass isCancelled]);
+}
+
+/**
+ * \brief The definition of the should_cancel() function of python scripts.
+ */
+static PyMethodDef shouldCancelDefinition = {
+        "should_cancel",
+        shouldCancel,
+        METH_NOARGS,
+        "Return whether the syntax highlighting pass being colored was cancelled."
+};
+
+/**
+ * \brief The thread state saved by releaseGILOfCallingThread, or NULL.
+ */
+static PyThreadState * initialThreadState = NULL;
+
+/**
+ * \brief The thread state of the thread keeping the GIL outside of
+ *        PyGILState_Ensure() and PyGILState_Release(), or NULL.
+ *
+ * \details This is the thread that held the GIL when a syntax highlighter was
+ *          initialized, such as the main thread after Py_Initialize(), until
+ *          releaseGILOfCallingThread is called, and then the thread given the
+ *          GIL back by restoreInitialThreadState.
+ */
+static PyThreadState * keepingThreadState = NULL;
+
+/**
+ * \brief Return whether the calling thread keeps the GIL outside of
+ *        PyGILState_Ensure() and PyGILState_Release().
+ */
+static BOOL currentThreadHoldsGIL(void)
+{
+        return keepingThreadState != NULL && PyGILState_GetThisThreadState() == keepingThreadState;
+}
+
+/**
+ * \brief Return the range of characters of a range of the decoded text of a
+ *        source buffer, as returned by get_coloring_dict() and
+ *        get_line_coloring().
+ *
+ * \details A wide build of Python counts the code points of the decoded text,
+ *          and a narrow build its UTF-16 code units, which are the characters.
+ */
+static NSRange characterRangeOfUnicodeRange(PLSourceBuffer * source, NSRange range)
+{
+        return (PyUnicode_GetMax() > 0xFFFF) ? [source characterRangeOfCodePointRange:range] : range;
+}
+
+/**
+ * \brief Return the offset in the decoded text of a source buffer of a
+ *        character, as passed to get_line_coloring().
+ */
+static NSUInteger unicodeOffsetOfCharacterOffset(PLSourceBuffer * source, NSUInteger offset)
+{
+        return (PyUnicode_GetMax() > 0xFFFF) ? [source codePointOffsetOfCharacterOffset:offset] : offset;
+}
+
 #pragma mark -
 
 @implementation PLSyntaxHighlighter
 
 @synthesize activePythonScript;
 
+@synthesize activeEngine;
+
+@synthesize tokenCache;
+
+@synthesize focusedTextStorage;
+
+@synthesize lastMetrics;
+
+@synthesize metricsLogCapacity;
+
+@synthesize numberOfCancelledPasses;
+
 -(id)init
 {
+        PyGILState_STATE gilState;
+        NSUInteger i, numberOfProcessors;
         self = [super init];
         if (self) {
                 importedModules = [[NSMutableDictionary alloc] init];
                 activePythonScript = nil;
+                activeEngine = PLSyntaxHighlighterEngineScript;
                 isColoringEnabled = YES;
-                
+                pythonTokenizer = [[PLPythonTokenizer alloc] init];
+                styleTable = [[PLStyleTable alloc] initWithThemeManager:[PLThemeManager defaultThemeManager]];
+                tokenCache = [[PLTokenCache alloc] init];
+                coloringQueue = dispatch_queue_create("com.liasis.LiasisKit.PLSyntaxHighlighter", DISPATCH_QUEUE_SERIAL);
+                dispatch_set_target_queue(coloringQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0));
+                numberOfProcessors = [[NSProcessInfo processInfo] activeProcessorCount];
+                numberOfBackgroundQueues = (numberOfProcessors > 1) ? numberOfProcessors - 1 : 1;
+                backgroundQueues = malloc(numberOfBackgroundQueues * sizeof(dispatch_queue_t));
+                for (i = 0; i < numberOfBackgroundQueues; i++) {
+                        backgroundQueues[i] = dispatch_queue_create("com.liasis.LiasisKit.PLSyntaxHighlighter.background", DISPATCH_QUEUE_SERIAL);
+                        dispatch_set_target_queue(backgroundQueues[i], dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+                }
+                nextBackgroundQueue = 0;
+                semanticQueue = dispatch_queue_create("com.liasis.LiasisKit.PLSyntaxHighlighter.semantic", DISPATCH_QUEUE_SERIAL);
+                dispatch_set_target_queue(semanticQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+                focusedTextStorage = nil;
+                coloringTextStorages = [[NSMutableArray alloc] init];
+                coloringPasses = [[NSMutableArray alloc] init];
+                pendingTextStorages = [[NSMutableArray alloc] init];
+                progressiveTextStorages = [[NSMutableArray alloc] init];
+                lastMetrics = nil;
+                metricsLog = [[NSMutableArray alloc] init];
+                metricsLogCapacity = 0;
+                numberOfCancelledPasses = 0;
+                [[NSNotificationCenter defaultCenter] addObserver:self
+                                                         selector:@selector(colorProgressivelyWhenIdle:)
+                                                             name:PLSyntaxHighlighterIdleNotification
+                                                           object:self];
+
+                if (PyEval_ThreadsInitialized() == 0)
+                        PyEval_InitThreads();
+                gilState = PyGILState_Ensure();
+                /* a thread already holding the GIL keeps it until the host calls releaseGILOfCallingThread */
+                @synchronized([PLSyntaxHighlighter class]) {
+                        if (gilState == PyGILState_LOCKED && initialThreadState == NULL)
+                                keepingThreadState = PyGILState_GetThisThreadState();
+                }
                 PyObject * pyPath = PySys_GetObject("path");
                 NSString * localPath = [[NSBundle bundleForClass:[self class]] resourcePath];
                 int err = PyList_Append(pyPath, PyString_FromString([localPath UTF8String]));
                 if (err < 0) {
                         NSLog(@"Error in init: could not append local path to Python sys.path");
                         PyErr_Clear();
+                        PyGILState_Release(gilState);
                         [self release];
                         self = nil;
                         goto exit;
                 }
+                PyGILState_Release(gilState);
         }
 
 exit:
         return self;
 }
 
++(void)releaseGILOfCallingThread
+{
+        PyGILState_STATE gilState;
+        @synchronized([PLSyntaxHighlighter class]) {
+                if (PyEval_ThreadsInitialized() == 0)
+                        PyEval_InitThreads();
+                /* PyGILState_Ensure() tells whether the calling thread already held the GIL */
+                gilState = PyGILState_Ensure();
+                PyGILState_Release(gilState);
+                if (initialThreadState == NULL && gilState == PyGILState_LOCKED) {
+                        initialThreadState = PyEval_SaveThread();
+                        keepingThreadState = NULL;
+                }
+        }
+}
+
++(void)restoreInitialThreadState
+{
+        @synchronized([PLSyntaxHighlighter class]) {
+                if (initialThreadState) {
+                        PyEval_RestoreThread(initialThreadState);
+                        keepingThreadState = initialThreadState;
+                        initialThreadState = NULL;
+                }
+        }
+}
+
 -(void)dealloc
 {
+        NSUInteger i;
+        [[NSNotificationCenter defaultCenter] removeObserver:self];
         [importedModules release];
+        [pythonTokenizer release];
+        [styleTable release];
+        [tokenCache release];
+        [coloringTextStorages release];
+        [coloringPasses release];
+        [pendingTextStorages release];
+        [progressiveTextStorages release];
+        [focusedTextStorage release];
+        [lastMetrics release];
+        [metricsLog release];
+        dispatch_release(coloringQueue);
+        for (i = 0; i < numberOfBackgroundQueues; i++)
+                dispatch_release(backgroundQueues[i]);
+        free(backgroundQueues);
+        dispatch_release(semanticQueue);
         [super dealloc];
 }
 
@@ -82,89 +311,1031 @@ exit:
 {
         BOOL successful = YES;
         PyObject * module = NULL;
-        
-        if ([importedModules objectForKey:scriptName] == nil) {
-                module = PyImport_ImportModule([scriptName UTF8String]);
-                if (module == NULL) {
-                        if (error) {
-                                *error = [NSError errorWithDomain:PLLiasisKitErrorDomain
-                                                             code:PLErrorCodeLog
-                                                         userInfo:@{NSLocalizedDescriptionKey: [NSString stringWithFormat:@"Disabling coloring: could not import '%@' module", scriptName]}];
-                                
+        PyGILState_STATE gilState;
+
+        @synchronized(importedModules) {
+                if ([importedModules objectForKey:scriptName] == nil) {
+                        gilState = PyGILState_Ensure();
+                        module = PyImport_ImportModule([scriptName UTF8String]);
+                        if (module == NULL)
+                                PyErr_Clear();
+                        else
+                                [self addCancelFunctionToModule:module];
+                        PyGILState_Release(gilState);
+                        if (module == NULL) {
+                                if (error) {
+                                        *error = [NSError errorWithDomain:PLLiasisKitErrorDomain
+                                                                     code:PLErrorCodeLog
+                                                                 userInfo:@{NSLocalizedDescriptionKey: [NSString stringWithFormat:@"Disabling coloring: could not import '%@' module", scriptName]}];
+
+                                }
+                                isColoringEnabled = NO;
+                                successful = NO;
+                        } else {
+                                [importedModules setObject:[NSValue valueWithPointer:module] forKey:scriptName];
+                                activePythonScript = scriptName;
+                                isColoringEnabled = YES;
                         }
-                        isColoringEnabled = NO;
-                        successful = NO;
+                }
+        }
+        if (successful)
+                activeEngine = PLSyntaxHighlighterEngineScript;
+        return successful;
+}
+
+-(void)setActiveEngine:(PLSyntaxHighlighterEngine)engine
+{
+        activeEngine = engine;
+        isColoringEnabled = YES;
+}
+
+-(void)setMetricsLogCapacity:(NSUInteger)capacity
+{
+        metricsLogCapacity = capacity;
+        if ([metricsLog count] > metricsLogCapacity)
+                [metricsLog removeObjectsInRange:NSMakeRange(0, [metricsLog count] - metricsLogCapacity)];
+}
+
+-(NSArray *)metricsLog
+{
+        return [[metricsLog copy] autorelease];
+}
+
+-(BOOL)colorTextStorage:(PLTextStorage *)textStorage error:(NSError **)error
+{
+        BOOL successful = YES;
+
+        if (activeEngine == PLSyntaxHighlighterEngineNativeTokenizer) {
+                if ([textStorage isKindOfClass:[PLTextStorage class]])
+                        successful = [self colorDamagedLinesOfTextStorage:textStorage error:error];
+                else
+                        [self colorAllOfTextStorageWithPythonTokenizer:textStorage];
+                goto exit;
+        }
+
+        /* check if there is an active Python script to use */
+        if (activePythonScript == nil) {
+                [styleTable applyRuns:NULL count:0 inRange:NSMakeRange(0, [textStorage length]) toTextStorage:textStorage];
+                if (error) {
+                        *error = [NSError errorWithDomain:PLLiasisKitErrorDomain
+                                                     code:PLErrorCodeStatusBar
+                                                 userInfo:@{NSLocalizedDescriptionKey: @"Disabling coloring: no syntax coloring python script loaded."}];
+                }
+                isColoringEnabled = NO;
+                successful = NO;
+                goto exit;
+        }
+
+        if ([textStorage isKindOfClass:[PLTextStorage class]])
+                successful = [self colorDamagedLinesOfTextStorage:textStorage error:error];
+        else
+                successful = [self colorAllOfTextStorage:textStorage error:error];
+
+exit:
+        return successful;
+}
+
+-(void)colorTextStorageInBackground:(PLTextStorage *)textStorage
+{
+        PLSyntaxHighlightingPass * pass;
+        PLSyntaxHighlighterEngine engine = activeEngine;
+        NSString * scriptName = activePythonScript;
+        NSError * error = nil;
+        NSUInteger index;
+
+        /* a text storage has at most one pass in flight, and edits made meanwhile are colored by the next pass */
+        index = [coloringTextStorages indexOfObjectIdenticalTo:textStorage];
+        if (index != NSNotFound) {
+                pass = [coloringPasses objectAtIndex:index];
+                if ([pass generation] != [textStorage generation])
+                        [pass cancel];
+                if ([pendingTextStorages indexOfObjectIdenticalTo:textStorage] == NSNotFound)
+                        [pendingTextStorages addObject:textStorage];
+                goto exit;
+        }
+        /* scripts are colored on the calling thread while it keeps the GIL, as a background pass would wait for it forever */
+        if (engine == PLSyntaxHighlighterEngineScript && (scriptName == nil || currentThreadHoldsGIL())) {
+                [self colorTextStorage:textStorage error:&error];
+                [self postDidColorNotificationForTextStorage:textStorage error:error];
+                goto exit;
+        }
+
+        pass = [[PLSyntaxHighlightingPass alloc] initWithTextStorage:textStorage copySource:YES];
+        [coloringTextStorages addObject:textStorage];
+        [coloringPasses addObject:pass];
+        [self dispatchPass:pass ofTextStorage:textStorage engine:engine script:scriptName];
+        [pass release];
+
+exit:
+        return;
+}
+
+-(BOOL)colorTextStorage:(PLTextStorage *)textStorage visibleRange:(NSRange)visibleRange error:(NSError **)error
+{
+        BOOL successful;
+        if ([self activeEngineColorsLines] == NO) {
+                successful = [self colorTextStorage:textStorage error:error];
+                goto exit;
+        }
+
+        successful = [self colorLinesInRange:[self lineRangeOfTextStorage:textStorage forCharacterRange:visibleRange]
+                               ofTextStorage:textStorage
+                                       error:error];
+        if (successful) {
+                if ([progressiveTextStorages indexOfObjectIdenticalTo:textStorage] == NSNotFound)
+                        [progressiveTextStorages addObject:textStorage];
+                [self enqueueIdleNotification];
+        } else {
+                isColoringEnabled = NO;
+                [self stopColoringTextStorageProgressively:textStorage];
+        }
+
+exit:
+        return successful;
+}
+
+-(void)stopColoringTextStorageProgressively:(PLTextStorage *)textStorage
+{
+        NSUInteger index = [progressiveTextStorages indexOfObjectIdenticalTo:textStorage];
+        if (index != NSNotFound)
+                [progressiveTextStorages removeObjectAtIndex:index];
+}
+
+-(void)colorSemanticRangesOfTextStorage:(PLTextStorage *)textStorage withPlugin:(id <PLAddOnPluginIntrospection>)plugin
+{
+        PLTextSnapshot * source;
+        if ([plugin respondsToSelector:@selector(semanticRangesOfSource:error:)] == NO)
+                goto exit;
+        source = [textStorage snapshot];
+        if (currentThreadHoldsGIL()) {
+                [self applySemanticRanges:[plugin semanticRangesOfSource:source error:NULL]
+                            toTextStorage:textStorage
+                               generation:[source generation]];
+                goto exit;
+        }
+        [self dispatchSemanticPassOfTextStorage:textStorage source:source generation:[source generation] plugin:plugin];
+
+exit:
+        return;
+}
+
+#pragma mark - Private Methods
+
+/**
+ * \brief Return whether the active engine colors the lines of a text storage
+ *        incrementally, rather than the text as a whole.
+ */
+-(BOOL)activeEngineColorsLines
+{
+        if (activeEngine == PLSyntaxHighlighterEngineNativeTokenizer)
+                return YES;
+        return (activePythonScript != nil
+                && ([self pythonScript:activePythonScript implementsFunction:PYTHON_LINE_BUFFER_METHOD]
+                    || [self pythonScript:activePythonScript implementsFunction:PYTHON_LINE_METHOD]));
+}
+
+/**
+ * \brief Return the range of line numbers of a text storage containing a range
+ *        of characters.
+ */
+-(NSRange)lineRangeOfTextStorage:(PLTextStorage *)textStorage forCharacterRange:(NSRange)characterRange
+{
+        NSUInteger first = [textStorage lineNumberForCharacterIndex:characterRange.location];
+        NSUInteger last = [textStorage lineNumberForCharacterIndex:NSMaxRange(characterRange)];
+        return NSMakeRange(first, last - first + 1);
+}
+
+/**
+ * \brief Color the damaged lines of a text storage within a range of lines,
+ *        on the calling thread, and redraw them.
+ *
+ * \details The pass is created with initWithTextStorage:lineRange:copySource:,
+ *          so that lines are colored from a guessed lexer state when the lines
+ *          preceding the range are damaged.
+ */
+-(BOOL)colorLinesInRange:(NSRange)lineRange ofTextStorage:(PLTextStorage *)textStorage error:(NSError **)error
+{
+        BOOL successful;
+        PLSyntaxHighlightingPass * pass = [[PLSyntaxHighlightingPass alloc] initWithTextStorage:textStorage
+                                                                                      lineRange:lineRange
+                                                                                     copySource:NO];
+        successful = [self colorPass:pass engine:activeEngine script:activePythonScript error:error];
+        if (successful) {
+                [self applyPass:pass toTextStorage:textStorage];
+                for (NSLayoutManager * layoutManager in [textStorage layoutManagers])
+                        [layoutManager invalidateDisplayForCharacterRange:[pass coloredCharacterRange]];
+        }
+        [pass release];
+        return successful;
+}
+
+/**
+ * \brief Post a PLSyntaxHighlighterIdleNotification to the syntax highlighter
+ *        the next time the run loop is idle, unless one is already queued.
+ */
+-(void)enqueueIdleNotification
+{
+        [[NSNotificationQueue defaultQueue] enqueueNotification:[NSNotification notificationWithName:PLSyntaxHighlighterIdleNotification
+                                                                                             object:self]
+                                                   postingStyle:NSPostWhenIdle
+                                                   coalesceMask:NSNotificationCoalescingOnName | NSNotificationCoalescingOnSender
+                                                       forModes:nil];
+}
+
+/**
+ * \brief Color chunks of the damaged lines of the text storage objects colored
+ *        progressively, for a slice of idle time.
+ *
+ * \details Chunks start at the first damaged line of each text storage, so
+ *          that the lexer state preceding them is known. Text storage objects
+ *          with a pass colored in the background are skipped until the pass is
+ *          applied. A text storage without damaged lines is done: a
+ *          PLSyntaxHighlighterDidColorNotification is posted for it. Another
+ *          slice is queued while text storage objects remain.
+ */
+-(void)colorProgressivelyWhenIdle:(NSNotification *)notification
+{
+        NSDate * start = [NSDate date];
+        NSArray * textStorages = [[progressiveTextStorages copy] autorelease];
+        NSRange damagedLineRange;
+        NSError * error = nil;
+        BOOL isDone;
+
+        for (PLTextStorage * textStorage in textStorages) {
+                if ([coloringTextStorages indexOfObjectIdenticalTo:textStorage] != NSNotFound)
+                        continue;
+                isDone = NO;
+                while (isDone == NO && -[start timeIntervalSinceNow] < PROGRESSIVE_SLICE_DURATION) {
+                        damagedLineRange = [[textStorage lexerStates] damagedLineRange];
+                        if (damagedLineRange.length == 0 || [self activeEngineColorsLines] == NO) {
+                                isDone = YES;
+                        } else if ([self colorLinesInRange:NSMakeRange(damagedLineRange.location, LINES_PER_PROGRESSIVE_CHUNK)
+                                             ofTextStorage:textStorage
+                                                     error:&error] == NO) {
+                                isColoringEnabled = NO;
+                                isDone = YES;
+                        }
+                }
+                if (isDone) {
+                        [self stopColoringTextStorageProgressively:textStorage];
+                        [self postDidColorNotificationForTextStorage:textStorage error:error];
+                        error = nil;
+                }
+        }
+        if ([progressiveTextStorages count] > 0)
+                [self enqueueIdleNotification];
+}
+
+/**
+ * \brief Color a pass on a coloring queue, and finish it on the main thread.
+ *
+ * \details The pass of the focused text storage is colored on the coloring
+ *          queue, which runs at a high priority. The passes of the other text
+ *          storages are spread over the background queues, which run at a low
+ *          priority on the remaining processors. Passes colored by a script
+ *          hold the GIL, so the background passes of the script engine share
+ *          the first background queue rather than contending for the GIL with
+ *          the focused pass from every queue.
+ */
+-(void)dispatchPass:(PLSyntaxHighlightingPass *)pass
+      ofTextStorage:(PLTextStorage *)textStorage
+             engine:(PLSyntaxHighlighterEngine)engine
+             script:(NSString *)scriptName
+{
+        dispatch_queue_t queue = coloringQueue;
+        if (textStorage != focusedTextStorage) {
+                if (engine == PLSyntaxHighlighterEngineNativeTokenizer) {
+                        queue = backgroundQueues[nextBackgroundQueue];
+                        nextBackgroundQueue = (nextBackgroundQueue + 1) % numberOfBackgroundQueues;
+                } else {
+                        queue = backgroundQueues[0];
+                }
+        }
+        dispatch_async(queue, ^{
+                @autoreleasepool {
+                        NSError * passError = nil;
+                        BOOL successful = [self colorPass:pass engine:engine script:scriptName error:&passError];
+                        [passError retain];
+                        dispatch_async(dispatch_get_main_queue(), ^{
+                                [self finishPass:pass ofTextStorage:textStorage successful:successful error:passError];
+                                [passError release];
+                        });
+                }
+        });
+}
+
+/**
+ * \brief Find the semantic ranges of a snapshot of the string of a text
+ *        storage on the semantic queue, and apply them on the main thread.
+ *
+ * \details The plugin parses the snapshot itself, so that the parse state used
+ *          by its other methods on the main thread is left alone. A plugin
+ *          returning nil leaves the semantic runs of the text storage
+ *          unchanged.
+ */
+-(void)dispatchSemanticPassOfTextStorage:(PLTextStorage *)textStorage
+                                  source:(NSString *)source
+                              generation:(NSUInteger)generation
+                                  plugin:(id <PLAddOnPluginIntrospection>)plugin
+{
+        dispatch_async(semanticQueue, ^{
+                @autoreleasepool {
+                        NSDictionary * ranges = [[plugin semanticRangesOfSource:source error:NULL] retain];
+                        dispatch_async(dispatch_get_main_queue(), ^{
+                                [self applySemanticRanges:ranges toTextStorage:textStorage generation:generation];
+                                [ranges release];
+                        });
+                }
+        });
+}
+
+/**
+ * \brief Set the semantic ranges found by a plugin as the runs of the semantic
+ *        overlay of a text storage, and color the lines whose runs changed.
+ *
+ * \details The ranges are dropped if the text storage was edited since they
+ *          were requested. The changed lines are damaged and colored again by
+ *          a background pass, which applies the lexical ranges and then the
+ *          semantic runs of the lines, so that the first semantic pass of a
+ *          document does not recolor it on the main thread.
+ *
+ * \param ranges The ranges of each group, or nil.
+ *
+ * \param textStorage The text storage whose source was introspected.
+ *
+ * \param generation The edit generation of the text storage when its source
+ *                   was copied.
+ */
+-(void)applySemanticRanges:(NSDictionary *)ranges toTextStorage:(PLTextStorage *)textStorage generation:(NSUInteger)generation
+{
+        NSUInteger count = 0, runsCapacity = 256, line, first;
+        PLStyleRun * runs = NULL;
+        NSIndexSet * changedLines;
+        NSRange range;
+        PLStyle style;
+        if (ranges == nil || [textStorage generation] != generation)
+                goto exit;
+
+        runs = malloc(runsCapacity * sizeof(PLStyleRun));
+        for (NSString * group in ranges) {
+                style = [styleTable styleOfGroup:group];
+                for (NSValue * rangeValue in [ranges objectForKey:group]) {
+                        range = NSIntersectionRange([rangeValue rangeValue], NSMakeRange(0, [textStorage length]));
+                        if (range.length == 0)
+                                continue;
+                        if (count == runsCapacity) {
+                                runsCapacity *= 2;
+                                runs = realloc(runs, runsCapacity * sizeof(PLStyleRun));
+                        }
+                        runs[count].range = range;
+                        runs[count].style = style;
+                        count++;
+                }
+        }
+        changedLines = [[textStorage semanticOverlay] setRuns:runs count:count ofTextStorage:textStorage];
+        if ([changedLines count] == 0) {
+                [self postDidColorNotificationForTextStorage:textStorage error:nil];
+                goto exit;
+        }
+        for (line = [changedLines firstIndex]; line != NSNotFound; line = [changedLines indexGreaterThanIndex:line]) {
+                first = line;
+                while ([changedLines containsIndex:line + 1])
+                        line++;
+                [[textStorage lexerStates] damageLinesInRange:NSMakeRange(first, line - first + 1)];
+        }
+        [self colorTextStorageInBackground:textStorage];
+
+exit:
+        free(runs);
+}
+
+/**
+ * \brief Apply syntax coloring to the whole text of a text storage object.
+ *
+ * \details This method is used for text storage objects that do not keep
+ *          lexer states.
+ */
+-(BOOL)colorAllOfTextStorage:(NSTextStorage *)textStorage error:(NSError **)error
+{
+        BOOL successful = YES;
+        NSError * matchesError = nil;
+        PLSourceBuffer * source = [[PLSourceBuffer alloc] init];
+        [source setString:[textStorage string] range:NSMakeRange(0, [textStorage length])];
+
+        /* color all ranges, and the rest of the text with the theme's foreground color */
+        NSDictionary * matches = [self rangesFromPythonScript:activePythonScript
+                                                   withSource:source
+                                                        error:&matchesError];
+        if (matches == nil) {
+                if (error) {
+                        *error = [NSError errorWithDomain:PLLiasisKitErrorDomain
+                                                     code:PLErrorCodeStatusBar
+                                                 userInfo:@{NSLocalizedDescriptionKey: @"Disabling coloring: error calling the python script."}];
+                }
+                isColoringEnabled = NO;
+                successful = NO;
+                goto exit;
+        }
+        [self applyMatches:matches toTextStorage:textStorage];
+
+exit:
+        [source release];
+        return successful;
+}
+
+/**
+ * \brief Apply syntax coloring to the lines of a text storage object edited
+ *        since they were last colored, on the calling thread.
+ *
+ * \details The pass works on the text storage string without copying it, and
+ *          its result is applied immediately.
+ */
+-(BOOL)colorDamagedLinesOfTextStorage:(PLTextStorage *)textStorage error:(NSError **)error
+{
+        BOOL successful;
+        PLSyntaxHighlightingPass * pass = [[PLSyntaxHighlightingPass alloc] initWithTextStorage:textStorage copySource:NO];
+        successful = [self colorPass:pass engine:activeEngine script:activePythonScript error:error];
+        if (successful)
+                [self applyPass:pass toTextStorage:textStorage];
+        else
+                isColoringEnabled = NO;
+        [pass release];
+        return successful;
+}
+
+/**
+ * \brief Find the ranges to color and the lexer states of a pass.
+ *
+ * \details Coloring starts at the first line of the pass, in the lexer state
+ *          at the end of the previous line, and continues past the damaged
+ *          lines until the lexer state at the end of the last colored line
+ *          matches the state stored by the previous pass. The cost of a pass
+ *          depends on the size of the edit rather than the size of the text,
+ *          except when the edit changes the state of the following lines, such
+ *          as opening a docstring. Scripts that do not implement
+ *          get_line_coloring() color the whole text.
+ *
+ *          Lines found in the token cache with the lexer state at their start
+ *          are colored from the cache, and the lines colored by the engine are
+ *          added to it.
+ *
+ *          This method does not touch the text storage of the pass, and can be
+ *          called on any thread. The GIL is held only while calling the
+ *          script.
+ *
+ *          If the pass is cancelled, coloring stops after the lines being
+ *          colored by the engine, at most LINES_PER_CANCELLATION_CHECK lines,
+ *          and the method returns YES with an incomplete pass, which must not
+ *          be applied. Scripts may also return early when their
+ *          should_cancel() function returns True.
+ *
+ * \param pass The pass to color.
+ *
+ * \param engine The engine finding the ranges to color.
+ *
+ * \param scriptName The name of the script used by the script engine.
+ *
+ * \param error On input, a pointer to a pointer for an error object. If an
+ *              error occurs, this parameter contains an error object on output
+ *              unless it was NULL on input.
+ */
+-(BOOL)colorPass:(PLSyntaxHighlightingPass *)pass
+          engine:(PLSyntaxHighlighterEngine)engine
+          script:(NSString *)scriptName
+           error:(NSError **)error
+{
+        BOOL successful = YES;
+        PLPythonTokenizer * tokenizer = nil;
+        PLSourceBuffer * source = [[PLSourceBuffer alloc] init];
+        NSRange damagedLineRange = [pass damagedLineRange];
+        NSUInteger first, last, count, lastLineToColor = [pass lastLineToColor];
+        PLLexerState state, previousState;
+        NSDictionary * matches;
+        BOOL usesBuffer = NO;
+        NSUInteger seed = [scriptName hash];
+        NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+        PLSyntaxHighlightingPass * previousPass = currentPass;
+        currentPass = pass;
+
+        [[pass metrics] setEngineName:scriptName];
+        if (engine == PLSyntaxHighlighterEngineNativeTokenizer) {
+                tokenizer = [[PLPythonTokenizer alloc] init];
+                seed = [NSStringFromClass([PLPythonTokenizer class]) hash];
+                [[pass metrics] setEngineName:NSStringFromClass([PLPythonTokenizer class])];
+        } else if ([self pythonScript:scriptName implementsFunction:PYTHON_LINE_BUFFER_METHOD]) {
+                usesBuffer = YES;
+        } else if ([self pythonScript:scriptName implementsFunction:PYTHON_LINE_METHOD] == NO) {
+                [source setString:[pass source] range:NSMakeRange(0, [[pass source] length])];
+                if ([self pythonScript:scriptName implementsFunction:PYTHON_BUFFER_METHOD]) {
+                        successful = [self addRangesFromPythonScript:scriptName
+                                                              toPass:pass
+                                                          withSource:source
+                                                              offset:0
+                                                          lexerState:PLLexerStateDefault
+                                                            lineEnds:NULL
+                                                         lexerStates:NULL
+                                                               count:0
+                                                               error:error];
+                        if (successful == NO)
+                                goto exit;
                 } else {
-                        [importedModules setObject:[NSValue valueWithPointer:module] forKey:scriptName];
-                        activePythonScript = scriptName;
-                        isColoringEnabled = YES;
+                        matches = [self rangesFromPythonScript:scriptName withSource:source error:error];
+                        if (matches == nil) {
+                                successful = NO;
+                                goto exit;
+                        }
+                        for (NSString * group in matches) {
+                                for (NSValue * rangeValue in [matches objectForKey:group])
+                                        [pass addRange:[rangeValue rangeValue] group:group];
+                        }
+                }
+                [pass setColoredCharacterRange:NSMakeRange(0, [[pass source] length])];
+                goto exit;
+        }
+        first = [pass firstLine];
+        if (damagedLineRange.length == 0 || first > lastLineToColor)
+                goto exit;
+
+        state = [pass entryState];
+        if ([pass isEntryStateGuessed])
+                last = lastLineToColor;
+        else
+                last = MIN(NSMaxRange(damagedLineRange) - 1, lastLineToColor);
+        while (YES) {
+                previousState = [pass previousStateAtEndOfLine:last];
+                successful = [self colorCachedLines:last - first + 1
+                                             ofPass:pass
+                                         entryState:state
+                                          tokenizer:tokenizer
+                                             script:scriptName
+                                             buffer:usesBuffer
+                                             source:source
+                                               seed:seed
+                                              error:error];
+                if (successful == NO || [pass isCancelled])
+                        goto exit;
+                state = [pass stateAtEndOfLine:last];
+                if (last == lastLineToColor || (state == previousState && state != PLLexerStateUnknown))
+                        break;
+                count = MAX(2 * (last - first + 1), (NSUInteger)MINIMUM_LINES_PER_PASS);
+                first = last + 1;
+                last = MIN(first + count - 1, lastLineToColor);
+        }
+
+exit:
+        [[pass metrics] setColoringDuration:[NSDate timeIntervalSinceReferenceDate] - start];
+        currentPass = previousPass;
+        [tokenizer release];
+        [source release];
+        return successful;
+}
+
+/**
+ * \brief Find the ranges to color in the lines following the last colored line
+ *        of a pass from the token cache, and color the lines not cached with
+ *        the engine.
+ *
+ * \details The lines not found in the cache are colored in spans of lines,
+ *          doubling in length while the following line is not found either, so
+ *          that text not seen before only calls the engine a few times. The
+ *          lines colored by the engine are then cached. A span has at most
+ *          LINES_PER_CANCELLATION_CHECK lines, and coloring stops between
+ *          spans if the pass is cancelled.
+ *
+ * \param count The number of lines to color.
+ *
+ * \param pass The pass to color.
+ *
+ * \param state The lexer state at the end of the line preceding the lines.
+ *
+ * \param tokenizer The tokenizer of the native engine, or nil to use the
+ *                  script.
+ *
+ * \param scriptName The name of the script used if tokenizer is nil.
+ *
+ * \param usesBuffer Whether to call the get_line_coloring_buffer() function of
+ *                   the script rather than get_line_coloring().
+ *
+ * \param source The source buffer in which the lines are encoded for the
+ *               script.
+ *
+ * \param seed The value identifying the engine in the token cache.
+ *
+ * \param error On input, a pointer to a pointer for an error object. If an
+ *              error occurs, this parameter contains an error object on output
+ *              unless it was NULL on input.
+ */
+-(BOOL)colorCachedLines:(NSUInteger)count
+                 ofPass:(PLSyntaxHighlightingPass *)pass
+             entryState:(PLLexerState)state
+              tokenizer:(PLPythonTokenizer *)tokenizer
+                 script:(NSString *)scriptName
+                 buffer:(BOOL)usesBuffer
+                 source:(PLSourceBuffer *)source
+                   seed:(NSUInteger)seed
+                  error:(NSError **)error
+{
+        BOOL successful = YES, usesCache = [tokenCache capacity] > 0;
+        NSUInteger last = [pass lastLine] + count, span, firstRange;
+        span = (usesCache) ? 1 : LINES_PER_CANCELLATION_CHECK;
+
+        while ([pass lastLine] < last) {
+                if ([pass isCancelled])
+                        goto exit;
+                if (usesCache && [tokenCache colorNextLineOfPass:pass entryState:state seed:seed]) {
+                        [[pass metrics] addCachedLines:1];
+                        state = [pass stateAtEndOfLine:[pass lastLine]];
+                        span = 1;
+                        continue;
                 }
+                span = MIN(span, last - [pass lastLine]);
+                firstRange = [pass numberOfColoredRanges];
+                successful = [self colorLines:span
+                                       ofPass:pass
+                                   entryState:state
+                                    tokenizer:tokenizer
+                                       script:scriptName
+                                       buffer:usesBuffer
+                                       source:source
+                                        error:error];
+                /* a cancelled script may return early, with ranges that must not be cached */
+                if (successful == NO || [pass isCancelled])
+                        goto exit;
+                if (usesCache)
+                        [tokenCache addLines:span
+                                      ofPass:pass
+                                  entryState:state
+                                  firstRange:firstRange
+                                        seed:seed];
+                state = [pass stateAtEndOfLine:[pass lastLine]];
+                span = MIN(2 * span, (NSUInteger)LINES_PER_CANCELLATION_CHECK);
         }
+
+exit:
         return successful;
 }
 
--(BOOL)colorTextStorage:(PLTextStorage *)textStorage error:(NSError **)error
+/**
+ * \brief Find the ranges to color in the lines following the last colored line
+ *        of a pass, and the lexer state at the end of each line.
+ *
+ * \param count The number of lines to color.
+ *
+ * \param pass The pass to color.
+ *
+ * \param state The lexer state at the end of the line preceding the lines.
+ *
+ * \param tokenizer The tokenizer of the native engine, or nil to use the
+ *                  script.
+ *
+ * \param scriptName The name of the script used if tokenizer is nil.
+ *
+ * \param usesBuffer Whether to call the get_line_coloring_buffer() function of
+ *                   the script rather than get_line_coloring().
+ *
+ * \param source The source buffer in which the lines are encoded for the
+ *               script.
+ *
+ * \param error On input, a pointer to a pointer for an error object. If an
+ *              error occurs, this parameter contains an error object on output
+ *              unless it was NULL on input.
+ */
+-(BOOL)colorLines:(NSUInteger)count
+           ofPass:(PLSyntaxHighlightingPass *)pass
+       entryState:(PLLexerState)state
+        tokenizer:(PLPythonTokenizer *)tokenizer
+           script:(NSString *)scriptName
+           buffer:(BOOL)usesBuffer
+           source:(PLSourceBuffer *)source
+            error:(NSError **)error
 {
         BOOL successful = YES;
+        NSUInteger line, first = [pass lastLine] + 1, * lineEnds = NULL;
+        PLLexerState * states = NULL;
+        unichar * characters = NULL;
+        NSRange characterRange, range;
+        NSDictionary * matches;
         NSError * matchesError = nil;
-        
-        /* set text storage font color to the theme's foreground color */
-        [textStorage addAttributeWithoutEditing:NSForegroundColorAttributeName
-                                          value:[[PLThemeManager defaultThemeManager] getThemeProperty:PLThemeManagerForeground
-                                                                                             fromGroup:PLThemeManagerSettings]
-                                          range:NSMakeRange(0, [textStorage length])];
-        
-        /* check if there is an active Python script to use */
-        if (activePythonScript == nil) {
-                if (error) {
-                        *error = [NSError errorWithDomain:PLLiasisKitErrorDomain
-                                                     code:PLErrorCodeStatusBar
-                                                 userInfo:@{NSLocalizedDescriptionKey: @"Disabling coloring: no syntax coloring python script loaded."}];
-                }
-                isColoringEnabled = NO;
-                successful = NO;
-                goto exit;
+        NSTimeInterval start;
+        lineEnds = malloc(count * sizeof(NSUInteger));
+        states = malloc(count * sizeof(PLLexerState));
+        characterRange = [pass nextLines:count lineEnds:lineEnds];
+
+        if (tokenizer) {
+                characters = malloc(MAX(characterRange.length, (NSUInteger)1) * sizeof(unichar));
+                [[pass source] getCharacters:characters range:characterRange];
+                start = [NSDate timeIntervalSinceReferenceDate];
+                [tokenizer tokenizeCharacters:characters
+                                       length:characterRange.length
+                                   lexerState:state
+                                     lineEnds:lineEnds
+                                  lexerStates:states
+                                        count:count];
+                [[pass metrics] addEngineCallWithBytes:0 duration:[NSDate timeIntervalSinceReferenceDate] - start];
+                start = [NSDate timeIntervalSinceReferenceDate];
+                [pass addTokens:[tokenizer tokens] count:[tokenizer numberOfTokens] offset:characterRange.location];
+                [[pass metrics] addConversionDuration:[NSDate timeIntervalSinceReferenceDate] - start];
+                goto setStates;
+        }
+        [source setString:[pass source] range:characterRange];
+        if (usesBuffer) {
+                successful = [self addRangesFromPythonScript:scriptName
+                                                      toPass:pass
+                                                  withSource:source
+                                                      offset:characterRange.location
+                                                  lexerState:state
+                                                    lineEnds:lineEnds
+                                                 lexerStates:states
+                                                       count:count
+                                                       error:error];
+                if (successful == NO)
+                        goto exit;
+                goto setStates;
         }
 
-        /* color all ranges */
-        NSDictionary * matches = [self rangesFromPythonScript:activePythonScript
-                                                   withSource:[[textStorage string] UTF8String]
-                                                        error:&matchesError];
+        matches = [self rangesFromPythonScript:scriptName
+                                    withSource:source
+                                    lexerState:state
+                                      lineEnds:lineEnds
+                                   lexerStates:states
+                                         count:count
+                                         error:&matchesError];
         if (matches == nil) {
                 if (error) {
                         *error = [NSError errorWithDomain:PLLiasisKitErrorDomain
                                                      code:PLErrorCodeStatusBar
                                                  userInfo:@{NSLocalizedDescriptionKey: @"Disabling coloring: error calling the python script."}];
                 }
-                isColoringEnabled = NO;
                 successful = NO;
                 goto exit;
         }
         for (NSString * group in matches) {
-                NSArray * groupMatches = [matches objectForKey:group];
-                for (NSValue * range in groupMatches) {
-                        [textStorage addAttributeWithoutEditing:NSForegroundColorAttributeName
-                                                          value:[[PLThemeManager defaultThemeManager] getThemeProperty:PLThemeManagerForeground
-                                                                                                             fromGroup:group]
-                                                          range:[range rangeValue]];
+                for (NSValue * rangeValue in [matches objectForKey:group]) {
+                        range = [rangeValue rangeValue];
+                        range.location += characterRange.location;
+                        [pass addRange:range group:group];
                 }
         }
-        
+
+setStates:
+        for (line = 0; line < count; line++)
+                [pass setState:states[line] atEndOfLine:first + line];
+
 exit:
+        free(lineEnds);
+        free(states);
+        free(characters);
         return successful;
 }
 
+/**
+ * \brief Apply the colors and lexer states of a pass to its text storage.
+ *
+ * \details The style of each group is looked up once, and the colored ranges
+ *          are applied as style runs over the colored characters, which take
+ *          the default style between runs. The runs of the semantic overlay of
+ *          the text storage are then applied over them. The colored lines are
+ *          repaired in the lexer states of the text storage, and the metrics
+ *          of the pass are recorded. This method must be called on the main
+ *          thread, with a pass of the current generation of the text storage.
+ */
+-(void)applyPass:(PLSyntaxHighlightingPass *)pass toTextStorage:(PLTextStorage *)textStorage
+{
+        PLLexerStates * lexerStates = [textStorage lexerStates];
+        NSArray * groups = [pass groups];
+        const PLColoredRange * coloredRanges = [pass coloredRanges];
+        NSUInteger i, line, damagedLocation = [pass damagedLineRange].location, lastLine = [pass lastLine];
+        PLStyle * styles = malloc([groups count] * sizeof(PLStyle));
+        PLStyleRun * runs = malloc(MAX([pass numberOfColoredRanges], (NSUInteger)1) * sizeof(PLStyleRun));
+        PLSyntaxHighlightingMetrics * metrics = [pass metrics];
+        NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+        for (i = 0; i < [groups count]; i++)
+                styles[i] = [styleTable styleOfGroup:[groups objectAtIndex:i]];
+        for (i = 0; i < [pass numberOfColoredRanges]; i++) {
+                runs[i].range = coloredRanges[i].range;
+                runs[i].style = styles[coloredRanges[i].group];
+        }
+        [styleTable applyRuns:runs count:[pass numberOfColoredRanges] inRange:[pass coloredCharacterRange] toTextStorage:textStorage];
+        [[textStorage semanticOverlay] applyRunsInRange:[pass coloredCharacterRange] toTextStorage:textStorage styleTable:styleTable];
+        free(styles);
+        free(runs);
+
+        for (line = [pass firstLine]; line <= lastLine; line++)
+                [lexerStates setState:[pass stateAtEndOfLine:line] atEndOfLine:line];
+        if ([pass isEntryStateGuessed] && lastLine >= [pass firstLine])
+                [lexerStates damageLinesInRange:NSMakeRange([pass firstLine], lastLine - [pass firstLine] + 1)];
+        else if ([pass damagedLineRange].length > 0 && lastLine >= damagedLocation)
+                [lexerStates repairLinesInRange:NSMakeRange(damagedLocation, lastLine - damagedLocation + 1)];
+
+        /* a pass stopped at its last line to color leaves the following line to confirm */
+        if (lastLine >= [pass firstLine] && lastLine < [pass numberOfLines]
+            && ([pass stateAtEndOfLine:lastLine] != [pass previousStateAtEndOfLine:lastLine]
+                || [pass stateAtEndOfLine:lastLine] == PLLexerStateUnknown))
+                [lexerStates damageLinesInRange:NSMakeRange(lastLine + 1, 1)];
+
+        [metrics setApplyDuration:[NSDate timeIntervalSinceReferenceDate] - start];
+        [metrics setNumberOfLines:(lastLine >= [pass firstLine]) ? lastLine - [pass firstLine] + 1 : 0];
+        [metrics setNumberOfCharacters:[pass coloredCharacterRange].length];
+        [metrics setNumberOfRanges:[pass numberOfColoredRanges]];
+        [self recordMetrics:metrics ofTextStorage:textStorage];
+}
+
+/**
+ * \brief Keep the metrics of a pass applied to a text storage as the last
+ *        metrics and in the metrics log, and post a
+ *        PLSyntaxHighlighterDidMeasurePassNotification.
+ */
+-(void)recordMetrics:(PLSyntaxHighlightingMetrics *)metrics ofTextStorage:(PLTextStorage *)textStorage
+{
+        [lastMetrics release];
+        lastMetrics = [metrics retain];
+        if (metricsLogCapacity > 0) {
+                if ([metricsLog count] == metricsLogCapacity)
+                        [metricsLog removeObjectAtIndex:0];
+                [metricsLog addObject:metrics];
+        }
+        [[NSNotificationCenter defaultCenter] postNotificationName:PLSyntaxHighlighterDidMeasurePassNotification
+                                                            object:textStorage
+                                                          userInfo:@{PLSyntaxHighlighterMetricsKey: metrics}];
+}
+
+/**
+ * \brief Finish a pass colored on the coloring queue, on the main thread.
+ *
+ * \details A pass of the current generation of its text storage is applied in
+ *          a single batch, and the layout managers redraw the colored
+ *          characters once. A stale pass, whose text storage was edited while
+ *          it was colored, is dropped: the edited lines are still damaged, and
+ *          a new pass is started from the current text.
+ */
+-(void)finishPass:(PLSyntaxHighlightingPass *)pass
+    ofTextStorage:(PLTextStorage *)textStorage
+       successful:(BOOL)successful
+            error:(NSError *)error
+{
+        NSUInteger index;
+        BOOL needsPass = NO;
+        [textStorage retain];
+        index = [coloringTextStorages indexOfObjectIdenticalTo:textStorage];
+        [coloringTextStorages removeObjectAtIndex:index];
+        [coloringPasses removeObjectAtIndex:index];
+        index = [pendingTextStorages indexOfObjectIdenticalTo:textStorage];
+        if (index != NSNotFound) {
+                [pendingTextStorages removeObjectAtIndex:index];
+                needsPass = YES;
+        }
+
+        if ([textStorage generation] != [pass generation] || [pass isCancelled]) {
+                if ([pass isCancelled])
+                        numberOfCancelledPasses++;
+                needsPass = YES;
+        } else if (successful) {
+                [self applyPass:pass toTextStorage:textStorage];
+                for (NSLayoutManager * layoutManager in [textStorage layoutManagers])
+                        [layoutManager invalidateDisplayForCharacterRange:[pass coloredCharacterRange]];
+                [self postDidColorNotificationForTextStorage:textStorage error:nil];
+        } else {
+                isColoringEnabled = NO;
+                needsPass = NO;
+                [self postDidColorNotificationForTextStorage:textStorage error:error];
+        }
+
+        if (needsPass)
+                [self colorTextStorageInBackground:textStorage];
+        [textStorage release];
+}
+
+/**
+ * \brief Post a PLSyntaxHighlighterDidColorNotification for a text storage.
+ *
+ * \param error The error that disabled coloring, or nil.
+ */
+-(void)postDidColorNotificationForTextStorage:(PLTextStorage *)textStorage error:(NSError *)error
+{
+        [[NSNotificationCenter defaultCenter] postNotificationName:PLSyntaxHighlighterDidColorNotification
+                                                            object:textStorage
+                                                          userInfo:(error) ? @{PLSyntaxHighlighterErrorKey: error} : nil];
+}
+
+/**
+ * \brief Return whether the module of a Python script defines a function.
+ */
+-(BOOL)pythonScript:(NSString *)scriptName implementsFunction:(const char *)functionName
+{
+        BOOL implementsFunction;
+        PyGILState_STATE gilState = PyGILState_Ensure();
+        implementsFunction = PyObject_HasAttrString([self moduleOfPythonScript:scriptName], functionName) != 0;
+        PyGILState_Release(gilState);
+        return implementsFunction;
+}
+
+/**
+ * \brief Define the should_cancel() function in the module of a Python script.
+ *
+ * \details The function returns whether the pass being colored by the calling
+ *          thread was cancelled, so that a script can return early from a
+ *          long call. It replaces the default function defined by the script,
+ *          if any. The GIL must be held.
+ */
+-(void)addCancelFunctionToModule:(PyObject *)module
+{
+        PyObject * function = PyCFunction_New(&shouldCancelDefinition, NULL);
+        if (function == NULL || PyObject_SetAttrString(module, PYTHON_CANCEL_FUNCTION, function) < 0)
+                PyErr_Clear();
+        Py_XDECREF(function);
+}
+
+/**
+ * \brief Return the imported module of a Python script.
+ */
+-(PyObject *)moduleOfPythonScript:(NSString *)scriptName
+{
+        PyObject * module;
+        @synchronized(importedModules) {
+                module = [[importedModules objectForKey:scriptName] pointerValue];
+        }
+        return module;
+}
+
+/**
+ * \brief Apply syntax coloring to the whole text of a text storage object
+ *        with the native Python tokenizer.
+ *
+ * \details This method is used for text storage objects that do not keep
+ *          lexer states. The style of a token is its group plus one in the
+ *          style table.
+ */
+-(void)colorAllOfTextStorageWithPythonTokenizer:(NSTextStorage *)textStorage
+{
+        const PLPythonToken * tokens;
+        PLStyleRun * runs;
+        NSUInteger i;
+        unichar * characters = malloc(MAX([textStorage length], (NSUInteger)1) * sizeof(unichar));
+        [[textStorage string] getCharacters:characters range:NSMakeRange(0, [textStorage length])];
+        [pythonTokenizer tokenizeCharacters:characters
+                                     length:[textStorage length]
+                                 lexerState:PLLexerStateDefault
+                                   lineEnds:NULL
+                                lexerStates:NULL
+                                      count:0];
+        free(characters);
+        
+        tokens = [pythonTokenizer tokens];
+        runs = malloc(MAX([pythonTokenizer numberOfTokens], (NSUInteger)1) * sizeof(PLStyleRun));
+        for (i = 0; i < [pythonTokenizer numberOfTokens]; i++) {
+                runs[i].range = tokens[i].range;
+                runs[i].style = (PLStyle)(tokens[i].group + 1);
+        }
+        [styleTable applyRuns:runs
+                        count:[pythonTokenizer numberOfTokens]
+                      inRange:NSMakeRange(0, [textStorage length])
+                toTextStorage:(PLTextStorage *)textStorage];
+        free(runs);
+}
+
+/**
+ * \brief Color the ranges of each group of matches returned by a Python
+ *        script, and the rest of the text with the default style.
+ *
+ * \param matches The ranges of each group, as returned by
+ *                rangesFromPythonScript:withSource:error:.
+ *
+ * \param textStorage The text storage object in which to apply syntax coloring.
+ */
+-(void)applyMatches:(NSDictionary *)matches toTextStorage:(NSTextStorage *)textStorage
+{
+        NSUInteger count = 0, capacity = 256;
+        PLStyleRun * runs = malloc(capacity * sizeof(PLStyleRun));
+        PLStyle style;
+        for (NSString * group in matches) {
+                style = [styleTable styleOfGroup:group];
+                for (NSValue * rangeValue in [matches objectForKey:group]) {
+                        if (count == capacity) {
+                                capacity *= 2;
+                                runs = realloc(runs, capacity * sizeof(PLStyleRun));
+                        }
+                        runs[count].range = [rangeValue rangeValue];
+                        runs[count].style = style;
+                        count++;
+                }
+        }
+        [styleTable applyRuns:runs count:count inRange:NSMakeRange(0, [textStorage length]) toTextStorage:(PLTextStorage *)textStorage];
+        free(runs);
+}
+
 /**
  * \brief Get the ranges in which to apply syntax coloring by running a Python
  *        script.
  *
  * \details This function calls the get_coloring_dict() function in a Python
- *          module, passing in a single input argument: a C string of the text
- *          source that will be colored.
+ *          module, passing in a single input argument: a string of the UTF-8
+ *          bytes of the source buffer. The ranges returned are offsets in the
+ *          decoded text, and are mapped to character ranges. The GIL is held
+ *          during the call, so that it can be made from any thread.
  *
  * \param scriptName The name of the file to import without an extension.
  *
- * \param source The source code to apply syntax coloring.
+ * \param source The source buffer of the text to apply syntax coloring.
  *
  * \param error On input, a pointer to a pointer for an error object. If an
  *              error occurs while getting the match ranges, this parameter
@@ -175,23 +1346,20 @@ exit:
  *         structs specifying the range to color. Returns nil if an error
  *         occurred.
  */
--(NSDictionary *)rangesFromPythonScript:(NSString *)scriptName withSource:(const char *)source error:(NSError **)error
+-(NSDictionary *)rangesFromPythonScript:(NSString *)scriptName withSource:(PLSourceBuffer *)source error:(NSError **)error
 {
         NSDictionary * matches = nil;
         NSString * errorMessage = @"Disabling coloring: error getting coloring ranges from source.";
-        NSError * matchError = nil;
-        PyObject * pyOutput = NULL;
-        
-        __block NSArray * groupMatches = nil;
-        __block NSArray * rangeArray = nil;
-        __block NSError * groupMatchError = nil;
-        __block NSError * rangeError = nil;
-        __block NSString * matchErrorMessage = nil;
-        __block NSString * groupMatchErrorMessage = nil;
-        __block NSString * rangeErrorMessage = nil;
+        PyObject * pyText = NULL, * pyOutput = NULL;
+        NSTimeInterval start;
+        PyGILState_STATE gilState = PyGILState_Ensure();
         
-        pyOutput = PyObject_CallMethod([[importedModules objectForKey:scriptName] pointerValue], (char *)PYTHON_METHOD, "s", source);
+        pyText = PyString_FromStringAndSize([source bytes], [source length]);
+        start = [NSDate timeIntervalSinceReferenceDate];
+        pyOutput = PyObject_CallMethod([self moduleOfPythonScript:scriptName], (char *)PYTHON_METHOD, "O", pyText);
+        [[currentPass metrics] addEngineCallWithBytes:[source length] duration:[NSDate timeIntervalSinceReferenceDate] - start];
         if (pyOutput == NULL) {
+                PyErr_Clear();
                 if (error) {
                         *error = [NSError errorWithDomain:PLLiasisKitErrorDomain
                                                      code:PLErrorCodeLog
@@ -201,7 +1369,49 @@ exit:
                 goto exit;
         }
         
-        matches = [NSDictionary dictionaryByEnumeratingPythonDict:pyOutput error:&matchError withBlock:^PLDictionaryItem *(PyObject *key, PyObject *value) {
+        start = [NSDate timeIntervalSinceReferenceDate];
+        matches = [self matchesFromPythonDict:pyOutput source:source error:error];
+        [[currentPass metrics] addConversionDuration:[NSDate timeIntervalSinceReferenceDate] - start];
+        
+exit:
+        Py_XDECREF(pyText);
+        Py_XDECREF(pyOutput);
+        PyGILState_Release(gilState);
+        return matches;
+}
+
+/**
+ * \brief Convert the dict of ranges returned by a Python script.
+ *
+ * \param pyDict A Python dict mapping group names to a list of (start position,
+ *               length of range) tuples.
+ *
+ * \param source The source buffer passed to the script, mapping the ranges
+ *               of the decoded text to character ranges.
+ *
+ * \param error On input, a pointer to a pointer for an error object. If an
+ *              error occurs while converting the ranges, this parameter
+ *              contains an error object on output unless it was NULL on input.
+ *
+ * \return An NSDictionary where keys are NSString objects of the groups to
+ *         color that map to an NSArray of NSRange structs specifying the range
+ *         to color. Returns nil if an error occurred.
+ */
+-(NSDictionary *)matchesFromPythonDict:(PyObject *)pyDict source:(PLSourceBuffer *)source error:(NSError **)error
+{
+        NSDictionary * matches = nil;
+        NSString * errorMessage = @"Disabling coloring: error getting coloring ranges from source.";
+        NSError * matchError = nil;
+        
+        __block NSArray * groupMatches = nil;
+        __block NSArray * rangeArray = nil;
+        __block NSError * groupMatchError = nil;
+        __block NSError * rangeError = nil;
+        __block NSString * matchErrorMessage = nil;
+        __block NSString * groupMatchErrorMessage = nil;
+        __block NSString * rangeErrorMessage = nil;
+        
+        matches = [NSDictionary dictionaryByEnumeratingPythonDict:pyDict error:&matchError withBlock:^PLDictionaryItem *(PyObject *key, PyObject *value) {
                 NSString * groupKey = nil;
                 char * groupString = NULL;
                 
@@ -228,8 +1438,8 @@ exit:
                                 groupMatchErrorMessage = @"Error converting range for group match.";
                                 return nil;
                         }
-                        return [NSValue valueWithRange:NSMakeRange([[rangeArray objectAtIndex:0] longValue],
-                                                                   [[rangeArray objectAtIndex:1] longValue])];
+                        return [NSValue valueWithRange:characterRangeOfUnicodeRange(source, NSMakeRange([[rangeArray objectAtIndex:0] longValue],
+                                                                                                         [[rangeArray objectAtIndex:1] longValue]))];
                 }];
                 
                 if (groupMatches == nil)
@@ -256,8 +1466,290 @@ exit:
         }
         
 exit:
+        return matches;
+}
+
+/**
+ * \brief Get the ranges in which to apply syntax coloring in a span of lines,
+ *        and the lexer state at the end of each line, by running a Python
+ *        script.
+ *
+ * \details This function calls the get_line_coloring() function in a Python
+ *          module, passing in a string of the UTF-8 bytes of the lines, the
+ *          lexer state at the start of the lines and a list with the offset of
+ *          the end of each line in the decoded text. The GIL is held during
+ *          the call.
+ *
+ * \param scriptName The name of the file to import without an extension.
+ *
+ * \param source The source buffer of the lines to apply syntax coloring.
+ *
+ * \param state The lexer state at the start of the source.
+ *
+ * \param lineEnds A C array with the character offset of the end of each line
+ *                 in the source.
+ *
+ * \param states A C array set to the lexer state at the end of each line.
+ *
+ * \param count The number of lines.
+ *
+ * \param error On input, a pointer to a pointer for an error object. If an
+ *              error occurs while getting the match ranges, this parameter
+ *              contains an error object on output unless it was NULL on input.
+ *
+ * \return The ranges to color, relative to the start of the source, as
+ *         returned by rangesFromPythonScript:withSource:error:. Returns nil if
+ *         an error occurred.
+ */
+-(NSDictionary *)rangesFromPythonScript:(NSString *)scriptName
+                             withSource:(PLSourceBuffer *)source
+                             lexerState:(PLLexerState)state
+                               lineEnds:(const NSUInteger *)lineEnds
+                            lexerStates:(PLLexerState *)states
+                                  count:(NSUInteger)count
+                                  error:(NSError **)error
+{
+        NSDictionary * matches = nil;
+        NSString * errorMessage = @"Disabling coloring: error getting coloring ranges from source.";
+        PyObject * pyText = NULL, * pyLineEnds = NULL, * pyOutput = NULL;
+        NSUInteger i;
+        NSTimeInterval start;
+        PyGILState_STATE gilState = PyGILState_Ensure();
+        
+        pyText = PyString_FromStringAndSize([source bytes], [source length]);
+        pyLineEnds = PyList_New(count);
+        for (i = 0; i < count; i++)
+                PyList_SET_ITEM(pyLineEnds, i, PyInt_FromSize_t(unicodeOffsetOfCharacterOffset(source, lineEnds[i])));
+        start = [NSDate timeIntervalSinceReferenceDate];
+        pyOutput = PyObject_CallMethod([self moduleOfPythonScript:scriptName],
+                                       (char *)PYTHON_LINE_METHOD, "OiO", pyText, (int)state, pyLineEnds);
+        [[currentPass metrics] addEngineCallWithBytes:[source length] duration:[NSDate timeIntervalSinceReferenceDate] - start];
+        if (pyOutput == NULL || PyTuple_Check(pyOutput) == 0 || PyTuple_Size(pyOutput) != 2) {
+                PyErr_Clear();
+                if (error) {
+                        *error = [NSError errorWithDomain:PLLiasisKitErrorDomain
+                                                     code:PLErrorCodeLog
+                                                 userInfo:@{NSLocalizedDescriptionKey: errorMessage,
+                                                            NSLocalizedFailureReasonErrorKey: [NSString stringWithFormat:@"Could not call '%s' function in '%@' module.", PYTHON_LINE_METHOD, scriptName]}];
+                }
+                goto exit;
+        }
+        
+        start = [NSDate timeIntervalSinceReferenceDate];
+        if ([self getLexerStates:states count:count fromPythonSequence:PyTuple_GetItem(pyOutput, 1) error:error] == NO)
+                goto exit;
+        matches = [self matchesFromPythonDict:PyTuple_GetItem(pyOutput, 0) source:source error:error];
+        [[currentPass metrics] addConversionDuration:[NSDate timeIntervalSinceReferenceDate] - start];
+        
+exit:
+        Py_XDECREF(pyText);
+        Py_XDECREF(pyLineEnds);
         Py_XDECREF(pyOutput);
+        PyGILState_Release(gilState);
         return matches;
 }
 
+/**
+ * \brief Convert the lexer states returned by a Python script.
+ *
+ * \details The GIL must be held.
+ *
+ * \param states A C array set to the lexer state at the end of each line.
+ *
+ * \param count The number of lines.
+ *
+ * \param pyStates A Python sequence of integer lexer states.
+ *
+ * \param error On input, a pointer to a pointer for an error object. If the
+ *              states are not a sequence of count states, this parameter
+ *              contains an error object on output unless it was NULL on input.
+ */
+-(BOOL)getLexerStates:(PLLexerState *)states count:(NSUInteger)count fromPythonSequence:(PyObject *)pyStates error:(NSError **)error
+{
+        BOOL successful = NO;
+        NSString * errorMessage = @"Disabling coloring: error getting coloring ranges from source.";
+        NSUInteger i;
+        long lineState;
+        if (PySequence_Check(pyStates) == 0 || PySequence_Size(pyStates) != (Py_ssize_t)count) {
+                if (error) {
+                        *error = [NSError errorWithDomain:PLLiasisKitErrorDomain
+                                                     code:PLErrorCodeLog
+                                                 userInfo:@{NSLocalizedDescriptionKey: errorMessage,
+                                                            NSLocalizedFailureReasonErrorKey: @"The lexer states do not match the lines."}];
+                }
+                goto exit;
+        }
+        for (i = 0; i < count; i++) {
+                PyObject * pyState = PySequence_GetItem(pyStates, i);
+                lineState = PyLong_AsLong(pyState);
+                Py_XDECREF(pyState);
+                if (PyErr_Occurred() || lineState < 0 || lineState >= PLLexerStateUnknown) {
+                        PyErr_Clear();
+                        if (error) {
+                                *error = [NSError errorWithDomain:PLLiasisKitErrorDomain
+                                                             code:PLErrorCodeLog
+                                                         userInfo:@{NSLocalizedDescriptionKey: errorMessage,
+                                                                    NSLocalizedFailureReasonErrorKey: @"Could not get lexer state from states list."}];
+                        }
+                        goto exit;
+                }
+                states[i] = (PLLexerState)lineState;
+        }
+        successful = YES;
+exit:
+        return successful;
+}
+
+/**
+ * \brief Add the ranges in which to apply syntax coloring to a pass, by running
+ *        the buffer functions of a Python script.
+ *
+ * \details This function calls get_coloring_buffer(text) in a Python module,
+ *          or get_line_coloring_buffer(text, state, line_ends) if lineEnds is
+ *          not NULL. The script returns the list of group names and a buffer of
+ *          (group index, start, length) triples of 32 bit integers, such as an
+ *          array('i'), followed by the list of lexer states for the line
+ *          function. The text is passed as a read-only Python buffer sharing
+ *          the UTF-8 bytes of the source buffer, and line ends and ranges are
+ *          mapped between byte and character offsets. The ranges are read in
+ *          place, and the group names are resolved once per call, so that no
+ *          object is created per range. The GIL is held during the call.
+ *
+ * \param scriptName The name of the file to import without an extension.
+ *
+ * \param pass The pass to which the ranges are added.
+ *
+ * \param source The source buffer of the text to apply syntax coloring.
+ *
+ * \param offset The character index of the text storage at which the source
+ *               starts.
+ *
+ * \param state The lexer state at the start of the source.
+ *
+ * \param lineEnds A C array with the character offset of the end of each line
+ *                 in the source, or NULL to color the source as a whole.
+ *
+ * \param states A C array set to the lexer state at the end of each line.
+ *
+ * \param count The number of lines.
+ *
+ * \param error On input, a pointer to a pointer for an error object. If an
+ *              error occurs while getting the ranges, this parameter contains
+ *              an error object on output unless it was NULL on input.
+ */
+-(BOOL)addRangesFromPythonScript:(NSString *)scriptName
+                          toPass:(PLSyntaxHighlightingPass *)pass
+                      withSource:(PLSourceBuffer *)source
+                          offset:(NSUInteger)offset
+                      lexerState:(PLLexerState)state
+                        lineEnds:(const NSUInteger *)lineEnds
+                     lexerStates:(PLLexerState *)states
+                           count:(NSUInteger)count
+                           error:(NSError **)error
+{
+        BOOL successful = NO;
+        NSString * errorMessage = @"Disabling coloring: error getting coloring ranges from source.";
+        NSString * failureReason = nil;
+        const char * functionName = (lineEnds) ? PYTHON_LINE_BUFFER_METHOD : PYTHON_BUFFER_METHOD;
+        PyObject * pyText = NULL, * pyLineEnds = NULL, * pyOutput = NULL, * pyGroups, * pyBuffer;
+        NSUInteger i, numberOfGroups = 0, * groupIndexes = NULL;
+        Py_ssize_t outputSize = (lineEnds) ? 3 : 2, length = 0;
+        const char * bytes = NULL, * groupName;
+        Py_buffer view;
+        BOOL hasView = NO;
+        int32_t triple[3];
+        NSRange range;
+        NSTimeInterval start;
+        PyGILState_STATE gilState = PyGILState_Ensure();
+
+        pyText = PyBuffer_FromMemory((void *)[source bytes], [source length]);
+        start = [NSDate timeIntervalSinceReferenceDate];
+        if (lineEnds) {
+                pyLineEnds = PyList_New(count);
+                for (i = 0; i < count; i++)
+                        PyList_SET_ITEM(pyLineEnds, i, PyInt_FromSize_t([source byteOffsetOfCharacterOffset:lineEnds[i]]));
+                pyOutput = PyObject_CallMethod([self moduleOfPythonScript:scriptName],
+                                               (char *)functionName, "OiO", pyText, (int)state, pyLineEnds);
+        } else {
+                pyOutput = PyObject_CallMethod([self moduleOfPythonScript:scriptName], (char *)functionName, "O", pyText);
+        }
+        [[pass metrics] addEngineCallWithBytes:[source length] duration:[NSDate timeIntervalSinceReferenceDate] - start];
+        start = [NSDate timeIntervalSinceReferenceDate];
+        if (pyOutput == NULL || PyTuple_Check(pyOutput) == 0 || PyTuple_Size(pyOutput) != outputSize) {
+                failureReason = [NSString stringWithFormat:@"Could not call '%s' function in '%@' module.", functionName, scriptName];
+                goto exit;
+        }
+
+        /* resolve the group names once */
+        pyGroups = PyTuple_GetItem(pyOutput, 0);
+        if (PySequence_Check(pyGroups) == 0) {
+                failureReason = @"The group names are not a sequence.";
+                goto exit;
+        }
+        numberOfGroups = PySequence_Size(pyGroups);
+        groupIndexes = malloc(MAX(numberOfGroups, (NSUInteger)1) * sizeof(NSUInteger));
+        for (i = 0; i < numberOfGroups; i++) {
+                PyObject * pyGroup = PySequence_GetItem(pyGroups, i);
+                groupName = (pyGroup) ? PyString_AsString(pyGroup) : NULL;
+                if (groupName)
+                        groupIndexes[i] = [pass indexOfGroup:[NSString stringWithUTF8String:groupName]];
+                Py_XDECREF(pyGroup);
+                if (groupName == NULL) {
+                        failureReason = @"Could not get group string from group names.";
+                        goto exit;
+                }
+        }
+
+        /* read the triples in place */
+        pyBuffer = PyTuple_GetItem(pyOutput, 1);
+        if (PyObject_CheckBuffer(pyBuffer)) {
+                if (PyObject_GetBuffer(pyBuffer, &view, PyBUF_SIMPLE) == 0) {
+                        hasView = YES;
+                        bytes = view.buf;
+                        length = view.len;
+                }
+        } else if (PyObject_AsReadBuffer(pyBuffer, (const void **)&bytes, &length) != 0) {
+                bytes = NULL;
+        }
+        if (bytes == NULL || length % sizeof(triple) != 0) {
+                failureReason = @"The ranges are not a buffer of 32 bit integer triples.";
+                goto exit;
+        }
+        for (i = 0; i < (NSUInteger)length / sizeof(triple); i++) {
+                memcpy(triple, bytes + i * sizeof(triple), sizeof(triple));
+                if (triple[0] < 0 || (NSUInteger)triple[0] >= numberOfGroups || triple[1] < 0 || triple[2] < 0
+                    || (NSUInteger)triple[1] + triple[2] > [source length]) {
+                        failureReason = @"A range of the buffer is invalid.";
+                        goto exit;
+                }
+                range = [source characterRangeOfByteRange:NSMakeRange(triple[1], triple[2])];
+                range.location += offset;
+                [pass addRange:range groupIndex:groupIndexes[triple[0]]];
+        }
+
+        if (lineEnds && [self getLexerStates:states count:count fromPythonSequence:PyTuple_GetItem(pyOutput, 2) error:error] == NO)
+                goto exit;
+        [[pass metrics] addConversionDuration:[NSDate timeIntervalSinceReferenceDate] - start];
+        successful = YES;
+
+exit:
+        if (failureReason) {
+                PyErr_Clear();
+                if (error) {
+                        *error = [NSError errorWithDomain:PLLiasisKitErrorDomain
+                                                     code:PLErrorCodeLog
+                                                 userInfo:@{NSLocalizedDescriptionKey: errorMessage,
+                                                            NSLocalizedFailureReasonErrorKey: failureReason}];
+                }
+        }
+        if (hasView)
+                PyBuffer_Release(&view);
+        free(groupIndexes);
+        Py_XDECREF(pyText);
+        Py_XDECREF(pyLineEnds);
+        Py_XDECREF(pyOutput);
+        PyGILState_Release(gilState);
+        return successful;
+}
+
 @end
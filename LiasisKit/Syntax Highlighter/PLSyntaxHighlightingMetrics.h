@@ -0,0 +1,207 @@
+/**
+ * \file PLSyntaxHighlightingMetrics.h
+ * \brief Liasis Python IDE syntax highlighting metrics interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for an object
+ * recording the sizes and durations of a syntax highlighting pass, from the
+ * calls to the coloring engine to the attributes applied to the text storage.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ * \class PLSyntaxHighlightingMetrics \headerfile \headerfile
+ * \brief The sizes and durations of a syntax highlighting pass.
+ *
+ * \details Each PLSyntaxHighlightingPass records its metrics while it is
+ *          colored and applied. The durations are wall clock times in seconds:
+ *          the time in the engine is spent in the Python script, or in the
+ *          PLPythonTokenizer for the native engine, and the time converting
+ *          its results is spent turning the returned ranges into the colored
+ *          ranges of the pass. The metrics are only written by the thread
+ *          coloring or applying the pass.
+ */
+@interface PLSyntaxHighlightingMetrics : NSObject {
+        /**
+         * \brief The name of the engine.
+         */
+        NSString * engineName;
+
+        /**
+         * \brief The edit generation of the text storage colored.
+         */
+        NSUInteger generation;
+
+        /**
+         * \brief The number of characters of the text storage.
+         */
+        NSUInteger sourceLength;
+
+        /**
+         * \brief The number of lines colored.
+         */
+        NSUInteger numberOfLines;
+
+        /**
+         * \brief The number of characters colored.
+         */
+        NSUInteger numberOfCharacters;
+
+        /**
+         * \brief The number of colored ranges.
+         */
+        NSUInteger numberOfRanges;
+
+        /**
+         * \brief The number of lines colored from the token cache.
+         */
+        NSUInteger numberOfCachedLines;
+
+        /**
+         * \brief The number of calls to the engine.
+         */
+        NSUInteger numberOfEngineCalls;
+
+        /**
+         * \brief The number of bytes passed to the Python script.
+         */
+        NSUInteger numberOfBytesSent;
+
+        /**
+         * \brief The time spent in the engine.
+         */
+        NSTimeInterval engineDuration;
+
+        /**
+         * \brief The time spent converting the results of the engine.
+         */
+        NSTimeInterval conversionDuration;
+
+        /**
+         * \brief The time spent applying the attributes to the text storage.
+         */
+        NSTimeInterval applyDuration;
+
+        /**
+         * \brief The time spent coloring the pass, excluding applying it.
+         */
+        NSTimeInterval coloringDuration;
+}
+
+/**
+ * \brief The name of the engine: the name of the Python script, or
+ *        PLPythonTokenizer for the native engine.
+ */
+@property (nonatomic, copy) NSString * engineName;
+
+/**
+ * \brief The edit generation of the text storage colored by the pass.
+ */
+@property (nonatomic) NSUInteger generation;
+
+/**
+ * \brief The number of characters of the text storage colored by the pass.
+ */
+@property (nonatomic) NSUInteger sourceLength;
+
+/**
+ * \brief The number of lines colored, or zero when the text was colored as a
+ *        whole.
+ */
+@property (nonatomic) NSUInteger numberOfLines;
+
+/**
+ * \brief The number of characters colored.
+ */
+@property (nonatomic) NSUInteger numberOfCharacters;
+
+/**
+ * \brief The number of colored ranges applied.
+ */
+@property (nonatomic) NSUInteger numberOfRanges;
+
+/**
+ * \brief The number of lines colored from the token cache rather than by the
+ *        engine.
+ */
+@property (readonly) NSUInteger numberOfCachedLines;
+
+/**
+ * \brief The number of calls to the engine.
+ */
+@property (readonly) NSUInteger numberOfEngineCalls;
+
+/**
+ * \brief The number of UTF-8 bytes passed to the Python script, zero for the
+ *        native engine.
+ */
+@property (readonly) NSUInteger numberOfBytesSent;
+
+/**
+ * \brief The time spent in the engine.
+ */
+@property (readonly) NSTimeInterval engineDuration;
+
+/**
+ * \brief The time spent converting the results of the engine into colored
+ *        ranges.
+ */
+@property (readonly) NSTimeInterval conversionDuration;
+
+/**
+ * \brief The time spent applying the styles of the colored ranges and of the
+ *        semantic overlay to the text storage.
+ */
+@property (nonatomic) NSTimeInterval applyDuration;
+
+/**
+ * \brief The time spent coloring the pass, including the token cache, the
+ *        engine and the conversion of its results, but not applying it.
+ */
+@property (nonatomic) NSTimeInterval coloringDuration;
+
+/**
+ * \brief Record a call to the engine.
+ *
+ * \param numberOfBytes The number of bytes passed to the Python script, or
+ *                      zero.
+ *
+ * \param duration The time spent in the engine.
+ */
+-(void)addEngineCallWithBytes:(NSUInteger)numberOfBytes duration:(NSTimeInterval)duration;
+
+/**
+ * \brief Record the time spent converting the results of a call to the
+ *        engine.
+ */
+-(void)addConversionDuration:(NSTimeInterval)duration;
+
+/**
+ * \brief Record lines colored from the token cache.
+ */
+-(void)addCachedLines:(NSUInteger)count;
+
+@end
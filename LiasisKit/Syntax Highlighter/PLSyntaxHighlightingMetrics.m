@@ -0,0 +1,96 @@
+/**
+ * \file PLSyntaxHighlightingMetrics.m
+ * \brief Liasis Python IDE syntax highlighting metrics implementation file.
+ *
+ * \details
+ * This file contains the method implementation for an object recording the
+ * sizes and durations of a syntax highlighting pass, from the calls to the
+ * coloring engine to the attributes applied to the text storage.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLSyntaxHighlightingMetrics.h"
+
+@implementation PLSyntaxHighlightingMetrics
+
+-(void)dealloc
+{
+        [engineName release];
+        [super dealloc];
+}
+
+@synthesize engineName;
+
+@synthesize generation;
+
+@synthesize sourceLength;
+
+@synthesize numberOfLines;
+
+@synthesize numberOfCharacters;
+
+@synthesize numberOfRanges;
+
+@synthesize numberOfCachedLines;
+
+@synthesize numberOfEngineCalls;
+
+@synthesize numberOfBytesSent;
+
+@synthesize engineDuration;
+
+@synthesize conversionDuration;
+
+@synthesize applyDuration;
+
+@synthesize coloringDuration;
+
+-(void)addEngineCallWithBytes:(NSUInteger)numberOfBytes duration:(NSTimeInterval)duration
+{
+        numberOfEngineCalls++;
+        numberOfBytesSent += numberOfBytes;
+        engineDuration += duration;
+}
+
+-(void)addConversionDuration:(NSTimeInterval)duration
+{
+        conversionDuration += duration;
+}
+
+-(void)addCachedLines:(NSUInteger)count
+{
+        numberOfCachedLines += count;
+}
+
+-(NSString *)description
+{
+        return [NSString stringWithFormat:@"%@ generation %lu: %lu of %lu characters, %lu lines (%lu cached), %lu ranges, "
+                                          @"%lu calls sending %lu bytes; engine %.3f ms, conversion %.3f ms, coloring %.3f ms, apply %.3f ms",
+                engineName, (unsigned long)generation, (unsigned long)numberOfCharacters, (unsigned long)sourceLength,
+                (unsigned long)numberOfLines, (unsigned long)numberOfCachedLines, (unsigned long)numberOfRanges,
+                (unsigned long)numberOfEngineCalls, (unsigned long)numberOfBytesSent, 1000.0 * engineDuration,
+                1000.0 * conversionDuration, 1000.0 * coloringDuration, 1000.0 * applyDuration];
+}
+
+@end
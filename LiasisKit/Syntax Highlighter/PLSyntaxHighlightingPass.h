@@ -0,0 +1,391 @@
+/**
+ * \file PLSyntaxHighlightingPass.h
+ * \brief Liasis Python IDE syntax highlighting pass interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for an object
+ * holding a snapshot of the lines of a text storage to color, and the ranges
+ * and lexer states found by coloring them.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#import "PLTextStorage.h"
+#import "PLPythonTokenizer.h"
+#import "PLSyntaxHighlightingMetrics.h"
+
+/**
+ * \brief A range of characters to color with the color of a group.
+ */
+typedef struct {
+        NSRange range;
+        NSUInteger group;
+} PLColoredRange;
+
+/**
+ * \class PLSyntaxHighlightingPass \headerfile \headerfile
+ * \brief A snapshot of the damaged lines of a PLTextStorage, and the result of
+ *        coloring them.
+ *
+ * \details A pass is created on the main thread from a text storage, and
+ *          copies everything needed to color its damaged lines: the string,
+ *          the edit generation, the damaged line range, the lexer state
+ *          preceding the first line, and the lexer states and line ends of the
+ *          following lines, taken from the PLLineIndex of the text storage so
+ *          that the string is never scanned for line terminators. The pass can then be colored on any thread without touching
+ *          the text storage, by taking consecutive lines with
+ *          nextLines:lineEnds: and adding the ranges and lexer states found.
+ *          The result is applied on the main thread if the generation of the
+ *          text storage still matches.
+ *
+ *          Line numbers start at 1, as in the PLLineIndex.
+ */
+@interface PLSyntaxHighlightingPass : NSObject {
+        /**
+         * \brief The text storage string, or a snapshot of it.
+         */
+        NSString * source;
+
+        /**
+         * \brief The edit generation of the text storage when the pass was
+         *        created.
+         */
+        NSUInteger generation;
+
+        /**
+         * \brief The damaged line range of the text storage when the pass was
+         *        created.
+         */
+        NSRange damagedLineRange;
+
+        /**
+         * \brief The first line to color, the last line preceding the damaged
+         *        lines with a known lexer state.
+         */
+        NSUInteger firstLine;
+
+        /**
+         * \brief The last line colored, or firstLine - 1 if none.
+         */
+        NSUInteger lastLine;
+
+        /**
+         * \brief The number of lines of the text storage.
+         */
+        NSUInteger numberOfLines;
+
+        /**
+         * \brief The lexer state at the end of the line preceding firstLine.
+         */
+        PLLexerState entryState;
+
+        /**
+         * \brief Whether the entry state is a guess, because the line
+         *        preceding firstLine is damaged.
+         */
+        BOOL isEntryStateGuessed;
+
+        /**
+         * \brief The last line the pass may color.
+         */
+        NSUInteger lastLineToColor;
+
+        /**
+         * \brief A C array with the lexer states of the lines from firstLine to
+         *        lastLineToColor, as stored by the previous pass.
+         */
+        PLLexerState * previousStates;
+
+        /**
+         * \brief A C array with the lexer states of the lines from firstLine to
+         *        lastLine, as found by this pass.
+         */
+        PLLexerState * states;
+
+        /**
+         * \brief A C array with the character index of the start of the lines
+         *        from firstLine to lastLineToColor, followed by the end of
+         *        lastLineToColor.
+         */
+        NSUInteger * lineStarts;
+
+        /**
+         * \brief The character index of the start of the line following
+         *        lastLine.
+         */
+        NSUInteger nextCharacterIndex;
+
+        /**
+         * \brief The range of characters colored.
+         */
+        NSRange coloredCharacterRange;
+
+        /**
+         * \brief The names of the groups of the colored ranges.
+         */
+        NSMutableArray * groups;
+
+        /**
+         * \brief A C array with the colored ranges.
+         */
+        PLColoredRange * coloredRanges;
+
+        /**
+         * \brief The number of colored ranges.
+         */
+        NSUInteger numberOfColoredRanges;
+
+        /**
+         * \brief The number of ranges the coloredRanges array can hold.
+         */
+        NSUInteger capacity;
+
+        /**
+         * \brief Whether the pass was cancelled.
+         */
+        BOOL isCancelled;
+
+        /**
+         * \brief The metrics of the pass.
+         */
+        PLSyntaxHighlightingMetrics * metrics;
+}
+
+/**
+ * \brief Initialize a pass with the damaged lines of a text storage.
+ *
+ * \details This method must be called on the thread editing the text storage.
+ *          The first groups of the pass are those of the PLPythonTokenizer, in
+ *          the order of PLPythonTokenGroup.
+ *
+ * \param textStorage The text storage to color.
+ *
+ * \param copySource Whether to take a PLTextSnapshot of the text storage
+ *                   string, so that the pass can be colored on another thread
+ *                   while the text storage is edited.
+ */
+-(id)initWithTextStorage:(PLTextStorage *)textStorage copySource:(BOOL)copySource;
+
+/**
+ * \brief Initialize a pass with the damaged lines of a text storage within a
+ *        range of lines, such as the lines visible in a text view.
+ *
+ * \details If the damaged lines start within or after the line range, the pass
+ *          starts with them as a pass of the whole text does. Otherwise the
+ *          lines preceding the range are still damaged, and the pass starts at
+ *          the first line of the range with a guessed entry state: the state
+ *          stored at the end of the preceding line, or the default state if it
+ *          is unknown. The pass never colors past the last line of the range.
+ *
+ * \param textStorage The text storage to color.
+ *
+ * \param lineRange The range of line numbers the pass may color.
+ *
+ * \param copySource Whether to take a snapshot of the text storage string.
+ */
+-(id)initWithTextStorage:(PLTextStorage *)textStorage lineRange:(NSRange)lineRange copySource:(BOOL)copySource;
+
+/**
+ * \brief The text storage string, or a snapshot of it.
+ */
+@property (readonly) NSString * source;
+
+/**
+ * \brief The edit generation of the text storage when the pass was created.
+ */
+@property (readonly) NSUInteger generation;
+
+/**
+ * \brief The damaged line range of the text storage when the pass was
+ *        created. The length is zero if no line is damaged.
+ */
+@property (readonly) NSRange damagedLineRange;
+
+/**
+ * \brief The first line to color.
+ */
+@property (readonly) NSUInteger firstLine;
+
+/**
+ * \brief The last line colored, or firstLine - 1 if no line was colored.
+ */
+@property (readonly) NSUInteger lastLine;
+
+/**
+ * \brief The number of lines of the text storage.
+ */
+@property (readonly) NSUInteger numberOfLines;
+
+/**
+ * \brief The lexer state at the end of the line preceding the first line.
+ */
+@property (readonly) PLLexerState entryState;
+
+/**
+ * \brief Whether the entry state is a guess. The lines colored by the pass
+ *        then remain damaged until they are colored from a known state.
+ */
+@property (readonly) BOOL isEntryStateGuessed;
+
+/**
+ * \brief The last line the pass may color, at most the number of lines.
+ */
+@property (readonly) NSUInteger lastLineToColor;
+
+/**
+ * \brief The range of characters colored. Their foreground color is reset
+ *        before the colored ranges are applied.
+ */
+@property NSRange coloredCharacterRange;
+
+/**
+ * \brief The names of the groups of the colored ranges, indexed by the group
+ *        of each PLColoredRange.
+ */
+@property (readonly) NSArray * groups;
+
+/**
+ * \brief The colored ranges, in the coordinates of the text storage.
+ */
+@property (readonly) const PLColoredRange * coloredRanges;
+
+/**
+ * \brief The number of colored ranges.
+ */
+@property (readonly) NSUInteger numberOfColoredRanges;
+
+/**
+ * \brief Whether the pass was cancelled, in which case it stops being colored
+ *        at the next check and must not be applied.
+ */
+@property (readonly) BOOL isCancelled;
+
+/**
+ * \brief The sizes and durations of the pass, recorded by the syntax
+ *        highlighter while the pass is colored and applied.
+ */
+@property (readonly) PLSyntaxHighlightingMetrics * metrics;
+
+/**
+ * \brief Cancel the pass, such as when the text storage was edited after the
+ *        pass was created.
+ *
+ * \details The pass may be cancelled from any thread while it is colored.
+ *          Coloring checks the flag between chunks of lines, and scripts can
+ *          check it through the should_cancel() function of their module.
+ */
+-(void)cancel;
+
+/**
+ * \brief Take the lines following the last colored line.
+ *
+ * \details The lines become colored: the last line and the colored character
+ *          range are extended to include them.
+ *
+ * \param count The number of lines, which must not extend past the last line.
+ *
+ * \param lineEnds A C array of count elements set to the offset of the end of
+ *                 each line, relative to the start of the first line.
+ *
+ * \return The range of characters of the lines.
+ */
+-(NSRange)nextLines:(NSUInteger)count lineEnds:(NSUInteger *)lineEnds;
+
+/**
+ * \brief Return the character range of a line, including its line terminator.
+ *
+ * \details The range is taken from the line index of the text storage when
+ *          the pass was created, without reading the source.
+ *
+ * \param lineNumber A line number from the first line to the last line to
+ *                   color. Other lines return an empty range at the start of
+ *                   the first line.
+ */
+-(NSRange)rangeOfLineNumber:(NSUInteger)lineNumber;
+
+/**
+ * \brief Return the lexer state at the end of a line stored by the previous
+ *        pass, or PLLexerStateUnknown.
+ *
+ * \param lineNumber A line number from the first line to the last line to
+ *                   color.
+ */
+-(PLLexerState)previousStateAtEndOfLine:(NSUInteger)lineNumber;
+
+/**
+ * \brief Return the lexer state at the end of a colored line.
+ *
+ * \param lineNumber A line number from the first line to the last line.
+ */
+-(PLLexerState)stateAtEndOfLine:(NSUInteger)lineNumber;
+
+/**
+ * \brief Set the lexer state at the end of a colored line.
+ *
+ * \param state The lexer state.
+ *
+ * \param lineNumber A line number from the first line to the last line.
+ */
+-(void)setState:(PLLexerState)state atEndOfLine:(NSUInteger)lineNumber;
+
+/**
+ * \brief Return the index of a group in the groups array, adding the group if
+ *        it is not in the array.
+ *
+ * \param group The name of the group, as in the theme property lists.
+ */
+-(NSUInteger)indexOfGroup:(NSString *)group;
+
+/**
+ * \brief Add a range to color with the color of a group.
+ *
+ * \param range The range of characters, in the coordinates of the text
+ *              storage.
+ *
+ * \param groupIndex The index of the group in the groups array.
+ */
+-(void)addRange:(NSRange)range groupIndex:(NSUInteger)groupIndex;
+
+/**
+ * \brief Add a range to color with the color of a group.
+ *
+ * \param range The range of characters, in the coordinates of the text
+ *              storage.
+ *
+ * \param group The name of the group, as in the theme property lists.
+ */
+-(void)addRange:(NSRange)range group:(NSString *)group;
+
+/**
+ * \brief Add the tokens of a PLPythonTokenizer to color.
+ *
+ * \param tokens A C array of tokens.
+ *
+ * \param count The number of tokens.
+ *
+ * \param offset The character index at which the tokenized characters start.
+ */
+-(void)addTokens:(const PLPythonToken *)tokens count:(NSUInteger)count offset:(NSUInteger)offset;
+
+@end
@@ -0,0 +1,236 @@
+/**
+ * \file PLSyntaxHighlightingPass.m
+ * \brief Liasis Python IDE syntax highlighting pass implementation file.
+ *
+ * \details
+ * This file contains the method implementation for an object
+ * holding a snapshot of the lines of a text storage to color, and the ranges
+ * and lexer states found by coloring them.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLSyntaxHighlightingPass.h"
+
+@implementation PLSyntaxHighlightingPass
+
+-(id)initWithTextStorage:(PLTextStorage *)textStorage copySource:(BOOL)copySource
+{
+        return [self initWithTextStorage:textStorage lineRange:NSMakeRange(1, [textStorage numberOfLines]) copySource:copySource];
+}
+
+-(id)initWithTextStorage:(PLTextStorage *)textStorage lineRange:(NSRange)lineRange copySource:(BOOL)copySource
+{
+        PLLexerStates * lexerStates;
+        NSUInteger group, count, line;
+        self = [super init];
+        if (self) {
+                lexerStates = [textStorage lexerStates];
+                source = (copySource) ? [[textStorage snapshot] retain] : [[textStorage string] retain];
+                generation = [textStorage generation];
+                damagedLineRange = [lexerStates damagedLineRange];
+                numberOfLines = [textStorage numberOfLines];
+                lineRange.location = MAX(MIN(lineRange.location, numberOfLines), (NSUInteger)1);
+                lastLineToColor = MIN(NSMaxRange(lineRange) - 1, numberOfLines);
+
+                if (damagedLineRange.length > 0 && damagedLineRange.location < lineRange.location) {
+                        /* the lines preceding the range are damaged, so their states are guesses */
+                        firstLine = lineRange.location;
+                        entryState = [lexerStates stateAtEndOfLine:firstLine - 1];
+                        if (entryState == PLLexerStateUnknown)
+                                entryState = PLLexerStateDefault;
+                        isEntryStateGuessed = YES;
+                } else {
+                        /* resume after the last line with a known lexer state */
+                        firstLine = (damagedLineRange.length > 0) ? damagedLineRange.location : 1;
+                        while (firstLine > 1 && [lexerStates stateAtEndOfLine:firstLine - 1] == PLLexerStateUnknown)
+                                firstLine--;
+                        entryState = (firstLine == 1) ? PLLexerStateDefault : [lexerStates stateAtEndOfLine:firstLine - 1];
+                        isEntryStateGuessed = NO;
+                }
+                lastLine = firstLine - 1;
+
+                /* only the states of the lines the pass may color are copied */
+                count = (lastLineToColor >= firstLine) ? lastLineToColor - firstLine + 1 : 0;
+                previousStates = malloc(MAX(count, (NSUInteger)1) * sizeof(PLLexerState));
+                states = malloc(MAX(count, (NSUInteger)1) * sizeof(PLLexerState));
+                [lexerStates getStates:previousStates inLineRange:NSMakeRange(firstLine, count)];
+                memset(states, PLLexerStateUnknown, count * sizeof(PLLexerState));
+
+                /* the line ends come from the line index rather than a scan of the source */
+                lineStarts = malloc((count + 1) * sizeof(NSUInteger));
+                lineStarts[0] = [textStorage characterIndexForLineNumber:firstLine];
+                [textStorage getLineLengths:lineStarts + 1 inLineRange:NSMakeRange(firstLine, count)];
+                for (line = 1; line <= count; line++)
+                        lineStarts[line] += lineStarts[line - 1];
+                nextCharacterIndex = lineStarts[0];
+                coloredCharacterRange = NSMakeRange(nextCharacterIndex, 0);
+
+                groups = [[NSMutableArray alloc] init];
+                for (group = 0; group < PLPythonTokenGroupCount; group++)
+                        [groups addObject:[PLPythonTokenizer nameOfGroup:(PLPythonTokenGroup)group]];
+                coloredRanges = NULL;
+                numberOfColoredRanges = 0;
+                capacity = 0;
+                isCancelled = NO;
+                metrics = [[PLSyntaxHighlightingMetrics alloc] init];
+                [metrics setGeneration:generation];
+                [metrics setSourceLength:[source length]];
+        }
+        return self;
+}
+
+-(void)dealloc
+{
+        [source release];
+        [groups release];
+        [metrics release];
+        free(previousStates);
+        free(states);
+        free(lineStarts);
+        free(coloredRanges);
+        [super dealloc];
+}
+
+@synthesize source;
+
+@synthesize generation;
+
+@synthesize damagedLineRange;
+
+@synthesize firstLine;
+
+@synthesize lastLine;
+
+@synthesize numberOfLines;
+
+@synthesize entryState;
+
+@synthesize isEntryStateGuessed;
+
+@synthesize lastLineToColor;
+
+@synthesize coloredCharacterRange;
+
+@synthesize groups;
+
+@synthesize coloredRanges;
+
+@synthesize numberOfColoredRanges;
+
+@synthesize isCancelled;
+
+@synthesize metrics;
+
+-(void)cancel
+{
+        isCancelled = YES;
+}
+
+-(NSRange)nextLines:(NSUInteger)count lineEnds:(NSUInteger *)lineEnds
+{
+        NSUInteger start = nextCharacterIndex, line;
+        for (line = 0; line < count; line++)
+                lineEnds[line] = lineStarts[lastLine + line + 2 - firstLine] - start;
+        lastLine += count;
+        nextCharacterIndex = lineStarts[lastLine + 1 - firstLine];
+        coloredCharacterRange.length = nextCharacterIndex - coloredCharacterRange.location;
+        return NSMakeRange(start, nextCharacterIndex - start);
+}
+
+-(NSRange)rangeOfLineNumber:(NSUInteger)lineNumber
+{
+        NSRange range = NSMakeRange(lineStarts[0], 0);
+        NSUInteger line;
+        if (lineNumber < firstLine || lineNumber > lastLineToColor)
+                goto exit;
+        line = lineNumber - firstLine;
+        range = NSMakeRange(lineStarts[line], lineStarts[line + 1] - lineStarts[line]);
+exit:
+        return range;
+}
+
+-(PLLexerState)previousStateAtEndOfLine:(NSUInteger)lineNumber
+{
+        PLLexerState state = PLLexerStateUnknown;
+        if (lineNumber < firstLine || lineNumber > lastLineToColor)
+                goto exit;
+        state = previousStates[lineNumber - firstLine];
+exit:
+        return state;
+}
+
+-(PLLexerState)stateAtEndOfLine:(NSUInteger)lineNumber
+{
+        PLLexerState state = PLLexerStateUnknown;
+        if (lineNumber < firstLine || lineNumber > lastLine)
+                goto exit;
+        state = states[lineNumber - firstLine];
+exit:
+        return state;
+}
+
+-(void)setState:(PLLexerState)state atEndOfLine:(NSUInteger)lineNumber
+{
+        if (lineNumber < firstLine || lineNumber > lastLine)
+                goto exit;
+        states[lineNumber - firstLine] = state;
+exit:
+        return;
+}
+
+-(NSUInteger)indexOfGroup:(NSString *)group
+{
+        NSUInteger index = [groups indexOfObject:group];
+        if (index == NSNotFound) {
+                index = [groups count];
+                [groups addObject:group];
+        }
+        return index;
+}
+
+-(void)addRange:(NSRange)range groupIndex:(NSUInteger)groupIndex
+{
+        if (numberOfColoredRanges == capacity) {
+                capacity = MAX(2 * capacity, (NSUInteger)256);
+                coloredRanges = realloc(coloredRanges, capacity * sizeof(PLColoredRange));
+        }
+        coloredRanges[numberOfColoredRanges].range = range;
+        coloredRanges[numberOfColoredRanges].group = groupIndex;
+        numberOfColoredRanges++;
+}
+
+-(void)addRange:(NSRange)range group:(NSString *)group
+{
+        [self addRange:range groupIndex:[self indexOfGroup:group]];
+}
+
+-(void)addTokens:(const PLPythonToken *)tokens count:(NSUInteger)count offset:(NSUInteger)offset
+{
+        NSUInteger i;
+        for (i = 0; i < count; i++)
+                [self addRange:NSMakeRange(tokens[i].range.location + offset, tokens[i].range.length)
+                    groupIndex:tokens[i].group];
+}
+
+@end
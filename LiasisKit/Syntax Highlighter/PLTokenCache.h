@@ -0,0 +1,222 @@
+/**
+ * \file PLTokenCache.h
+ * \brief Liasis Python IDE token cache interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for a memory bounded
+ * cache of the colored ranges of lines, keyed by a hash of their characters and
+ * the lexer state at their start.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#import "PLSyntaxHighlightingPass.h"
+
+/**
+ * \brief A cached line, with its colored ranges relative to the start of the
+ *        line. The entries are private to the PLTokenCache.
+ */
+typedef struct PLTokenCacheEntry PLTokenCacheEntry;
+
+/**
+ * \class PLTokenCache \headerfile \headerfile
+ * \brief Cache the colored ranges and lexer state at the end of lines, so that
+ *        coloring lines seen before does not call the engine again.
+ *
+ * \details The ranges colored in a line only depend on the characters of the
+ *          line, including its line terminator, and on the lexer state at its
+ *          start. A line is cached under a 64 bit FNV-1a hash of its
+ *          characters, the lexer state and a seed identifying the engine, and
+ *          is only found again if its characters, stored with its ranges, and
+ *          its lexer state and seed also match, so that a collision of hashes
+ *          is never taken for a hit. Text
+ *          colored before, such as after an undo, a revert from disk or
+ *          reopening a file, is then colored from the cache.
+ *
+ *          The cache holds at most capacity bytes of entries, and discards the
+ *          least recently used lines past it. The number of lines found and
+ *          not found are counted to size the cache. All methods can be called
+ *          from any thread.
+ */
+@interface PLTokenCache : NSObject {
+        /**
+         * \brief The maximum number of bytes of the entries.
+         */
+        NSUInteger capacity;
+
+        /**
+         * \brief The number of bytes of the entries.
+         */
+        NSUInteger size;
+
+        /**
+         * \brief The number of cached lines.
+         */
+        NSUInteger numberOfLines;
+
+        /**
+         * \brief The number of lines found in the cache.
+         */
+        NSUInteger numberOfHits;
+
+        /**
+         * \brief The number of lines not found in the cache.
+         */
+        NSUInteger numberOfMisses;
+
+        /**
+         * \brief A C array of the chains of entries of each hash bucket.
+         */
+        PLTokenCacheEntry ** buckets;
+
+        /**
+         * \brief The number of hash buckets, a power of two.
+         */
+        NSUInteger numberOfBuckets;
+
+        /**
+         * \brief The most and least recently used entries.
+         */
+        PLTokenCacheEntry * newestEntry, * oldestEntry;
+
+        /**
+         * \brief The names of the groups of the cached ranges, starting with
+         *        those of the PLPythonTokenizer as in a pass.
+         */
+        NSMutableArray * groups;
+
+        /**
+         * \brief A C array holding the characters of the line being hashed.
+         */
+        unichar * characters;
+
+        /**
+         * \brief The number of characters the characters array can hold.
+         */
+        NSUInteger charactersCapacity;
+}
+
+/**
+ * \brief Initialize an empty cache of at most a number of bytes.
+ *
+ * \param aCapacity The maximum number of bytes of the cached lines. A capacity
+ *                  of zero disables the cache.
+ */
+-(id)initWithCapacity:(NSUInteger)aCapacity;
+
+/**
+ * \brief Initialize an empty cache with a capacity of 8 MB.
+ */
+-(id)init;
+
+/**
+ * \brief The maximum number of bytes of the cached lines. Lowering the
+ *        capacity discards the least recently used lines past it.
+ */
+@property (nonatomic) NSUInteger capacity;
+
+/**
+ * \brief The number of bytes of the cached lines.
+ */
+@property (readonly) NSUInteger size;
+
+/**
+ * \brief The number of cached lines.
+ */
+@property (readonly) NSUInteger numberOfLines;
+
+/**
+ * \brief The number of lines found in the cache since the statistics were
+ *        reset.
+ */
+@property (readonly) NSUInteger numberOfHits;
+
+/**
+ * \brief The number of lines looked up and not found in the cache since the
+ *        statistics were reset.
+ */
+@property (readonly) NSUInteger numberOfMisses;
+
+/**
+ * \brief The fraction of the lines looked up that were found, or 0 if no line
+ *        was looked up.
+ */
+@property (readonly) double hitRate;
+
+/**
+ * \brief Set the number of hits and misses to zero.
+ */
+-(void)resetStatistics;
+
+/**
+ * \brief Discard every cached line.
+ */
+-(void)removeAllLines;
+
+/**
+ * \brief Color the line following the last colored line of a pass from the
+ *        cache.
+ *
+ * \details If the line is cached, it is taken from the pass, its ranges are
+ *          added to the pass and the lexer state at its end is set.
+ *          Otherwise, the pass is left unchanged.
+ *
+ * \param pass The pass to color, whose last line is before its last line to
+ *             color.
+ *
+ * \param state The lexer state at the start of the line.
+ *
+ * \param seed A value identifying the engine coloring the pass, as passed to
+ *             addLines:ofPass:entryState:firstRange:seed:.
+ *
+ * \return YES if the line was colored from the cache.
+ */
+-(BOOL)colorNextLineOfPass:(PLSyntaxHighlightingPass *)pass entryState:(PLLexerState)state seed:(NSUInteger)seed;
+
+/**
+ * \brief Cache the lines last colored by a pass.
+ *
+ * \details The colored ranges added to the pass from a range index are split
+ *          at the end of each line, and each line is cached with its ranges
+ *          and the lexer state at its end.
+ *
+ * \param count The number of lines to cache, ending at the last line of the
+ *              pass.
+ *
+ * \param pass The pass colored.
+ *
+ * \param state The lexer state at the start of the first line.
+ *
+ * \param firstRange The index of the first colored range of the pass added to
+ *                   color the lines.
+ *
+ * \param seed A value identifying the engine coloring the pass.
+ */
+-(void)addLines:(NSUInteger)count
+         ofPass:(PLSyntaxHighlightingPass *)pass
+     entryState:(PLLexerState)state
+     firstRange:(NSUInteger)firstRange
+           seed:(NSUInteger)seed;
+
+@end
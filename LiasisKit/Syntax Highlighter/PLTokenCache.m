@@ -0,0 +1,555 @@
+/**
+ * \file PLTokenCache.m
+ * \brief Liasis Python IDE token cache implementation file.
+ *
+ * \details
+ * This file contains the method implementation for a memory bounded cache of
+ * the colored ranges of lines, keyed by a hash of their characters and the
+ * lexer state at their start.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLTokenCache.h"
+
+/**
+ * \brief The capacity in bytes of a cache initialized with init.
+ */
+#define DEFAULT_CAPACITY (8 * 1024 * 1024)
+
+/**
+ * \brief The initial number of hash buckets. The number of buckets doubles
+ *        when there are more cached lines than buckets.
+ */
+#define INITIAL_NUMBER_OF_BUCKETS 1024
+
+/**
+ * \brief The offset basis and prime of the 64 bit FNV-1a hash.
+ */
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/**
+ * \brief A colored range of a cached line, relative to the start of the line.
+ */
+typedef struct {
+        uint32_t location;
+        uint32_t length;
+        uint32_t group;
+} PLCachedRange;
+
+struct PLTokenCacheEntry {
+        /**
+         * \brief The hash of the characters, entry state and seed of the line.
+         */
+        uint64_t hash;
+
+        /**
+         * \brief The number of characters of the line.
+         */
+        NSUInteger length;
+
+        /**
+         * \brief The value identifying the engine that colored the line.
+         */
+        NSUInteger seed;
+
+        /**
+         * \brief The lexer states at the start and at the end of the line.
+         */
+        PLLexerState entryState;
+        PLLexerState exitState;
+
+        /**
+         * \brief The next entry of the same hash bucket.
+         */
+        PLTokenCacheEntry * next;
+
+        /**
+         * \brief The entries used just after and just before this entry.
+         */
+        PLTokenCacheEntry * newer;
+        PLTokenCacheEntry * older;
+
+        /**
+         * \brief The colored ranges of the line, with group indices of the
+         *        groups of the cache, followed by the characters of the line.
+         */
+        NSUInteger numberOfRanges;
+        PLCachedRange ranges[];
+};
+
+/**
+ * \brief Return the 64 bit FNV-1a hash of the characters of a line, the lexer
+ *        state at its start and the seed of the engine coloring it.
+ */
+static uint64_t hashOfLine(const unichar * characters, NSUInteger length, PLLexerState state, NSUInteger seed)
+{
+        uint64_t hash = FNV_OFFSET_BASIS;
+        NSUInteger i;
+        hash = (hash ^ (uint64_t)seed) * FNV_PRIME;
+        hash = (hash ^ (uint64_t)state) * FNV_PRIME;
+        for (i = 0; i < length; i++)
+                hash = (hash ^ (uint64_t)characters[i]) * FNV_PRIME;
+        return hash;
+}
+
+/**
+ * \brief Compare two colored ranges by location, for qsort().
+ */
+static int compareColoredRanges(const void * first, const void * second)
+{
+        NSUInteger firstLocation = ((const PLColoredRange *)first)->range.location;
+        NSUInteger secondLocation = ((const PLColoredRange *)second)->range.location;
+        return (firstLocation > secondLocation) - (firstLocation < secondLocation);
+}
+
+/**
+ * \brief Return the number of bytes of an entry with a number of ranges and
+ *        characters.
+ */
+static NSUInteger sizeOfEntry(NSUInteger numberOfRanges, NSUInteger length)
+{
+        return sizeof(PLTokenCacheEntry) + numberOfRanges * sizeof(PLCachedRange) + length * sizeof(unichar);
+}
+
+/**
+ * \brief Return the characters of the line of an entry, stored after its
+ *        ranges.
+ */
+static unichar * charactersOfEntry(PLTokenCacheEntry * entry)
+{
+        return (unichar *)(entry->ranges + entry->numberOfRanges);
+}
+
+@implementation PLTokenCache
+
+-(id)initWithCapacity:(NSUInteger)aCapacity
+{
+        NSUInteger group;
+        self = [super init];
+        if (self) {
+                capacity = aCapacity;
+                size = 0;
+                numberOfLines = 0;
+                numberOfHits = 0;
+                numberOfMisses = 0;
+                numberOfBuckets = INITIAL_NUMBER_OF_BUCKETS;
+                buckets = calloc(numberOfBuckets, sizeof(PLTokenCacheEntry *));
+                newestEntry = NULL;
+                oldestEntry = NULL;
+                groups = [[NSMutableArray alloc] init];
+                for (group = 0; group < PLPythonTokenGroupCount; group++)
+                        [groups addObject:[PLPythonTokenizer nameOfGroup:(PLPythonTokenGroup)group]];
+                characters = NULL;
+                charactersCapacity = 0;
+        }
+        return self;
+}
+
+-(id)init
+{
+        return [self initWithCapacity:DEFAULT_CAPACITY];
+}
+
+-(void)dealloc
+{
+        [self removeAllLines];
+        free(buckets);
+        free(characters);
+        [groups release];
+        [super dealloc];
+}
+
+-(NSUInteger)capacity
+{
+        @synchronized(self) {
+                return capacity;
+        }
+}
+
+-(void)setCapacity:(NSUInteger)aCapacity
+{
+        @synchronized(self) {
+                capacity = aCapacity;
+                [self removeEntriesPastCapacity];
+        }
+}
+
+-(NSUInteger)size
+{
+        @synchronized(self) {
+                return size;
+        }
+}
+
+-(NSUInteger)numberOfLines
+{
+        @synchronized(self) {
+                return numberOfLines;
+        }
+}
+
+-(NSUInteger)numberOfHits
+{
+        @synchronized(self) {
+                return numberOfHits;
+        }
+}
+
+-(NSUInteger)numberOfMisses
+{
+        @synchronized(self) {
+                return numberOfMisses;
+        }
+}
+
+-(double)hitRate
+{
+        @synchronized(self) {
+                if (numberOfHits + numberOfMisses == 0)
+                        return 0.0;
+                return (double)numberOfHits / (double)(numberOfHits + numberOfMisses);
+        }
+}
+
+-(void)resetStatistics
+{
+        @synchronized(self) {
+                numberOfHits = 0;
+                numberOfMisses = 0;
+        }
+}
+
+-(void)removeAllLines
+{
+        PLTokenCacheEntry * entry, * older;
+        @synchronized(self) {
+                for (entry = newestEntry; entry; entry = older) {
+                        older = entry->older;
+                        free(entry);
+                }
+                memset(buckets, 0, numberOfBuckets * sizeof(PLTokenCacheEntry *));
+                newestEntry = NULL;
+                oldestEntry = NULL;
+                numberOfLines = 0;
+                size = 0;
+        }
+}
+
+-(BOOL)colorNextLineOfPass:(PLSyntaxHighlightingPass *)pass entryState:(PLLexerState)state seed:(NSUInteger)seed
+{
+        BOOL found;
+        @synchronized(self) {
+                found = [self lockedColorNextLineOfPass:pass entryState:state seed:seed];
+        }
+        return found;
+}
+
+-(void)addLines:(NSUInteger)count
+         ofPass:(PLSyntaxHighlightingPass *)pass
+     entryState:(PLLexerState)state
+     firstRange:(NSUInteger)firstRange
+           seed:(NSUInteger)seed
+{
+        @synchronized(self) {
+                [self lockedAddLines:count ofPass:pass entryState:state firstRange:firstRange seed:seed];
+        }
+}
+
+#pragma mark - Private Methods
+
+/**
+ * \brief Color the next line of a pass from the cache, with the cache locked.
+ *
+ * \see colorNextLineOfPass:entryState:seed:
+ */
+-(BOOL)lockedColorNextLineOfPass:(PLSyntaxHighlightingPass *)pass entryState:(PLLexerState)state seed:(NSUInteger)seed
+{
+        BOOL found = NO;
+        NSUInteger lineEnd, i, groupIndex;
+        NSRange lineRange = [pass rangeOfLineNumber:[pass lastLine] + 1];
+        PLTokenCacheEntry * entry;
+        uint64_t hash;
+        if (capacity == 0)
+                goto exit;
+
+        entry = [self entryOfLine:lineRange inString:[pass source] entryState:state seed:seed hash:&hash];
+        if (entry == NULL) {
+                numberOfMisses++;
+                goto exit;
+        }
+        numberOfHits++;
+        [self removeEntryFromUseOrder:entry];
+        [self insertEntryInUseOrder:entry];
+
+        [pass nextLines:1 lineEnds:&lineEnd];
+        for (i = 0; i < entry->numberOfRanges; i++) {
+                groupIndex = entry->ranges[i].group;
+                if (groupIndex >= PLPythonTokenGroupCount)
+                        groupIndex = [pass indexOfGroup:[groups objectAtIndex:groupIndex]];
+                [pass addRange:NSMakeRange(lineRange.location + entry->ranges[i].location, entry->ranges[i].length) groupIndex:groupIndex];
+        }
+        [pass setState:entry->exitState atEndOfLine:[pass lastLine]];
+        found = YES;
+
+exit:
+        return found;
+}
+
+/**
+ * \brief Cache the lines last colored by a pass, with the cache locked.
+ *
+ * \details The colored ranges are sorted by location, and swept with the
+ *          lines, so that a range spanning several lines, such as a docstring,
+ *          is clipped to each line. Lines whose lexer state at their end is
+ *          unknown are not cached.
+ *
+ * \see addLines:ofPass:entryState:firstRange:seed:
+ */
+-(void)lockedAddLines:(NSUInteger)numberOfLineRanges
+               ofPass:(PLSyntaxHighlightingPass *)pass
+           entryState:(PLLexerState)state
+           firstRange:(NSUInteger)firstRange
+                 seed:(NSUInteger)seed
+{
+        NSString * source = [pass source];
+        NSArray * passGroups = [pass groups];
+        NSUInteger numberOfRanges = [pass numberOfColoredRanges] - firstRange;
+        NSUInteger line, firstLine = [pass lastLine] + 1 - numberOfLineRanges, lineStart, lineEnd, start, end, i, j, count;
+        NSRange * lineRanges = malloc(MAX(numberOfLineRanges, (NSUInteger)1) * sizeof(NSRange));
+        PLColoredRange * ranges = malloc(MAX(numberOfRanges, (NSUInteger)1) * sizeof(PLColoredRange));
+        NSUInteger * cacheGroups = malloc(MAX([passGroups count], (NSUInteger)1) * sizeof(NSUInteger));
+        PLTokenCacheEntry * entry, * existingEntry;
+        PLLexerState exitState;
+        uint64_t hash;
+        if (capacity == 0)
+                goto exit;
+
+        /* the group indices of the pass and of the cache only differ past the tokenizer groups */
+        for (i = 0; i < [passGroups count]; i++)
+                cacheGroups[i] = (i < PLPythonTokenGroupCount) ? i : [self indexOfGroup:[passGroups objectAtIndex:i]];
+        memcpy(ranges, [pass coloredRanges] + firstRange, numberOfRanges * sizeof(PLColoredRange));
+        qsort(ranges, numberOfRanges, sizeof(PLColoredRange), compareColoredRanges);
+        for (line = 0; line < numberOfLineRanges; line++)
+                lineRanges[line] = [pass rangeOfLineNumber:firstLine + line];
+
+        j = 0;
+        for (line = 0; line < numberOfLineRanges; line++) {
+                lineStart = lineRanges[line].location;
+                lineEnd = NSMaxRange(lineRanges[line]);
+                exitState = [pass stateAtEndOfLine:firstLine + line];
+                if (line > 0)
+                        state = [pass stateAtEndOfLine:firstLine + line - 1];
+                if (exitState == PLLexerStateUnknown || state == PLLexerStateUnknown || lineRanges[line].length > UINT32_MAX)
+                        continue;
+
+                /* the ranges before j end before this line */
+                while (j < numberOfRanges && NSMaxRange(ranges[j].range) <= lineStart)
+                        j++;
+                count = 0;
+                for (i = j; i < numberOfRanges && ranges[i].range.location < lineEnd; i++) {
+                        if (MIN(NSMaxRange(ranges[i].range), lineEnd) > MAX(ranges[i].range.location, lineStart))
+                                count++;
+                }
+                entry = malloc(sizeOfEntry(count, lineRanges[line].length));
+                entry->length = lineRanges[line].length;
+                entry->seed = seed;
+                entry->entryState = state;
+                entry->exitState = exitState;
+                entry->numberOfRanges = 0;
+                for (i = j; i < numberOfRanges && ranges[i].range.location < lineEnd; i++) {
+                        start = MAX(ranges[i].range.location, lineStart);
+                        end = MIN(NSMaxRange(ranges[i].range), lineEnd);
+                        if (end <= start)
+                                continue;
+                        entry->ranges[entry->numberOfRanges].location = (uint32_t)(start - lineStart);
+                        entry->ranges[entry->numberOfRanges].length = (uint32_t)(end - start);
+                        entry->ranges[entry->numberOfRanges].group = (uint32_t)cacheGroups[ranges[i].group];
+                        entry->numberOfRanges++;
+                }
+
+                existingEntry = [self entryOfLine:lineRanges[line] inString:source entryState:state seed:seed hash:&hash];
+                if (existingEntry)
+                        [self removeEntry:existingEntry];
+                entry->hash = hash;
+                memcpy(charactersOfEntry(entry), characters, entry->length * sizeof(unichar));
+                [self insertEntry:entry];
+        }
+        [self removeEntriesPastCapacity];
+
+exit:
+        free(lineRanges);
+        free(ranges);
+        free(cacheGroups);
+}
+
+/**
+ * \brief Return the entry of a line of a string, or NULL if the line is not
+ *        cached.
+ *
+ * \details An entry with the same hash is only returned if its characters,
+ *          lexer state and seed are those of the line, so that a collision of
+ *          hashes never colors a line with the ranges of another. The
+ *          characters of the line are left in the characters array.
+ *
+ * \param lineRange The range of characters of the line in the string.
+ *
+ * \param string The string containing the line.
+ *
+ * \param state The lexer state at the start of the line.
+ *
+ * \param seed The value identifying the engine.
+ *
+ * \param hash On output, the hash of the line.
+ */
+-(PLTokenCacheEntry *)entryOfLine:(NSRange)lineRange
+                         inString:(NSString *)string
+                       entryState:(PLLexerState)state
+                             seed:(NSUInteger)seed
+                             hash:(uint64_t *)hash
+{
+        PLTokenCacheEntry * entry;
+        if (lineRange.length > charactersCapacity) {
+                charactersCapacity = MAX(lineRange.length, 2 * charactersCapacity);
+                characters = realloc(characters, charactersCapacity * sizeof(unichar));
+        }
+        [string getCharacters:characters range:lineRange];
+        *hash = hashOfLine(characters, lineRange.length, state, seed);
+        for (entry = buckets[*hash & (numberOfBuckets - 1)]; entry; entry = entry->next) {
+                if (entry->hash == *hash && entry->length == lineRange.length && entry->entryState == state &&
+                    entry->seed == seed && memcmp(charactersOfEntry(entry), characters, lineRange.length * sizeof(unichar)) == 0)
+                        break;
+        }
+        return entry;
+}
+
+/**
+ * \brief Return the index of a group in the groups of the cache, adding the
+ *        group if it is not in the array.
+ */
+-(NSUInteger)indexOfGroup:(NSString *)group
+{
+        NSUInteger index = [groups indexOfObject:group];
+        if (index == NSNotFound) {
+                index = [groups count];
+                [groups addObject:group];
+        }
+        return index;
+}
+
+/**
+ * \brief Add an entry to its hash bucket, as the most recently used entry.
+ *
+ * \details The number of buckets doubles when there are more entries than
+ *          buckets.
+ */
+-(void)insertEntry:(PLTokenCacheEntry *)entry
+{
+        PLTokenCacheEntry ** bucket;
+        if (numberOfLines >= numberOfBuckets)
+                [self doubleNumberOfBuckets];
+        bucket = &buckets[entry->hash & (numberOfBuckets - 1)];
+        entry->next = *bucket;
+        *bucket = entry;
+        [self insertEntryInUseOrder:entry];
+        numberOfLines++;
+        size += sizeOfEntry(entry->numberOfRanges, entry->length);
+}
+
+/**
+ * \brief Remove an entry from its hash bucket and free it.
+ */
+-(void)removeEntry:(PLTokenCacheEntry *)entry
+{
+        PLTokenCacheEntry ** link = &buckets[entry->hash & (numberOfBuckets - 1)];
+        while (*link != entry)
+                link = &(*link)->next;
+        *link = entry->next;
+        [self removeEntryFromUseOrder:entry];
+        numberOfLines--;
+        size -= sizeOfEntry(entry->numberOfRanges, entry->length);
+        free(entry);
+}
+
+/**
+ * \brief Link an entry as the most recently used entry.
+ */
+-(void)insertEntryInUseOrder:(PLTokenCacheEntry *)entry
+{
+        entry->newer = NULL;
+        entry->older = newestEntry;
+        if (newestEntry)
+                newestEntry->newer = entry;
+        newestEntry = entry;
+        if (oldestEntry == NULL)
+                oldestEntry = entry;
+}
+
+/**
+ * \brief Unlink an entry from the order of use.
+ */
+-(void)removeEntryFromUseOrder:(PLTokenCacheEntry *)entry
+{
+        if (entry->newer)
+                entry->newer->older = entry->older;
+        else
+                newestEntry = entry->older;
+        if (entry->older)
+                entry->older->newer = entry->newer;
+        else
+                oldestEntry = entry->newer;
+}
+
+/**
+ * \brief Remove the least recently used entries until the size of the entries
+ *        is at most the capacity.
+ */
+-(void)removeEntriesPastCapacity
+{
+        while (size > capacity && oldestEntry)
+                [self removeEntry:oldestEntry];
+}
+
+/**
+ * \brief Double the number of hash buckets, and move each entry to its new
+ *        bucket.
+ */
+-(void)doubleNumberOfBuckets
+{
+        NSUInteger i, newNumberOfBuckets = 2 * numberOfBuckets;
+        PLTokenCacheEntry ** newBuckets = calloc(newNumberOfBuckets, sizeof(PLTokenCacheEntry *));
+        PLTokenCacheEntry * entry, * next;
+        for (i = 0; i < numberOfBuckets; i++) {
+                for (entry = buckets[i]; entry; entry = next) {
+                        next = entry->next;
+                        entry->next = newBuckets[entry->hash & (newNumberOfBuckets - 1)];
+                        newBuckets[entry->hash & (newNumberOfBuckets - 1)] = entry;
+                }
+        }
+        free(buckets);
+        buckets = newBuckets;
+        numberOfBuckets = newNumberOfBuckets;
+}
+
+@end
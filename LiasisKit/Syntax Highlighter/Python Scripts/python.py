@@ -1,4 +1,5 @@
 import __builtin__
+import array
 import collections
 import keyword
 import re
@@ -52,6 +53,41 @@ KEYWORD = "Keyword"
 EXCEPTION = "Exception"
 FUNCTION = "Function name"
 
+##
+# \details The lexer states between two lines, as stored by the syntax
+#          highlighter. Only docstrings continue past the end of a line, so the
+#          state identifies the delimiter of the open docstring, if any. The
+#          end of the open docstring is searched with a regular expression, as
+#          the text may be a buffer rather than a string.
+#
+DEFAULT_STATE = 0
+DOCSTRING_STATES = {'"""': 1, "'''": 2}
+DOCSTRING_DELIMITERS = {1: '"""', 2: "'''"}
+DOCSTRING_END_REGEXES = {1: re.compile('"""'), 2: re.compile("'''")}
+
+##
+# \details The number of matches between two calls to should_cancel().
+#
+CANCEL_CHECK_INTERVAL = 1024
+
+##
+# \details The group names and the compiled regular expression matching every
+#          group, built on first use.
+#
+_coloring_regex = None
+
+
+def should_cancel():
+    """ Return whether the syntax highlighting pass being colored was cancelled.
+
+    The syntax highlighter replaces this function when importing the script,
+    so that a long call can return early once its result is no longer needed.
+    The ranges returned after a cancellation are ignored.
+
+    """
+    
+    return False
+
 
 def get_coloring_dict(text):
     """ Return the ranges to apply syntax coloring.
@@ -61,27 +97,172 @@ def get_coloring_dict(text):
     A dict of lists is returned where keys are the group names of matches and
     the lists contain tuples of the matched range as (start index, length).
 
+    The text is a UTF-8 encoded string, and the ranges are offsets in the
+    decoded text.
+
     Input arguments:
         text -> the text string to parse for syntax coloring ranges.
 
     """
     
-    groups = collections.OrderedDict([('Docstring', DOCSTRING_QUOTES_PATTERN),
-                                      ('String', STRING_PATTERN),
-                                      ('Number', NUMBER_PATTERN),
-                                      ('Comment', COMMENT_PATTERN)])
-    groups.update(_keywords_regex())
-    pattern = '|'.join(['(?P<{0}>{1})'.format(n.replace(' ', '_'), v)
-                        for n, v in groups.items()])
-    regex = re.compile(pattern, re.VERBOSE)
-    matches = {group: [] for group in groups}
-    for match in regex.finditer(unicode(text, 'UTF-8')):
-        group = match.lastgroup.replace('_', ' ')
+    groups, ranges = get_coloring_buffer(unicode(text, 'UTF-8'))
+    return _matches_dict(groups, ranges)
+
+
+def get_coloring_buffer(text):
+    """ Return the ranges to apply syntax coloring as a flat buffer.
+
+    The ranges are those of get_coloring_dict(), returned as a tuple of the
+    list of group names and an array of C ints, with a (group index, start
+    index, length) triple for each range. The syntax highlighter reads the
+    array in place through the buffer protocol, without converting each
+    range to an object. Matching stops early if should_cancel() returns True.
+
+    The text is UTF-8 encoded, as a read-only buffer shared with the syntax
+    highlighter, and is matched without being decoded. The ranges are offsets
+    in bytes, which the syntax highlighter maps to its characters. A decoded
+    text is matched as well, with offsets in the decoded text.
+
+    Input arguments:
+        text -> the UTF-8 text to parse for syntax coloring ranges.
+
+    """
+    
+    groups, regex = _get_coloring_regex()
+    group_ids = _get_group_ids()
+    ranges = array.array('i')
+    for count, match in enumerate(regex.finditer(text)):
+        if count % CANCEL_CHECK_INTERVAL == 0 and should_cancel():
+            break
         match_start, match_end = match.span()
-        matches[group].append((match_start, match_end - match_start))
+        ranges.extend((group_ids[match.lastgroup], match_start,
+                       match_end - match_start))
+    return groups, ranges
+
+
+def get_line_coloring(text, state, line_ends):
+    """ Return the ranges to apply syntax coloring in a span of lines, and the
+    lexer state at the end of each line.
+
+    The text starts at the beginning of a line, in the lexer state at the end
+    of the previous line. The ranges are returned as by get_coloring_dict(),
+    and the lexer states as a list with the state at each offset of line_ends.
+    As in get_coloring_dict(), the text is a UTF-8 encoded string, and the
+    ranges and line_ends are offsets in the decoded text.
+
+    Input arguments:
+        text -> the text string of the lines to parse for syntax coloring.
+        state -> the lexer state at the start of the text.
+        line_ends -> the sorted offsets of the end of each line in the text.
+
+    """
+    
+    groups, ranges, states = get_line_coloring_buffer(unicode(text, 'UTF-8'),
+                                                      state, line_ends)
+    return _matches_dict(groups, ranges), states
+
+
+def get_line_coloring_buffer(text, state, line_ends):
+    """ Return the ranges to apply syntax coloring in a span of lines as a flat
+    buffer, and the lexer state at the end of each line.
+
+    The ranges are returned as by get_coloring_buffer(), followed by the
+    lexer states as returned by get_line_coloring(). As in
+    get_coloring_buffer(), the text is a UTF-8 buffer, and the ranges and
+    line_ends are offsets in bytes.
+
+    Input arguments:
+        text -> the UTF-8 text of the lines to parse for syntax coloring.
+        state -> the lexer state at the start of the text.
+        line_ends -> the sorted offsets of the end of each line in the text.
+
+    """
+    
+    groups, regex = _get_coloring_regex()
+    group_ids = _get_group_ids()
+    docstring_id = groups.index(DOCSTRING)
+    ranges = array.array('i')
+    docstrings = []
+    position = 0
+    if state in DOCSTRING_DELIMITERS:
+        match = DOCSTRING_END_REGEXES[state].search(text)
+        end = -1 if match is None else match.start()
+        position = len(text) if end < 0 else end + 3
+        ranges.extend((docstring_id, 0, position))
+        # the docstring starts before the text
+        docstrings.append((-1, position, state, end < 0))
+    for count, match in enumerate(regex.finditer(text, position)):
+        if count % CANCEL_CHECK_INTERVAL == 0 and should_cancel():
+            break
+        group_id = group_ids[match.lastgroup]
+        match_start, match_end = match.span()
+        ranges.extend((group_id, match_start, match_end - match_start))
+        if group_id == docstring_id:
+            delimiter = text[match_start:match_start + 3]
+            is_open = (match_end - match_start < 6 or
+                       text[match_end - 3:match_end] != delimiter)
+            docstrings.append((match_start, match_end,
+                               DOCSTRING_STATES[delimiter], is_open))
+
+    states = []
+    index = 0
+    for line_end in line_ends:
+        while index < len(docstrings) and docstrings[index][1] < line_end:
+            index += 1
+        line_state = DEFAULT_STATE
+        if index < len(docstrings):
+            start, end, docstring_state, is_open = docstrings[index]
+            if start < line_end and (line_end < end or is_open):
+                line_state = docstring_state
+        states.append(line_state)
+    return groups, ranges, states
+
+
+def _matches_dict(groups, ranges):
+    """ Return the dict of lists of ranges of each group, as returned by
+    get_coloring_dict(), from a flat buffer of ranges.
+
+    """
+    
+    matches = {group: [] for group in groups}
+    for index in xrange(0, len(ranges), 3):
+        matches[groups[ranges[index]]].append((ranges[index + 1],
+                                               ranges[index + 2]))
     return matches
 
 
+def _get_group_ids():
+    """ Return a dict mapping the name of each group of the coloring regular
+    expression, as in match.lastgroup, to its index in the group names.
+
+    """
+    
+    groups, regex = _get_coloring_regex()
+    return {group.replace(' ', '_'): index
+            for index, group in enumerate(groups)}
+
+
+def _get_coloring_regex():
+    """ Return the coloring group names and their compiled regular expression.
+
+    The regular expression is compiled on the first call only, as building the
+    pattern of builtin names is slow relative to coloring a few lines.
+
+    """
+    
+    global _coloring_regex
+    if _coloring_regex is None:
+        groups = collections.OrderedDict([('Docstring', DOCSTRING_QUOTES_PATTERN),
+                                          ('String', STRING_PATTERN),
+                                          ('Number', NUMBER_PATTERN),
+                                          ('Comment', COMMENT_PATTERN)])
+        groups.update(_keywords_regex())
+        pattern = '|'.join(['(?P<{0}>{1})'.format(n.replace(' ', '_'), v)
+                            for n, v in groups.items()])
+        _coloring_regex = (list(groups), re.compile(pattern, re.VERBOSE))
+    return _coloring_regex
+
+
 def _keywords_regex():
     """ Return a dict regex pattern to match builtin keywords.
 
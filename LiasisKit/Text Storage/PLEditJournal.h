@@ -0,0 +1,148 @@
+/**
+ * \file PLEditJournal.h
+ * \brief Liasis Python IDE edit journal interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for an ordered list
+ * of the replacements of characters of a text storage, delivered to its
+ * observers once per batch of edits.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ * \brief A replacement of characters in a text storage.
+ */
+typedef struct PLTextEdit {
+        /**
+         * \brief The range of characters replaced, before the edit.
+         */
+        NSRange range;
+
+        /**
+         * \brief The change in length of the text, the length of the
+         *        replacement string minus the length of the range.
+         */
+        NSInteger changeInLength;
+
+        /**
+         * \brief The change in the number of lines of the text.
+         */
+        NSInteger changeInNumberOfLines;
+
+        /**
+         * \brief The edit generation of the text storage after the edit.
+         */
+        NSUInteger generation;
+} PLTextEdit;
+
+/**
+ * \class PLEditJournal \headerfile \headerfile
+ * \brief An ordered list of the edits of a text storage.
+ *
+ * \details The text storage adds an edit for each replacement of characters
+ *          between beginEditing and endEditing, and hands the journal to its
+ *          observers once at the end of the batch, so that an observer folds
+ *          the edits into its indexes in a single pass rather than handling a
+ *          notification for each edit.
+ *
+ *          The range of each edit is in the coordinates of the text as it was
+ *          just before that edit, so that replaying the edits in order moves
+ *          positions from the text before the batch to the text after it. An
+ *          edit touching the characters inserted by the previous edit, such as
+ *          consecutive keystrokes, is coalesced with it.
+ */
+@interface PLEditJournal : NSObject {
+        /**
+         * \brief A C array of the edits, in order.
+         */
+        PLTextEdit * edits;
+
+        /**
+         * \brief The number of edits.
+         */
+        NSUInteger count;
+
+        /**
+         * \brief The number of edits the edits array can hold.
+         */
+        NSUInteger capacity;
+}
+
+/**
+ * \brief The number of edits.
+ */
+@property (readonly) NSUInteger count;
+
+/**
+ * \brief The edits, in order.
+ */
+@property (readonly) const PLTextEdit * edits;
+
+/**
+ * \brief The generation of the last edit, or 0 for an empty journal.
+ */
+@property (readonly) NSUInteger generation;
+
+/**
+ * \brief The change in length of the text over all the edits.
+ */
+@property (readonly) NSInteger changeInLength;
+
+/**
+ * \brief The change in the number of lines over all the edits.
+ */
+@property (readonly) NSInteger changeInNumberOfLines;
+
+/**
+ * \brief The range of characters changed by the edits, in the coordinates of
+ *        the text after the last edit.
+ *
+ * \details The range spans the characters inserted by every edit, moved by
+ *          the following edits. It is an empty range at the location of the
+ *          edits that only deleted characters, and {NSNotFound, 0} for an
+ *          empty journal.
+ */
+@property (readonly) NSRange editedRange;
+
+/**
+ * \brief Add an edit, coalescing it with the last edit if they touch.
+ *
+ * \param range The range of characters replaced, before the edit.
+ *
+ * \param length The length of the replacement string.
+ *
+ * \param changeInNumberOfLines The change in the number of lines.
+ *
+ * \param generation The edit generation after the edit.
+ */
+-(void)addEditInRange:(NSRange)range withLength:(NSUInteger)length changeInNumberOfLines:(NSInteger)changeInNumberOfLines generation:(NSUInteger)generation;
+
+/**
+ * \brief Remove every edit.
+ */
+-(void)removeAllEdits;
+
+@end
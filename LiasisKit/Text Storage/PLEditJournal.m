@@ -0,0 +1,150 @@
+/**
+ * \file PLEditJournal.m
+ * \brief Liasis Python IDE edit journal implementation file.
+ *
+ * \details
+ * This file contains the method implementation for an ordered list of the
+ * replacements of characters of a text storage, delivered to its observers once
+ * per batch of edits.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLEditJournal.h"
+
+/**
+ * \brief Move a character index of the text before an edit to the text after
+ *        it.
+ *
+ * \details An index within the replaced characters moves to the start of the
+ *          replacement if it is the start of a range, and to its end otherwise.
+ */
+static NSUInteger moveIndexThroughEdit(NSUInteger index, const PLTextEdit * edit, BOOL isStart)
+{
+        if (index < edit->range.location || (index == edit->range.location && isStart))
+                return index;
+        if (index >= NSMaxRange(edit->range))
+                return index + edit->changeInLength;
+        return isStart ? edit->range.location : NSMaxRange(edit->range) + edit->changeInLength;
+}
+
+@implementation PLEditJournal
+
+-(id)init
+{
+        self = [super init];
+        if (self) {
+                edits = NULL;
+                count = 0;
+                capacity = 0;
+        }
+        return self;
+}
+
+-(void)dealloc
+{
+        free(edits);
+        [super dealloc];
+}
+
+@synthesize count;
+
+@synthesize edits;
+
+-(NSUInteger)generation
+{
+        return (count > 0) ? edits[count - 1].generation : 0;
+}
+
+-(NSInteger)changeInLength
+{
+        NSInteger changeInLength = 0;
+        NSUInteger i;
+        for (i = 0; i < count; i++)
+                changeInLength += edits[i].changeInLength;
+        return changeInLength;
+}
+
+-(NSInteger)changeInNumberOfLines
+{
+        NSInteger changeInNumberOfLines = 0;
+        NSUInteger i;
+        for (i = 0; i < count; i++)
+                changeInNumberOfLines += edits[i].changeInNumberOfLines;
+        return changeInNumberOfLines;
+}
+
+-(NSRange)editedRange
+{
+        NSUInteger i, start = NSNotFound, end = 0, editEnd;
+        for (i = 0; i < count; i++) {
+                editEnd = NSMaxRange(edits[i].range) + edits[i].changeInLength;
+                if (start == NSNotFound) {
+                        start = edits[i].range.location;
+                        end = editEnd;
+                        continue;
+                }
+                start = MIN(moveIndexThroughEdit(start, edits + i, YES), edits[i].range.location);
+                end = MAX(moveIndexThroughEdit(end, edits + i, NO), editEnd);
+        }
+        return NSMakeRange(start, end - start);
+}
+
+-(void)addEditInRange:(NSRange)range withLength:(NSUInteger)length changeInNumberOfLines:(NSInteger)changeInNumberOfLines generation:(NSUInteger)generation
+{
+        PLTextEdit * last = (count > 0) ? edits + count - 1 : NULL;
+        NSUInteger lastEnd, end;
+
+        /* coalesce an edit touching the characters inserted by the last one */
+        if (last) {
+                lastEnd = NSMaxRange(last->range) + last->changeInLength;
+                if (range.location <= lastEnd && NSMaxRange(range) >= last->range.location) {
+                        end = MAX(lastEnd, NSMaxRange(range)) - last->changeInLength;
+                        last->range.location = MIN(last->range.location, range.location);
+                        last->range.length = end - last->range.location;
+                        last->changeInLength += (NSInteger)length - (NSInteger)range.length;
+                        last->changeInNumberOfLines += changeInNumberOfLines;
+                        last->generation = generation;
+                        goto exit;
+                }
+        }
+
+        if (count == capacity) {
+                capacity = MAX(2 * capacity, (NSUInteger)16);
+                edits = realloc(edits, capacity * sizeof(PLTextEdit));
+        }
+        edits[count].range = range;
+        edits[count].changeInLength = (NSInteger)length - (NSInteger)range.length;
+        edits[count].changeInNumberOfLines = changeInNumberOfLines;
+        edits[count].generation = generation;
+        count++;
+exit:
+        return;
+}
+
+-(void)removeAllEdits
+{
+        count = 0;
+}
+
+@end
@@ -0,0 +1,185 @@
+/**
+ * \file PLLineIndex.h
+ * \brief Liasis Python IDE line index interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for an object
+ * relating physical line numbers with character positions in a string.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ * \class PLLineIndex \headerfile \headerfile
+ * \brief Relate physical line numbers with the character index of their first
+ *        character.
+ *
+ * \details The line index stores the length of every line in a string rather
+ *          than the position of its first character, so that an edit only
+ *          changes the lines it touches. Lines are grouped in fixed capacity
+ *          blocks, at least half full, kept in order by a treap as the chunks
+ *          of a PLRopeString are. Each block stores the number of lines and
+ *          characters of its subtree, so that looking up a line or a character
+ *          index is O(log n) in the number of lines. An edit replaces only the
+ *          blocks of the lines it touches, splitting the treap around them and
+ *          merging it back in O(log n), so that splitting a full block or
+ *          pasting many lines never visits the other blocks.
+ *
+ *          Line numbers start at 1. A string always has at least one line: an
+ *          empty string has a single line of length zero, and a string ending
+ *          in a line terminator has an empty last line.
+ */
+@interface PLLineIndex : NSObject {
+        /**
+         * \brief The root of the treap of line blocks.
+         */
+        struct PLLineIndexBlock * root;
+
+        /**
+         * \brief The state of the generator of the priorities of new blocks.
+         */
+        uint32_t seed;
+}
+
+/**
+ * \brief Initialize the line index with the single line of an empty string.
+ */
+-(id)init;
+
+/**
+ * \brief The number of lines in the indexed string.
+ */
+@property (readonly) NSUInteger numberOfLines;
+
+/**
+ * \brief The number of characters in the indexed string.
+ */
+@property (readonly) NSUInteger length;
+
+/**
+ * \brief The number of bytes allocated for the lines.
+ */
+@property (readonly) NSUInteger size;
+
+/**
+ * \brief Reset the line index to the single line of an empty string.
+ */
+-(void)removeAllLines;
+
+/**
+ * \brief Return the line number containing a character index.
+ *
+ * \param index The character index. An index at or beyond the end of the
+ *              string returns the last line number.
+ *
+ * \return The line number, starting at 1.
+ */
+-(NSUInteger)lineNumberForCharacterIndex:(NSUInteger)index;
+
+/**
+ * \brief Return the character index of the first character of a line.
+ *
+ * \param lineNumber The line number, starting at 1. Line numbers beyond the
+ *                   last line are clamped to the last line.
+ *
+ * \return The index of the first character of the line.
+ */
+-(NSUInteger)characterIndexForLineNumber:(NSUInteger)lineNumber;
+
+/**
+ * \brief Return the character range of a line, including its line terminator.
+ *
+ * \param lineNumber The line number, starting at 1. Line numbers beyond the
+ *                   last line are clamped to the last line.
+ *
+ * \return The range of characters in the line.
+ */
+-(NSRange)rangeOfLineNumber:(NSUInteger)lineNumber;
+
+/**
+ * \brief Copy the lengths of a range of lines, including their line
+ *        terminators.
+ *
+ * \details The blocks holding the lines are copied in order, so the cost is
+ *          O(log n) plus the number of lines, rather than a lookup per line.
+ *
+ * \param buffer A C array of at least lineRange.length elements, set to the
+ *               length of each line. Lines beyond the last line are set to
+ *               zero.
+ *
+ * \param lineRange The range of line numbers, starting at 1.
+ */
+-(void)getLineLengths:(NSUInteger *)buffer inLineRange:(NSRange)lineRange;
+
+/**
+ * \brief Replace a range of lines with lines of the given lengths.
+ *
+ * \details Lines following the replaced range keep their lengths, so their
+ *          positions move by the difference in length without being visited.
+ *          The cost is O(log n) in the number of lines, plus the number of new
+ *          lines and the capacity of a block.
+ *
+ * \param lineRange The range of line numbers to replace. The location is the
+ *                  first line number, starting at 1, and the length is the
+ *                  number of lines removed. A location of numberOfLines + 1
+ *                  with a zero length appends lines.
+ *
+ * \param lineLengths A C array with the length of each new line, including its
+ *                    line terminator.
+ *
+ * \param count The number of new lines. The index must contain at least one
+ *              line after the replacement.
+ */
+-(void)replaceLinesInRange:(NSRange)lineRange withLineLengths:(const NSUInteger *)lineLengths count:(NSUInteger)count;
+
+/**
+ * \brief Update the line index for a replacement of characters in the indexed
+ *        string.
+ *
+ * \details Only the lines touched by the edit are rescanned: the characters
+ *          of the first and last edited lines that are kept, and the
+ *          replacement string. Characters are read in chunks with
+ *          getCharacters:range: into a fixed buffer, and the new line lengths
+ *          are spliced into the index in a single batch, so the memory used is
+ *          proportional to the number of new lines. The line preceding the
+ *          edit is included when the edit starts a line, in order to join or
+ *          split carriage return and newline pairs. An edit crossing the
+ *          boundary of a block replaces only the blocks of its lines, so the
+ *          cost is O(log n) plus the length of the edited lines and of the
+ *          replacement string, wherever the edit is.
+ *
+ * \param range The range of replaced characters in the indexed string.
+ *
+ * \param string The replacement string.
+ *
+ * \param text The indexed string before the replacement.
+ *
+ * \return The range of line numbers spanned by the edit after the
+ *         replacement. The difference in the number of lines is the change in
+ *         numberOfLines.
+ */
+-(NSRange)replaceCharactersInRange:(NSRange)range withString:(NSString *)string inString:(NSString *)text;
+
+@end
@@ -0,0 +1,594 @@
+/**
+ * \file PLLineIndex.m
+ * \brief Liasis Python IDE line index implementation file.
+ *
+ * \details
+ * This file contains the method implementation for an object relating physical
+ * line numbers with character positions in a string.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLLineIndex.h"
+
+/**
+ * \brief The maximum number of lines stored in a single block.
+ */
+#define PL_LINE_INDEX_BLOCK_CAPACITY 512
+
+/**
+ * \brief A block of consecutive lines in the line index, and a node of the
+ *        treap of blocks.
+ */
+typedef struct PLLineIndexBlock {
+        /**
+         * \brief The blocks preceding and following this block in its subtree.
+         */
+        struct PLLineIndexBlock * left, * right;
+
+        /**
+         * \brief The random priority of the block, greater than the priorities
+         *        of its children.
+         */
+        uint32_t priority;
+
+        /**
+         * \brief The number of blocks, lines and characters of the subtree of
+         *        the block.
+         */
+        NSUInteger subtreeBlocks, subtreeLines, subtreeLength;
+
+        /**
+         * \brief The number of lines stored in the block.
+         */
+        NSUInteger numberOfLines;
+
+        /**
+         * \brief The number of characters spanned by the lines in the block.
+         */
+        NSUInteger length;
+
+        /**
+         * \brief The length of each line, including its line terminator.
+         */
+        NSUInteger lineLengths[PL_LINE_INDEX_BLOCK_CAPACITY];
+} PLLineIndexBlock;
+
+/**
+ * \brief A run of consecutive line lengths, the new lines of a block being
+ *        read from several runs.
+ */
+typedef struct PLLineLengthRun {
+        const NSUInteger * lineLengths;
+        NSUInteger count;
+} PLLineLengthRun;
+
+/**
+ * \brief The number of characters read at once when scanning for lines.
+ */
+#define PL_LINE_INDEX_SCAN_BUFFER_LENGTH 4096
+
+/**
+ * \brief The state of a scan for line terminators over consecutive strings.
+ */
+typedef struct PLLineScanner {
+        /**
+         * \brief A malloc'ed array with the length of each terminated line.
+         */
+        NSUInteger * lineLengths;
+
+        /**
+         * \brief The number of terminated lines.
+         */
+        NSUInteger count;
+
+        /**
+         * \brief The number of elements allocated in lineLengths.
+         */
+        NSUInteger capacity;
+
+        /**
+         * \brief The length of the line being scanned.
+         */
+        NSUInteger lineLength;
+
+        /**
+         * \brief Flag denoting if the last character was a carriage return.
+         */
+        BOOL followsCarriageReturn;
+} PLLineScanner;
+
+#pragma mark Line Scanning Utility Functions
+
+/**
+ * \brief Return YES for the characters terminating a line, matching those
+ *        used by lineRangeForRange:.
+ */
+static inline BOOL isLineTerminator(unichar character)
+{
+        return (character == '\n' || character == '\r' ||
+                character == 0x0085 || character == 0x2028 || character == 0x2029);
+}
+
+/**
+ * \brief Scan a range of a string for line terminators.
+ *
+ * \details The string is read in chunks with getCharacters:range:. A newline
+ *          directly following a carriage return, even across strings, is
+ *          added to the line terminated by the carriage return.
+ */
+static void lineScannerScanString(PLLineScanner * scanner, NSString * string, NSRange range)
+{
+        unichar buffer[PL_LINE_INDEX_SCAN_BUFFER_LENGTH];
+        NSUInteger i, chunkLength;
+        unichar character;
+        while (range.length > 0) {
+                chunkLength = MIN(range.length, (NSUInteger)PL_LINE_INDEX_SCAN_BUFFER_LENGTH);
+                [string getCharacters:buffer range:NSMakeRange(range.location, chunkLength)];
+                for (i = 0; i < chunkLength; i++) {
+                        character = buffer[i];
+                        if (character == '\n' && scanner->followsCarriageReturn) {
+                                scanner->lineLengths[scanner->count - 1]++;
+                                scanner->followsCarriageReturn = NO;
+                                continue;
+                        }
+                        scanner->lineLength++;
+                        scanner->followsCarriageReturn = (character == '\r');
+                        if (isLineTerminator(character) == NO)
+                                continue;
+                        if (scanner->count == scanner->capacity) {
+                                scanner->capacity = MAX(2 * scanner->capacity, (NSUInteger)16);
+                                scanner->lineLengths = realloc(scanner->lineLengths, scanner->capacity * sizeof(NSUInteger));
+                        }
+                        scanner->lineLengths[scanner->count++] = scanner->lineLength;
+                        scanner->lineLength = 0;
+                }
+                range.location += chunkLength;
+                range.length -= chunkLength;
+        }
+}
+
+#pragma mark Treap Utility Functions
+
+/**
+ * \brief Return the number of blocks of a subtree, zero for NULL.
+ */
+static inline NSUInteger subtreeBlocks(PLLineIndexBlock * block)
+{
+        return (block) ? block->subtreeBlocks : 0;
+}
+
+/**
+ * \brief Return the number of lines of a subtree, zero for NULL.
+ */
+static inline NSUInteger subtreeLines(PLLineIndexBlock * block)
+{
+        return (block) ? block->subtreeLines : 0;
+}
+
+/**
+ * \brief Return the number of characters of a subtree, zero for NULL.
+ */
+static inline NSUInteger subtreeLength(PLLineIndexBlock * block)
+{
+        return (block) ? block->subtreeLength : 0;
+}
+
+/**
+ * \brief Recompute the number of blocks, lines and characters of the subtree
+ *        of a block from its children.
+ */
+static inline void updateSubtree(PLLineIndexBlock * block)
+{
+        block->subtreeBlocks = subtreeBlocks(block->left) + 1 + subtreeBlocks(block->right);
+        block->subtreeLines = subtreeLines(block->left) + block->numberOfLines + subtreeLines(block->right);
+        block->subtreeLength = subtreeLength(block->left) + block->length + subtreeLength(block->right);
+}
+
+/**
+ * \brief Return the next priority of a xorshift generator.
+ */
+static inline uint32_t nextPriority(uint32_t * seed)
+{
+        *seed ^= *seed << 13;
+        *seed ^= *seed >> 17;
+        *seed ^= *seed << 5;
+        return *seed;
+}
+
+/**
+ * \brief Free the blocks of a subtree.
+ */
+static void freeBlocks(PLLineIndexBlock * block)
+{
+        if (block == NULL)
+                return;
+        freeBlocks(block->left);
+        freeBlocks(block->right);
+        free(block);
+}
+
+/**
+ * \brief Merge two treaps, all the lines of the first preceding those of the
+ *        second, and return the root of the merged treap.
+ */
+static PLLineIndexBlock * mergeBlocks(PLLineIndexBlock * first, PLLineIndexBlock * second)
+{
+        if (first == NULL)
+                return second;
+        if (second == NULL)
+                return first;
+        if (first->priority > second->priority) {
+                first->right = mergeBlocks(first->right, second);
+                updateSubtree(first);
+                return first;
+        }
+        second->left = mergeBlocks(first, second->left);
+        updateSubtree(second);
+        return second;
+}
+
+/**
+ * \brief Split a treap into its first blocks and the blocks following them.
+ */
+static void splitBlocks(PLLineIndexBlock * block, NSUInteger count, PLLineIndexBlock ** first, PLLineIndexBlock ** second)
+{
+        if (block == NULL) {
+                *first = NULL;
+                *second = NULL;
+                return;
+        }
+        if (count <= subtreeBlocks(block->left)) {
+                splitBlocks(block->left, count, first, &block->left);
+                updateSubtree(block);
+                *second = block;
+        } else {
+                splitBlocks(block->right, count - subtreeBlocks(block->left) - 1, &block->right, second);
+                updateSubtree(block);
+                *first = block;
+        }
+}
+
+/**
+ * \brief Recompute the subtrees on the path from the root of a treap to the
+ *        block at an index, after the lines of that block changed.
+ */
+static void updatePathToBlock(PLLineIndexBlock * block, NSUInteger blockIndex)
+{
+        NSUInteger leftBlocks = subtreeBlocks(block->left);
+        if (blockIndex < leftBlocks)
+                updatePathToBlock(block->left, blockIndex);
+        else if (blockIndex > leftBlocks)
+                updatePathToBlock(block->right, blockIndex - leftBlocks - 1);
+        updateSubtree(block);
+}
+
+/**
+ * \brief Return the block containing a zero based line, and the index of the
+ *        block and of its first character.
+ *
+ * \details On return, line is the zero based line in the block. A line equal
+ *          to the number of lines of the treap is found at the end of its last
+ *          block, to append lines.
+ */
+static PLLineIndexBlock * findBlockOfLine(PLLineIndexBlock * block, NSUInteger * line, NSUInteger * blockIndex, NSUInteger * blockStart)
+{
+        NSUInteger leftLines;
+        *blockIndex = 0;
+        *blockStart = 0;
+        while (block) {
+                leftLines = subtreeLines(block->left);
+                if (*line < leftLines) {
+                        block = block->left;
+                        continue;
+                }
+                *line -= leftLines;
+                *blockIndex += subtreeBlocks(block->left);
+                *blockStart += subtreeLength(block->left);
+                if (*line < block->numberOfLines || block->right == NULL)
+                        break;
+                *line -= block->numberOfLines;
+                *blockIndex += 1;
+                *blockStart += block->length;
+                block = block->right;
+        }
+        return block;
+}
+
+/**
+ * \brief Return the block containing a character index, which must be less
+ *        than the length of the treap, and the zero based line of its first
+ *        line.
+ *
+ * \details On return, index is the character index in the block.
+ */
+static PLLineIndexBlock * findBlockOfCharacter(PLLineIndexBlock * block, NSUInteger * index, NSUInteger * firstLine)
+{
+        NSUInteger leftLength;
+        *firstLine = 0;
+        while (block) {
+                leftLength = subtreeLength(block->left);
+                if (*index < leftLength) {
+                        block = block->left;
+                        continue;
+                }
+                *index -= leftLength;
+                *firstLine += subtreeLines(block->left);
+                if (*index < block->length)
+                        break;
+                *index -= block->length;
+                *firstLine += block->numberOfLines;
+                block = block->right;
+        }
+        return block;
+}
+
+/**
+ * \brief Copy the lengths of consecutive lines of a subtree, starting at a zero
+ *        based line of the subtree, and return the number of lines copied.
+ *
+ * \details Only the subtrees holding the lines are visited, so the cost is
+ *          O(log n) plus the number of lines copied.
+ */
+static NSUInteger copyLineLengths(PLLineIndexBlock * block, NSUInteger line, NSUInteger count, NSUInteger * buffer)
+{
+        NSUInteger copied = 0, leftLines, length;
+        if (block == NULL || count == 0)
+                return 0;
+        leftLines = subtreeLines(block->left);
+        if (line < leftLines)
+                copied = copyLineLengths(block->left, line, count, buffer);
+        line = (line > leftLines) ? line - leftLines : 0;
+        if (copied < count && line < block->numberOfLines) {
+                length = MIN(block->numberOfLines - line, count - copied);
+                memcpy(buffer + copied, block->lineLengths + line, length * sizeof(NSUInteger));
+                copied += length;
+        }
+        line = (line > block->numberOfLines) ? line - block->numberOfLines : 0;
+        if (copied < count)
+                copied += copyLineLengths(block->right, line, count - copied, buffer + copied);
+        return copied;
+}
+
+/**
+ * \brief Create the blocks holding the lines of consecutive runs, and return
+ *        the root of their treap.
+ *
+ * \details The lines are spread evenly over the fewest blocks holding them,
+ *          so that every block is at least half full when there is more than
+ *          one. No block is created for zero lines.
+ */
+static PLLineIndexBlock * createBlocks(const PLLineLengthRun * runs, NSUInteger numberOfRuns, uint32_t * seed)
+{
+        PLLineIndexBlock * root = NULL, * block;
+        NSUInteger numberOfLines = 0, numberOfBlocks, run = 0, offset = 0, i, j, count;
+        for (i = 0; i < numberOfRuns; i++)
+                numberOfLines += runs[i].count;
+        numberOfBlocks = (numberOfLines + PL_LINE_INDEX_BLOCK_CAPACITY - 1) / PL_LINE_INDEX_BLOCK_CAPACITY;
+        for (i = 0; i < numberOfBlocks; i++) {
+                block = malloc(sizeof(PLLineIndexBlock));
+                block->left = NULL;
+                block->right = NULL;
+                block->priority = nextPriority(seed);
+                block->numberOfLines = numberOfLines / numberOfBlocks + (i < numberOfLines % numberOfBlocks);
+                block->length = 0;
+                for (j = 0; j < block->numberOfLines; j += count) {
+                        while (offset == runs[run].count) {
+                                run++;
+                                offset = 0;
+                        }
+                        count = MIN(block->numberOfLines - j, runs[run].count - offset);
+                        memcpy(block->lineLengths + j, runs[run].lineLengths + offset, count * sizeof(NSUInteger));
+                        offset += count;
+                }
+                for (j = 0; j < block->numberOfLines; j++)
+                        block->length += block->lineLengths[j];
+                updateSubtree(block);
+                root = mergeBlocks(root, block);
+        }
+        return root;
+}
+
+#pragma mark -
+
+@implementation PLLineIndex
+
+-(id)init
+{
+        self = [super init];
+        if (self) {
+                seed = 0x9E3779B9;
+                root = NULL;
+                [self removeAllLines];
+        }
+        return self;
+}
+
+-(void)dealloc
+{
+        freeBlocks(root);
+        [super dealloc];
+}
+
+#pragma mark - Querying Lines
+
+-(NSUInteger)numberOfLines
+{
+        return subtreeLines(root);
+}
+
+-(NSUInteger)length
+{
+        return subtreeLength(root);
+}
+
+-(NSUInteger)size
+{
+        return subtreeBlocks(root) * sizeof(PLLineIndexBlock);
+}
+
+-(NSUInteger)lineNumberForCharacterIndex:(NSUInteger)index
+{
+        NSUInteger firstLine, line = 0;
+        PLLineIndexBlock * block;
+        if (index >= [self length])
+                return [self numberOfLines];
+        block = findBlockOfCharacter(root, &index, &firstLine);
+        while (index >= block->lineLengths[line]) {
+                index -= block->lineLengths[line];
+                line++;
+        }
+        return firstLine + line + 1;
+}
+
+-(NSUInteger)characterIndexForLineNumber:(NSUInteger)lineNumber
+{
+        return [self rangeOfLineNumber:lineNumber].location;
+}
+
+-(NSRange)rangeOfLineNumber:(NSUInteger)lineNumber
+{
+        NSUInteger blockIndex, line, location, numberOfLines;
+        PLLineIndexBlock * block;
+        numberOfLines = [self numberOfLines];
+        if (lineNumber > numberOfLines)
+                lineNumber = numberOfLines;
+        line = (lineNumber > 0) ? lineNumber - 1 : 0;
+        block = findBlockOfLine(root, &line, &blockIndex, &location);
+        for (NSUInteger i = 0; i < line; i++)
+                location += block->lineLengths[i];
+        return NSMakeRange(location, block->lineLengths[line]);
+}
+
+-(void)getLineLengths:(NSUInteger *)buffer inLineRange:(NSRange)lineRange
+{
+        NSUInteger copied = 0;
+        if (lineRange.location > 0)
+                copied = copyLineLengths(root, lineRange.location - 1, lineRange.length, buffer);
+        memset(buffer + copied, 0, (lineRange.length - copied) * sizeof(NSUInteger));
+}
+
+#pragma mark - Editing Lines
+
+-(void)removeAllLines
+{
+        NSUInteger emptyLine = 0;
+        PLLineLengthRun run = {&emptyLine, 1};
+        freeBlocks(root);
+        root = createBlocks(&run, 1, &seed);
+}
+
+-(void)replaceLinesInRange:(NSRange)lineRange withLineLengths:(const NSUInteger *)lineLengths count:(NSUInteger)count
+{
+        PLLineIndexBlock * firstBlock, * lastBlock, * before, * middle, * after, * previous = NULL, * next = NULL;
+        NSUInteger firstIndex, lastIndex, firstLine, lastLine, tailCount, numberOfLines, start, i;
+        PLLineLengthRun runs[4];
+        NSUInteger numberOfRuns = 0, removedLength = 0, addedLength = 0;
+
+        numberOfLines = [self numberOfLines];
+        if (lineRange.location == 0 || NSMaxRange(lineRange) > numberOfLines + 1)
+                goto exit;
+        if (lineRange.length >= numberOfLines && count == 0)
+                goto exit;
+
+        /* locate the first removed line and the line following the last one */
+        firstLine = lineRange.location - 1;
+        firstBlock = findBlockOfLine(root, &firstLine, &firstIndex, &start);
+        lastLine = NSMaxRange(lineRange) - 1;
+        lastBlock = findBlockOfLine(root, &lastLine, &lastIndex, &start);
+        tailCount = lastBlock->numberOfLines - lastLine;
+
+        /* lines replaced within a block that stays at least half full are replaced in place */
+        if (firstBlock == lastBlock &&
+            firstLine + count + tailCount <= PL_LINE_INDEX_BLOCK_CAPACITY &&
+            (firstLine + count + tailCount >= PL_LINE_INDEX_BLOCK_CAPACITY / 2 || root->subtreeBlocks == 1)) {
+                for (i = firstLine; i < lastLine; i++)
+                        removedLength += firstBlock->lineLengths[i];
+                for (i = 0; i < count; i++)
+                        addedLength += lineLengths[i];
+                memmove(firstBlock->lineLengths + firstLine + count,
+                        firstBlock->lineLengths + lastLine,
+                        tailCount * sizeof(NSUInteger));
+                memcpy(firstBlock->lineLengths + firstLine, lineLengths, count * sizeof(NSUInteger));
+                firstBlock->numberOfLines = firstLine + count + tailCount;
+                firstBlock->length = firstBlock->length - removedLength + addedLength;
+                updatePathToBlock(root, firstIndex);
+                goto exit;
+        }
+
+        /* detach the blocks spanned by the replaced range */
+        splitBlocks(root, firstIndex, &before, &middle);
+        splitBlocks(middle, lastIndex - firstIndex + 1, &middle, &after);
+
+        /* a block that would be less than half full takes the lines of a neighbour */
+        if (firstLine + count + tailCount < PL_LINE_INDEX_BLOCK_CAPACITY / 2) {
+                if (after)
+                        splitBlocks(after, 1, &next, &after);
+                else if (before)
+                        splitBlocks(before, before->subtreeBlocks - 1, &before, &previous);
+        }
+        if (previous)
+                runs[numberOfRuns++] = (PLLineLengthRun){previous->lineLengths, previous->numberOfLines};
+        runs[numberOfRuns++] = (PLLineLengthRun){firstBlock->lineLengths, firstLine};
+        runs[numberOfRuns++] = (PLLineLengthRun){lineLengths, count};
+        runs[numberOfRuns++] = (PLLineLengthRun){lastBlock->lineLengths + lastLine, tailCount};
+        if (next)
+                runs[numberOfRuns++] = (PLLineLengthRun){next->lineLengths, next->numberOfLines};
+
+        /* replace them with blocks of the kept and new lines, touching only the edited lines */
+        root = mergeBlocks(mergeBlocks(before, createBlocks(runs, numberOfRuns, &seed)), after);
+        freeBlocks(middle);
+        freeBlocks(previous);
+        freeBlocks(next);
+exit:
+        return;
+}
+
+-(NSRange)replaceCharactersInRange:(NSRange)range withString:(NSString *)string inString:(NSString *)text
+{
+        PLLineScanner scanner = {NULL, 0, 0, 0, NO};
+        NSUInteger firstLine, lastLine, windowStart, windowEnd;
+        firstLine = [self lineNumberForCharacterIndex:(range.location > 0) ? range.location - 1 : 0];
+        lastLine = [self lineNumberForCharacterIndex:NSMaxRange(range)];
+        windowStart = [self characterIndexForLineNumber:firstLine];
+        windowEnd = NSMaxRange([self rangeOfLineNumber:lastLine]);
+
+        /* scan the edited lines as they will read after the replacement */
+        lineScannerScanString(&scanner, text, NSMakeRange(windowStart, range.location - windowStart));
+        lineScannerScanString(&scanner, string, NSMakeRange(0, [string length]));
+        lineScannerScanString(&scanner, text, NSMakeRange(NSMaxRange(range), windowEnd - NSMaxRange(range)));
+
+        /* the last line of the string is unterminated */
+        if (lastLine == [self numberOfLines]) {
+                if (scanner.count == scanner.capacity)
+                        scanner.lineLengths = realloc(scanner.lineLengths, (++scanner.capacity) * sizeof(NSUInteger));
+                scanner.lineLengths[scanner.count++] = scanner.lineLength;
+        }
+        [self replaceLinesInRange:NSMakeRange(firstLine, lastLine - firstLine + 1)
+                  withLineLengths:scanner.lineLengths
+                            count:scanner.count];
+        free(scanner.lineLengths);
+        return NSMakeRange(firstLine, scanner.count);
+}
+
+@end
@@ -0,0 +1,107 @@
+/**
+ * \file PLRopeAttributedString.h
+ * \brief Liasis Python IDE rope attributed string interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for a mutable
+ * attributed string storing its characters in a PLRopeString and its
+ * attributes in a balanced tree of runs.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#import "PLRopeString.h"
+
+/**
+ * \brief A run of consecutive characters with the same attributes. The runs
+ *        are private to the PLRopeAttributedString.
+ */
+typedef struct PLAttributeRun PLAttributeRun;
+
+/**
+ * \class PLRopeAttributedString \headerfile \headerfile
+ * \brief A mutable attributed string whose edits cost O(log n) wherever they
+ *        are.
+ *
+ * \details The characters are stored in a PLRopeString, and the attributes in
+ *          a treap of runs ordered by position, each run storing the number of
+ *          characters of its subtree like the chunks of the rope. Replacing
+ *          characters or setting attributes splits the runs at the ends of the
+ *          range and merges them back, coalescing the new run with equal
+ *          neighbors, so that coloring the same range again does not
+ *          fragment the runs.
+ *
+ *          The string returned by string is the rope itself, and reflects the
+ *          edits of the attributed string. Characters inserted take the
+ *          attributes of the first replaced character, or of the character
+ *          preceding them when no character is replaced, as in
+ *          NSMutableAttributedString.
+ */
+@interface PLRopeAttributedString : NSMutableAttributedString {
+        /**
+         * \brief The characters of the attributed string.
+         */
+        PLRopeString * string;
+
+        /**
+         * \brief The root of the treap of attribute runs, or NULL for an
+         *        empty string.
+         */
+        PLAttributeRun * root;
+
+        /**
+         * \brief The state of the generator of the priorities of new runs.
+         */
+        uint32_t seed;
+}
+
+/**
+ * \brief Initialize an empty attributed string.
+ */
+-(id)init;
+
+/**
+ * \brief Initialize an attributed string with the characters of a string and
+ *        no attributes.
+ */
+-(id)initWithString:(NSString *)aString;
+
+/**
+ * \brief Initialize an attributed string with the characters of a string
+ *        having the same attributes.
+ */
+-(id)initWithString:(NSString *)aString attributes:(NSDictionary *)attributes;
+
+/**
+ * \brief Initialize an attributed string with the characters and attributes
+ *        of another attributed string.
+ */
+-(id)initWithAttributedString:(NSAttributedString *)attributedString;
+
+/**
+ * \brief The number of attribute runs.
+ */
+@property (readonly) NSUInteger numberOfRuns;
+
+@end
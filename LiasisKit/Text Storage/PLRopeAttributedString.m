@@ -0,0 +1,429 @@
+/**
+ * \file PLRopeAttributedString.m
+ * \brief Liasis Python IDE rope attributed string implementation file.
+ *
+ * \details
+ * This file contains the method implementation for a mutable attributed string
+ * storing its characters in a PLRopeString and its attributes in a balanced
+ * tree of runs.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLRopeAttributedString.h"
+
+/**
+ * \brief A run of characters with the same attributes, and a node of the treap
+ *        of runs.
+ */
+struct PLAttributeRun {
+        /**
+         * \brief The runs preceding and following this run in its subtree.
+         */
+        struct PLAttributeRun * left, * right;
+
+        /**
+         * \brief The random priority of the run, greater than the priorities of
+         *        its children.
+         */
+        uint32_t priority;
+
+        /**
+         * \brief The number of characters of the subtree of the run.
+         */
+        NSUInteger length;
+
+        /**
+         * \brief The number of characters of the run.
+         */
+        NSUInteger runLength;
+
+        /**
+         * \brief The retained attributes of the characters of the run.
+         */
+        NSDictionary * attributes;
+};
+
+#pragma mark Treap Utility Functions
+
+/**
+ * \brief Return the number of characters of a subtree, zero for NULL.
+ */
+static inline NSUInteger subtreeLength(PLAttributeRun * run)
+{
+        return (run) ? run->length : 0;
+}
+
+/**
+ * \brief Recompute the number of characters of the subtree of a run from its
+ *        children.
+ */
+static inline void updateLength(PLAttributeRun * run)
+{
+        run->length = subtreeLength(run->left) + run->runLength + subtreeLength(run->right);
+}
+
+/**
+ * \brief Return the next priority of a xorshift generator.
+ */
+static inline uint32_t nextPriority(uint32_t * seed)
+{
+        *seed ^= *seed << 13;
+        *seed ^= *seed >> 17;
+        *seed ^= *seed << 5;
+        return *seed;
+}
+
+/**
+ * \brief Return whether two attribute dictionaries are equal, comparing their
+ *        pointers first.
+ */
+static inline BOOL equalAttributes(NSDictionary * first, NSDictionary * second)
+{
+        return first == second || [first isEqualToDictionary:second];
+}
+
+/**
+ * \brief Allocate a run of characters with the same attributes.
+ */
+static PLAttributeRun * createRun(NSDictionary * attributes, NSUInteger length, uint32_t * seed)
+{
+        PLAttributeRun * run = malloc(sizeof(PLAttributeRun));
+        run->left = NULL;
+        run->right = NULL;
+        run->priority = nextPriority(seed);
+        run->runLength = length;
+        run->length = length;
+        run->attributes = [attributes retain];
+        return run;
+}
+
+/**
+ * \brief Free the runs of a subtree, releasing their attributes.
+ */
+static void freeRuns(PLAttributeRun * run)
+{
+        if (run == NULL)
+                return;
+        freeRuns(run->left);
+        freeRuns(run->right);
+        [run->attributes release];
+        free(run);
+}
+
+/**
+ * \brief Merge two treaps, all the characters of the first preceding those of
+ *        the second, and return the root of the merged treap.
+ */
+static PLAttributeRun * mergeRuns(PLAttributeRun * first, PLAttributeRun * second)
+{
+        if (first == NULL)
+                return second;
+        if (second == NULL)
+                return first;
+        if (first->priority > second->priority) {
+                first->right = mergeRuns(first->right, second);
+                updateLength(first);
+                return first;
+        }
+        second->left = mergeRuns(first, second->left);
+        updateLength(second);
+        return second;
+}
+
+/**
+ * \brief Split a treap into the runs preceding a character index and the runs
+ *        following it.
+ *
+ * \details A run containing the index is split in two runs with the same
+ *          attributes. The second run takes the priority of the first, so that
+ *          it can replace it in the subtree of its parent.
+ */
+static void splitRuns(PLAttributeRun * run, NSUInteger index, PLAttributeRun ** first, PLAttributeRun ** second, uint32_t * seed)
+{
+        NSUInteger leftLength, offset;
+        PLAttributeRun * tail, * right;
+        if (run == NULL) {
+                *first = NULL;
+                *second = NULL;
+                return;
+        }
+        leftLength = subtreeLength(run->left);
+        if (index <= leftLength) {
+                splitRuns(run->left, index, first, &run->left, seed);
+                updateLength(run);
+                *second = run;
+        } else if (index >= leftLength + run->runLength) {
+                splitRuns(run->right, index - leftLength - run->runLength, &run->right, second, seed);
+                updateLength(run);
+                *first = run;
+        } else {
+                offset = index - leftLength;
+                tail = createRun(run->attributes, run->runLength - offset, seed);
+                tail->priority = run->priority;
+                right = run->right;
+                run->runLength = offset;
+                run->right = NULL;
+                updateLength(run);
+                *first = run;
+                *second = mergeRuns(tail, right);
+        }
+}
+
+/**
+ * \brief Return the last or first run of a treap, or NULL for an empty treap.
+ */
+static PLAttributeRun * edgeRun(PLAttributeRun * run, BOOL last)
+{
+        while (run && ((last) ? run->right : run->left))
+                run = (last) ? run->right : run->left;
+        return run;
+}
+
+/**
+ * \brief Add characters to the last or first run of a non empty treap.
+ */
+static void extendEdgeRun(PLAttributeRun * run, BOOL last, NSUInteger count)
+{
+        while (YES) {
+                run->length += count;
+                if (((last) ? run->right : run->left) == NULL)
+                        break;
+                run = (last) ? run->right : run->left;
+        }
+        run->runLength += count;
+}
+
+/**
+ * \brief Remove the first run of a non empty treap, and return the root of
+ *        the remaining runs.
+ *
+ * \param removedLength Set to the number of characters of the removed run.
+ */
+static PLAttributeRun * removeFirstRun(PLAttributeRun * run, NSUInteger * removedLength)
+{
+        PLAttributeRun * right;
+        if (run->left) {
+                run->left = removeFirstRun(run->left, removedLength);
+                run->length -= *removedLength;
+                return run;
+        }
+        right = run->right;
+        *removedLength = run->runLength;
+        [run->attributes release];
+        free(run);
+        return right;
+}
+
+/**
+ * \brief Merge two treaps, coalescing the last run of the first and the first
+ *        run of the second if their attributes are equal, and return the root
+ *        of the merged treap.
+ */
+static PLAttributeRun * joinRuns(PLAttributeRun * first, PLAttributeRun * last)
+{
+        PLAttributeRun * previousRun = edgeRun(first, YES), * nextRun = edgeRun(last, NO);
+        NSUInteger nextLength;
+        if (previousRun && nextRun && equalAttributes(previousRun->attributes, nextRun->attributes)) {
+                last = removeFirstRun(last, &nextLength);
+                extendEdgeRun(first, YES, nextLength);
+        }
+        return mergeRuns(first, last);
+}
+
+/**
+ * \brief Insert a run of characters between two treaps, and return the root of
+ *        the merged treap.
+ *
+ * \details The run is added to the preceding run if it has equal attributes
+ *          rather than creating a run, and coalesced with the following run.
+ */
+static PLAttributeRun * insertRun(PLAttributeRun * first, PLAttributeRun * last, NSDictionary * attributes, NSUInteger length, uint32_t * seed)
+{
+        PLAttributeRun * previousRun = edgeRun(first, YES);
+        if (previousRun && equalAttributes(previousRun->attributes, attributes))
+                extendEdgeRun(first, YES, length);
+        else
+                first = mergeRuns(first, createRun(attributes, length, seed));
+        return joinRuns(first, last);
+}
+
+/**
+ * \brief Return the run containing a character index, which must be less than
+ *        the length of the treap, and set the index of its first character.
+ */
+static PLAttributeRun * findRun(PLAttributeRun * run, NSUInteger index, NSUInteger * runStart)
+{
+        NSUInteger start = 0, leftLength;
+        while (run) {
+                leftLength = subtreeLength(run->left);
+                if (index < leftLength) {
+                        run = run->left;
+                } else if (index < leftLength + run->runLength) {
+                        *runStart = start + leftLength;
+                        break;
+                } else {
+                        index -= leftLength + run->runLength;
+                        start += leftLength + run->runLength;
+                        run = run->right;
+                }
+        }
+        return run;
+}
+
+/**
+ * \brief Return the number of runs of a subtree.
+ */
+static NSUInteger countRuns(PLAttributeRun * run)
+{
+        if (run == NULL)
+                return 0;
+        return countRuns(run->left) + 1 + countRuns(run->right);
+}
+
+#pragma mark -
+
+@implementation PLRopeAttributedString
+
+-(id)init
+{
+        self = [super init];
+        if (self) {
+                string = [[PLRopeString alloc] init];
+                root = NULL;
+                seed = 0x2545F491;
+        }
+        return self;
+}
+
+-(id)initWithString:(NSString *)aString
+{
+        return [self initWithString:aString attributes:nil];
+}
+
+-(id)initWithString:(NSString *)aString attributes:(NSDictionary *)attributes
+{
+        self = [self init];
+        if (self) {
+                [string replaceCharactersInRange:NSMakeRange(0, 0) withString:aString];
+                if ([aString length] > 0)
+                        root = createRun((attributes) ? attributes : @{}, [aString length], &seed);
+        }
+        return self;
+}
+
+-(id)initWithAttributedString:(NSAttributedString *)attributedString
+{
+        NSUInteger index = 0;
+        NSRange range;
+        NSDictionary * attributes;
+        self = [self init];
+        if (self) {
+                [string replaceCharactersInRange:NSMakeRange(0, 0) withString:[attributedString string]];
+                while (index < [attributedString length]) {
+                        attributes = [attributedString attributesAtIndex:index effectiveRange:&range];
+                        range.length = NSMaxRange(range) - index;
+                        root = insertRun(root, NULL, attributes, range.length, &seed);
+                        index = NSMaxRange(range);
+                }
+        }
+        return self;
+}
+
+-(void)dealloc
+{
+        [string release];
+        freeRuns(root);
+        [super dealloc];
+}
+
+-(NSUInteger)numberOfRuns
+{
+        return countRuns(root);
+}
+
+#pragma mark - NSAttributedString and NSMutableAttributedString primitives
+
+-(NSString *)string
+{
+        return string;
+}
+
+-(NSUInteger)length
+{
+        return subtreeLength(root);
+}
+
+-(NSDictionary *)attributesAtIndex:(NSUInteger)location effectiveRange:(NSRangePointer)range
+{
+        PLAttributeRun * run;
+        NSUInteger runStart = 0;
+        if (location >= subtreeLength(root))
+                [NSException raise:NSRangeException format:@"Index %lu out of bounds", (unsigned long)location];
+        run = findRun(root, location, &runStart);
+        if (range)
+                *range = NSMakeRange(runStart, run->runLength);
+        return run->attributes;
+}
+
+-(void)replaceCharactersInRange:(NSRange)range withString:(NSString *)aString
+{
+        PLAttributeRun * first, * replaced, * last;
+        NSDictionary * attributes = @{};
+        NSUInteger length = subtreeLength(root);
+        if (NSMaxRange(range) > length)
+                [NSException raise:NSRangeException format:@"Range %@ out of bounds", NSStringFromRange(range)];
+
+        /* the new characters take the attributes of the first replaced or the preceding character */
+        if (range.length > 0 || (range.location == 0 && length > 0))
+                attributes = [self attributesAtIndex:range.location effectiveRange:NULL];
+        else if (range.location > 0)
+                attributes = [self attributesAtIndex:range.location - 1 effectiveRange:NULL];
+        [attributes retain];
+
+        [string replaceCharactersInRange:range withString:aString];
+        splitRuns(root, range.location, &first, &last, &seed);
+        splitRuns(last, range.length, &replaced, &last, &seed);
+        freeRuns(replaced);
+        if ([aString length] > 0)
+                root = insertRun(first, last, attributes, [aString length], &seed);
+        else
+                root = joinRuns(first, last);
+        [attributes release];
+}
+
+-(void)setAttributes:(NSDictionary *)attributes range:(NSRange)range
+{
+        PLAttributeRun * first, * replaced, * last;
+        if (NSMaxRange(range) > subtreeLength(root))
+                [NSException raise:NSRangeException format:@"Range %@ out of bounds", NSStringFromRange(range)];
+        if (range.length == 0)
+                return;
+        attributes = [[attributes copy] autorelease];
+        splitRuns(root, range.location, &first, &last, &seed);
+        splitRuns(last, range.length, &replaced, &last, &seed);
+        freeRuns(replaced);
+        root = insertRun(first, last, (attributes) ? attributes : @{}, range.length, &seed);
+}
+
+@end
@@ -0,0 +1,129 @@
+/**
+ * \file PLRopeString.h
+ * \brief Liasis Python IDE rope string interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for a mutable string
+ * storing its characters in a balanced tree of chunks, so that replacing
+ * characters anywhere in a large string does not move the rest of the string.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ * \brief A chunk of consecutive characters of a rope string. The chunks are
+ *        private to the PLRopeString.
+ */
+typedef struct PLRopeChunk PLRopeChunk;
+
+/**
+ * \class PLRopeString \headerfile \headerfile
+ * \brief A mutable string stored as a rope of character chunks.
+ *
+ * \details The characters are split in chunks of at most 1024 characters,
+ *          kept in order by a treap: a binary tree ordered by the position of
+ *          the chunks, balanced by random priorities. Each chunk stores the
+ *          number of characters of its subtree, so that the chunk containing a
+ *          character index is found in O(log n). Replacing characters splits
+ *          the treap at the ends of the replaced range and merges it back with
+ *          the chunks of the new characters, in O(log n) expected time
+ *          wherever the edit is, rather than moving the tail of a contiguous
+ *          buffer.
+ *
+ *          Characters typed at the end of a chunk are added to the free space
+ *          of the chunk, so that typing does not create a chunk per keystroke,
+ *          and the chunks on either side of an edit are merged when their
+ *          characters fit in one chunk, so that deletions do not leave small
+ *          chunks behind.
+ *          A rope being edited remembers the chunk of the last character read,
+ *          so that reading characters in order with characterAtIndex: does not
+ *          walk the tree for each character; getCharacters:range: copies whole
+ *          chunks.
+ *
+ *          Copying a rope string is O(1): the copy shares the chunks of the
+ *          rope, whose references are counted. A shared chunk is never
+ *          modified; an edit of either string copies the chunks on the path to
+ *          the edited characters, so that a copy made on the main thread may
+ *          be read on other threads while the original is edited. A copy
+ *          remembers no chunk, and reading it only walks the shared chunks, so
+ *          that any number of threads may read it at once.
+ */
+@interface PLRopeString : NSMutableString {
+        /**
+         * \brief The root of the treap of chunks, or NULL for an empty string.
+         */
+        PLRopeChunk * root;
+
+        /**
+         * \brief The state of the generator of the priorities of new chunks.
+         */
+        uint32_t seed;
+
+        /**
+         * \brief Whether the chunk of the last character read is remembered,
+         *        which is NO for a copy made by copyWithZone:.
+         */
+        BOOL remembersLastChunk;
+
+        /**
+         * \brief The chunk of the last character read, and the index of its
+         *        first character, or NULL.
+         */
+        PLRopeChunk * lastChunk;
+        NSUInteger lastChunkStart;
+}
+
+/**
+ * \brief Initialize an empty rope string.
+ */
+-(id)init;
+
+/**
+ * \brief Initialize a rope string with the characters of a string.
+ */
+-(id)initWithString:(NSString *)aString;
+
+/**
+ * \brief Return a rope string sharing the chunks of the receiver, in O(1).
+ *
+ * \details The copy remembers no chunk, so that several threads may read it at
+ *          once.
+ */
+-(id)copyWithZone:(NSZone *)zone;
+
+/**
+ * \brief Return a rope string sharing the chunks of the receiver, in O(1).
+ *
+ * \details The copy remembers the chunk of the last character read, as a
+ *          rope being edited does.
+ */
+-(id)mutableCopyWithZone:(NSZone *)zone;
+
+/**
+ * \brief The number of chunks of the rope.
+ */
+@property (readonly) NSUInteger numberOfChunks;
+
+@end
@@ -0,0 +1,505 @@
+/**
+ * \file PLRopeString.m
+ * \brief Liasis Python IDE rope string implementation file.
+ *
+ * \details
+ * This file contains the method implementation for a mutable string storing its
+ * characters in a balanced tree of chunks, so that replacing characters
+ * anywhere in a large string does not move the rest of the string.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLRopeString.h"
+#import <stdatomic.h>
+
+/**
+ * \brief The maximum number of characters stored in a single chunk.
+ */
+#define PL_ROPE_CHUNK_CAPACITY 1024
+
+/**
+ * \brief A chunk of consecutive characters, and a node of the treap of chunks.
+ */
+struct PLRopeChunk {
+        /**
+         * \brief The chunks preceding and following this chunk in its subtree.
+         */
+        struct PLRopeChunk * left, * right;
+
+        /**
+         * \brief The number of parent chunks and ropes referencing the chunk.
+         *        A chunk referenced more than once is shared with a copy of the
+         *        rope, and is copied before it is modified.
+         */
+        atomic_int_fast32_t referenceCount;
+
+        /**
+         * \brief The random priority of the chunk, greater than the priorities
+         *        of its children.
+         */
+        uint32_t priority;
+
+        /**
+         * \brief The number of characters of the subtree of the chunk.
+         */
+        NSUInteger length;
+
+        /**
+         * \brief The number of characters stored in the chunk.
+         */
+        NSUInteger numberOfCharacters;
+
+        /**
+         * \brief The characters of the chunk.
+         */
+        unichar characters[PL_ROPE_CHUNK_CAPACITY];
+};
+
+#pragma mark Treap Utility Functions
+
+/**
+ * \brief Return the number of characters of a subtree, zero for NULL.
+ */
+static inline NSUInteger subtreeLength(PLRopeChunk * chunk)
+{
+        return (chunk) ? chunk->length : 0;
+}
+
+/**
+ * \brief Recompute the number of characters of the subtree of a chunk from its
+ *        children.
+ */
+static inline void updateLength(PLRopeChunk * chunk)
+{
+        chunk->length = subtreeLength(chunk->left) + chunk->numberOfCharacters + subtreeLength(chunk->right);
+}
+
+/**
+ * \brief Return the next priority of a xorshift generator.
+ */
+static inline uint32_t nextPriority(uint32_t * seed)
+{
+        *seed ^= *seed << 13;
+        *seed ^= *seed >> 17;
+        *seed ^= *seed << 5;
+        return *seed;
+}
+
+/**
+ * \brief Allocate a chunk holding a copy of at most PL_ROPE_CHUNK_CAPACITY
+ *        characters.
+ */
+static PLRopeChunk * createChunk(const unichar * characters, NSUInteger count, uint32_t * seed)
+{
+        PLRopeChunk * chunk = malloc(sizeof(PLRopeChunk));
+        chunk->left = NULL;
+        chunk->right = NULL;
+        atomic_init(&chunk->referenceCount, 1);
+        chunk->priority = nextPriority(seed);
+        chunk->numberOfCharacters = count;
+        chunk->length = count;
+        memcpy(chunk->characters, characters, count * sizeof(unichar));
+        return chunk;
+}
+
+/**
+ * \brief Add a reference to the chunks of a subtree.
+ */
+static void retainChunks(PLRopeChunk * chunk)
+{
+        if (chunk)
+                atomic_fetch_add(&chunk->referenceCount, 1);
+}
+
+/**
+ * \brief Remove a reference to the chunks of a subtree, freeing the chunks no
+ *        longer referenced.
+ *
+ * \details The references are counted atomically, so that a copy of the rope
+ *          may be released on another thread.
+ */
+static void releaseChunks(PLRopeChunk * chunk)
+{
+        if (chunk == NULL || atomic_fetch_sub(&chunk->referenceCount, 1) > 1)
+                return;
+        releaseChunks(chunk->left);
+        releaseChunks(chunk->right);
+        free(chunk);
+}
+
+/**
+ * \brief Return a chunk that may be modified in place of a referenced chunk.
+ *
+ * \details A chunk shared with a copy of the rope is replaced by a copy
+ *          referencing the same children, so that edits copy the chunks on the
+ *          path to the edited characters rather than the whole rope. Only the
+ *          chunks reached through unshared chunks are modified, so the chunks
+ *          of a copy never change.
+ */
+static PLRopeChunk * uniqueChunk(PLRopeChunk * chunk)
+{
+        PLRopeChunk * copy;
+        if (atomic_load(&chunk->referenceCount) == 1)
+                return chunk;
+        copy = malloc(sizeof(PLRopeChunk));
+        memcpy(copy, chunk, offsetof(PLRopeChunk, characters) + chunk->numberOfCharacters * sizeof(unichar));
+        atomic_init(&copy->referenceCount, 1);
+        retainChunks(copy->left);
+        retainChunks(copy->right);
+        releaseChunks(chunk);
+        return copy;
+}
+
+/**
+ * \brief Merge two treaps, all the characters of the first preceding those of
+ *        the second, and return the root of the merged treap.
+ */
+static PLRopeChunk * mergeChunks(PLRopeChunk * first, PLRopeChunk * second)
+{
+        if (first == NULL)
+                return second;
+        if (second == NULL)
+                return first;
+        if (first->priority > second->priority) {
+                first = uniqueChunk(first);
+                first->right = mergeChunks(first->right, second);
+                updateLength(first);
+                return first;
+        }
+        second = uniqueChunk(second);
+        second->left = mergeChunks(first, second->left);
+        updateLength(second);
+        return second;
+}
+
+/**
+ * \brief Split a treap into the characters preceding a character index and
+ *        the characters following it.
+ *
+ * \details A chunk containing the index is split in two chunks, the second
+ *          holding the characters from the index. The second chunk takes the
+ *          priority of the first, so that it can replace it in the subtree of
+ *          its parent.
+ */
+static void splitChunks(PLRopeChunk * chunk, NSUInteger index, PLRopeChunk ** first, PLRopeChunk ** second, uint32_t * seed)
+{
+        NSUInteger leftLength, offset;
+        PLRopeChunk * tail, * right;
+        if (chunk == NULL) {
+                *first = NULL;
+                *second = NULL;
+                return;
+        }
+        chunk = uniqueChunk(chunk);
+        leftLength = subtreeLength(chunk->left);
+        if (index <= leftLength) {
+                splitChunks(chunk->left, index, first, &chunk->left, seed);
+                updateLength(chunk);
+                *second = chunk;
+        } else if (index >= leftLength + chunk->numberOfCharacters) {
+                splitChunks(chunk->right, index - leftLength - chunk->numberOfCharacters, &chunk->right, second, seed);
+                updateLength(chunk);
+                *first = chunk;
+        } else {
+                offset = index - leftLength;
+                tail = createChunk(chunk->characters + offset, chunk->numberOfCharacters - offset, seed);
+                tail->priority = chunk->priority;
+                right = chunk->right;
+                chunk->numberOfCharacters = offset;
+                chunk->right = NULL;
+                updateLength(chunk);
+                *first = chunk;
+                *second = mergeChunks(tail, right);
+        }
+}
+
+/**
+ * \brief Add characters at the end of the last chunk of a treap, which must
+ *        have room for them, and return the root of the treap.
+ */
+static PLRopeChunk * appendToLastChunk(PLRopeChunk * chunk, const unichar * characters, NSUInteger count)
+{
+        chunk = uniqueChunk(chunk);
+        chunk->length += count;
+        if (chunk->right) {
+                chunk->right = appendToLastChunk(chunk->right, characters, count);
+        } else {
+                memcpy(chunk->characters + chunk->numberOfCharacters, characters, count * sizeof(unichar));
+                chunk->numberOfCharacters += count;
+        }
+        return chunk;
+}
+
+/**
+ * \brief Add characters at the start of the first chunk of a treap, which must
+ *        have room for them, and return the root of the treap.
+ */
+static PLRopeChunk * prependToFirstChunk(PLRopeChunk * chunk, const unichar * characters, NSUInteger count)
+{
+        chunk = uniqueChunk(chunk);
+        chunk->length += count;
+        if (chunk->left) {
+                chunk->left = prependToFirstChunk(chunk->left, characters, count);
+        } else {
+                memmove(chunk->characters + count, chunk->characters, chunk->numberOfCharacters * sizeof(unichar));
+                memcpy(chunk->characters, characters, count * sizeof(unichar));
+                chunk->numberOfCharacters += count;
+        }
+        return chunk;
+}
+
+/**
+ * \brief Return the number of characters stored in the last or first chunk of
+ *        a treap, or PL_ROPE_CHUNK_CAPACITY for an empty treap.
+ */
+static NSUInteger edgeChunkLength(PLRopeChunk * chunk, BOOL last)
+{
+        if (chunk == NULL)
+                return PL_ROPE_CHUNK_CAPACITY;
+        while ((last) ? chunk->right : chunk->left)
+                chunk = (last) ? chunk->right : chunk->left;
+        return chunk->numberOfCharacters;
+}
+
+/**
+ * \brief Remove the first chunk of a treap, and return the root of the treap.
+ */
+static PLRopeChunk * removeFirstChunk(PLRopeChunk * chunk)
+{
+        PLRopeChunk * right;
+        chunk = uniqueChunk(chunk);
+        if (chunk->left) {
+                chunk->left = removeFirstChunk(chunk->left);
+                updateLength(chunk);
+                return chunk;
+        }
+        right = chunk->right;
+        chunk->right = NULL;
+        releaseChunks(chunk);
+        return right;
+}
+
+/**
+ * \brief Move the characters of the first chunk of a treap to the last chunk
+ *        of the treap preceding it, if they fit in one chunk.
+ *
+ * \details An edit splits the chunks at the ends of the replaced range, so
+ *          that deleting or typing within a chunk would otherwise leave two
+ *          partly filled chunks for each edit.
+ */
+static void mergeEdgeChunks(PLRopeChunk ** first, PLRopeChunk ** second)
+{
+        PLRopeChunk * head;
+        if (*first == NULL || *second == NULL)
+                return;
+        for (head = *second; head->left; head = head->left)
+                ;
+        if (edgeChunkLength(*first, YES) + head->numberOfCharacters > PL_ROPE_CHUNK_CAPACITY)
+                return;
+        *first = appendToLastChunk(*first, head->characters, head->numberOfCharacters);
+        *second = removeFirstChunk(*second);
+}
+
+/**
+ * \brief Build a treap from characters, in chunks filled to capacity.
+ */
+static PLRopeChunk * createChunks(const unichar * characters, NSUInteger count, uint32_t * seed)
+{
+        PLRopeChunk * chunks = NULL;
+        NSUInteger chunkLength;
+        while (count > 0) {
+                chunkLength = MIN(count, (NSUInteger)PL_ROPE_CHUNK_CAPACITY);
+                chunks = mergeChunks(chunks, createChunk(characters, chunkLength, seed));
+                characters += chunkLength;
+                count -= chunkLength;
+        }
+        return chunks;
+}
+
+/**
+ * \brief Return the chunk containing a character index, which must be less
+ *        than the length of the treap, and set the index of its first
+ *        character.
+ */
+static PLRopeChunk * findChunk(PLRopeChunk * chunk, NSUInteger index, NSUInteger * chunkStart)
+{
+        NSUInteger start = 0, leftLength;
+        while (chunk) {
+                leftLength = subtreeLength(chunk->left);
+                if (index < leftLength) {
+                        chunk = chunk->left;
+                } else if (index < leftLength + chunk->numberOfCharacters) {
+                        *chunkStart = start + leftLength;
+                        break;
+                } else {
+                        index -= leftLength + chunk->numberOfCharacters;
+                        start += leftLength + chunk->numberOfCharacters;
+                        chunk = chunk->right;
+                }
+        }
+        return chunk;
+}
+
+/**
+ * \brief Copy the characters of a subtree within a range of character indexes,
+ *        the subtree starting at an index.
+ */
+static void copyCharacters(PLRopeChunk * chunk, NSUInteger start, NSRange range, unichar * buffer)
+{
+        NSUInteger chunkStart, first, last;
+        if (chunk == NULL || range.location >= start + chunk->length || NSMaxRange(range) <= start)
+                return;
+        chunkStart = start + subtreeLength(chunk->left);
+        if (range.location < chunkStart)
+                copyCharacters(chunk->left, start, range, buffer);
+        first = MAX(range.location, chunkStart);
+        last = MIN(NSMaxRange(range), chunkStart + chunk->numberOfCharacters);
+        if (last > first)
+                memcpy(buffer + (first - range.location), chunk->characters + (first - chunkStart), (last - first) * sizeof(unichar));
+        if (NSMaxRange(range) > chunkStart + chunk->numberOfCharacters)
+                copyCharacters(chunk->right, chunkStart + chunk->numberOfCharacters, range, buffer);
+}
+
+/**
+ * \brief Return the number of chunks of a subtree.
+ */
+static NSUInteger countChunks(PLRopeChunk * chunk)
+{
+        if (chunk == NULL)
+                return 0;
+        return countChunks(chunk->left) + 1 + countChunks(chunk->right);
+}
+
+#pragma mark -
+
+@implementation PLRopeString
+
+-(id)init
+{
+        self = [super init];
+        if (self) {
+                root = NULL;
+                seed = 0x9E3779B9;
+                remembersLastChunk = YES;
+                lastChunk = NULL;
+                lastChunkStart = 0;
+        }
+        return self;
+}
+
+-(id)initWithString:(NSString *)aString
+{
+        self = [self init];
+        if (self)
+                [self replaceCharactersInRange:NSMakeRange(0, 0) withString:aString];
+        return self;
+}
+
+-(void)dealloc
+{
+        releaseChunks(root);
+        [super dealloc];
+}
+
+-(id)copyWithZone:(NSZone *)zone
+{
+        PLRopeString * copy = [[PLRopeString allocWithZone:zone] init];
+        retainChunks(root);
+        copy->root = root;
+        copy->seed = nextPriority(&seed);
+        copy->remembersLastChunk = NO;
+        return copy;
+}
+
+-(id)mutableCopyWithZone:(NSZone *)zone
+{
+        PLRopeString * copy = [self copyWithZone:zone];
+        copy->remembersLastChunk = YES;
+        return copy;
+}
+
+-(NSUInteger)numberOfChunks
+{
+        return countChunks(root);
+}
+
+#pragma mark - NSString and NSMutableString primitives
+
+-(NSUInteger)length
+{
+        return subtreeLength(root);
+}
+
+-(unichar)characterAtIndex:(NSUInteger)index
+{
+        PLRopeChunk * chunk;
+        NSUInteger chunkStart;
+        if (index >= subtreeLength(root))
+                [NSException raise:NSRangeException format:@"Index %lu out of bounds", (unsigned long)index];
+        /* a copy may be read by several threads at once, so it keeps nothing between reads */
+        if (remembersLastChunk == NO) {
+                chunk = findChunk(root, index, &chunkStart);
+                return chunk->characters[index - chunkStart];
+        }
+        if (lastChunk == NULL || index < lastChunkStart || index >= lastChunkStart + lastChunk->numberOfCharacters)
+                lastChunk = findChunk(root, index, &lastChunkStart);
+        return lastChunk->characters[index - lastChunkStart];
+}
+
+-(void)getCharacters:(unichar *)buffer range:(NSRange)range
+{
+        if (NSMaxRange(range) > subtreeLength(root))
+                [NSException raise:NSRangeException format:@"Range %@ out of bounds", NSStringFromRange(range)];
+        copyCharacters(root, 0, range, buffer);
+}
+
+-(void)replaceCharactersInRange:(NSRange)range withString:(NSString *)aString
+{
+        PLRopeChunk * first, * replaced, * last;
+        NSUInteger count = [aString length];
+        unichar * characters;
+        if (NSMaxRange(range) > subtreeLength(root))
+                [NSException raise:NSRangeException format:@"Range %@ out of bounds", NSStringFromRange(range)];
+        lastChunk = NULL;
+
+        splitChunks(root, range.location, &first, &last, &seed);
+        splitChunks(last, range.length, &replaced, &last, &seed);
+        releaseChunks(replaced);
+
+        /* typed characters fill the free space of the adjacent chunks */
+        characters = malloc(MAX(count, (NSUInteger)1) * sizeof(unichar));
+        [aString getCharacters:characters range:NSMakeRange(0, count)];
+        if (first && count <= PL_ROPE_CHUNK_CAPACITY - edgeChunkLength(first, YES)) {
+                first = appendToLastChunk(first, characters, count);
+        } else if (last && count <= PL_ROPE_CHUNK_CAPACITY - edgeChunkLength(last, NO)) {
+                last = prependToFirstChunk(last, characters, count);
+        } else {
+                first = mergeChunks(first, createChunks(characters, count, &seed));
+        }
+        free(characters);
+        mergeEdgeChunks(&first, &last);
+        root = mergeChunks(first, last);
+}
+
+@end
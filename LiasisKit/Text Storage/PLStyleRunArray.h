@@ -0,0 +1,147 @@
+/**
+ * \file PLStyleRunArray.h
+ * \brief Liasis Python IDE style run array interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for a compact
+ * run-length array of the syntax coloring styles of the characters of a text
+ * storage.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ * \brief The index of a style in a PLStyleTable.
+ */
+typedef uint16_t PLStyle;
+
+enum {
+        PLStyleDefault = 0
+};
+
+/**
+ * \brief A range of characters to color with a style.
+ */
+typedef struct {
+        NSRange range;
+        PLStyle style;
+} PLStyleRun;
+
+/**
+ * \class PLStyleRunArray \headerfile \headerfile
+ * \brief Store the style of each character of a string as runs of small
+ *        integer styles.
+ *
+ * \details A run is a 32 bit length and a 16 bit PLStyle, rather than an
+ *          attribute dictionary run of an NSMutableAttributedString. Adjacent
+ *          runs always have different styles. Runs are grouped in fixed
+ *          capacity blocks, at least half full, kept in order by a treap as the
+ *          lines of a PLLineIndex are. Each block stores the number of runs and
+ *          characters of its subtree, so that finding the style of a character
+ *          is O(log n). Replacing the styles of a range of characters splices
+ *          the runs of the range in the blocks it spans, which are split out of
+ *          the treap and merged back in O(log n), so that an edit never visits
+ *          the other blocks.
+ *
+ *          The styles are resolved into attributes by a PLStyleTable only when
+ *          they are asked for.
+ */
+@interface PLStyleRunArray : NSObject {
+        /**
+         * \brief The root of the treap of run blocks, or NULL when there are no
+         *        runs.
+         */
+        struct PLStyleRunBlock * root;
+
+        /**
+         * \brief The state of the generator of the priorities of new blocks.
+         */
+        uint32_t seed;
+}
+
+/**
+ * \brief Initialize an empty style run array.
+ */
+-(id)init;
+
+/**
+ * \brief The number of characters of the runs.
+ */
+@property (readonly) NSUInteger length;
+
+/**
+ * \brief The number of runs.
+ */
+@property (readonly) NSUInteger numberOfRuns;
+
+/**
+ * \brief The number of bytes allocated for the runs.
+ */
+@property (readonly) NSUInteger size;
+
+/**
+ * \brief Return the style of a character.
+ *
+ * \param index The index of the character, less than the length.
+ *
+ * \param range Set to the range of the run of the character, unless NULL.
+ */
+-(PLStyle)styleAtIndex:(NSUInteger)index effectiveRange:(NSRangePointer)range;
+
+/**
+ * \brief Replace a range of characters with a number of characters.
+ *
+ * \details The new characters take the style of the first replaced
+ *          character, or of the character preceding them when no character is
+ *          replaced, or of the following character at the start of the string,
+ *          as in NSMutableAttributedString.
+ *
+ * \param range The range of characters replaced.
+ *
+ * \param length The number of new characters.
+ */
+-(void)replaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length;
+
+/**
+ * \brief Set the styles of a range of characters from style runs.
+ *
+ * \details The characters of the range not covered by a run take the default
+ *          style.
+ *
+ * \param runs A C array of runs sorted by location and not overlapping. Runs
+ *             are clipped to the range.
+ *
+ * \param count The number of runs.
+ *
+ * \param range The range of characters whose styles are set.
+ */
+-(void)setStyleRuns:(const PLStyleRun *)runs count:(NSUInteger)count inRange:(NSRange)range;
+
+/**
+ * \brief Set the style of a range of characters.
+ */
+-(void)setStyle:(PLStyle)style range:(NSRange)range;
+
+@end
@@ -0,0 +1,649 @@
+/**
+ * \file PLStyleRunArray.m
+ * \brief Liasis Python IDE style run array implementation file.
+ *
+ * \details
+ * This file contains the method implementation for a compact run-length array
+ * of the syntax coloring styles of the characters of a text storage.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLStyleRunArray.h"
+
+/**
+ * \brief The maximum number of runs stored in a single block.
+ */
+#define PL_STYLE_RUN_BLOCK_CAPACITY 512
+
+/**
+ * \brief A block of consecutive runs in the style run array, and a node of the
+ *        treap of blocks.
+ */
+typedef struct PLStyleRunBlock {
+        /**
+         * \brief The blocks preceding and following this block in its subtree.
+         */
+        struct PLStyleRunBlock * left, * right;
+
+        /**
+         * \brief The random priority of the block, greater than the priorities
+         *        of its children.
+         */
+        uint32_t priority;
+
+        /**
+         * \brief The number of blocks, runs and characters of the subtree of
+         *        the block.
+         */
+        NSUInteger subtreeBlocks, subtreeRuns, subtreeLength;
+
+        /**
+         * \brief The number of runs stored in the block.
+         */
+        NSUInteger numberOfRuns;
+
+        /**
+         * \brief The number of characters spanned by the runs in the block.
+         */
+        NSUInteger length;
+
+        /**
+         * \brief The number of characters of each run.
+         */
+        uint32_t runLengths[PL_STYLE_RUN_BLOCK_CAPACITY];
+
+        /**
+         * \brief The style of each run.
+         */
+        PLStyle styles[PL_STYLE_RUN_BLOCK_CAPACITY];
+} PLStyleRunBlock;
+
+/**
+ * \brief A growable list of runs built before they are spliced into the
+ *        blocks.
+ */
+typedef struct PLStyleRunList {
+        /**
+         * \brief A malloc'ed array with the length of each run.
+         */
+        uint32_t * runLengths;
+
+        /**
+         * \brief A malloc'ed array with the style of each run.
+         */
+        PLStyle * styles;
+
+        /**
+         * \brief The number of runs.
+         */
+        NSUInteger count;
+
+        /**
+         * \brief The number of elements allocated in the arrays.
+         */
+        NSUInteger capacity;
+} PLStyleRunList;
+
+/**
+ * \brief A slice of consecutive runs, the new runs of a block being read from
+ *        several slices.
+ */
+typedef struct PLStyleRunSlice {
+        const uint32_t * runLengths;
+        const PLStyle * styles;
+        NSUInteger count;
+} PLStyleRunSlice;
+
+#pragma mark Run List Utility Functions
+
+/**
+ * \brief Append characters of a style to a run list.
+ *
+ * \details Empty runs are skipped, and characters of the style of the last
+ *          run are added to it, so that adjacent runs always differ. Runs are
+ *          split at UINT32_MAX characters.
+ */
+static void runListAppend(PLStyleRunList * list, NSUInteger length, PLStyle style)
+{
+        NSUInteger added;
+        while (length > 0) {
+                if (list->count > 0 && list->styles[list->count - 1] == style && list->runLengths[list->count - 1] < UINT32_MAX) {
+                        added = MIN(length, (NSUInteger)(UINT32_MAX - list->runLengths[list->count - 1]));
+                        list->runLengths[list->count - 1] += (uint32_t)added;
+                        length -= added;
+                        continue;
+                }
+                if (list->count == list->capacity) {
+                        list->capacity = MAX(2 * list->capacity, (NSUInteger)16);
+                        list->runLengths = realloc(list->runLengths, list->capacity * sizeof(uint32_t));
+                        list->styles = realloc(list->styles, list->capacity * sizeof(PLStyle));
+                }
+                added = MIN(length, (NSUInteger)UINT32_MAX);
+                list->runLengths[list->count] = (uint32_t)added;
+                list->styles[list->count] = style;
+                list->count++;
+                length -= added;
+        }
+}
+
+#pragma mark Treap Utility Functions
+
+/**
+ * \brief Return the number of blocks of a subtree, zero for NULL.
+ */
+static inline NSUInteger subtreeBlocks(PLStyleRunBlock * block)
+{
+        return (block) ? block->subtreeBlocks : 0;
+}
+
+/**
+ * \brief Return the number of runs of a subtree, zero for NULL.
+ */
+static inline NSUInteger subtreeRuns(PLStyleRunBlock * block)
+{
+        return (block) ? block->subtreeRuns : 0;
+}
+
+/**
+ * \brief Return the number of characters of a subtree, zero for NULL.
+ */
+static inline NSUInteger subtreeLength(PLStyleRunBlock * block)
+{
+        return (block) ? block->subtreeLength : 0;
+}
+
+/**
+ * \brief Recompute the number of blocks, runs and characters of the subtree
+ *        of a block from its children.
+ */
+static inline void updateSubtree(PLStyleRunBlock * block)
+{
+        block->subtreeBlocks = subtreeBlocks(block->left) + 1 + subtreeBlocks(block->right);
+        block->subtreeRuns = subtreeRuns(block->left) + block->numberOfRuns + subtreeRuns(block->right);
+        block->subtreeLength = subtreeLength(block->left) + block->length + subtreeLength(block->right);
+}
+
+/**
+ * \brief Return the next priority of a xorshift generator.
+ */
+static inline uint32_t nextPriority(uint32_t * seed)
+{
+        *seed ^= *seed << 13;
+        *seed ^= *seed >> 17;
+        *seed ^= *seed << 5;
+        return *seed;
+}
+
+/**
+ * \brief Free the blocks of a subtree.
+ */
+static void freeBlocks(PLStyleRunBlock * block)
+{
+        if (block == NULL)
+                return;
+        freeBlocks(block->left);
+        freeBlocks(block->right);
+        free(block);
+}
+
+/**
+ * \brief Merge two treaps, all the runs of the first preceding those of the
+ *        second, and return the root of the merged treap.
+ */
+static PLStyleRunBlock * mergeBlocks(PLStyleRunBlock * first, PLStyleRunBlock * second)
+{
+        if (first == NULL)
+                return second;
+        if (second == NULL)
+                return first;
+        if (first->priority > second->priority) {
+                first->right = mergeBlocks(first->right, second);
+                updateSubtree(first);
+                return first;
+        }
+        second->left = mergeBlocks(first, second->left);
+        updateSubtree(second);
+        return second;
+}
+
+/**
+ * \brief Split a treap into its first blocks and the blocks following them.
+ */
+static void splitBlocks(PLStyleRunBlock * block, NSUInteger count, PLStyleRunBlock ** first, PLStyleRunBlock ** second)
+{
+        if (block == NULL) {
+                *first = NULL;
+                *second = NULL;
+                return;
+        }
+        if (count <= subtreeBlocks(block->left)) {
+                splitBlocks(block->left, count, first, &block->left);
+                updateSubtree(block);
+                *second = block;
+        } else {
+                splitBlocks(block->right, count - subtreeBlocks(block->left) - 1, &block->right, second);
+                updateSubtree(block);
+                *first = block;
+        }
+}
+
+/**
+ * \brief Recompute the subtrees on the path from the root of a treap to the
+ *        block at an index, after the runs of that block changed.
+ */
+static void updatePathToBlock(PLStyleRunBlock * block, NSUInteger blockIndex)
+{
+        NSUInteger leftBlocks = subtreeBlocks(block->left);
+        if (blockIndex < leftBlocks)
+                updatePathToBlock(block->left, blockIndex);
+        else if (blockIndex > leftBlocks)
+                updatePathToBlock(block->right, blockIndex - leftBlocks - 1);
+        updateSubtree(block);
+}
+
+/**
+ * \brief Return the block containing a zero based run, and the index of the
+ *        block.
+ *
+ * \details On return, run is the zero based run in the block. A run equal to
+ *          the number of runs of the treap is found at the end of its last
+ *          block, to append runs. NULL is returned for an empty treap.
+ */
+static PLStyleRunBlock * findBlockOfRun(PLStyleRunBlock * block, NSUInteger * run, NSUInteger * blockIndex)
+{
+        NSUInteger leftRuns;
+        *blockIndex = 0;
+        while (block) {
+                leftRuns = subtreeRuns(block->left);
+                if (*run < leftRuns) {
+                        block = block->left;
+                        continue;
+                }
+                *run -= leftRuns;
+                *blockIndex += subtreeBlocks(block->left);
+                if (*run < block->numberOfRuns || block->right == NULL)
+                        break;
+                *run -= block->numberOfRuns;
+                *blockIndex += 1;
+                block = block->right;
+        }
+        return block;
+}
+
+/**
+ * \brief Return the block containing a character index, which must be less
+ *        than the length of the treap, and the zero based index of its first
+ *        run.
+ *
+ * \details On return, index is the character index in the block.
+ */
+static PLStyleRunBlock * findBlockOfCharacter(PLStyleRunBlock * block, NSUInteger * index, NSUInteger * firstRun)
+{
+        NSUInteger leftLength;
+        *firstRun = 0;
+        while (block) {
+                leftLength = subtreeLength(block->left);
+                if (*index < leftLength) {
+                        block = block->left;
+                        continue;
+                }
+                *index -= leftLength;
+                *firstRun += subtreeRuns(block->left);
+                if (*index < block->length)
+                        break;
+                *index -= block->length;
+                *firstRun += block->numberOfRuns;
+                block = block->right;
+        }
+        return block;
+}
+
+/**
+ * \brief Create the blocks holding the runs of consecutive slices, and return
+ *        the root of their treap.
+ *
+ * \details The runs are spread evenly over the fewest blocks holding them, so
+ *          that every block is at least half full when there is more than one.
+ *          No block is created for zero runs.
+ */
+static PLStyleRunBlock * createBlocks(const PLStyleRunSlice * slices, NSUInteger numberOfSlices, uint32_t * seed)
+{
+        PLStyleRunBlock * root = NULL, * block;
+        NSUInteger numberOfRuns = 0, numberOfBlocks, slice = 0, offset = 0, i, j, count;
+        for (i = 0; i < numberOfSlices; i++)
+                numberOfRuns += slices[i].count;
+        numberOfBlocks = (numberOfRuns + PL_STYLE_RUN_BLOCK_CAPACITY - 1) / PL_STYLE_RUN_BLOCK_CAPACITY;
+        for (i = 0; i < numberOfBlocks; i++) {
+                block = malloc(sizeof(PLStyleRunBlock));
+                block->left = NULL;
+                block->right = NULL;
+                block->priority = nextPriority(seed);
+                block->numberOfRuns = numberOfRuns / numberOfBlocks + (i < numberOfRuns % numberOfBlocks);
+                block->length = 0;
+                for (j = 0; j < block->numberOfRuns; j += count) {
+                        while (offset == slices[slice].count) {
+                                slice++;
+                                offset = 0;
+                        }
+                        count = MIN(block->numberOfRuns - j, slices[slice].count - offset);
+                        memcpy(block->runLengths + j, slices[slice].runLengths + offset, count * sizeof(uint32_t));
+                        memcpy(block->styles + j, slices[slice].styles + offset, count * sizeof(PLStyle));
+                        offset += count;
+                }
+                for (j = 0; j < block->numberOfRuns; j++)
+                        block->length += block->runLengths[j];
+                updateSubtree(block);
+                root = mergeBlocks(root, block);
+        }
+        return root;
+}
+
+#pragma mark -
+
+@implementation PLStyleRunArray
+
+-(id)init
+{
+        self = [super init];
+        if (self) {
+                seed = 0x9E3779B9;
+                root = NULL;
+        }
+        return self;
+}
+
+-(void)dealloc
+{
+        freeBlocks(root);
+        [super dealloc];
+}
+
+#pragma mark - Querying Styles
+
+-(NSUInteger)length
+{
+        return subtreeLength(root);
+}
+
+-(NSUInteger)numberOfRuns
+{
+        return subtreeRuns(root);
+}
+
+-(NSUInteger)size
+{
+        return subtreeBlocks(root) * sizeof(PLStyleRunBlock);
+}
+
+-(PLStyle)styleAtIndex:(NSUInteger)index effectiveRange:(NSRangePointer)range
+{
+        NSUInteger firstRun, run = 0, location;
+        PLStyleRunBlock * block;
+        if (index >= [self length]) {
+                [NSException raise:NSRangeException format:@"Index %lu out of bounds; length %lu", (unsigned long)index, (unsigned long)[self length]];
+        }
+        location = index;
+        block = findBlockOfCharacter(root, &index, &firstRun);
+        while (index >= block->runLengths[run]) {
+                index -= block->runLengths[run];
+                run++;
+        }
+        if (range)
+                *range = NSMakeRange(location - index, block->runLengths[run]);
+        return block->styles[run];
+}
+
+#pragma mark - Editing Styles
+
+-(void)replaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length
+{
+        PLStyle style = PLStyleDefault;
+        NSUInteger textLength = [self length];
+        if (NSMaxRange(range) > textLength) {
+                [NSException raise:NSRangeException format:@"Range %@ out of bounds; length %lu", NSStringFromRange(range), (unsigned long)textLength];
+        }
+        if (range.length > 0)
+                style = [self styleAtIndex:range.location effectiveRange:NULL];
+        else if (range.location > 0)
+                style = [self styleAtIndex:range.location - 1 effectiveRange:NULL];
+        else if (textLength > 0)
+                style = [self styleAtIndex:0 effectiveRange:NULL];
+        [self spliceRunsInRange:range withRuns:NULL count:0 style:style length:length];
+}
+
+-(void)setStyleRuns:(const PLStyleRun *)runs count:(NSUInteger)count inRange:(NSRange)range
+{
+        PLStyleRunList list = {NULL, NULL, 0, 0};
+        NSUInteger i, start, end, position = range.location;
+        if (NSMaxRange(range) > [self length]) {
+                [NSException raise:NSRangeException format:@"Range %@ out of bounds; length %lu", NSStringFromRange(range), (unsigned long)[self length]];
+        }
+        for (i = 0; i < count; i++) {
+                start = MAX(runs[i].range.location, position);
+                end = MIN(NSMaxRange(runs[i].range), NSMaxRange(range));
+                if (end <= start)
+                        continue;
+                runListAppend(&list, start - position, PLStyleDefault);
+                runListAppend(&list, end - start, runs[i].style);
+                position = end;
+        }
+        runListAppend(&list, NSMaxRange(range) - position, PLStyleDefault);
+        [self spliceRunsInRange:range withRuns:&list count:list.count style:PLStyleDefault length:0];
+        free(list.runLengths);
+        free(list.styles);
+}
+
+-(void)setStyle:(PLStyle)style range:(NSRange)range
+{
+        if (NSMaxRange(range) > [self length]) {
+                [NSException raise:NSRangeException format:@"Range %@ out of bounds; length %lu", NSStringFromRange(range), (unsigned long)[self length]];
+        }
+        [self spliceRunsInRange:range withRuns:NULL count:0 style:style length:range.length];
+}
+
+#pragma mark - Private Methods
+
+/**
+ * \brief Return the index of the run containing a character.
+ *
+ * \param index The index of the character, less than the length.
+ *
+ * \param offset Set to the offset of the character in its run.
+ */
+-(NSUInteger)runIndexForCharacterIndex:(NSUInteger)index offset:(NSUInteger *)offset
+{
+        NSUInteger firstRun, run = 0;
+        PLStyleRunBlock * block;
+        block = findBlockOfCharacter(root, &index, &firstRun);
+        while (index >= block->runLengths[run]) {
+                index -= block->runLengths[run];
+                run++;
+        }
+        *offset = index;
+        return firstRun + run;
+}
+
+/**
+ * \brief Return the style of a run, and its length in runLength.
+ */
+-(PLStyle)getRunAtIndex:(NSUInteger)runIndex length:(NSUInteger *)runLength
+{
+        NSUInteger blockIndex;
+        PLStyleRunBlock * block = findBlockOfRun(root, &runIndex, &blockIndex);
+        *runLength = block->runLengths[runIndex];
+        return block->styles[runIndex];
+}
+
+/**
+ * \brief Replace the styles of a range of characters.
+ *
+ * \details The runs of the characters surrounding the range are spliced with
+ *          the new runs, coalescing the new runs with the neighbouring runs of
+ *          the same style, and the runs spanning them are replaced in the
+ *          blocks.
+ *
+ * \param range The range of characters replaced.
+ *
+ * \param list The new runs, or NULL for a single run of a style.
+ *
+ * \param count The number of new runs in list.
+ *
+ * \param style The style of the single run, when list is NULL.
+ *
+ * \param length The length of the single run, when list is NULL.
+ */
+-(void)spliceRunsInRange:(NSRange)range withRuns:(const PLStyleRunList *)list count:(NSUInteger)count style:(PLStyle)style length:(NSUInteger)length
+{
+        PLStyleRunList splice = {NULL, NULL, 0, 0};
+        NSUInteger textLength = [self length], numberOfRuns = [self numberOfRuns];
+        NSUInteger firstRun, lastRun, offset = 0, runLength, i;
+        PLStyle runStyle;
+
+        /* the head of the run containing the range, or the whole preceding run */
+        firstRun = (range.location < textLength) ? [self runIndexForCharacterIndex:range.location offset:&offset] : numberOfRuns;
+        if (offset > 0) {
+                runStyle = [self getRunAtIndex:firstRun length:&runLength];
+                runListAppend(&splice, offset, runStyle);
+        } else if (firstRun > 0) {
+                firstRun--;
+                runStyle = [self getRunAtIndex:firstRun length:&runLength];
+                runListAppend(&splice, runLength, runStyle);
+        }
+
+        /* the new runs */
+        if (list) {
+                for (i = 0; i < count; i++)
+                        runListAppend(&splice, list->runLengths[i], list->styles[i]);
+        } else {
+                runListAppend(&splice, length, style);
+        }
+
+        /* the tail of the run containing the end of the range */
+        lastRun = numberOfRuns;
+        if (NSMaxRange(range) < textLength) {
+                lastRun = [self runIndexForCharacterIndex:NSMaxRange(range) offset:&offset];
+                runStyle = [self getRunAtIndex:lastRun length:&runLength];
+                runListAppend(&splice, runLength - offset, runStyle);
+                lastRun++;
+        }
+
+        [self replaceRunsInRange:NSMakeRange(firstRun, lastRun - firstRun)
+                  withRunLengths:splice.runLengths
+                          styles:splice.styles
+                           count:splice.count];
+        free(splice.runLengths);
+        free(splice.styles);
+}
+
+/**
+ * \brief Replace a range of runs with new runs.
+ *
+ * \details Runs replaced within a block that stays at least half full are
+ *          replaced in place. Otherwise the blocks spanned by the range are
+ *          split out of the treap, and their kept runs and the new runs are
+ *          packed into new blocks merged back in O(log n), as in the
+ *          PLLineIndex. The new runs must differ in style from the runs
+ *          surrounding the range.
+ *
+ * \param runRange The zero based range of runs replaced.
+ *
+ * \param runLengths A C array with the length of each new run.
+ *
+ * \param styles A C array with the style of each new run.
+ *
+ * \param count The number of new runs.
+ */
+-(void)replaceRunsInRange:(NSRange)runRange withRunLengths:(const uint32_t *)runLengths styles:(const PLStyle *)styles count:(NSUInteger)count
+{
+        PLStyleRunBlock * firstBlock, * lastBlock, * before, * middle, * after, * previous = NULL, * next = NULL;
+        NSUInteger firstIndex, lastIndex, firstRun, lastRun, tailCount, i;
+        PLStyleRunSlice slices[4];
+        NSUInteger numberOfSlices = 0, removedLength = 0, addedLength = 0;
+
+        if (NSMaxRange(runRange) > [self numberOfRuns])
+                goto exit;
+        if (root == NULL) {
+                slices[numberOfSlices++] = (PLStyleRunSlice){runLengths, styles, count};
+                root = createBlocks(slices, numberOfSlices, &seed);
+                goto exit;
+        }
+
+        /* locate the first removed run and the run following the last one */
+        firstRun = runRange.location;
+        firstBlock = findBlockOfRun(root, &firstRun, &firstIndex);
+        lastRun = NSMaxRange(runRange);
+        lastBlock = findBlockOfRun(root, &lastRun, &lastIndex);
+        tailCount = lastBlock->numberOfRuns - lastRun;
+
+        /* runs replaced within a block that stays at least half full are replaced in place */
+        if (firstBlock == lastBlock &&
+            firstRun + count + tailCount <= PL_STYLE_RUN_BLOCK_CAPACITY &&
+            (firstRun + count + tailCount >= PL_STYLE_RUN_BLOCK_CAPACITY / 2 || root->subtreeBlocks == 1)) {
+                for (i = firstRun; i < lastRun; i++)
+                        removedLength += firstBlock->runLengths[i];
+                for (i = 0; i < count; i++)
+                        addedLength += runLengths[i];
+                memmove(firstBlock->runLengths + firstRun + count,
+                        firstBlock->runLengths + lastRun,
+                        tailCount * sizeof(uint32_t));
+                memmove(firstBlock->styles + firstRun + count,
+                        firstBlock->styles + lastRun,
+                        tailCount * sizeof(PLStyle));
+                memcpy(firstBlock->runLengths + firstRun, runLengths, count * sizeof(uint32_t));
+                memcpy(firstBlock->styles + firstRun, styles, count * sizeof(PLStyle));
+                firstBlock->numberOfRuns = firstRun + count + tailCount;
+                firstBlock->length = firstBlock->length - removedLength + addedLength;
+                updatePathToBlock(root, firstIndex);
+                goto exit;
+        }
+
+        /* detach the blocks spanned by the replaced range */
+        splitBlocks(root, firstIndex, &before, &middle);
+        splitBlocks(middle, lastIndex - firstIndex + 1, &middle, &after);
+
+        /* a block that would be less than half full takes the runs of a neighbour */
+        if (firstRun + count + tailCount < PL_STYLE_RUN_BLOCK_CAPACITY / 2) {
+                if (after)
+                        splitBlocks(after, 1, &next, &after);
+                else if (before)
+                        splitBlocks(before, before->subtreeBlocks - 1, &before, &previous);
+        }
+        if (previous)
+                slices[numberOfSlices++] = (PLStyleRunSlice){previous->runLengths, previous->styles, previous->numberOfRuns};
+        slices[numberOfSlices++] = (PLStyleRunSlice){firstBlock->runLengths, firstBlock->styles, firstRun};
+        slices[numberOfSlices++] = (PLStyleRunSlice){runLengths, styles, count};
+        slices[numberOfSlices++] = (PLStyleRunSlice){lastBlock->runLengths + lastRun, lastBlock->styles + lastRun, tailCount};
+        if (next)
+                slices[numberOfSlices++] = (PLStyleRunSlice){next->runLengths, next->styles, next->numberOfRuns};
+
+        /* replace them with blocks of the kept and new runs, touching only the edited runs */
+        root = mergeBlocks(mergeBlocks(before, createBlocks(slices, numberOfSlices, &seed)), after);
+        freeBlocks(middle);
+        freeBlocks(previous);
+        freeBlocks(next);
+exit:
+        return;
+}
+
+@end
@@ -0,0 +1,78 @@
+/**
+ * \file PLTextSnapshot.h
+ * \brief Liasis Python IDE text snapshot interface file.
+ *
+ * \details
+ * This file contains the function prototypes and interface for an immutable
+ * string of the characters of a text storage at an edit generation.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ * \class PLTextSnapshot \headerfile \headerfile
+ * \brief An immutable string of the characters of a text storage, and the
+ *        edit generation they reflect.
+ *
+ * \details A snapshot is taken on the main thread and read on any thread,
+ *          without locks, while the text storage is edited. The snapshot of a
+ *          text storage with the rope backing store shares the chunks of its
+ *          PLRopeString and is taken in O(1), the chunks being copied only
+ *          when an edit of the text storage modifies them. The snapshot of a
+ *          text storage with the attributed string backing store is a copy of
+ *          its string.
+ *
+ *          Reading a snapshot changes no state, so that any number of threads
+ *          may read the same snapshot at once.
+ */
+@interface PLTextSnapshot : NSString {
+        /**
+         * \brief The immutable characters of the snapshot.
+         */
+        NSString * string;
+
+        /**
+         * \brief The edit generation of the text storage when the snapshot was
+         *        taken.
+         */
+        NSUInteger generation;
+}
+
+/**
+ * \brief Initialize a snapshot of the characters of a string.
+ *
+ * \param aString The string, copied. The copy of a PLRopeString shares its
+ *                chunks.
+ *
+ * \param aGeneration The edit generation of the characters.
+ */
+-(id)initWithString:(NSString *)aString generation:(NSUInteger)aGeneration;
+
+/**
+ * \brief The edit generation of the text storage when the snapshot was taken.
+ */
+@property (readonly) NSUInteger generation;
+
+@end
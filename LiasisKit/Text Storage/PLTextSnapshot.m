@@ -0,0 +1,81 @@
+/**
+ * \file PLTextSnapshot.m
+ * \brief Liasis Python IDE text snapshot implementation file.
+ *
+ * \details
+ * This file contains the method implementation for an immutable string of the
+ * characters of a text storage at an edit generation.
+ *
+ * \copyright Copyright (C) 2012-2014 Jason Lomnitz and Danny Nicklas.
+ *
+ * This file is part of the Python Liasis IDE.
+ *
+ * The Python Liasis IDE is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The Python Liasis IDE is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Python Liasis IDE. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * \author Danny Nicklas.
+ * \author Jason Lomnitz.
+ * \date 2012-2014.
+ *
+ */
+
+#import "PLTextSnapshot.h"
+
+@implementation PLTextSnapshot
+
+-(id)initWithString:(NSString *)aString generation:(NSUInteger)aGeneration
+{
+        self = [super init];
+        if (self) {
+                string = [aString copy];
+                generation = aGeneration;
+        }
+        return self;
+}
+
+-(id)init
+{
+        return [self initWithString:@"" generation:0];
+}
+
+-(void)dealloc
+{
+        [string release];
+        [super dealloc];
+}
+
+-(id)copyWithZone:(NSZone *)zone
+{
+        return [self retain];
+}
+
+@synthesize generation;
+
+#pragma mark - NSString primitives
+
+-(NSUInteger)length
+{
+        return [string length];
+}
+
+-(unichar)characterAtIndex:(NSUInteger)index
+{
+        return [string characterAtIndex:index];
+}
+
+-(void)getCharacters:(unichar *)buffer range:(NSRange)range
+{
+        [string getCharacters:buffer range:range];
+}
+
+@end
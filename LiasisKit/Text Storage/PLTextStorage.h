@@ -31,6 +31,11 @@
 
 #import <Cocoa/Cocoa.h>
 #import "PLTextDocument.h"
+#import "PLLineIndex.h"
+#import "PLStyleRunArray.h"
+#import "PLEditJournal.h"
+#import "PLTextSnapshot.h"
+#import "PLRopeAttributedString.h"
 
 
 /**
@@ -38,42 +43,234 @@
  *        by the PLTextStorage.
  * \details The PLTextStorage class posts a notification with the name contained
  *          by this variable during the replaceCharactersInRange:withString:
- *          method, prior to manipulating the text storage data. This notification
- *          is important for the line number view behavior, since it allows for
- *          calculating the differences between previous and novel states. 
+ *          method, prior to manipulating the text storage data. It is posted
+ *          once for each batch of edits, before its first replacement, rather
+ *          than for each replacement. It has no user info and does not
+ *          describe the edits: the replacementString and replacementRange
+ *          are not yet set when it is posted, and the edits of the batch are
+ *          listed by the PLEditJournal of the matching
+ *          PLTextStorageDidReplaceStringNotification.
  * \note This may also be used to determine if any changes have been made to a
  *       file from the last save point.
  *
  */
 FOUNDATION_EXPORT NSString * PLTextStorageWillReplaceStringNotification;
+
+/**
+ * \brief Notification posted once for each batch of edits, after the edit
+ *        observers are given the edit journal of the batch.
+ *
+ * \details The user info dictionary holds the PLEditJournal of the batch for
+ *          the PLTextStorageEditJournalKey.
+ */
 FOUNDATION_EXPORT NSString * PLTextStorageDidReplaceStringNotification;
 
+/**
+ * \brief The user info key of the PLEditJournal of a
+ *        PLTextStorageDidReplaceStringNotification.
+ */
+FOUNDATION_EXPORT NSString * PLTextStorageEditJournalKey;
+
+@class PLTextStorage;
+@class PLLexerStates;
+@class PLSemanticOverlay;
+@class PLStyleTable;
+
+/**
+ * \protocol PLTextStorageObserver
+ * \brief The protocol of the objects folding the edits of a text storage into
+ *        their own indexes.
+ *
+ * \details An observer subscribes to the edits of the characters, to the
+ *          edits of the attributes, or to both, and implements the method of
+ *          each channel it subscribes to. Coloring the text through its style
+ *          runs or without editing is not an edit of the attributes. An edit
+ *          observer is not retained by the text storage, and must be removed
+ *          from it before it is deallocated.
+ */
+@protocol PLTextStorageObserver <NSObject>
+
+@optional
+
+/**
+ * \brief Fold a batch of edits of a text storage.
+ *
+ * \details This method is called once at the end of each batch of edits, the
+ *          outermost endEditing, or after a replacement of characters made
+ *          outside of beginEditing and endEditing. The text storage and its
+ *          line index are in their state after the last edit.
+ *
+ * \param textStorage The edited text storage.
+ *
+ * \param journal The edits of the batch, in order.
+ */
+-(void)textStorage:(PLTextStorage *)textStorage didApplyEdits:(PLEditJournal *)journal;
+
+/**
+ * \brief Handle the edits of the attributes of a batch of edits, without
+ *        replacement of characters.
+ *
+ * \details This method is called once at the end of each batch of edits
+ *          setting or adding attributes, after the edits of the characters are
+ *          delivered.
+ *
+ * \param textStorage The edited text storage.
+ *
+ * \param range The range of characters whose attributes were edited, in the
+ *              coordinates of the text after the batch.
+ */
+-(void)textStorage:(PLTextStorage *)textStorage didEditAttributesInRange:(NSRange)range;
+
+@end
+
+/**
+ * \brief The containers storing the characters and attributes of a text
+ *        storage.
+ *
+ * \details PLTextStorageBackingStoreAttributedString stores them in an
+ *          NSMutableAttributedString, whose contiguous buffer moves the
+ *          characters following each edit. PLTextStorageBackingStoreRope stores
+ *          them in a PLRopeAttributedString, whose edits cost O(log n)
+ *          wherever they are, for large files, and whose string is copied in
+ *          O(1) for snapshots. The initializers that do not name a backing
+ *          store use the attributed string; the text storages of documents,
+ *          made by the PLTextDocument newTextStorage method, use the rope.
+ */
+typedef enum {
+        PLTextStorageBackingStoreAttributedString = 0,
+        PLTextStorageBackingStoreRope
+} PLTextStorageBackingStore;
+
 /**
  * \class PLTextStorage \headerfile \headerfile
  *
  * \brief A custom text storage object that adds specific functionality to the
  *        NSTextStorage class.
  *
- * \details This class allows the program to determine the difference between 
- *          the state of the text storage prior to editing, and the new state 
- *          following edits. This is important for the line number view, as
- *          the line number view calculates the line numbers by comparing the
- *          state of the text storage prior to performing edits to the data and
- *          the replacement text data. Additionally, this class allows editing 
- *          the text storage data without invoking the edited:range: method
- *          that can cause the text view to shift when altering text outside the
- *          scope of the visible rect.
+ * \details This class records each replacement of characters in a
+ *          PLEditJournal, and gives the journal of each batch of edits, once
+ *          at the outermost endEditing, to the objects conforming to the
+ *          PLTextStorageObserver protocol added with addEditObserver:. The
+ *          line number view is such an observer: it moves its markers through
+ *          the edits of the journal and rescans only the lines of its edited
+ *          range, so that indenting many lines does not notify it of each
+ *          line. Observers may instead subscribe to the edits of the
+ *          attributes alone, delivered apart from those of the characters.
+ *          The PLTextStorageWillReplaceStringNotification and
+ *          PLTextStorageDidReplaceStringNotification are posted once per batch
+ *          for other objects, such as those tracking unsaved changes.
+ *          Additionally, this class allows editing the text storage data
+ *          without invoking the edited:range: method that can cause the text
+ *          view to shift when altering text outside the scope of the visible
+ *          rect.
+ *
+ *          The text storage also maintains a PLLineIndex of its string, which
+ *          is updated once for each replacement of characters. Objects that
+ *          need the line structure of the text (the line number view, the
+ *          formatter and the navigation popup button) query the text storage
+ *          rather than rescanning its string.
+ *
+ *          The syntax coloring is kept apart from the characters and their
+ *          attributes, as a PLStyleRunArray of small integer styles. Once a
+ *          PLStyleTable colors the text storage, the attributes of a character
+ *          are merged with those of its style only when they are asked for.
  */
 @interface PLTextStorage : NSTextStorage {
         /**
          * \brief An NSMutableAttributedString that serves as the actual data
-         *        container.
+         *        container, or a PLRopeAttributedString for the rope backing
+         *        store.
          */
         NSMutableAttributedString * _internalStorage;
+        /**
+         * \brief The container of the characters and attributes.
+         */
+        PLTextStorageBackingStore backingStore;
         NSString * replacementString;
         NSRange replacementRange;
+        /**
+         * \brief The line index of the text storage string.
+         */
+        PLLineIndex * lineIndex;
+        /**
+         * \brief The syntax coloring lexer states of the lines of the text
+         *        storage string.
+         */
+        PLLexerStates * lexerStates;
+        /**
+         * \brief The semantic style runs applied over the syntax coloring.
+         */
+        PLSemanticOverlay * semanticOverlay;
+        /**
+         * \brief The syntax coloring style of each character.
+         */
+        PLStyleRunArray * styleRuns;
+        /**
+         * \brief The style table resolving the style runs into attributes.
+         */
+        PLStyleTable * styleTable;
+        /**
+         * \brief The attributes of each style merged with the last attributes
+         *        of a character they were merged with.
+         */
+        NSMutableArray * mergedAttributes;
+        NSRange editedLineRange;
+        NSInteger changeInNumberOfLines;
+        /**
+         * \brief The number of replacements of characters since the text
+         *        storage was created.
+         */
+        NSUInteger generation;
+        /**
+         * \brief The edits of the current batch.
+         */
+        PLEditJournal * editJournal;
+        /**
+         * \brief The observers of the edits of the characters, as non
+         *        retained NSValue objects.
+         */
+        NSMutableArray * editObservers;
+        /**
+         * \brief The observers of the edits of the attributes, as non retained
+         *        NSValue objects, or nil.
+         */
+        NSMutableArray * attributeObservers;
+        /**
+         * \brief Flag denoting if attributes were edited in the current batch.
+         */
+        BOOL hasAttributeEdits;
+        /**
+         * \brief The range of characters whose attributes were edited in the
+         *        current batch.
+         */
+        NSRange attributeEditedRange;
+        /**
+         * \brief The nesting level of beginEditing.
+         */
+        NSUInteger editingDepth;
 }
 
+/**
+ * \brief Initialize a text storage with a string, stored in a backing store.
+ *
+ * \details The other initializers use PLTextStorageBackingStoreAttributedString,
+ *          and PLTextDocument uses PLTextStorageBackingStoreRope.
+ *          The string, attributesAtIndex:effectiveRange: and
+ *          replaceCharactersInRange:withString: primitives are served from the
+ *          backing store, so that the rope backing store keeps typing fast
+ *          anywhere in files of many megabytes.
+ *
+ * \param aString The characters of the text storage.
+ *
+ * \param aBackingStore The container of the characters and attributes.
+ */
+-(id)initWithString:(NSString *)aString backingStore:(PLTextStorageBackingStore)aBackingStore;
+
+/**
+ * \brief The container of the characters and attributes of the text storage.
+ */
+@property (readonly) PLTextStorageBackingStore backingStore;
+
 #pragma mark - Replacement information
 
 /**
@@ -81,9 +278,8 @@ FOUNDATION_EXPORT NSString * PLTextStorageDidReplaceStringNotification;
  *        data.
  *
  * \details This NSString instance is NULL for the majority of the time,
- *          and is non-NULL between the time the PLTextStorageWillReplaceStringNotification
- *          notification is posted to the default notification center,
- *          and the time the replacement takes effect.
+ *          and is non-NULL while a replacement is applied. The string is not
+ *          copied.
  */
 @property (readonly) NSString * replacementString;
 
@@ -92,12 +288,223 @@ FOUNDATION_EXPORT NSString * PLTextStorageDidReplaceStringNotification;
  *        replaceCharactersInRange:withString: method has taken effect.
  *
  * \details The NSRange location is NSNotFound for the majority of the time,
- *          and is different only between the time the PLTextStorageWillReplaceStringNotification
- *          notification is posted to the default notification center,
- *          and the time the replacement takes effect.
+ *          and is different only while a replacement is applied.
  */
 @property (readonly) NSRange replacementRange;
 
+#pragma mark - Line information
+
+/**
+ * \brief The number of lines in the text storage.
+ *
+ * \details An empty string, or a string ending in a line terminator, has an
+ *          empty last line.
+ */
+@property (readonly) NSUInteger numberOfLines;
+
+/**
+ * \brief Return the line number containing a character index.
+ *
+ * \param index The character index. An index at or beyond the end of the
+ *              string returns the last line number.
+ *
+ * \return The line number, starting at 1.
+ */
+-(NSUInteger)lineNumberForCharacterIndex:(NSUInteger)index;
+
+/**
+ * \brief Return the character index of the first character of a line.
+ *
+ * \param lineNumber The line number, starting at 1. Line numbers beyond the
+ *                   last line are clamped to the last line.
+ */
+-(NSUInteger)characterIndexForLineNumber:(NSUInteger)lineNumber;
+
+/**
+ * \brief Return the character range of a line, including its line terminator.
+ *
+ * \param lineNumber The line number, starting at 1. Line numbers beyond the
+ *                   last line are clamped to the last line.
+ */
+-(NSRange)rangeOfLineNumber:(NSUInteger)lineNumber;
+
+/**
+ * \brief Copy the lengths of a range of lines, including their line
+ *        terminators.
+ *
+ * \param buffer A C array of at least lineRange.length elements, set to the
+ *               length of each line. Lines beyond the last line are set to
+ *               zero.
+ *
+ * \param lineRange The range of line numbers, starting at 1.
+ */
+-(void)getLineLengths:(NSUInteger *)buffer inLineRange:(NSRange)lineRange;
+
+/**
+ * \brief Return the range of the lines containing a range of characters.
+ *
+ * \details This method is equivalent to the NSString lineRangeForRange:
+ *          method of the text storage string, without scanning the string.
+ */
+-(NSRange)lineRangeForRange:(NSRange)range;
+
+/**
+ * \brief The range of line numbers spanned by the last replacement of
+ *        characters, after the replacement.
+ *
+ * \details This range may include the line preceding the edited characters.
+ *          It only describes the last replacement of a batch of edits, whose
+ *          edits are described by the PLEditJournal given to edit observers.
+ */
+@property (readonly) NSRange editedLineRange;
+
+/**
+ * \brief The change in the number of lines caused by the last replacement of
+ *        characters.
+ *
+ * \details This value only describes the last replacement of a batch of
+ *          edits, whose edits are described by the PLEditJournal given to edit
+ *          observers.
+ */
+@property (readonly) NSInteger changeInNumberOfLines;
+
+/**
+ * \brief The lexer state at the end of each line, and the lines edited since
+ *        the syntax highlighter last colored them.
+ *
+ * \details The lexer states are spliced with the line index on each
+ *          replacement of characters, so that the PLSyntaxHighlighter only
+ *          colors the damaged lines.
+ */
+@property (readonly) PLLexerStates * lexerStates;
+
+/**
+ * \brief The semantic style runs applied over the syntax coloring, such as
+ *        the local variables found by an introspection plugin.
+ *
+ * \details The runs follow each replacement of characters, and the runs
+ *          touching the replaced characters are removed until the
+ *          PLSyntaxHighlighter sets new runs.
+ */
+@property (readonly) PLSemanticOverlay * semanticOverlay;
+
+#pragma mark - Style information
+
+/**
+ * \brief The syntax coloring style of each character.
+ *
+ * \details The runs follow each replacement of characters, the inserted
+ *          characters taking the style of their neighbours until they are
+ *          colored again.
+ */
+@property (readonly) PLStyleRunArray * styleRuns;
+
+/**
+ * \brief The style table resolving the style runs into attributes, or nil.
+ *
+ * \details While the style table is nil, the style runs are not used, and the
+ *          attributes are those of the backing store. Setting a style table
+ *          resets every character to the default style and removes the
+ *          foreground colors of the backing store, after which the attributes
+ *          of each style override those of the characters. A theme change is
+ *          seen without recoloring the text, since the styles are resolved when
+ *          the attributes are asked for.
+ */
+@property (retain, nonatomic) PLStyleTable * styleTable;
+
+/**
+ * \brief Set the styles of a range of characters from style runs, without
+ *        setting an edited state in the text storage object.
+ *
+ * \param runs A C array of runs sorted by location. A run overlapping a
+ *             preceding run only styles the characters past it.
+ *
+ * \param count The number of runs.
+ *
+ * \param range The range of characters whose styles are set. The characters
+ *              not covered by a run get the default style.
+ */
+-(void)setStyleRuns:(const PLStyleRun *)runs count:(NSUInteger)count inRange:(NSRange)range;
+
+/**
+ * \brief Set the style of a range of characters, without setting an edited
+ *        state in the text storage object.
+ */
+-(void)setStyle:(PLStyle)style range:(NSRange)range;
+
+/**
+ * \brief The edit generation of the text storage string.
+ *
+ * \details The generation is incremented on each replacement of characters,
+ *          and not by attribute changes. Work done on a copy of the string,
+ *          such as coloring on a background thread, is tagged with the
+ *          generation of the copy, so that it is dropped if the string was
+ *          edited before the work is applied.
+ */
+@property (readonly) NSUInteger generation;
+
+/**
+ * \brief Return an immutable snapshot of the characters of the text storage,
+ *        tagged with its edit generation.
+ *
+ * \details A snapshot is read on a background thread while the text storage
+ *          is edited, such as by the syntax highlighter or an introspection
+ *          plugin. With the rope backing store, taking a snapshot is O(1) and
+ *          the snapshot shares the chunks of the text storage string until
+ *          they are edited, as for the text storages of documents; with the
+ *          attributed string backing store, the string is copied in O(n).
+ */
+-(PLTextSnapshot *)snapshot;
+
+#pragma mark - Edit observers
+
+/**
+ * \brief Add an observer of the edits of the characters, given the edits of
+ *        each batch.
+ *
+ * \details Observers are called in the order they were added. The observer
+ *          is not retained.
+ */
+-(void)addEditObserver:(id <PLTextStorageObserver>)observer;
+
+/**
+ * \brief Add an observer of the edits of the characters, of the attributes,
+ *        or both.
+ *
+ * \param observer The observer, not retained.
+ *
+ * \param editMask NSTextStorageEditedCharacters to be given the edit journal
+ *                 of each batch with replacements of characters, and
+ *                 NSTextStorageEditedAttributes to be given the range of the
+ *                 attributes edited by each batch.
+ */
+-(void)addEditObserver:(id <PLTextStorageObserver>)observer editMask:(NSUInteger)editMask;
+
+/**
+ * \brief Remove an edit observer from every channel.
+ */
+-(void)removeEditObserver:(id <PLTextStorageObserver>)observer;
+
+/**
+ * \brief Begin a batch of edits.
+ *
+ * \details The replacements of characters until the matching endEditing are
+ *          recorded in a single PLEditJournal. Calls may be nested.
+ */
+-(void)beginEditing;
+
+/**
+ * \brief End a batch of edits.
+ *
+ * \details The outermost endEditing gives the edit journal of the batch to
+ *          the observers of the characters and posts a
+ *          PLTextStorageDidReplaceStringNotification, then gives the range of
+ *          the edited attributes to the observers of the attributes, once the
+ *          text storage processed the edits and the editing depth is back to
+ *          zero.
+ */
+-(void)endEditing;
+
 #pragma mark - NSAttributedString and NSMutableAttributedString primitives (necessary)
 
 /**
@@ -30,59 +30,228 @@
  */
 
 #import "PLTextStorage.h"
+#import "PLLexerStates.h"
+#import "PLSemanticOverlay.h"
+#import "PLStyleTable.h"
 
 NSString * PLTextStorageWillReplaceStringNotification = @"PLTextStorageWillReplaceString";
 NSString * PLTextStorageDidReplaceStringNotification = @"PLTextStorageDidReplaceString";
+NSString * PLTextStorageEditJournalKey = @"PLTextStorageEditJournal";
+
+/**
+ * \brief Move a range of characters of the text before a replacement of
+ *        characters to the text after it, extending it over the replacement
+ *        string if they overlap.
+ */
+static NSRange moveRangeThroughReplacement(NSRange range, NSRange replacedRange, NSUInteger length)
+{
+        NSUInteger start = range.location, end = NSMaxRange(range);
+        if (start >= NSMaxRange(replacedRange))
+                start = start - replacedRange.length + length;
+        else if (start > replacedRange.location)
+                start = replacedRange.location;
+        if (end >= NSMaxRange(replacedRange))
+                end = end - replacedRange.length + length;
+        else if (end > replacedRange.location)
+                end = replacedRange.location + length;
+        return NSMakeRange(start, end - start);
+}
 
 @implementation PLTextStorage
 
 - (id)initWithString:(NSString *)aString
 {
-	if (self = [super init])
-	{
-		_internalStorage = [[NSMutableAttributedString alloc] initWithString:aString];
-	}
-	return self;
+        self = [super init];
+        if (self)
+                [self setUpWithString:aString backingStore:PLTextStorageBackingStoreAttributedString];
+        return self;
 }
 
 - (id)initWithString:(NSString *)aString attributes:(NSDictionary *)attributes
 {
-	if (self = [super init])
-	{
-		_internalStorage = [[NSMutableAttributedString alloc] initWithString:aString attributes:attributes];
-	}
-	return self;
+        self = [super init];
+        if (self) {
+                [self setUpWithString:aString backingStore:PLTextStorageBackingStoreAttributedString];
+                if (attributes && [aString length] > 0)
+                        [_internalStorage setAttributes:attributes range:NSMakeRange(0, [aString length])];
+        }
+        return self;
 }
 
-
-- (id)initWithAttributedString:(NSAttributedString *)attrStr {
-        if (self = [super init]) {
-                _internalStorage = [[NSMutableAttributedString alloc] initWithAttributedString:attrStr];
+- (id)initWithAttributedString:(NSAttributedString *)attrStr
+{
+        self = [super init];
+        if (self) {
+                [self setUpWithString:[attrStr string] backingStore:PLTextStorageBackingStoreAttributedString];
+                [attrStr enumerateAttributesInRange:NSMakeRange(0, [attrStr length])
+                                            options:0
+                                         usingBlock:^(NSDictionary * attributes, NSRange range, BOOL * stop) {
+                                                 [_internalStorage setAttributes:attributes range:range];
+                                         }];
         }
         return self;
 }
 
+-(id)initWithString:(NSString *)aString backingStore:(PLTextStorageBackingStore)aBackingStore
+{
+        self = [super init];
+        if (self)
+                [self setUpWithString:aString backingStore:aBackingStore];
+        return self;
+}
+
 -(id)init
 {
         self = [super init];
-        if (self) {
-                _internalStorage = [[NSMutableAttributedString alloc] initWithString:@""];
-        }
+        if (self)
+                [self setUpWithString:@"" backingStore:PLTextStorageBackingStoreAttributedString];
         return self;
 }
 
 -(void)dealloc
 {
         [_internalStorage release];
+        [lineIndex release];
+        [lexerStates release];
+        [semanticOverlay release];
+        [styleRuns release];
+        [styleTable release];
+        [mergedAttributes release];
+        [editJournal release];
+        [editObservers release];
+        [attributeObservers release];
         [[NSNotificationCenter defaultCenter] removeObserver:self];
         [super dealloc];
 }
 
+@synthesize backingStore;
+
 #pragma mark - Replacement information
 
 @synthesize replacementString;
 @synthesize replacementRange;
 
+#pragma mark - Line information
+
+@synthesize editedLineRange;
+@synthesize changeInNumberOfLines;
+@synthesize lexerStates;
+@synthesize semanticOverlay;
+@synthesize generation;
+
+-(PLTextSnapshot *)snapshot
+{
+        return [[[PLTextSnapshot alloc] initWithString:[_internalStorage string] generation:generation] autorelease];
+}
+
+#pragma mark - Style information
+
+@synthesize styleRuns;
+@synthesize styleTable;
+
+-(void)setStyleTable:(PLStyleTable *)aStyleTable
+{
+        NSRange range = NSMakeRange(0, [_internalStorage length]);
+        if (aStyleTable == styleTable)
+                goto exit;
+        [styleTable release];
+        styleTable = [aStyleTable retain];
+        [mergedAttributes removeAllObjects];
+        [styleRuns setStyle:PLStyleDefault range:range];
+        if (styleTable && range.length > 0)
+                [_internalStorage removeAttribute:NSForegroundColorAttributeName range:range];
+exit:
+        return;
+}
+
+-(void)setStyleRuns:(const PLStyleRun *)runs count:(NSUInteger)count inRange:(NSRange)range
+{
+        [styleRuns setStyleRuns:runs count:count inRange:range];
+}
+
+-(void)setStyle:(PLStyle)style range:(NSRange)range
+{
+        [styleRuns setStyle:style range:range];
+}
+
+-(NSUInteger)numberOfLines
+{
+        return [lineIndex numberOfLines];
+}
+
+-(NSUInteger)lineNumberForCharacterIndex:(NSUInteger)index
+{
+        return [lineIndex lineNumberForCharacterIndex:index];
+}
+
+-(NSUInteger)characterIndexForLineNumber:(NSUInteger)lineNumber
+{
+        return [lineIndex characterIndexForLineNumber:lineNumber];
+}
+
+-(NSRange)rangeOfLineNumber:(NSUInteger)lineNumber
+{
+        return [lineIndex rangeOfLineNumber:lineNumber];
+}
+
+-(void)getLineLengths:(NSUInteger *)buffer inLineRange:(NSRange)lineRange
+{
+        [lineIndex getLineLengths:buffer inLineRange:lineRange];
+}
+
+-(NSRange)lineRangeForRange:(NSRange)range
+{
+        NSUInteger firstLine, lastLine, start;
+        firstLine = [lineIndex lineNumberForCharacterIndex:range.location];
+        if (range.length > 0)
+                lastLine = [lineIndex lineNumberForCharacterIndex:NSMaxRange(range) - 1];
+        else
+                lastLine = firstLine;
+        start = [lineIndex characterIndexForLineNumber:firstLine];
+        return NSMakeRange(start, NSMaxRange([lineIndex rangeOfLineNumber:lastLine]) - start);
+}
+
+#pragma mark - Edit observers
+
+-(void)addEditObserver:(id <PLTextStorageObserver>)observer
+{
+        [self addEditObserver:observer editMask:NSTextStorageEditedCharacters];
+}
+
+-(void)addEditObserver:(id <PLTextStorageObserver>)observer editMask:(NSUInteger)editMask
+{
+        if (editMask & NSTextStorageEditedCharacters)
+                [editObservers addObject:[NSValue valueWithNonretainedObject:observer]];
+        if (editMask & NSTextStorageEditedAttributes) {
+                if (attributeObservers == nil)
+                        attributeObservers = [[NSMutableArray alloc] init];
+                [attributeObservers addObject:[NSValue valueWithNonretainedObject:observer]];
+        }
+}
+
+-(void)removeEditObserver:(id <PLTextStorageObserver>)observer
+{
+        [editObservers removeObject:[NSValue valueWithNonretainedObject:observer]];
+        [attributeObservers removeObject:[NSValue valueWithNonretainedObject:observer]];
+}
+
+-(void)beginEditing
+{
+        editingDepth++;
+        [super beginEditing];
+}
+
+-(void)endEditing
+{
+        BOOL closesBatch = (editingDepth == 1);
+        if (editingDepth > 0)
+                editingDepth--;
+        [super endEditing];
+        /* the batch is delivered once the layout managers processed it */
+        if (closesBatch && editingDepth == 0)
+                [self deliverEdits];
+}
+
 #pragma mark - NSAttributedString and NSMutableAttributedString primitives (necessary)
 
 -(NSUInteger)length
@@ -97,25 +266,27 @@ NSString * PLTextStorageDidReplaceStringNotification = @"PLTextStorageDidReplace
 
 -(NSDictionary *)attributesAtIndex:(NSUInteger)location effectiveRange:(NSRangePointer)range
 {
-        return [_internalStorage attributesAtIndex:location effectiveRange:range];
+        NSDictionary * attributes = [_internalStorage attributesAtIndex:location effectiveRange:range];
+        NSRange styleRange;
+        PLStyle style;
+        if (styleTable == nil)
+                return attributes;
+        style = [styleRuns styleAtIndex:location effectiveRange:&styleRange];
+        if (range)
+                *range = NSIntersectionRange(*range, styleRange);
+        return [self attributes:attributes mergedWithStyle:style];
 }
 
 -(void)replaceCharactersInRange:(NSRange)range withString:(NSString *)string
 {
-        NSNotificationCenter * defaultCenter = [NSNotificationCenter defaultCenter];
-        replacementString = [NSString stringWithString:string];
-        replacementRange = range;
-        [defaultCenter postNotificationName:PLTextStorageWillReplaceStringNotification
-                                     object:self];
+        [self willReplaceCharactersInRange:range withString:string];
+        [self updateLineIndexForRange:range withString:string];
         [_internalStorage replaceCharactersInRange:range withString:string];
         NSUInteger deltaLength = [string length] - range.length;
         [super edited:NSTextStorageEditedCharacters
                range:range
       changeInLength:deltaLength];
-        [defaultCenter postNotificationName:PLTextStorageDidReplaceStringNotification
-                                     object:self];
-        replacementRange = NSMakeRange(NSNotFound, 0);
-        replacementString = nil;
+        [self didReplaceCharactersInRange:range withLength:[string length]];
         return;
 }
 
@@ -123,6 +294,7 @@ NSString * PLTextStorageDidReplaceStringNotification = @"PLTextStorageDidReplace
 {
         [_internalStorage setAttributes:attrs range:range];
         [super edited:NSTextStorageEditedAttributes range:range changeInLength:0];
+        [self didEditAttributesInRange:range];
 }
 
 - (void)addAttribute:(NSString *)name value:(id)value range:(NSRange)aRange
@@ -131,26 +303,24 @@ NSString * PLTextStorageDidReplaceStringNotification = @"PLTextStorageDidReplace
 	[self edited:NSTextStorageEditedAttributes
                range:aRange
         changeInLength:0];
+        [self didEditAttributesInRange:aRange];
 }
 
 #pragma mark - New text storage functionality
 
 -(void)replaceCharactersInRange:(NSRange)range withAttributedString:(NSAttributedString *)attrString
 {
-        NSNotificationCenter * defaultCenter = [NSNotificationCenter defaultCenter];
-        replacementString = [attrString string];
-        replacementRange = range;
-        [defaultCenter postNotificationName:PLTextStorageWillReplaceStringNotification
-                                     object:self];
+        [self willReplaceCharactersInRange:range withString:[attrString string]];
+        [self updateLineIndexForRange:range withString:[attrString string]];
         [_internalStorage replaceCharactersInRange:range withAttributedString:attrString];
         NSUInteger deltaLength = [attrString length] - range.length;
         [super edited:NSTextStorageEditedCharacters|NSTextStorageEditedAttributes
                 range:range
        changeInLength:deltaLength];
-        [defaultCenter postNotificationName:PLTextStorageDidReplaceStringNotification
-                                     object:self];
-        replacementRange = NSMakeRange(NSNotFound, 0);
-        replacementString = nil;
+        [self didReplaceCharactersInRange:range withLength:[attrString length]];
+        /* the attributes of the new characters are edited as well */
+        if ([attrString length] > 0)
+                [self didEditAttributesInRange:NSMakeRange(range.location, [attrString length])];
         return;
 }
 
@@ -166,4 +336,171 @@ NSString * PLTextStorageDidReplaceStringNotification = @"PLTextStorageDidReplace
         }];
 }
 
+#pragma mark - Private Methods
+
+/**
+ * \brief Create the backing store holding a string, and the line index, lexer
+ *        states, semantic overlay, style runs and edit journal of the text
+ *        storage, shared by all the initializers.
+ */
+-(void)setUpWithString:(NSString *)aString backingStore:(PLTextStorageBackingStore)aBackingStore
+{
+        if (aBackingStore == PLTextStorageBackingStoreRope)
+                _internalStorage = [[PLRopeAttributedString alloc] initWithString:aString];
+        else
+                _internalStorage = [[NSMutableAttributedString alloc] initWithString:aString];
+        backingStore = aBackingStore;
+        lineIndex = [[PLLineIndex alloc] init];
+        [lineIndex replaceCharactersInRange:NSMakeRange(0, 0) withString:aString inString:@""];
+        lexerStates = [[PLLexerStates alloc] initWithNumberOfLines:[lineIndex numberOfLines]];
+        semanticOverlay = [[PLSemanticOverlay alloc] init];
+        styleRuns = [[PLStyleRunArray alloc] init];
+        if ([aString length] > 0)
+                [styleRuns replaceCharactersInRange:NSMakeRange(0, 0) withLength:[aString length]];
+        mergedAttributes = [[NSMutableArray alloc] init];
+        editJournal = [[PLEditJournal alloc] init];
+        editObservers = [[NSMutableArray alloc] init];
+}
+
+/**
+ * \brief Post a PLTextStorageWillReplaceStringNotification before the first
+ *        replacement of a batch of edits, then record the replacement string
+ *        and range before replacing characters.
+ *
+ * \details The notification is posted before the replacement is recorded, so
+ *          that observers never mistake the first edit for the whole batch.
+ */
+-(void)willReplaceCharactersInRange:(NSRange)range withString:(NSString *)string
+{
+        if ([editJournal count] == 0) {
+                [[NSNotificationCenter defaultCenter] postNotificationName:PLTextStorageWillReplaceStringNotification
+                                                                    object:self];
+        }
+        replacementString = string;
+        replacementRange = range;
+}
+
+/**
+ * \brief Add a replacement of characters to the edit journal, and deliver the
+ *        journal unless a batch of edits is open.
+ */
+-(void)didReplaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length
+{
+        replacementRange = NSMakeRange(NSNotFound, 0);
+        replacementString = nil;
+        if (hasAttributeEdits)
+                attributeEditedRange = moveRangeThroughReplacement(attributeEditedRange, range, length);
+        [editJournal addEditInRange:range
+                         withLength:length
+              changeInNumberOfLines:changeInNumberOfLines
+                         generation:generation];
+        if (editingDepth == 0)
+                [self deliverEdits];
+}
+
+/**
+ * \brief Add an edit of attributes to the current batch, and deliver it unless
+ *        a batch of edits is open.
+ */
+-(void)didEditAttributesInRange:(NSRange)range
+{
+        if (hasAttributeEdits)
+                attributeEditedRange = NSUnionRange(attributeEditedRange, range);
+        else
+                attributeEditedRange = range;
+        hasAttributeEdits = YES;
+        if (editingDepth == 0)
+                [self deliverEdits];
+}
+
+/**
+ * \brief Give the edit journal to the observers of the characters and post a
+ *        PLTextStorageDidReplaceStringNotification with it, then give the range
+ *        of the edited attributes to the observers of the attributes.
+ *
+ * \details A new journal records the edits made by the observers, which are
+ *          delivered in turn.
+ */
+-(void)deliverEdits
+{
+        PLEditJournal * journal;
+        NSArray * observers;
+        NSRange range;
+        while ([editJournal count] > 0 || hasAttributeEdits) {
+                if ([editJournal count] > 0) {
+                        journal = editJournal;
+                        editJournal = [[PLEditJournal alloc] init];
+                        observers = [NSArray arrayWithArray:editObservers];
+                        for (NSValue * observer in observers)
+                                [[observer nonretainedObjectValue] textStorage:self didApplyEdits:journal];
+                        [[NSNotificationCenter defaultCenter] postNotificationName:PLTextStorageDidReplaceStringNotification
+                                                                            object:self
+                                                                          userInfo:@{PLTextStorageEditJournalKey: journal}];
+                        [journal release];
+                }
+                if (hasAttributeEdits) {
+                        range = attributeEditedRange;
+                        hasAttributeEdits = NO;
+                        observers = [NSArray arrayWithArray:attributeObservers];
+                        for (NSValue * observer in observers)
+                                [[observer nonretainedObjectValue] textStorage:self didEditAttributesInRange:range];
+                }
+        }
+}
+
+/**
+ * \brief Return the attributes of a character merged with those of its style.
+ *
+ * \details The attributes of the style override those of the character. The
+ *          merged dictionary is cached for each style with the dictionaries it
+ *          was merged from, since adjacent runs of a style mostly share the
+ *          same character attributes, and the cache entry is replaced when
+ *          either changes, such as after a theme change.
+ */
+-(NSDictionary *)attributes:(NSDictionary *)attributes mergedWithStyle:(PLStyle)style
+{
+        NSDictionary * styleAttributes = [styleTable attributesOfStyle:style];
+        NSMutableDictionary * merged;
+        NSArray * entry;
+        if ([styleAttributes count] == 0)
+                return attributes;
+        if ([attributes count] == 0)
+                return styleAttributes;
+        while ([mergedAttributes count] <= style)
+                [mergedAttributes addObject:[NSNull null]];
+        entry = [mergedAttributes objectAtIndex:style];
+        if (entry != (id)[NSNull null] &&
+            [entry objectAtIndex:1] == styleAttributes &&
+            [[entry objectAtIndex:0] isEqualToDictionary:attributes])
+                return [entry objectAtIndex:2];
+        merged = [NSMutableDictionary dictionaryWithDictionary:attributes];
+        [merged addEntriesFromDictionary:styleAttributes];
+        [mergedAttributes replaceObjectAtIndex:style withObject:@[attributes, styleAttributes, merged]];
+        return merged;
+}
+
+/**
+ * \brief Update the line index before replacing characters in the text storage.
+ *
+ * \details The line index is updated from the string before the replacement,
+ *          rescanning only the edited lines, and the edited line range and
+ *          change in the number of lines are recorded for the edit journal.
+ *          The lexer states of the replaced lines are spliced to match, the
+ *          semantic and style runs are moved, and the edit generation is
+ *          incremented.
+ */
+-(void)updateLineIndexForRange:(NSRange)range withString:(NSString *)string
+{
+        NSUInteger numberOfLines = [lineIndex numberOfLines];
+        editedLineRange = [lineIndex replaceCharactersInRange:range
+                                                   withString:string
+                                                     inString:[_internalStorage string]];
+        changeInNumberOfLines = (NSInteger)[lineIndex numberOfLines] - (NSInteger)numberOfLines;
+        [lexerStates replaceLinesInRange:NSMakeRange(editedLineRange.location, editedLineRange.length - changeInNumberOfLines)
+                               withCount:editedLineRange.length];
+        [semanticOverlay replaceCharactersInRange:range withLength:[string length]];
+        [styleRuns replaceCharactersInRange:range withLength:[string length]];
+        generation++;
+}
+
 @end
@@ -31,6 +31,175 @@
 
 @end
 
+/**
+ * \brief An edit observer of a text storage counting the batches of edits of
+ *        each channel.
+ */
+@interface PLTestEditObserver : NSObject <PLTextStorageObserver> {
+@public
+        /**
+         * \brief The number of batches of edits of the characters delivered.
+         */
+        NSUInteger numberOfCharacterEdits;
+        /**
+         * \brief The number of batches of edits of the attributes delivered.
+         */
+        NSUInteger numberOfAttributeEdits;
+        /**
+         * \brief The range of the last edits of the attributes delivered.
+         */
+        NSRange attributeEditedRange;
+        /**
+         * \brief The edited mask of the text storage when the last batch of
+         *        edits of the characters was delivered.
+         */
+        NSUInteger editedMask;
+}
+@end
+
+@implementation PLTestEditObserver
+
+-(void)textStorage:(PLTextStorage *)textStorage didApplyEdits:(PLEditJournal *)journal
+{
+        numberOfCharacterEdits++;
+        editedMask = (NSUInteger)[textStorage editedMask];
+}
+
+-(void)textStorage:(PLTextStorage *)textStorage didEditAttributesInRange:(NSRange)range
+{
+        numberOfAttributeEdits++;
+        attributeEditedRange = range;
+}
+
+@end
+
+/**
+ * \brief A scroll view showing a text storage of repeated lines in a text
+ *        view, with a PLLineNumberView as its vertical ruler.
+ */
+@interface PLTestLineNumberViewFixture : NSObject {
+@public
+        /**
+         * \brief The text storage of the text view.
+         */
+        PLTextStorage * textStorage;
+        /**
+         * \brief The layout manager of the text storage.
+         */
+        NSLayoutManager * layoutManager;
+        /**
+         * \brief The text container of the layout manager, 600 points wide.
+         */
+        NSTextContainer * textContainer;
+        /**
+         * \brief The scroll view, 600 by 800 points.
+         */
+        NSScrollView * scrollView;
+        /**
+         * \brief The document view of the scroll view.
+         */
+        NSTextView * textView;
+        /**
+         * \brief The vertical ruler of the scroll view.
+         */
+        PLLineNumberView * lineNumberView;
+}
+
+/**
+ * \brief Initialize the views of a text storage of repeated lines.
+ *
+ * \param line The line, ending in a line terminator.
+ *
+ * \param numberOfLines The number of lines of the text storage.
+ *
+ * \param allowsNonContiguousLayout Whether the layout manager allows
+ *                                  non-contiguous layout, set before the ruler
+ *                                  is given its client view.
+ */
+-(id)initWithLine:(NSString *)line numberOfLines:(NSUInteger)numberOfLines allowsNonContiguousLayout:(BOOL)allowsNonContiguousLayout;
+
+@end
+
+@implementation PLTestLineNumberViewFixture
+
+-(id)initWithLine:(NSString *)line numberOfLines:(NSUInteger)numberOfLines allowsNonContiguousLayout:(BOOL)allowsNonContiguousLayout
+{
+        self = [super init];
+        if (self == nil)
+                goto exit;
+        textStorage = [[PLTextStorage alloc] initWithString:[@"" stringByPaddingToLength:numberOfLines * [line length]
+                                                                               withString:line
+                                                                          startingAtIndex:0]];
+        layoutManager = [[NSLayoutManager alloc] init];
+        [layoutManager setAllowsNonContiguousLayout:allowsNonContiguousLayout];
+        textContainer = [[NSTextContainer alloc] initWithContainerSize:NSMakeSize(600.0f, FLT_MAX)];
+        [textContainer setWidthTracksTextView:YES];
+        [layoutManager addTextContainer:textContainer];
+        [textStorage addLayoutManager:layoutManager];
+        scrollView = [[NSScrollView alloc] initWithFrame:NSMakeRect(0.0f, 0.0f, 600.0f, 800.0f)];
+        textView = [[NSTextView alloc] initWithFrame:NSMakeRect(0.0f, 0.0f, 600.0f, 800.0f) textContainer:textContainer];
+        [textView setVerticallyResizable:YES];
+        [textView setMaxSize:NSMakeSize(FLT_MAX, FLT_MAX)];
+        [scrollView setDocumentView:textView];
+        lineNumberView = [[PLLineNumberView alloc] initWithScrollView:scrollView orientation:NSVerticalRuler];
+        [scrollView setVerticalRulerView:lineNumberView];
+        [scrollView setHasVerticalRuler:YES];
+        [scrollView setRulersVisible:YES];
+        [lineNumberView setClientView:textView];
+exit:
+        return self;
+}
+
+-(void)dealloc
+{
+        [lineNumberView release];
+        [textView release];
+        [scrollView release];
+        [textContainer release];
+        [layoutManager release];
+        [textStorage release];
+        [super dealloc];
+}
+
+@end
+
+/**
+ * \brief Return the length of each line in a string, as stored by PLLineIndex.
+ *
+ * \details The lines are found with lineRangeForRange:, and a string that is
+ *          empty or ends in a line terminator has an empty last line.
+ *
+ * \return A malloc'ed C array of line lengths that must be freed.
+ */
+static NSUInteger * lineLengthsOfString(NSString * text, NSUInteger * count)
+{
+        NSUInteger * lineLengths = malloc(([text length] + 1) * sizeof(NSUInteger));
+        NSUInteger position = 0;
+        NSRange lineRange;
+        *count = 0;
+        while (position < [text length]) {
+                lineRange = [text lineRangeForRange:NSMakeRange(position, 0)];
+                lineLengths[(*count)++] = lineRange.length;
+                position = NSMaxRange(lineRange);
+        }
+        if ([text length] == 0 || [text lineRangeForRange:NSMakeRange(position, 0)].length == 0)
+                lineLengths[(*count)++] = 0;
+        return lineLengths;
+}
+
+/**
+ * \brief Return a line index for a string.
+ */
+static PLLineIndex * lineIndexOfString(NSString * text)
+{
+        PLLineIndex * lineIndex = [[PLLineIndex alloc] init];
+        NSUInteger count;
+        NSUInteger * lineLengths = lineLengthsOfString(text, &count);
+        [lineIndex replaceLinesInRange:NSMakeRange(1, 1) withLineLengths:lineLengths count:count];
+        free(lineLengths);
+        return [lineIndex autorelease];
+}
+
 @implementation LiasisKitTests
 
 /**
@@ -90,4 +259,1838 @@
         XCTAssertEqual([PLFormatter characterIndexForNextOpenBracket:source fromIndex:44], NSNotFound);
 }
 
+/**
+ * \brief Test the PLLineIndex class.
+ *
+ * \details Compare the line index with the lines found by lineRangeForRange:
+ *          for a source string, before and after replacing a line with three
+ *          new lines:
+ *              1) Check the number of lines.
+ *              2) Check the range of every line.
+ *              3) Check the line number of every character index.
+ */
+-(void)testLineIndex
+{
+        NSMutableString * source;
+        PLLineIndex * lineIndex;
+        NSString * insertion = @"x = 1\ny = 2\n";
+        NSUInteger lineNumber, index, count;
+        NSUInteger * lineLengths;
+        NSRange lineRange;
+        
+        source = [NSMutableString stringWithUTF8String:"def func(arg1):\n"
+                  "    print arg1\n"
+                  "    return arg1 * 2\r\n"
+                  "\n"
+                  "def func2():\n"];
+        lineIndex = lineIndexOfString(source);
+        for (int edit = 0; edit < 2; edit++) {
+                free(lineLengthsOfString(source, &count));
+                XCTAssertEqual([lineIndex numberOfLines], count);
+                XCTAssertEqual([lineIndex length], [source length]);
+                for (lineNumber = 1, index = 0; index < [source length]; lineNumber++) {
+                        lineRange = [source lineRangeForRange:NSMakeRange(index, 0)];
+                        XCTAssertTrue(NSEqualRanges([lineIndex rangeOfLineNumber:lineNumber], lineRange));
+                        for (; index < NSMaxRange(lineRange); index++)
+                                XCTAssertEqual([lineIndex lineNumberForCharacterIndex:index], lineNumber);
+                }
+                XCTAssertEqual([lineIndex lineNumberForCharacterIndex:[source length]], count);
+                
+                /* replace the second line with three lines */
+                lineRange = [lineIndex rangeOfLineNumber:2];
+                [source insertString:insertion atIndex:lineRange.location];
+                lineLengths = lineLengthsOfString([insertion stringByAppendingString:[source substringWithRange:NSMakeRange(lineRange.location + [insertion length], lineRange.length)]], &count);
+                [lineIndex replaceLinesInRange:NSMakeRange(2, 1) withLineLengths:lineLengths count:count - 1];
+                free(lineLengths);
+        }
+}
+
+/**
+ * \brief Test the blocks of a PLLineIndex.
+ *
+ * \details Apply random replacements of lines, from single lines to
+ *          thousands of lines spanning several blocks, and compare the line
+ *          ranges and the copied line lengths of the index with a C array of
+ *          line lengths.
+ */
+-(void)testLineIndexBlocks
+{
+        PLLineIndex * lineIndex = [[PLLineIndex alloc] init];
+        NSUInteger * reference = malloc(1000000 * sizeof(NSUInteger));
+        NSUInteger lineLengths[3000];
+        NSUInteger numberOfLines = 1, edit, location, length, maximumLength, count, i, index;
+        reference[0] = 0;
+        srandom(1);
+        for (edit = 0; edit < 2000; edit++) {
+                location = 1 + random() % (numberOfLines + 1);
+                maximumLength = MIN(numberOfLines + 1 - location, (NSUInteger)3000);
+                if (random() % 10 != 0)
+                        maximumLength = MIN(maximumLength, (NSUInteger)5);
+                length = (maximumLength > 0) ? random() % maximumLength : 0;
+                count = (random() % 10 == 0) ? random() % 3000 : random() % 3;
+                if (length == numberOfLines && count == 0)
+                        count = 1;
+                for (i = 0; i < count; i++)
+                        lineLengths[i] = 1 + random() % 50;
+                [lineIndex replaceLinesInRange:NSMakeRange(location, length) withLineLengths:lineLengths count:count];
+                memmove(reference + location - 1 + count,
+                        reference + location - 1 + length,
+                        (numberOfLines - (location - 1 + length)) * sizeof(NSUInteger));
+                memcpy(reference + location - 1, lineLengths, count * sizeof(NSUInteger));
+                numberOfLines = numberOfLines - length + count;
+        }
+        XCTAssertEqual([lineIndex numberOfLines], numberOfLines);
+        for (i = 0, index = 0; i < numberOfLines; index += reference[i], i++) {
+                XCTAssertTrue(NSEqualRanges([lineIndex rangeOfLineNumber:i + 1], NSMakeRange(index, reference[i])));
+                if (reference[i] > 0)
+                        XCTAssertEqual([lineIndex lineNumberForCharacterIndex:index], i + 1);
+        }
+        XCTAssertEqual([lineIndex length], index);
+        location = numberOfLines / 3;
+        count = MIN(numberOfLines - location + 2, (NSUInteger)3000);
+        [lineIndex getLineLengths:lineLengths inLineRange:NSMakeRange(location + 1, count)];
+        for (i = 0; i < count; i++)
+                XCTAssertEqual(lineLengths[i], (location + i < numberOfLines) ? reference[location + i] : (NSUInteger)0);
+        free(reference);
+        [lineIndex release];
+}
+
+/**
+ * \brief Test updating a PLLineIndex with character replacements.
+ *
+ * \details Apply a sequence of insertions, deletions and replacements to a
+ *          source string, including edits that split and join carriage return
+ *          and newline pairs, and compare the line lengths of the index with
+ *          those found by lineRangeForRange: after each edit.
+ */
+-(void)testLineIndexCharacterEdits
+{
+        NSMutableString * source;
+        PLLineIndex * lineIndex;
+        NSUInteger i, line, count, * lineLengths;
+        NSRange editedLines;
+        struct {
+                NSUInteger location;
+                NSUInteger length;
+                NSString * string;
+        } edits[] = {
+                {0, 0, @"import os\r\n\r\ndef func():\n    pass"},
+                {10, 0, @"x"},
+                {10, 1, @""},
+                {9, 1, @""},
+                {9, 0, @"\r"},
+                {0, 0, @"\n"},
+                {22, 5, @"\u2028y = 2\r"},
+                {1, 10, @"z\r\n"},
+                {0, 0, @""},
+                {0, 12, @"a\nb\nc\n"},
+        };
+        
+        source = [NSMutableString string];
+        lineIndex = [[PLLineIndex alloc] init];
+        for (i = 0; i < sizeof(edits) / sizeof(edits[0]); i++) {
+                editedLines = [lineIndex replaceCharactersInRange:NSMakeRange(edits[i].location, edits[i].length)
+                                                       withString:edits[i].string
+                                                         inString:source];
+                [source replaceCharactersInRange:NSMakeRange(edits[i].location, edits[i].length)
+                                      withString:edits[i].string];
+                XCTAssertTrue(NSMaxRange(editedLines) <= [lineIndex numberOfLines] + 1);
+                lineLengths = lineLengthsOfString(source, &count);
+                XCTAssertEqual([lineIndex numberOfLines], count);
+                XCTAssertEqual([lineIndex length], [source length]);
+                for (line = 0; line < count && line < [lineIndex numberOfLines]; line++)
+                        XCTAssertEqual([lineIndex rangeOfLineNumber:line + 1].length, lineLengths[line]);
+                free(lineLengths);
+        }
+        [lineIndex release];
+}
+
+/**
+ * \brief Test pasting and deleting many lines with the PLLineIndex class.
+ *
+ * \details Paste 20,000 lines in the middle of a 2,000 line file, and delete
+ *          them again. Only the line lengths of the pasted string are
+ *          allocated, so the size of the index must stay within a few words
+ *          per line, and return to its initial size after the deletion.
+ */
+-(void)testLineIndexPaste
+{
+        NSUInteger numberOfLines = 20000;
+        NSString * line = @"    value = compute(value, index) + 1\n";
+        NSString * file, * paste, * pastedFile;
+        PLLineIndex * lineIndex;
+        NSUInteger location, initialSize, pasteSize;
+        
+        file = [@"" stringByPaddingToLength:2000 * [line length] withString:line startingAtIndex:0];
+        paste = [@"" stringByPaddingToLength:numberOfLines * [line length] withString:line startingAtIndex:0];
+        lineIndex = [[PLLineIndex alloc] init];
+        [lineIndex replaceCharactersInRange:NSMakeRange(0, 0) withString:file inString:@""];
+        location = [lineIndex characterIndexForLineNumber:1000];
+        pastedFile = [file stringByReplacingCharactersInRange:NSMakeRange(location, 0) withString:paste];
+        initialSize = [lineIndex size];
+        
+        [lineIndex replaceCharactersInRange:NSMakeRange(location, 0) withString:paste inString:file];
+        pasteSize = [lineIndex size];
+        XCTAssertEqual([lineIndex numberOfLines], (NSUInteger)(2000 + numberOfLines + 1));
+        XCTAssertEqual([lineIndex length], [pastedFile length]);
+        XCTAssertEqual([lineIndex characterIndexForLineNumber:1000 + numberOfLines], location + numberOfLines * [line length]);
+        XCTAssertTrue(pasteSize - initialSize < 4 * numberOfLines * sizeof(NSUInteger));
+        
+        [lineIndex replaceCharactersInRange:NSMakeRange(location, [paste length]) withString:@"" inString:pastedFile];
+        XCTAssertEqual([lineIndex numberOfLines], (NSUInteger)2001);
+        XCTAssertEqual([lineIndex characterIndexForLineNumber:1001], location + [line length]);
+        XCTAssertTrue([lineIndex size] < initialSize + pasteSize / 16);
+        [lineIndex release];
+}
+
+/**
+ * \brief Test the line information maintained by the PLTextStorage class.
+ *
+ * \details Replace characters in a text storage and compare its line queries
+ *          with those of the NSString lineRangeForRange: method:
+ *              1) Check the number of lines and the change in the number of
+ *                 lines reported for the edit.
+ *              2) Check the line range of every character index and of a
+ *                 range spanning several lines.
+ */
+-(void)testTextStorageLineIndex
+{
+        PLTextStorage * textStorage;
+        NSString * text;
+        NSUInteger index, count, numberOfLines;
+        
+        textStorage = [[PLTextStorage alloc] initWithString:@"class A:\n    pass\n"];
+        XCTAssertEqual([textStorage numberOfLines], (NSUInteger)3);
+        for (int edit = 0; edit < 3; edit++) {
+                numberOfLines = [textStorage numberOfLines];
+                if (edit == 0)
+                        [textStorage replaceCharactersInRange:NSMakeRange(9, 0) withString:@"    x = 1\n    y = 2\n"];
+                else if (edit == 1)
+                        [textStorage replaceCharactersInRange:NSMakeRange(8, 11) withString:@""];
+                else
+                        [textStorage replaceCharactersInRange:NSMakeRange(0, 5) withString:@"def f():\r\n   "];
+                text = [textStorage string];
+                free(lineLengthsOfString(text, &count));
+                XCTAssertEqual([textStorage numberOfLines], count);
+                XCTAssertEqual([textStorage changeInNumberOfLines], (NSInteger)count - (NSInteger)numberOfLines);
+                for (index = 0; index <= [text length]; index++)
+                        XCTAssertTrue(NSEqualRanges([textStorage lineRangeForRange:NSMakeRange(index, 0)],
+                                                    [text lineRangeForRange:NSMakeRange(index, 0)]));
+                XCTAssertTrue(NSEqualRanges([textStorage lineRangeForRange:NSMakeRange(3, 10)],
+                                            [text lineRangeForRange:NSMakeRange(3, 10)]));
+        }
+        [textStorage release];
+}
+
+/**
+ * \brief Test the PLLexerStates of a PLTextStorage.
+ *
+ * \details Color every line of a text storage, then edit it and check that:
+ *              1) The edited lines are damaged.
+ *              2) The lexer states following the edit are shifted.
+ *              3) The last edited line keeps the state of the last replaced
+ *                 line.
+ *              4) Repairing the damaged lines clears the damage.
+ *              5) Damaging lines extends the damaged range to cover them.
+ */
+-(void)testLexerStates
+{
+        PLTextStorage * textStorage;
+        PLLexerStates * lexerStates;
+        NSRange editedLineRange;
+        NSUInteger lineNumber;
+        
+        textStorage = [[PLTextStorage alloc] initWithString:@"a\n\"\"\"b\nc\nd\"\"\"\ne\n"];
+        lexerStates = [textStorage lexerStates];
+        XCTAssertEqual([lexerStates numberOfLines], (NSUInteger)6);
+        XCTAssertTrue(NSEqualRanges([lexerStates damagedLineRange], NSMakeRange(1, 6)));
+        for (lineNumber = 1; lineNumber <= 6; lineNumber++)
+                [lexerStates setState:(lineNumber >= 2 && lineNumber <= 3) ? 1 : 0 atEndOfLine:lineNumber];
+        [lexerStates repairLinesInRange:NSMakeRange(1, 6)];
+        XCTAssertEqual([lexerStates damagedLineRange].length, (NSUInteger)0);
+        
+        /* insert two lines at the start of line 3, inside the docstring */
+        [textStorage replaceCharactersInRange:NSMakeRange(7, 0) withString:@"x\ny\n"];
+        editedLineRange = [textStorage editedLineRange];
+        XCTAssertEqual([lexerStates numberOfLines], (NSUInteger)8);
+        XCTAssertTrue(NSEqualRanges([lexerStates damagedLineRange], editedLineRange));
+        XCTAssertEqual([lexerStates stateAtEndOfLine:NSMaxRange(editedLineRange) - 1], (PLLexerState)1);
+        XCTAssertEqual([lexerStates stateAtEndOfLine:1], (PLLexerState)0);
+        XCTAssertEqual([lexerStates stateAtEndOfLine:6], (PLLexerState)0);
+        XCTAssertEqual([lexerStates stateAtEndOfLine:7], (PLLexerState)0);
+        
+        /* a second edit extends the damaged range */
+        [textStorage replaceCharactersInRange:NSMakeRange(0, 1) withString:@"z"];
+        XCTAssertTrue(NSEqualRanges([lexerStates damagedLineRange], NSMakeRange(1, NSMaxRange(editedLineRange) - 1)));
+        [lexerStates repairLinesInRange:NSMakeRange(1, NSMaxRange(editedLineRange) - 1)];
+        XCTAssertEqual([lexerStates damagedLineRange].length, (NSUInteger)0);
+
+        /* damaged lines keep their states, and lines past the last line are ignored */
+        [lexerStates damageLinesInRange:NSMakeRange(6, 1)];
+        XCTAssertTrue(NSEqualRanges([lexerStates damagedLineRange], NSMakeRange(6, 1)));
+        XCTAssertEqual([lexerStates stateAtEndOfLine:6], (PLLexerState)0);
+        [lexerStates damageLinesInRange:NSMakeRange(2, 10)];
+        XCTAssertTrue(NSEqualRanges([lexerStates damagedLineRange], NSMakeRange(2, 7)));
+        [lexerStates damageLinesInRange:NSMakeRange(9, 1)];
+        XCTAssertTrue(NSEqualRanges([lexerStates damagedLineRange], NSMakeRange(2, 7)));
+        [textStorage release];
+}
+
+/**
+ * \brief Test the PLMarkerIndex class.
+ *
+ * \details Add markers to a string and check that they move with edits:
+ *              1) Markers after an insertion or deletion are shifted.
+ *              2) Markers inside deleted characters are removed.
+ *              3) Markers brought together by a deletion are merged.
+ *              4) Markers are found by range and removed by range.
+ */
+-(void)testMarkerIndex
+{
+        PLMarkerIndex * markerIndex;
+        NSIndexSet * markers;
+        NSMutableIndexSet * expected;
+        
+        markerIndex = [[PLMarkerIndex alloc] initWithLength:100];
+        [markerIndex addMarkerAtIndex:0];
+        [markerIndex addMarkerAtIndex:10];
+        [markerIndex addMarkerAtIndex:20];
+        [markerIndex addMarkerAtIndex:20];
+        [markerIndex addMarkerAtIndex:100];
+        XCTAssertEqual([markerIndex count], (NSUInteger)4);
+        XCTAssertTrue([markerIndex containsMarkerAtIndex:10]);
+        XCTAssertFalse([markerIndex containsMarkerAtIndex:11]);
+        
+        /* insert 5 characters at 10: the marker at 10 stays, the others shift */
+        [markerIndex replaceCharactersInRange:NSMakeRange(10, 0) withLength:5];
+        expected = [NSMutableIndexSet indexSet];
+        [expected addIndex:0];
+        [expected addIndex:10];
+        [expected addIndex:25];
+        [expected addIndex:105];
+        XCTAssertEqualObjects([markerIndex markersInRange:NSMakeRange(0, 106)], expected);
+        
+        /* delete [5, 25): the marker at 10 is removed, the marker at 25 moves to 5 */
+        [markerIndex replaceCharactersInRange:NSMakeRange(5, 20) withLength:0];
+        expected = [NSMutableIndexSet indexSet];
+        [expected addIndex:0];
+        [expected addIndex:5];
+        [expected addIndex:85];
+        XCTAssertEqualObjects([markerIndex markersInRange:NSMakeRange(0, 86)], expected);
+        XCTAssertEqual([markerIndex length], (NSUInteger)85);
+        
+        /* delete [0, 5): the markers at 0 and 5 meet and are merged */
+        [markerIndex replaceCharactersInRange:NSMakeRange(0, 5) withLength:0];
+        XCTAssertEqual([markerIndex count], (NSUInteger)2);
+        markers = [markerIndex markersInRange:NSMakeRange(0, 80)];
+        XCTAssertEqual([markers count], (NSUInteger)1);
+        XCTAssertEqual([markers firstIndex], (NSUInteger)0);
+        
+        /* remove by range, including the marker at the end of the string */
+        [markerIndex removeMarkersInRange:NSMakeRange(1, 80)];
+        XCTAssertEqual([markerIndex count], (NSUInteger)1);
+        [markerIndex removeMarkerAtIndex:0];
+        XCTAssertEqual([markerIndex count], (NSUInteger)0);
+        [markerIndex release];
+}
+
+/**
+ * \brief Test the PLDigitAtlas class.
+ *
+ * \details Check that numbers drawn from the digit atlas have the width of the
+ *          same number drawn as a string, and that drawing them into an image
+ *          changes its pixels.
+ */
+-(void)testDigitAtlas
+{
+        NSFont * font = [NSFont userFixedPitchFontOfSize:11.0f];
+        PLDigitAtlas * digitAtlas;
+        NSDictionary * attributes;
+        NSBitmapImageRep * bitmap;
+        NSUInteger numbers[] = {0, 7, 42, 1009, 123456789};
+        NSUInteger i;
+        NSInteger x, y, left;
+        BOOL drawnLeft, drawnRight;
+        
+        digitAtlas = [[PLDigitAtlas alloc] initWithFont:font color:[NSColor blackColor]];
+        attributes = [NSDictionary dictionaryWithObject:font forKey:NSFontAttributeName];
+        XCTAssertEqualWithAccuracy([digitAtlas height], [@"0" sizeWithAttributes:attributes].height, 0.01);
+        for (i = 0; i < sizeof(numbers)/sizeof(NSUInteger); i++) {
+                XCTAssertEqualWithAccuracy([digitAtlas widthOfNumber:numbers[i]],
+                                           [[NSString stringWithFormat:@"%lu", numbers[i]] sizeWithAttributes:attributes].width,
+                                           0.01);
+        }
+        
+        bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes:NULL
+                                                         pixelsWide:100
+                                                         pixelsHigh:20
+                                                      bitsPerSample:8
+                                                    samplesPerPixel:4
+                                                           hasAlpha:YES
+                                                           isPlanar:NO
+                                                     colorSpaceName:NSCalibratedRGBColorSpace
+                                                        bytesPerRow:0
+                                                       bitsPerPixel:0];
+        [NSGraphicsContext saveGraphicsState];
+        [NSGraphicsContext setCurrentContext:[NSGraphicsContext graphicsContextWithBitmapImageRep:bitmap]];
+        [digitAtlas drawNumber:1009 inRect:NSMakeRect(0.0f, 0.0f, 100.0f, 20.0f)];
+        [NSGraphicsContext restoreGraphicsState];
+        
+        /* the digits are drawn right-aligned, and nothing is drawn to their left */
+        left = 100 - (NSInteger)ceil([digitAtlas widthOfNumber:1009]);
+        drawnLeft = drawnRight = NO;
+        for (x = 0; x < 100; x++) {
+                for (y = 0; y < 20; y++) {
+                        if ([[bitmap colorAtX:x y:y] alphaComponent] == 0.0f)
+                                continue;
+                        if (x < left - 1)
+                                drawnLeft = YES;
+                        else
+                                drawnRight = YES;
+                }
+        }
+        XCTAssertTrue(drawnRight);
+        XCTAssertFalse(drawnLeft);
+        [bitmap release];
+        [digitAtlas release];
+}
+
+/**
+ * \brief Measure drawing the line number view of a scroll view while
+ *        scrolling through the middle of a file.
+ *
+ * \details The text view is laid out before measuring. The ruler view is drawn
+ *          into a bitmap after each scroll step of a quarter of its height.
+ *
+ * \param testCase The test case measuring the scroll steps.
+ *
+ * \param numberOfLines The number of lines in the file.
+ *
+ * \param numberOfFrames The number of scroll steps of each measurement.
+ */
+static void measureLineNumberViewScrolling(XCTestCase * testCase, NSUInteger numberOfLines, NSUInteger numberOfFrames)
+{
+        PLTestLineNumberViewFixture * fixture;
+        NSBitmapImageRep * bitmap;
+        
+        fixture = [[PLTestLineNumberViewFixture alloc] initWithLine:@"    value = compute(value, index) + 1\n"
+                                                      numberOfLines:numberOfLines
+                                          allowsNonContiguousLayout:NO];
+        [fixture->layoutManager ensureLayoutForTextContainer:fixture->textContainer];
+        [fixture->textView sizeToFit];
+        
+        bitmap = [fixture->lineNumberView bitmapImageRepForCachingDisplayInRect:[fixture->lineNumberView visibleRect]];
+        [testCase measureBlock:^{
+                NSScrollView * scrollView = fixture->scrollView;
+                PLLineNumberView * lineNumberView = fixture->lineNumberView;
+                NSPoint origin = NSMakePoint(0.0f, NSHeight([fixture->textView frame]) / 2.0f);
+                for (NSUInteger frame = 0; frame < numberOfFrames; frame++) {
+                        origin.y += 200.0f;
+                        [[scrollView contentView] scrollToPoint:origin];
+                        [scrollView reflectScrolledClipView:[scrollView contentView]];
+                        [lineNumberView cacheDisplayInRect:[lineNumberView visibleRect] toBitmapImageRep:bitmap];
+                }
+        }];
+        [fixture release];
+}
+
+/**
+ * \brief Test the estimated line heights of the PLLineNumberView.
+ *
+ * \details A file of 2,000 lines is laid out contiguously, while a file of
+ *          200,000 lines switches the ruler to estimated line heights when its
+ *          layout manager allows non-contiguous layout, which the ruler never
+ *          changes. Drawing the ruler at the end of the large file must not
+ *          lay out the text preceding it.
+ */
+-(void)testLineNumberViewEstimatedLineHeights
+{
+        NSUInteger numberOfLines[] = {2000, 200000, 200000};
+        BOOL allowsNonContiguousLayout[] = {YES, YES, NO};
+        PLTestLineNumberViewFixture * fixture;
+        PLLineNumberView * lineNumberView;
+        NSBitmapImageRep * bitmap;
+        NSUInteger i, length;
+        
+        for (i = 0; i < 3; i++) {
+                fixture = [[PLTestLineNumberViewFixture alloc] initWithLine:@"2014-01-01 00:00:00 INFO message\n"
+                                                              numberOfLines:numberOfLines[i]
+                                                  allowsNonContiguousLayout:allowsNonContiguousLayout[i]];
+                lineNumberView = fixture->lineNumberView;
+                length = [fixture->textStorage length];
+                XCTAssertEqual([lineNumberView usesEstimatedLineHeights], (BOOL)(i == 1));
+                XCTAssertEqual([fixture->layoutManager allowsNonContiguousLayout], allowsNonContiguousLayout[i]);
+                
+                if (i == 1) {
+                        [fixture->textView setSelectedRange:NSMakeRange(length, 0)];
+                        [fixture->textView scrollRangeToVisible:NSMakeRange(length, 0)];
+                        bitmap = [lineNumberView bitmapImageRepForCachingDisplayInRect:[lineNumberView visibleRect]];
+                        [lineNumberView cacheDisplayInRect:[lineNumberView visibleRect] toBitmapImageRep:bitmap];
+                        XCTAssertTrue([fixture->layoutManager firstUnlaidCharacterIndex] < length / 2);
+                }
+                [fixture release];
+        }
+}
+
+/**
+ * \brief Return a random string of Python source fragments, including
+ *        unterminated strings and docstrings, numbers next to words, and
+ *        non-ASCII characters.
+ */
+static NSString * randomPythonSource(NSUInteger numberOfFragments)
+{
+        NSArray * fragments = @[@"\"", @"'", @"\"\"\"", @"'''", @"#", @"\n", @"\n", @"\r\n", @" ", @" ", @"\t",
+                                @".", @"e", @"E", @"+", @"-", @"1", @"23", @"0.5", @"1e5", @".5", @"x", @"_",
+                                @"é", @"\U0001F600", @"(", @")", @":", @"\\", @"print", @"printer", @"def",
+                                @"as", @"assert", @"if", @"in", @"is", @"None", @"True", @"len", @"_len", @"len_",
+                                @"abs", @"ValueError", @"Exception"];
+        NSMutableString * source = [NSMutableString string];
+        NSUInteger i;
+        for (i = 0; i < numberOfFragments; i++)
+                [source appendString:[fragments objectAtIndex:random() % [fragments count]]];
+        return source;
+}
+
+/**
+ * \brief Return the tokens of a span of lines found by the get_line_coloring()
+ *        function of the python.py script, as strings of the group and range.
+ *        The ranges of the decoded text are mapped to characters by a
+ *        PLSourceBuffer in a wide build of Python.
+ *
+ * \param states A C array set to the lexer state at the end of each line.
+ */
+static NSSet * scriptTokensOfSource(PyObject * module, NSString * source, PLLexerState state,
+                                    const NSUInteger * lineEnds, PLLexerState * states, NSUInteger count)
+{
+        NSMutableSet * tokens = [NSMutableSet set];
+        PLSourceBuffer * sourceBuffer = [[[PLSourceBuffer alloc] init] autorelease];
+        PyObject * pyLineEnds, * pyOutput, * pyMatches, * pyStates, * key, * value, * item;
+        Py_ssize_t position = 0, i;
+        NSUInteger line;
+        NSRange range;
+        PyGILState_STATE gilState = PyGILState_Ensure();
+        BOOL countsCodePoints = PyUnicode_GetMax() > 0xFFFF;
+        [sourceBuffer setString:source range:NSMakeRange(0, [source length])];
+        pyLineEnds = PyList_New(count);
+        for (line = 0; line < count; line++)
+                PyList_SET_ITEM(pyLineEnds, line, PyInt_FromSize_t((countsCodePoints) ? [sourceBuffer codePointOffsetOfCharacterOffset:lineEnds[line]]
+                                                                                      : lineEnds[line]));
+        pyOutput = PyObject_CallMethod(module, "get_line_coloring", "s#iO", [sourceBuffer bytes], (int)[sourceBuffer length],
+                                       (int)state, pyLineEnds);
+        Py_DECREF(pyLineEnds);
+        if (pyOutput == NULL) {
+                PyErr_Clear();
+                PyGILState_Release(gilState);
+                return nil;
+        }
+        pyMatches = PyTuple_GetItem(pyOutput, 0);
+        while (PyDict_Next(pyMatches, &position, &key, &value)) {
+                for (i = 0; i < PyList_Size(value); i++) {
+                        item = PyList_GetItem(value, i);
+                        range = NSMakeRange(PyInt_AsLong(PyTuple_GetItem(item, 0)), PyInt_AsLong(PyTuple_GetItem(item, 1)));
+                        if (countsCodePoints)
+                                range = [sourceBuffer characterRangeOfCodePointRange:range];
+                        [tokens addObject:[NSString stringWithFormat:@"%s %@", PyString_AsString(key), NSStringFromRange(range)]];
+                }
+        }
+        pyStates = PyTuple_GetItem(pyOutput, 1);
+        for (line = 0; line < count; line++)
+                states[line] = (PLLexerState)PyInt_AsLong(PyList_GetItem(pyStates, line));
+        Py_DECREF(pyOutput);
+        PyGILState_Release(gilState);
+        return tokens;
+}
+
+/**
+ * \brief Return the tokens of a span of lines found by a PLPythonTokenizer, as
+ *        strings of the group and range.
+ *
+ * \param states A C array set to the lexer state at the end of each line.
+ */
+static NSSet * nativeTokensOfSource(PLPythonTokenizer * tokenizer, NSString * source, PLLexerState state,
+                                    const NSUInteger * lineEnds, PLLexerState * states, NSUInteger count)
+{
+        NSMutableSet * tokens = [NSMutableSet set];
+        unichar * characters = malloc(([source length] + 1) * sizeof(unichar));
+        NSUInteger i;
+        [source getCharacters:characters range:NSMakeRange(0, [source length])];
+        [tokenizer tokenizeCharacters:characters length:[source length] lexerState:state lineEnds:lineEnds lexerStates:states count:count];
+        free(characters);
+        for (i = 0; i < [tokenizer numberOfTokens]; i++)
+                [tokens addObject:[NSString stringWithFormat:@"%@ %@", [PLPythonTokenizer nameOfGroup:[tokenizer tokens][i].group],
+                                   NSStringFromRange([tokenizer tokens][i].range)]];
+        return tokens;
+}
+
+/**
+ * \brief Return the python.py syntax coloring module, initializing the Python
+ *        interpreter if needed. The GIL must be held to use the module.
+ */
+static PyObject * pythonColoringModule(void)
+{
+        PLSyntaxHighlighter * highlighter;
+        PyGILState_STATE gilState;
+        PyObject * module;
+        if (Py_IsInitialized() == 0)
+                Py_Initialize();
+        highlighter = [[PLSyntaxHighlighter alloc] init];
+        [highlighter release];
+        gilState = PyGILState_Ensure();
+        module = PyImport_ImportModule("python");
+        PyGILState_Release(gilState);
+        return module;
+}
+
+/**
+ * \brief Test the native Python tokenizer against the python.py script.
+ *
+ * \details Tokenize random sources as a whole and in spans of lines starting in
+ *          each lexer state, and compare the tokens and the lexer states at the
+ *          end of each line with those of get_line_coloring().
+ */
+-(void)testPythonTokenizerMatchesScript
+{
+        PLPythonTokenizer * tokenizer = [[PLPythonTokenizer alloc] init];
+        PyObject * module = pythonColoringModule();
+        NSString * source, * span;
+        NSUInteger iteration, count, first, last, line, * lineLengths, * lineEnds;
+        PLLexerState state, * scriptStates, * nativeStates;
+        NSSet * scriptTokens, * nativeTokens;
+        PyGILState_STATE gilState;
+        XCTAssertTrue(module != NULL);
+        srandom(10);
+
+        for (iteration = 0; iteration < 2000; iteration++) {
+                source = randomPythonSource(random() % 80);
+                lineLengths = lineLengthsOfString(source, &count);
+                lineEnds = malloc(count * sizeof(NSUInteger));
+                scriptStates = malloc(count * sizeof(PLLexerState));
+                nativeStates = malloc(count * sizeof(PLLexerState));
+
+                /* a span of lines of the source, starting in a random lexer state */
+                first = (iteration % 2 == 0) ? 0 : random() % count;
+                last = first + random() % (count - first);
+                state = (iteration % 2 == 0) ? PLLexerStateDefault : (PLLexerState)(random() % 3);
+                for (line = 0; line < first; line++)
+                        source = [source substringFromIndex:lineLengths[line]];
+                for (line = first; line <= last; line++)
+                        lineEnds[line - first] = lineLengths[line] + ((line > first) ? lineEnds[line - first - 1] : 0);
+                span = [source substringToIndex:lineEnds[last - first]];
+
+                scriptTokens = scriptTokensOfSource(module, span, state, lineEnds, scriptStates, last - first + 1);
+                nativeTokens = nativeTokensOfSource(tokenizer, span, state, lineEnds, nativeStates, last - first + 1);
+                XCTAssertEqualObjects(nativeTokens, scriptTokens, @"%@ in state %d", span, state);
+                XCTAssertTrue(memcmp(nativeStates, scriptStates, last - first + 1) == 0, @"%@ in state %d", span, state);
+                free(lineLengths);
+                free(lineEnds);
+                free(scriptStates);
+                free(nativeStates);
+        }
+        gilState = PyGILState_Ensure();
+        Py_XDECREF(module);
+        PyGILState_Release(gilState);
+        [tokenizer release];
+}
+
+/**
+ * \brief Test a syntax highlighter initialized after the host initialized
+ *        Python threads, keeping the GIL on the main thread.
+ *
+ * \details The highlighter leaves the GIL on the main thread until the host
+ *          opts into background coloring, after which a background thread can
+ *          take it, and the main thread calls into Python through the
+ *          NSArray (pythonList) category without holding it.
+ */
+-(void)testHighlighterAfterThreadsInitialized
+{
+        PLSyntaxHighlighter * highlighter;
+        PyGILState_STATE gilState;
+        PyObject * pyList;
+        NSArray * array;
+        dispatch_semaphore_t finished = dispatch_semaphore_create(0);
+        long timedOut;
+
+        /* the host initializes Python and its threads, keeping the GIL */
+        if (Py_IsInitialized() == 0)
+                Py_Initialize();
+        gilState = PyGILState_Ensure();
+        PyEval_InitThreads();
+        PyGILState_Release(gilState);
+
+        highlighter = [[PLSyntaxHighlighter alloc] init];
+        XCTAssertNotNil(highlighter);
+        gilState = PyGILState_Ensure();
+        XCTAssertEqual(gilState, PyGILState_LOCKED);
+        PyGILState_Release(gilState);
+        [PLSyntaxHighlighter releaseGILOfCallingThread];
+        gilState = PyGILState_Ensure();
+        XCTAssertEqual(gilState, PyGILState_UNLOCKED);
+        PyGILState_Release(gilState);
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                PyGILState_STATE state = PyGILState_Ensure();
+                PyGILState_Release(state);
+                dispatch_semaphore_signal(finished);
+        });
+        timedOut = dispatch_semaphore_wait(finished, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC));
+        XCTAssertEqual(timedOut, 0L);
+
+        gilState = PyGILState_Ensure();
+        pyList = Py_BuildValue("[iii]", 1, 2, 3);
+        PyGILState_Release(gilState);
+        array = [NSArray arrayByEnumeratingPythonSequence:pyList error:NULL withBlock:^id(PyObject * obj, NSUInteger idx) {
+                return [NSNumber numberWithLong:PyInt_AsLong(obj)];
+        }];
+        XCTAssertEqualObjects(array, (@[@1, @2, @3]));
+        gilState = PyGILState_Ensure();
+        Py_DECREF(pyList);
+        PyGILState_Release(gilState);
+        dispatch_release(finished);
+        [highlighter release];
+}
+
+/**
+ * \brief Run a block starting to color text storages in the background, then
+ *        run the run loop until the syntax highlighter colored them.
+ *
+ * \details The run loop runs until the syntax highlighter posted a number of
+ *          PLSyntaxHighlighterDidColorNotification, or for at most 30
+ *          seconds, then for a tenth of a second more, so that a notification
+ *          posted twice is counted.
+ *
+ * \param textStorage The text storage whose notifications are counted, or nil
+ *                    to count those of every text storage.
+ *
+ * \param count The number of notifications to wait for.
+ *
+ * \param block The block starting to color, or nil when the text storage is
+ *              already colored on the run loop.
+ *
+ * \return The number of notifications posted.
+ */
+-(NSUInteger)waitForColoringOfTextStorage:(PLTextStorage *)textStorage count:(NSUInteger)count afterBlock:(void (^)(void))block
+{
+        NSDate * timeout = [NSDate dateWithTimeIntervalSinceNow:30.0];
+        __block NSUInteger numberOfNotifications = 0;
+        id observer;
+        observer = [[NSNotificationCenter defaultCenter] addObserverForName:PLSyntaxHighlighterDidColorNotification
+                                                                     object:textStorage
+                                                                      queue:nil
+                                                                 usingBlock:^(NSNotification * notification) {
+                                                                         numberOfNotifications++;
+                                                                 }];
+        if (block)
+                block();
+        while (numberOfNotifications < count && [timeout timeIntervalSinceNow] > 0.0)
+                [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+        [[NSNotificationCenter defaultCenter] removeObserver:observer];
+        return numberOfNotifications;
+}
+
+/**
+ * \brief Test coloring a PLTextStorage on a background thread.
+ *
+ * \details Edit the text storage while its first pass is colored, so that the
+ *          pass is stale when it returns to the main thread. The stale result
+ *          must be dropped and the text colored again, leaving no damaged line
+ *          and the same lexer states as coloring the final text on the main
+ *          thread, with a single notification.
+ */
+-(void)testSyntaxHighlighterBackgroundColoring
+{
+        PLSyntaxHighlighter * highlighter = [[PLSyntaxHighlighter alloc] init];
+        PLTextStorage * textStorage, * reference;
+        NSUInteger numberOfNotifications, line;
+        srandom(11);
+        [highlighter setActiveEngine:PLSyntaxHighlighterEngineNativeTokenizer];
+        textStorage = [[PLTextStorage alloc] initWithString:randomPythonSource(20000)];
+
+        numberOfNotifications = [self waitForColoringOfTextStorage:textStorage count:1 afterBlock:^{
+                [highlighter colorTextStorageInBackground:textStorage];
+                [textStorage replaceCharactersInRange:NSMakeRange(0, 0) withString:@"'''\n"];
+                [highlighter colorTextStorageInBackground:textStorage];
+        }];
+        XCTAssertEqual(numberOfNotifications, (NSUInteger)1);
+        XCTAssertEqual([[textStorage lexerStates] damagedLineRange].length, (NSUInteger)0);
+
+        reference = [[PLTextStorage alloc] initWithString:[textStorage string]];
+        XCTAssertTrue([highlighter colorTextStorage:reference error:NULL]);
+        XCTAssertEqual([[reference lexerStates] damagedLineRange].length, (NSUInteger)0);
+        for (line = 1; line <= [textStorage numberOfLines]; line++)
+                XCTAssertEqual([[textStorage lexerStates] stateAtEndOfLine:line], [[reference lexerStates] stateAtEndOfLine:line]);
+
+        [reference release];
+        [textStorage release];
+        [highlighter release];
+}
+
+/**
+ * \brief Test the buffer protocol of the python.py script against the dict
+ *        protocol.
+ *
+ * \details Get the ranges of random sources from get_coloring_dict() and
+ *          get_coloring_buffer(), and compare them as strings of the group and
+ *          range. get_coloring_dict() returns offsets in the decoded text, so
+ *          get_coloring_buffer() is given the decoded text as well.
+ */
+-(void)testPythonScriptBufferMatchesDict
+{
+        PyObject * module = pythonColoringModule(), * pyOutput, * pyGroups, * pyText, * key, * value;
+        NSMutableSet * dictRanges, * bufferRanges;
+        NSString * source;
+        const int * triples;
+        Py_ssize_t position, length, i;
+        NSUInteger iteration;
+        PyGILState_STATE gilState;
+        XCTAssertTrue(module != NULL);
+        srandom(12);
+        gilState = PyGILState_Ensure();
+
+        for (iteration = 0; iteration < 200; iteration++) {
+                source = randomPythonSource(random() % 200);
+                dictRanges = [NSMutableSet set];
+                bufferRanges = [NSMutableSet set];
+
+                pyOutput = PyObject_CallMethod(module, "get_coloring_dict", "s", [source UTF8String]);
+                XCTAssertTrue(pyOutput != NULL);
+                position = 0;
+                while (pyOutput && PyDict_Next(pyOutput, &position, &key, &value)) {
+                        for (i = 0; i < PyList_Size(value); i++) {
+                                [dictRanges addObject:[NSString stringWithFormat:@"%s %ld %ld", PyString_AsString(key),
+                                                       PyInt_AsLong(PyTuple_GetItem(PyList_GetItem(value, i), 0)),
+                                                       PyInt_AsLong(PyTuple_GetItem(PyList_GetItem(value, i), 1))]];
+                        }
+                }
+                Py_XDECREF(pyOutput);
+
+                pyText = PyUnicode_DecodeUTF8([source UTF8String], strlen([source UTF8String]), NULL);
+                pyOutput = PyObject_CallMethod(module, "get_coloring_buffer", "O", pyText);
+                Py_XDECREF(pyText);
+                XCTAssertTrue(pyOutput != NULL);
+                XCTAssertTrue(PyObject_AsReadBuffer(PyTuple_GetItem(pyOutput, 1), (const void **)&triples, &length) == 0);
+                XCTAssertTrue(length % (3 * sizeof(int)) == 0);
+                pyGroups = PyTuple_GetItem(pyOutput, 0);
+                for (i = 0; i < length / (Py_ssize_t)sizeof(int); i += 3) {
+                        [bufferRanges addObject:[NSString stringWithFormat:@"%s %d %d",
+                                                 PyString_AsString(PyList_GetItem(pyGroups, triples[i])),
+                                                 triples[i + 1], triples[i + 2]]];
+                }
+                Py_XDECREF(pyOutput);
+                XCTAssertEqualObjects(bufferRanges, dictRanges, @"%@", source);
+        }
+        Py_XDECREF(module);
+        PyGILState_Release(gilState);
+}
+
+/**
+ * \brief Test the UTF-8 encoding and the offset mapping of a PLSourceBuffer.
+ *
+ * \details Encode ranges of ASCII and non-ASCII strings, including a surrogate
+ *          pair and an unpaired surrogate, and map each byte and code point
+ *          offset to its character and back.
+ */
+-(void)testSourceBuffer
+{
+        PLSourceBuffer * sourceBuffer = [[PLSourceBuffer alloc] init];
+        PLRopeString * rope;
+        NSString * string = [NSString stringWithFormat:@"a\u00e9\u20ac%C%Cb%C", (unichar)0xD83D, (unichar)0xDE00, (unichar)0xDC00];
+        const char expected[] = "a\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80" "b\xef\xbf\xbd";
+        NSUInteger characterOffsets[] = {0, 1, 1, 2, 2, 2, 3, 3, 3, 3, 5, 6, 6, 6, 7};
+        NSUInteger i;
+
+        [sourceBuffer setString:@"x = 'abc'\n" range:NSMakeRange(4, 5)];
+        XCTAssertTrue([sourceBuffer isASCII]);
+        XCTAssertEqual([sourceBuffer length], (NSUInteger)5);
+        XCTAssertTrue(memcmp([sourceBuffer bytes], "'abc'", 5) == 0);
+        XCTAssertEqual([sourceBuffer characterOffsetOfByteOffset:3], (NSUInteger)3);
+        XCTAssertEqual([sourceBuffer byteOffsetOfCharacterOffset:5], (NSUInteger)5);
+
+        [sourceBuffer setString:string range:NSMakeRange(0, [string length])];
+        XCTAssertFalse([sourceBuffer isASCII]);
+        XCTAssertEqual([sourceBuffer length], sizeof(expected) - 1);
+        XCTAssertTrue(memcmp([sourceBuffer bytes], expected, sizeof(expected) - 1) == 0);
+        for (i = 0; i <= [sourceBuffer length]; i++)
+                XCTAssertEqual([sourceBuffer characterOffsetOfByteOffset:i], characterOffsets[i]);
+        XCTAssertEqual([sourceBuffer byteOffsetOfCharacterOffset:2], (NSUInteger)3);
+        XCTAssertEqual([sourceBuffer byteOffsetOfCharacterOffset:5], (NSUInteger)10);
+        XCTAssertEqual([sourceBuffer byteOffsetOfCharacterOffset:7], (NSUInteger)14);
+        XCTAssertTrue(NSEqualRanges([sourceBuffer characterRangeOfByteRange:NSMakeRange(3, 7)], NSMakeRange(2, 3)));
+        XCTAssertEqual([sourceBuffer characterOffsetOfCodePointOffset:3], (NSUInteger)3);
+        XCTAssertEqual([sourceBuffer characterOffsetOfCodePointOffset:4], (NSUInteger)5);
+        XCTAssertEqual([sourceBuffer characterOffsetOfCodePointOffset:6], (NSUInteger)7);
+        XCTAssertEqual([sourceBuffer codePointOffsetOfCharacterOffset:5], (NSUInteger)4);
+        XCTAssertEqual([sourceBuffer codePointOffsetOfCharacterOffset:7], (NSUInteger)6);
+        XCTAssertTrue(NSEqualRanges([sourceBuffer characterRangeOfCodePointRange:NSMakeRange(3, 2)], NSMakeRange(3, 3)));
+
+        [sourceBuffer setString:string range:NSMakeRange(3, 3)];
+        XCTAssertEqual([sourceBuffer length], (NSUInteger)5);
+        XCTAssertEqual([sourceBuffer characterOffsetOfByteOffset:4], (NSUInteger)2);
+
+        /* a rope string is read in blocks, keeping a surrogate pair across a block boundary */
+        rope = [[PLRopeString alloc] initWithString:[[@"" stringByPaddingToLength:4095 withString:@"a" startingAtIndex:0]
+                                                     stringByAppendingString:@"\U0001F600\u00e9x"]];
+        [sourceBuffer setString:rope range:NSMakeRange(0, [rope length])];
+        XCTAssertFalse([sourceBuffer isASCII]);
+        XCTAssertEqual([sourceBuffer length], strlen([rope UTF8String]));
+        XCTAssertTrue(memcmp([sourceBuffer bytes], [rope UTF8String], [sourceBuffer length]) == 0);
+        XCTAssertEqual([sourceBuffer characterOffsetOfByteOffset:4099], (NSUInteger)4097);
+        XCTAssertEqual([sourceBuffer characterOffsetOfCodePointOffset:4096], (NSUInteger)4097);
+        [sourceBuffer setString:rope range:NSMakeRange(0, 4095)];
+        XCTAssertTrue([sourceBuffer isASCII]);
+        XCTAssertEqual([sourceBuffer length], (NSUInteger)4095);
+        [rope release];
+        [sourceBuffer release];
+}
+
+/**
+ * \brief Test coloring the visible lines of a PLTextStorage first, and the
+ *        rest of its lines in idle time.
+ *
+ * \details Color the lines in the middle of a text storage, which must
+ *          give a lexer state to the visible lines only, leaving every line
+ *          damaged as the visible lines were colored from a guessed state.
+ *          Then run the run loop until the idle slices colored every line. The
+ *          lexer states must match those of coloring the text in a single
+ *          pass, with a single notification.
+ */
+-(void)testSyntaxHighlighterProgressiveColoring
+{
+        PLSyntaxHighlighter * highlighter = [[PLSyntaxHighlighter alloc] init];
+        PLTextStorage * textStorage, * reference;
+        NSUInteger numberOfNotifications, line, middle;
+        NSRange visibleRange, visibleLines;
+        srandom(14);
+        [highlighter setActiveEngine:PLSyntaxHighlighterEngineNativeTokenizer];
+        textStorage = [[PLTextStorage alloc] initWithString:randomPythonSource(40000)];
+        reference = [[PLTextStorage alloc] initWithString:[textStorage string]];
+
+        /* the visible range ends at the start of its last line */
+        middle = [textStorage numberOfLines] / 2;
+        visibleLines = NSMakeRange(middle, 51);
+        visibleRange = NSMakeRange([textStorage characterIndexForLineNumber:middle],
+                                   [textStorage characterIndexForLineNumber:NSMaxRange(visibleLines) - 1]
+                                   - [textStorage characterIndexForLineNumber:middle]);
+        XCTAssertTrue([highlighter colorTextStorage:textStorage visibleRange:visibleRange error:NULL]);
+        for (line = 1; line <= [textStorage numberOfLines]; line++) {
+                XCTAssertEqual((BOOL)([[textStorage lexerStates] stateAtEndOfLine:line] != PLLexerStateUnknown),
+                               NSLocationInRange(line, visibleLines));
+        }
+        XCTAssertTrue(NSEqualRanges([[textStorage lexerStates] damagedLineRange], NSMakeRange(1, [textStorage numberOfLines])));
+
+        XCTAssertTrue([highlighter colorTextStorage:reference error:NULL]);
+
+        numberOfNotifications = [self waitForColoringOfTextStorage:textStorage count:1 afterBlock:nil];
+        XCTAssertEqual(numberOfNotifications, (NSUInteger)1);
+        XCTAssertEqual([[textStorage lexerStates] damagedLineRange].length, (NSUInteger)0);
+        for (line = 1; line <= [textStorage numberOfLines]; line++)
+                XCTAssertEqual([[textStorage lexerStates] stateAtEndOfLine:line], [[reference lexerStates] stateAtEndOfLine:line]);
+
+        [reference release];
+        [textStorage release];
+        [highlighter release];
+}
+
+/**
+ * \brief Test resolving groups to styles and applying runs of styles.
+ *
+ * \details The style of a token group is the group plus one, and a new group
+ *          gets the next style. Unsorted and overlapping runs are applied to a
+ *          text storage, whose characters must have the attributes of the
+ *          first run covering them, or of the default style.
+ */
+-(void)testStyleTable
+{
+        PLStyleTable * styleTable = [[PLStyleTable alloc] initWithThemeManager:[PLThemeManager defaultThemeManager]];
+        PLTextStorage * textStorage = [[PLTextStorage alloc] initWithString:@"0123456789abcdef"];
+        PLStyleRun runs[4] = {
+                {NSMakeRange(8, 4), 2},
+                {NSMakeRange(2, 3), 1},
+                {NSMakeRange(4, 2), 3},
+                {NSMakeRange(14, 10), 1}
+        };
+        PLStyle expected[16] = {0, 0, 1, 1, 1, 3, 0, 0, 2, 2, 2, 2, 0, 0, 1, 1};
+        NSUInteger i, numberOfStyles = [styleTable numberOfStyles];
+        PLPythonTokenGroup group;
+        for (group = 0; group < PLPythonTokenGroupCount; group++)
+                XCTAssertEqual([styleTable styleOfGroup:[PLPythonTokenizer nameOfGroup:group]], (PLStyle)(group + 1));
+        XCTAssertEqual([styleTable styleOfGroup:PLThemeManagerSettings], (PLStyle)PLStyleDefault);
+        XCTAssertEqual([styleTable styleOfGroup:@"Custom group"], (PLStyle)numberOfStyles);
+        XCTAssertEqual([styleTable styleOfGroup:@"Custom group"], (PLStyle)numberOfStyles);
+        XCTAssertEqual([styleTable numberOfStyles], numberOfStyles + 1);
+
+        [styleTable applyRuns:runs count:4 inRange:NSMakeRange(0, [textStorage length]) toTextStorage:textStorage];
+        XCTAssertEqual(runs[0].range.location, (NSUInteger)2);
+        for (i = 0; i < [textStorage length]; i++) {
+                XCTAssertEqualObjects([textStorage attribute:NSForegroundColorAttributeName atIndex:i effectiveRange:NULL],
+                                      [[styleTable attributesOfStyle:expected[i]] objectForKey:NSForegroundColorAttributeName]);
+        }
+        [textStorage release];
+        [styleTable release];
+}
+
+/**
+ * \brief Test coloring lines from the token cache of a syntax highlighter.
+ *
+ * \details Color a text storage, then a second text storage with the same
+ *          text, as when reopening a file. Every line of the second one must be
+ *          found in the cache, with the same lexer states and colors as the
+ *          first. Replacing a line and undoing the replacement must also be
+ *          colored from the cache, and the size of the cache must stay within
+ *          its capacity.
+ */
+-(void)testTokenCache
+{
+        PLSyntaxHighlighter * highlighter = [[PLSyntaxHighlighter alloc] init];
+        PLTokenCache * tokenCache = [highlighter tokenCache];
+        PLTextStorage * textStorage, * reopened;
+        NSString * line;
+        NSRange lineRange, effectiveRange;
+        NSUInteger i, numberOfHits;
+        srandom(16);
+        [highlighter setActiveEngine:PLSyntaxHighlighterEngineNativeTokenizer];
+        textStorage = [[PLTextStorage alloc] initWithString:randomPythonSource(2000)];
+        XCTAssertTrue([highlighter colorTextStorage:textStorage error:NULL]);
+        XCTAssertTrue([tokenCache numberOfLines] > 0);
+
+        [tokenCache resetStatistics];
+        reopened = [[PLTextStorage alloc] initWithString:[textStorage string]];
+        XCTAssertTrue([highlighter colorTextStorage:reopened error:NULL]);
+        XCTAssertEqual([tokenCache numberOfMisses], (NSUInteger)0);
+        XCTAssertEqual([tokenCache numberOfHits], [reopened numberOfLines]);
+        for (i = 1; i <= [reopened numberOfLines]; i++)
+                XCTAssertEqual([[reopened lexerStates] stateAtEndOfLine:i], [[textStorage lexerStates] stateAtEndOfLine:i]);
+        for (i = 0; i < [reopened length]; i += effectiveRange.length) {
+                XCTAssertEqualObjects([reopened attribute:NSForegroundColorAttributeName atIndex:i effectiveRange:&effectiveRange],
+                                      [textStorage attribute:NSForegroundColorAttributeName atIndex:i effectiveRange:NULL]);
+                effectiveRange.length = MAX(effectiveRange.length, (NSUInteger)1);
+        }
+
+        lineRange = [reopened rangeOfLineNumber:[reopened numberOfLines] / 2];
+        line = [[reopened string] substringWithRange:lineRange];
+        [reopened replaceCharactersInRange:lineRange withString:@"'''\n"];
+        XCTAssertTrue([highlighter colorTextStorage:reopened error:NULL]);
+        numberOfHits = [tokenCache numberOfHits];
+        [reopened replaceCharactersInRange:[reopened rangeOfLineNumber:[reopened numberOfLines] / 2] withString:line];
+        XCTAssertTrue([highlighter colorTextStorage:reopened error:NULL]);
+        XCTAssertTrue([tokenCache numberOfHits] > numberOfHits);
+        for (i = 1; i <= [reopened numberOfLines]; i++)
+                XCTAssertEqual([[reopened lexerStates] stateAtEndOfLine:i], [[textStorage lexerStates] stateAtEndOfLine:i]);
+        XCTAssertTrue([tokenCache size] > 0 && [tokenCache size] <= [tokenCache capacity]);
+        XCTAssertEqualWithAccuracy([tokenCache hitRate],
+                                   (double)[tokenCache numberOfHits] / ([tokenCache numberOfHits] + [tokenCache numberOfMisses]), 1e-9);
+
+        [tokenCache setCapacity:4096];
+        XCTAssertTrue([tokenCache size] <= (NSUInteger)4096);
+        [tokenCache removeAllLines];
+        XCTAssertEqual([tokenCache numberOfLines], (NSUInteger)0);
+        XCTAssertEqual([tokenCache size], (NSUInteger)0);
+
+        [reopened release];
+        [textStorage release];
+        [highlighter release];
+}
+
+/**
+ * \brief Test coloring several text storages in the background at once.
+ *
+ * \details Color eight text storages, one of them focused, as after restoring
+ *          a session. Each must be notified once, with no damaged line and the
+ *          same lexer states as coloring it on the main thread.
+ */
+-(void)testSyntaxHighlighterScheduler
+{
+        PLSyntaxHighlighter * highlighter = [[PLSyntaxHighlighter alloc] init];
+        NSMutableArray * textStorages = [NSMutableArray array];
+        PLTextStorage * textStorage, * reference;
+        NSUInteger numberOfNotifications, i, line;
+        srandom(17);
+        [highlighter setActiveEngine:PLSyntaxHighlighterEngineNativeTokenizer];
+        [[highlighter tokenCache] setCapacity:0];
+        for (i = 0; i < 8; i++) {
+                textStorage = [[PLTextStorage alloc] initWithString:randomPythonSource(10000)];
+                [textStorages addObject:textStorage];
+                [textStorage release];
+        }
+
+        [highlighter setFocusedTextStorage:[textStorages objectAtIndex:3]];
+        numberOfNotifications = [self waitForColoringOfTextStorage:nil count:[textStorages count] afterBlock:^{
+                for (NSUInteger index = 0; index < [textStorages count]; index++)
+                        [highlighter colorTextStorageInBackground:[textStorages objectAtIndex:index]];
+        }];
+        XCTAssertEqual(numberOfNotifications, [textStorages count]);
+
+        for (textStorage in textStorages) {
+                XCTAssertEqual([[textStorage lexerStates] damagedLineRange].length, (NSUInteger)0);
+                reference = [[PLTextStorage alloc] initWithString:[textStorage string]];
+                XCTAssertTrue([highlighter colorTextStorage:reference error:NULL]);
+                for (line = 1; line <= [textStorage numberOfLines]; line++)
+                        XCTAssertEqual([[textStorage lexerStates] stateAtEndOfLine:line], [[reference lexerStates] stateAtEndOfLine:line]);
+                [reference release];
+        }
+
+        [highlighter setFocusedTextStorage:nil];
+        [highlighter release];
+}
+
+/**
+ * \brief Test cancelling the pass of a text storage edited while it is
+ *        colored.
+ *
+ * \details Edit a text storage right after its first pass starts, so that
+ *          the pass is cancelled rather than colored to its end, and counted
+ *          by the syntax highlighter. A single notification must be
+ *          posted, for a text with no damaged line and the same lexer states
+ *          as coloring it on the main thread. The should_cancel() function
+ *          defined in the python.py module must return False outside of a
+ *          pass.
+ */
+-(void)testSyntaxHighlighterCancellation
+{
+        PLSyntaxHighlighter * highlighter = [[PLSyntaxHighlighter alloc] init];
+        PLTextStorage * textStorage, * reference;
+        PyObject * module, * pyResult;
+        PyGILState_STATE gilState;
+        NSUInteger numberOfNotifications, line;
+        srandom(18);
+        XCTAssertTrue([highlighter setActivePythonScript:@"python" error:NULL]);
+        module = pythonColoringModule();
+        gilState = PyGILState_Ensure();
+        pyResult = PyObject_CallMethod(module, "should_cancel", NULL);
+        XCTAssertTrue(pyResult == Py_False);
+        Py_XDECREF(pyResult);
+        Py_XDECREF(module);
+        PyGILState_Release(gilState);
+
+        [highlighter setActiveEngine:PLSyntaxHighlighterEngineNativeTokenizer];
+        [[highlighter tokenCache] setCapacity:0];
+        textStorage = [[PLTextStorage alloc] initWithString:randomPythonSource(40000)];
+        XCTAssertEqual([highlighter numberOfCancelledPasses], (NSUInteger)0);
+        numberOfNotifications = [self waitForColoringOfTextStorage:textStorage count:1 afterBlock:^{
+                [highlighter colorTextStorageInBackground:textStorage];
+                [textStorage replaceCharactersInRange:NSMakeRange(0, 0) withString:@"x = 1\n"];
+                [highlighter colorTextStorageInBackground:textStorage];
+        }];
+        XCTAssertEqual([highlighter numberOfCancelledPasses], (NSUInteger)1);
+        XCTAssertEqual(numberOfNotifications, (NSUInteger)1);
+        XCTAssertEqual([[textStorage lexerStates] damagedLineRange].length, (NSUInteger)0);
+
+        reference = [[PLTextStorage alloc] initWithString:[textStorage string]];
+        XCTAssertTrue([highlighter colorTextStorage:reference error:NULL]);
+        for (line = 1; line <= [textStorage numberOfLines]; line++)
+                XCTAssertEqual([[textStorage lexerStates] stateAtEndOfLine:line], [[reference lexerStates] stateAtEndOfLine:line]);
+
+        [reference release];
+        [textStorage release];
+        [highlighter release];
+}
+
+/**
+ * \brief Test the semantic overlay of a text storage.
+ *
+ * \details Setting the runs of the overlay must return the lines whose styles
+ *          changed, and nothing for the same runs. The runs follow the edits
+ *          of the text storage, so that lines only moved are unchanged, and an
+ *          edit touching a run removes it.
+ */
+-(void)testSemanticOverlay
+{
+        PLTextStorage * textStorage = [[PLTextStorage alloc] initWithString:@"a = 1\nb = a\nc = b\n"];
+        PLSemanticOverlay * overlay = [textStorage semanticOverlay];
+        PLStyleRun runs[3];
+        NSIndexSet * lines;
+
+        runs[0] = (PLStyleRun){NSMakeRange(12, 1), 3};
+        runs[1] = (PLStyleRun){NSMakeRange(0, 1), 1};
+        runs[2] = (PLStyleRun){NSMakeRange(10, 1), 2};
+        lines = [overlay setRuns:runs count:3 ofTextStorage:textStorage];
+        XCTAssertEqualObjects(lines, [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(1, 3)]);
+        XCTAssertEqual([overlay numberOfRuns], (NSUInteger)3);
+        XCTAssertEqual([overlay runs][1].range.location, (NSUInteger)10);
+
+        /* the same runs do not change any line */
+        runs[0] = (PLStyleRun){NSMakeRange(0, 1), 1};
+        runs[1] = (PLStyleRun){NSMakeRange(10, 1), 2};
+        runs[2] = (PLStyleRun){NSMakeRange(12, 1), 3};
+        XCTAssertEqual([[overlay setRuns:runs count:3 ofTextStorage:textStorage] count], (NSUInteger)0);
+
+        /* the runs follow an edit, so that lines only moved are unchanged */
+        [textStorage replaceCharactersInRange:NSMakeRange(6, 0) withString:@"\n"];
+        XCTAssertEqual([overlay runs][2].range.location, (NSUInteger)13);
+        runs[0] = (PLStyleRun){NSMakeRange(0, 1), 1};
+        runs[1] = (PLStyleRun){NSMakeRange(11, 1), 2};
+        runs[2] = (PLStyleRun){NSMakeRange(13, 1), 3};
+        XCTAssertEqual([[overlay setRuns:runs count:3 ofTextStorage:textStorage] count], (NSUInteger)0);
+
+        /* a run changing style only changes its line */
+        runs[0] = (PLStyleRun){NSMakeRange(0, 1), 1};
+        runs[1] = (PLStyleRun){NSMakeRange(11, 1), 1};
+        runs[2] = (PLStyleRun){NSMakeRange(13, 1), 3};
+        lines = [overlay setRuns:runs count:3 ofTextStorage:textStorage];
+        XCTAssertEqualObjects(lines, [NSIndexSet indexSetWithIndex:3]);
+
+        /* an edit touching a run removes it */
+        [textStorage replaceCharactersInRange:NSMakeRange(0, 1) withString:@"x"];
+        XCTAssertEqual([overlay numberOfRuns], (NSUInteger)2);
+        [textStorage release];
+}
+
+/**
+ * \brief Test the metrics of the syntax highlighting passes.
+ *
+ * \details Each pass must record the engine, generation, lines, characters,
+ *          ranges and engine calls it took, and post them with
+ *          PLSyntaxHighlighterDidMeasurePassNotification. Only a script engine
+ *          counts the bytes it was sent, and the log keeps at most as many
+ *          metrics as its capacity.
+ */
+-(void)testSyntaxHighlighterMetrics
+{
+        PLSyntaxHighlighter * highlighter = [[PLSyntaxHighlighter alloc] init];
+        PLTextStorage * textStorage;
+        __block PLSyntaxHighlightingMetrics * notifiedMetrics = nil;
+        PLSyntaxHighlightingMetrics * metrics;
+        id observer;
+        srandom(20);
+        textStorage = [[PLTextStorage alloc] initWithString:randomPythonSource(20000)];
+        observer = [[NSNotificationCenter defaultCenter] addObserverForName:PLSyntaxHighlighterDidMeasurePassNotification
+                                                                     object:textStorage
+                                                                      queue:nil
+                                                                 usingBlock:^(NSNotification * notification) {
+                                                                         notifiedMetrics = [[notification userInfo] objectForKey:PLSyntaxHighlighterMetricsKey];
+                                                                 }];
+        [highlighter setMetricsLogCapacity:2];
+        [highlighter setActiveEngine:PLSyntaxHighlighterEngineNativeTokenizer];
+        XCTAssertTrue([highlighter colorTextStorage:textStorage error:NULL]);
+        metrics = [highlighter lastMetrics];
+        XCTAssertTrue(metrics == notifiedMetrics);
+        XCTAssertEqualObjects([metrics engineName], @"PLPythonTokenizer");
+        XCTAssertTrue([[metrics description] hasPrefix:@"PLPythonTokenizer generation "]);
+        XCTAssertEqual([metrics numberOfLines], [textStorage numberOfLines]);
+        XCTAssertEqual([metrics numberOfCharacters], [textStorage length]);
+        XCTAssertTrue([metrics numberOfRanges] > 0);
+        XCTAssertTrue([metrics numberOfEngineCalls] > 0);
+        XCTAssertEqual([metrics numberOfBytesSent], (NSUInteger)0);
+
+        /* the script engine counts the bytes it was sent */
+        XCTAssertTrue([highlighter setActivePythonScript:@"python" error:NULL]);
+        [[highlighter tokenCache] setCapacity:0];
+        [textStorage replaceCharactersInRange:NSMakeRange(0, 0) withString:@"x = 1\n"];
+        XCTAssertTrue([highlighter colorTextStorage:textStorage error:NULL]);
+        metrics = [highlighter lastMetrics];
+        XCTAssertEqualObjects([metrics engineName], @"python");
+        XCTAssertEqual([metrics generation], [textStorage generation]);
+        XCTAssertTrue([metrics numberOfBytesSent] > 0);
+        XCTAssertTrue([metrics numberOfRanges] > 0);
+
+        [textStorage replaceCharactersInRange:NSMakeRange(0, 0) withString:@"y = 2\n"];
+        XCTAssertTrue([highlighter colorTextStorage:textStorage error:NULL]);
+        XCTAssertEqual([[highlighter metricsLog] count], (NSUInteger)2);
+        XCTAssertTrue([[highlighter metricsLog] lastObject] == [highlighter lastMetrics]);
+        [highlighter setMetricsLogCapacity:0];
+        XCTAssertEqual([[highlighter metricsLog] count], (NSUInteger)0);
+
+        [[NSNotificationCenter defaultCenter] removeObserver:observer];
+        [textStorage release];
+        [highlighter release];
+}
+
+/**
+ * \brief Test the rope backing store of a text storage.
+ *
+ * \details Random edits and attributes must leave a text storage backed by a
+ *          rope with the same characters, lines and attribute runs as one
+ *          backed by an attributed string.
+ */
+-(void)testRopeBackingStore
+{
+        PLTextStorage * reference = [[PLTextStorage alloc] initWithString:@""];
+        PLTextStorage * rope = [[PLTextStorage alloc] initWithString:@"" backingStore:PLTextStorageBackingStoreRope];
+        NSDictionary * red = @{NSForegroundColorAttributeName: [NSColor redColor]};
+        NSUInteger i, location, length, index;
+        NSRange referenceRange, ropeRange;
+        srandom(21);
+        XCTAssertEqual([reference backingStore], PLTextStorageBackingStoreAttributedString);
+        XCTAssertEqual([rope backingStore], PLTextStorageBackingStoreRope);
+
+        /* random edits and attributes match those of an NSMutableAttributedString */
+        for (i = 0; i < 5000; i++) {
+                location = ([reference length] > 0) ? random() % ([reference length] + 1) : 0;
+                length = (random() % 4 == 0) ? MIN(random() % 3000, [reference length] - location) : 0;
+                if (random() % 3 == 0 && length > 0) {
+                        [reference addAttributes:red range:NSMakeRange(location, length)];
+                        [rope addAttributes:red range:NSMakeRange(location, length)];
+                } else {
+                        NSString * string = randomPythonSource(random() % 8);
+                        [reference replaceCharactersInRange:NSMakeRange(location, length) withString:string];
+                        [rope replaceCharactersInRange:NSMakeRange(location, length) withString:string];
+                }
+        }
+        XCTAssertEqualObjects([rope string], [reference string]);
+        XCTAssertEqual([rope numberOfLines], [reference numberOfLines]);
+        for (i = 0; i < 1000 && [reference length] > 0; i++) {
+                index = random() % [reference length];
+                XCTAssertEqual([[rope string] characterAtIndex:index], [[reference string] characterAtIndex:index]);
+                [reference attribute:NSForegroundColorAttributeName atIndex:index longestEffectiveRange:&referenceRange inRange:NSMakeRange(0, [reference length])];
+                [rope attribute:NSForegroundColorAttributeName atIndex:index longestEffectiveRange:&ropeRange inRange:NSMakeRange(0, [rope length])];
+                XCTAssertTrue(NSEqualRanges(referenceRange, ropeRange));
+        }
+        [reference release];
+        [rope release];
+}
+
+/**
+ * \brief Test the merging of the chunks of a PLRopeString.
+ *
+ * \details Deleting and typing characters within chunks must not add chunks
+ *          when the characters on either side of each edit fit in one chunk.
+ */
+-(void)testRopeStringChunkMerging
+{
+        NSString * source = [@"" stringByPaddingToLength:64 << 10 withString:@"abcdefgh\n" startingAtIndex:0];
+        PLRopeString * rope = [[PLRopeString alloc] initWithString:source];
+        NSMutableString * reference = [source mutableCopy];
+        NSUInteger numberOfChunks = [rope numberOfChunks], location;
+        XCTAssertEqual(numberOfChunks, (NSUInteger)64);
+        for (location = [reference length] - 100; location > 0; location -= 100) {
+                [rope deleteCharactersInRange:NSMakeRange(location, 1)];
+                [reference deleteCharactersInRange:NSMakeRange(location, 1)];
+        }
+        XCTAssertEqualObjects(rope, reference);
+        XCTAssertTrue([rope numberOfChunks] <= numberOfChunks);
+        for (location = 0; location < 100; location++) {
+                [rope insertString:@"x" atIndex:location * 600];
+                [reference insertString:@"x" atIndex:location * 600];
+                [rope deleteCharactersInRange:NSMakeRange(location * 600 + 300, 2)];
+                [reference deleteCharactersInRange:NSMakeRange(location * 600 + 300, 2)];
+        }
+        XCTAssertEqualObjects(rope, reference);
+        XCTAssertTrue([rope numberOfChunks] <= numberOfChunks);
+        [reference release];
+        [rope release];
+}
+
+/**
+ * \brief Test typing at the head, middle and tail of a text storage with each
+ *        backing store.
+ *
+ * \details Both backing stores must hold the same characters and lines after
+ *          the same keystrokes.
+ */
+-(void)testRopeBackingStoreTyping
+{
+        PLTextStorageBackingStore backingStores[2] = {PLTextStorageBackingStoreAttributedString, PLTextStorageBackingStoreRope};
+        PLTextStorage * textStorages[2];
+        NSMutableString * source = [NSMutableString string];
+        NSUInteger backingStore, position, keystroke, location;
+        srandom(21);
+        while ([source length] < 64 << 10)
+                [source appendString:randomPythonSource(100)];
+        for (backingStore = 0; backingStore < 2; backingStore++) {
+                textStorages[backingStore] = [[PLTextStorage alloc] initWithString:source backingStore:backingStores[backingStore]];
+                for (position = 0; position < 3; position++) {
+                        location = position * [textStorages[backingStore] length] / 2;
+                        for (keystroke = 0; keystroke < 100; keystroke++) {
+                                [textStorages[backingStore] replaceCharactersInRange:NSMakeRange(location + keystroke, 0)
+                                                                          withString:(keystroke % 10 == 9) ? @"\n" : @"x"];
+                        }
+                }
+                XCTAssertEqual([textStorages[backingStore] length], [source length] + 300);
+        }
+        XCTAssertEqualObjects([textStorages[1] string], [textStorages[0] string]);
+        XCTAssertEqual([textStorages[1] numberOfLines], [textStorages[0] numberOfLines]);
+        [textStorages[0] release];
+        [textStorages[1] release];
+}
+
+/**
+ * \brief Test the style runs of a text storage.
+ *
+ * \details Random style and character edits of a PLStyleRunArray must match a
+ *          C array with the style of each character, with adjacent runs of
+ *          different styles. Coloring a text storage stores the styles in its
+ *          style runs, and its attributes must merge those of the characters
+ *          with those of their style, following edits. The style runs of a
+ *          colored source must be no more than its attribute runs, in a few
+ *          bytes each.
+ */
+-(void)testStyleRuns
+{
+        PLStyleRunArray * styleRuns = [[PLStyleRunArray alloc] init];
+        PLStyleTable * styleTable = [[PLStyleTable alloc] initWithThemeManager:[PLThemeManager defaultThemeManager]];
+        PLSyntaxHighlighter * highlighter;
+        PLTextStorage * textStorage;
+        PLStyleRun runs[2] = {{NSMakeRange(2, 3), 1}, {NSMakeRange(8, 4), 2}};
+        PLStyle * expected = malloc(20000 * sizeof(PLStyle)), style;
+        NSUInteger i, j, location, length, insertedLength, numberOfRuns, numberOfAttributeRuns;
+        NSRange range;
+        srandom(22);
+
+        for (i = 0; i < 5000; i++) {
+                location = ([styleRuns length] > 0) ? random() % ([styleRuns length] + 1) : 0;
+                length = random() % (MIN([styleRuns length] - location, (NSUInteger)20) + 1);
+                style = (PLStyle)(random() % 4);
+                if (random() % 2 == 0 && [styleRuns length] < 19000) {
+                        insertedLength = random() % 20;
+                        if (length > 0)
+                                style = expected[location];
+                        else if (location > 0)
+                                style = expected[location - 1];
+                        else if ([styleRuns length] > 0)
+                                style = expected[0];
+                        [styleRuns replaceCharactersInRange:NSMakeRange(location, length) withLength:insertedLength];
+                        memmove(expected + location + insertedLength, expected + location + length, ([styleRuns length] - location - insertedLength) * sizeof(PLStyle));
+                        for (j = location; j < location + insertedLength; j++)
+                                expected[j] = style;
+                } else {
+                        [styleRuns setStyle:style range:NSMakeRange(location, length)];
+                        for (j = location; j < location + length; j++)
+                                expected[j] = style;
+                }
+        }
+        for (i = 0, numberOfRuns = 0; i < [styleRuns length]; i = NSMaxRange(range), numberOfRuns++) {
+                style = [styleRuns styleAtIndex:i effectiveRange:&range];
+                XCTAssertEqual(range.location, i);
+                for (j = range.location; j < NSMaxRange(range); j++)
+                        XCTAssertEqual(expected[j], style);
+                if (NSMaxRange(range) < [styleRuns length])
+                        XCTAssertTrue(expected[NSMaxRange(range)] != style);
+        }
+        XCTAssertEqual([styleRuns numberOfRuns], numberOfRuns);
+        free(expected);
+        [styleRuns release];
+
+        /* the attributes of the characters are merged with those of their style */
+        textStorage = [[PLTextStorage alloc] initWithString:@"0123456789abcdef"];
+        [textStorage addAttribute:NSBackgroundColorAttributeName value:[NSColor yellowColor] range:NSMakeRange(0, 4)];
+        [styleTable applyRuns:runs count:2 inRange:NSMakeRange(0, [textStorage length]) toTextStorage:textStorage];
+        XCTAssertEqual([textStorage styleTable], styleTable);
+        XCTAssertEqual([[textStorage styleRuns] numberOfRuns], (NSUInteger)5);
+        XCTAssertEqualObjects([textStorage attribute:NSForegroundColorAttributeName atIndex:3 effectiveRange:&range],
+                              [[styleTable attributesOfStyle:1] objectForKey:NSForegroundColorAttributeName]);
+        XCTAssertTrue(NSEqualRanges(range, NSMakeRange(2, 2)));
+        XCTAssertEqualObjects([textStorage attribute:NSBackgroundColorAttributeName atIndex:3 effectiveRange:NULL], [NSColor yellowColor]);
+        XCTAssertEqualObjects([textStorage attributesAtIndex:9 effectiveRange:NULL], [styleTable attributesOfStyle:2]);
+        [textStorage replaceCharactersInRange:NSMakeRange(9, 0) withString:@"xyz"];
+        XCTAssertEqual([[textStorage styleRuns] length], [textStorage length]);
+        XCTAssertEqualObjects([textStorage attributesAtIndex:10 effectiveRange:&range], [styleTable attributesOfStyle:2]);
+        XCTAssertTrue(NSEqualRanges(range, NSMakeRange(8, 7)));
+        [textStorage release];
+
+        /* the style runs of a colored source */
+        highlighter = [[PLSyntaxHighlighter alloc] init];
+        textStorage = [[PLTextStorage alloc] initWithString:randomPythonSource(20000)];
+        XCTAssertTrue([highlighter colorTextStorage:textStorage error:NULL]);
+        XCTAssertEqual([[textStorage styleRuns] length], [textStorage length]);
+        for (i = 0, numberOfAttributeRuns = 0; i < [textStorage length]; i = NSMaxRange(range), numberOfAttributeRuns++)
+                [textStorage attributesAtIndex:i effectiveRange:&range];
+        XCTAssertTrue([[textStorage styleRuns] numberOfRuns] <= numberOfAttributeRuns);
+        XCTAssertTrue([[textStorage styleRuns] size] < 16 * [[textStorage styleRuns] numberOfRuns] + 16384);
+        [textStorage release];
+        [highlighter release];
+        [styleTable release];
+}
+
+/**
+ * \brief Test the edit journal of a text storage.
+ *
+ * \details Consecutive keystrokes are coalesced into a single edit, and the
+ *          edited range spans the characters inserted by every edit. Indenting
+ *          500 lines between beginEditing and endEditing must post a single
+ *          pair of notifications, whose journal holds the 500 edits, while a
+ *          replacement outside of a batch is delivered on its own. The will
+ *          notification is posted before the first replacement is recorded.
+ */
+-(void)testEditJournal
+{
+        PLEditJournal * journal = [[PLEditJournal alloc] init];
+        PLTextStorage * textStorage;
+        NSMutableString * source = [NSMutableString string];
+        __block NSUInteger numberOfNotifications = 0, numberOfWillNotifications = 0;
+        __block PLEditJournal * lastJournal = nil;
+        NSUInteger i;
+        id observer, willObserver;
+
+        for (i = 0; i < 3; i++)
+                [journal addEditInRange:NSMakeRange(10 + i, 0) withLength:1 changeInNumberOfLines:0 generation:i + 1];
+        XCTAssertEqual([journal count], (NSUInteger)1);
+        XCTAssertEqual([journal changeInLength], (NSInteger)3);
+        XCTAssertEqual([journal generation], (NSUInteger)3);
+        XCTAssertTrue(NSEqualRanges([journal editedRange], NSMakeRange(10, 3)));
+        [journal addEditInRange:NSMakeRange(100, 2) withLength:6 changeInNumberOfLines:1 generation:4];
+        XCTAssertEqual([journal count], (NSUInteger)2);
+        XCTAssertEqual([journal changeInNumberOfLines], (NSInteger)1);
+        XCTAssertTrue(NSEqualRanges([journal editedRange], NSMakeRange(10, 96)));
+        [journal release];
+
+        for (i = 0; i < 500; i++)
+                [source appendFormat:@"x = %lu\n", (unsigned long)i];
+        textStorage = [[PLTextStorage alloc] initWithString:source];
+        observer = [[NSNotificationCenter defaultCenter] addObserverForName:PLTextStorageDidReplaceStringNotification
+                                                                     object:textStorage
+                                                                      queue:nil
+                                                                 usingBlock:^(NSNotification * notification) {
+                                                                         numberOfNotifications++;
+                                                                         [lastJournal release];
+                                                                         lastJournal = [[[notification userInfo] objectForKey:PLTextStorageEditJournalKey] retain];
+                                                                 }];
+        willObserver = [[NSNotificationCenter defaultCenter] addObserverForName:PLTextStorageWillReplaceStringNotification
+                                                                         object:textStorage
+                                                                          queue:nil
+                                                                     usingBlock:^(NSNotification * notification) {
+                                                                             numberOfWillNotifications++;
+                                                                             XCTAssertEqual([textStorage replacementRange].location, (NSUInteger)NSNotFound);
+                                                                     }];
+        [textStorage beginEditing];
+        for (i = 500; i > 0; i--)
+                [textStorage replaceCharactersInRange:NSMakeRange([textStorage characterIndexForLineNumber:i], 0) withString:@"    "];
+        XCTAssertEqual(numberOfNotifications, (NSUInteger)0);
+        XCTAssertEqual(numberOfWillNotifications, (NSUInteger)1);
+        [textStorage endEditing];
+        XCTAssertEqual(numberOfNotifications, (NSUInteger)1);
+        XCTAssertEqual([lastJournal count], (NSUInteger)500);
+        XCTAssertEqual([lastJournal changeInLength], (NSInteger)2000);
+        XCTAssertEqual([lastJournal generation], [textStorage generation]);
+        XCTAssertTrue(NSEqualRanges([lastJournal editedRange], NSMakeRange(0, [textStorage length] - [@"x = 499\n" length])));
+
+        [textStorage replaceCharactersInRange:NSMakeRange(0, 4) withString:@""];
+        XCTAssertEqual(numberOfNotifications, (NSUInteger)2);
+        XCTAssertEqual(numberOfWillNotifications, (NSUInteger)2);
+        XCTAssertEqual([lastJournal count], (NSUInteger)1);
+        XCTAssertTrue(NSEqualRanges([lastJournal editedRange], NSMakeRange(0, 0)));
+        [[NSNotificationCenter defaultCenter] removeObserver:observer];
+        [[NSNotificationCenter defaultCenter] removeObserver:willObserver];
+        [lastJournal release];
+        [textStorage release];
+}
+
+/**
+ * \brief Test the snapshots of a text storage.
+ *
+ * \details A snapshot of each backing store keeps the characters and the edit
+ *          generation of the text storage when it was taken, while the text
+ *          storage is edited and several background threads read the
+ *          snapshot at once. The text storage of a document uses the rope
+ *          backing store, whose snapshot shares its string.
+ */
+-(void)testTextSnapshot
+{
+        PLTextDocument * document = [PLTextDocument emptyDocument];
+        PLTextStorageBackingStore backingStores[2] = {PLTextStorageBackingStoreAttributedString, PLTextStorageBackingStoreRope};
+        NSMutableString * source = [NSMutableString string];
+        dispatch_group_t group = dispatch_group_create();
+        __block NSString * read = nil;
+        PLTextStorage * textStorage;
+        PLTextSnapshot * snapshot;
+        NSString * expected;
+        NSUInteger i, backingStore, location, * mismatches = calloc(4, sizeof(NSUInteger));
+        srandom(24);
+        while ([source length] < 10 << 20)
+                [source appendString:randomPythonSource(1000)];
+
+        for (backingStore = 0; backingStore < 2; backingStore++) {
+                textStorage = [[PLTextStorage alloc] initWithString:source backingStore:backingStores[backingStore]];
+                [textStorage replaceCharactersInRange:NSMakeRange(0, 1) withString:@"#"];
+                snapshot = [textStorage snapshot];
+                expected = [[textStorage string] copy];
+                XCTAssertEqual([snapshot generation], [textStorage generation]);
+
+                /* a background thread reads the snapshot while the text storage is edited */
+                dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                        unichar * characters = malloc([snapshot length] * sizeof(unichar));
+                        [snapshot getCharacters:characters range:NSMakeRange(0, [snapshot length])];
+                        read = [[NSString alloc] initWithCharactersNoCopy:characters length:[snapshot length] freeWhenDone:YES];
+                });
+
+                /* other threads read the same snapshot character by character meanwhile */
+                for (i = 0; i < 4; i++) {
+                        dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                                for (NSUInteger index = i; index < [snapshot length]; index += 997)
+                                        mismatches[i] += ([snapshot characterAtIndex:index] != [expected characterAtIndex:index]);
+                        });
+                }
+                for (i = 0; i < 200; i++) {
+                        location = random() % [textStorage length];
+                        [textStorage replaceCharactersInRange:NSMakeRange(location, random() % 2) withString:@"x"];
+                }
+                dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+                XCTAssertEqualObjects(read, expected);
+                for (i = 0; i < 4; i++)
+                        XCTAssertEqual(mismatches[i], (NSUInteger)0);
+                XCTAssertEqualObjects(snapshot, expected);
+                XCTAssertEqual([snapshot generation] + 200, [textStorage generation]);
+                XCTAssertEqualObjects([textStorage snapshot], [textStorage string]);
+                [read release];
+                [expected release];
+                [textStorage release];
+        }
+        dispatch_release(group);
+        free(mismatches);
+
+        /* the text storage of a document is backed by a rope */
+        [document setData:[source dataUsingEncoding:NSUTF8StringEncoding]];
+        textStorage = [document newTextStorage];
+        XCTAssertEqual([textStorage backingStore], PLTextStorageBackingStoreRope);
+        XCTAssertEqualObjects([textStorage snapshot], source);
+        [textStorage release];
+        [document release];
+}
+
+/**
+ * \brief Test the edit channels of a text storage.
+ *
+ * \details Edits of the attributes reach only the observers of the
+ *          attributes, once per batch and in the coordinates of the text after
+ *          the batch, and leave the line index untouched, while edits of the
+ *          characters reach only the observers of the characters, after the
+ *          text storage processed them.
+ */
+-(void)testEditChannels
+{
+        PLTextStorage * textStorage = [[PLTextStorage alloc] initWithString:@"x = 1\ny = 2\nz = 3\n"];
+        PLTestEditObserver * characterObserver = [[PLTestEditObserver alloc] init];
+        PLTestEditObserver * attributeObserver = [[PLTestEditObserver alloc] init];
+        NSDictionary * attributes = @{NSForegroundColorAttributeName: [NSColor redColor]};
+        NSUInteger generation;
+
+        [textStorage addEditObserver:characterObserver];
+        [textStorage addEditObserver:attributeObserver editMask:NSTextStorageEditedAttributes];
+        generation = [textStorage generation];
+        [textStorage addAttribute:NSForegroundColorAttributeName value:[NSColor blueColor] range:NSMakeRange(0, 1)];
+        XCTAssertEqual(characterObserver->numberOfCharacterEdits, (NSUInteger)0);
+        XCTAssertEqual(attributeObserver->numberOfAttributeEdits, (NSUInteger)1);
+        XCTAssertTrue(NSEqualRanges(attributeObserver->attributeEditedRange, NSMakeRange(0, 1)));
+
+        [textStorage beginEditing];
+        [textStorage setAttributes:attributes range:NSMakeRange(6, 5)];
+        [textStorage setAttributes:attributes range:NSMakeRange(12, 5)];
+        XCTAssertEqual(attributeObserver->numberOfAttributeEdits, (NSUInteger)1);
+        [textStorage endEditing];
+        XCTAssertEqual(attributeObserver->numberOfAttributeEdits, (NSUInteger)2);
+        XCTAssertTrue(NSEqualRanges(attributeObserver->attributeEditedRange, NSMakeRange(6, 11)));
+        XCTAssertEqual(characterObserver->numberOfCharacterEdits, (NSUInteger)0);
+        XCTAssertEqual([textStorage generation], generation);
+        XCTAssertEqual([textStorage numberOfLines], (NSUInteger)4);
+
+        [textStorage beginEditing];
+        [textStorage setAttributes:attributes range:NSMakeRange(12, 5)];
+        [textStorage replaceCharactersInRange:NSMakeRange(0, 0) withString:@"# comment\n"];
+        [textStorage endEditing];
+        XCTAssertEqual(characterObserver->numberOfCharacterEdits, (NSUInteger)1);
+        XCTAssertEqual(characterObserver->editedMask, (NSUInteger)0);
+        XCTAssertEqual(attributeObserver->numberOfCharacterEdits, (NSUInteger)0);
+        XCTAssertEqual(attributeObserver->numberOfAttributeEdits, (NSUInteger)3);
+        XCTAssertTrue(NSEqualRanges(attributeObserver->attributeEditedRange, NSMakeRange(22, 5)));
+
+        [textStorage replaceCharactersInRange:NSMakeRange(10, 0)
+                         withAttributedString:[[[NSAttributedString alloc] initWithString:@"w = 0\n" attributes:attributes] autorelease]];
+        XCTAssertEqual(characterObserver->numberOfCharacterEdits, (NSUInteger)2);
+        XCTAssertEqual(attributeObserver->numberOfAttributeEdits, (NSUInteger)4);
+        XCTAssertTrue(NSEqualRanges(attributeObserver->attributeEditedRange, NSMakeRange(10, 6)));
+
+        [textStorage removeEditObserver:characterObserver];
+        [textStorage removeEditObserver:attributeObserver];
+        [textStorage setAttributes:attributes range:NSMakeRange(0, 1)];
+        XCTAssertEqual(attributeObserver->numberOfAttributeEdits, (NSUInteger)4);
+        [characterObserver release];
+        [attributeObserver release];
+        [textStorage release];
+}
+
+@end
+
+/**
+ * \brief Return a random Python source of a number of megabytes, built from a
+ *        repeated megabyte and kept across calls.
+ */
+static NSString * typingSourceOfSize(NSUInteger megabytes)
+{
+        static NSMutableDictionary * sources = nil;
+        NSMutableString * source;
+        NSString * megabyte;
+        NSUInteger i;
+        if (sources == nil)
+                sources = [[NSMutableDictionary alloc] init];
+        source = [sources objectForKey:@(megabytes)];
+        if (source)
+                return source;
+        srandom(21);
+        megabyte = randomPythonSource(1000);
+        while ([megabyte length] < 1 << 20)
+                megabyte = [megabyte stringByAppendingString:randomPythonSource(1000)];
+        megabyte = [megabyte substringToIndex:1 << 20];
+        source = [NSMutableString stringWithCapacity:megabytes << 20];
+        for (i = 0; i < megabytes; i++)
+                [source appendString:megabyte];
+        [sources setObject:source forKey:@(megabytes)];
+        return source;
+}
+
+/**
+ * \brief Measurements of LiasisKit that are too long for the regular unit
+ *        tests.
+ *
+ * \details The tests of this class run only when the PL_BENCHMARKS or the
+ *          PL_TYPING_BENCHMARK_SIZE environment variable is set, such as in
+ *          the arguments of a scheme made for them.
+ */
+@interface LiasisKitBenchmarks : XCTestCase
+
+@end
+
+@implementation LiasisKitBenchmarks
+
++(XCTestSuite *)defaultTestSuite
+{
+        if (getenv("PL_BENCHMARKS") == NULL && getenv("PL_TYPING_BENCHMARK_SIZE") == NULL)
+                return [XCTestSuite testSuiteWithName:NSStringFromClass(self)];
+        return [super defaultTestSuite];
+}
+
+/**
+ * \brief Measure typing near the top of a file with the PLLineIndex class.
+ *
+ * \details Measure single character insertions on the tenth line of a file
+ *          with 200,000 lines, every tenth keystroke being a newline that
+ *          splits the line, and eventually the block holding it. The cost of a
+ *          keystroke should not grow with the length of the file, which the
+ *          baseline of the measurement tracks.
+ */
+-(void)testLineIndexKeystrokePerformance
+{
+        NSUInteger numberOfLines = 200000, * lineLengths;
+        PLLineIndex * lineIndex = [[PLLineIndex alloc] init];
+        
+        lineLengths = malloc(numberOfLines * sizeof(NSUInteger));
+        for (NSUInteger line = 0; line < numberOfLines; line++)
+                lineLengths[line] = 40;
+        [lineIndex replaceLinesInRange:NSMakeRange(1, 1) withLineLengths:lineLengths count:numberOfLines];
+        free(lineLengths);
+        [self measureBlock:^{
+                NSUInteger lineLengths[2];
+                for (int keystroke = 0; keystroke < 10000; keystroke++) {
+                        lineLengths[0] = 1;
+                        lineLengths[1] = [lineIndex rangeOfLineNumber:10].length;
+                        if (keystroke % 10 == 9) {
+                                [lineIndex replaceLinesInRange:NSMakeRange(10, 1) withLineLengths:lineLengths count:2];
+                        } else {
+                                lineLengths[1]++;
+                                [lineIndex replaceLinesInRange:NSMakeRange(10, 1) withLineLengths:lineLengths + 1 count:1];
+                        }
+                        [lineIndex lineNumberForCharacterIndex:[lineIndex length] - 1];
+                }
+        }];
+        XCTAssertEqual(([lineIndex length] - numberOfLines * 40) % 10000, (NSUInteger)0);
+        XCTAssertEqual(([lineIndex numberOfLines] - numberOfLines) % 1000, (NSUInteger)0);
+        XCTAssertEqual([lineIndex rangeOfLineNumber:[lineIndex numberOfLines]].length, (NSUInteger)40);
+        [lineIndex release];
+}
+
+/**
+ * \brief Measure pasting and deleting a large string with the PLLineIndex
+ *        class.
+ *
+ * \details Paste a 30 MB string of 750,000 lines in the middle of a 2,000 line
+ *          file, and delete it again. testLineIndexPaste checks the same edit
+ *          on fewer lines.
+ */
+-(void)testLineIndexPastePerformance
+{
+        NSUInteger numberOfLines = 750000;
+        NSString * line = @"    value = compute(value, index) + 1\n";
+        NSString * file, * paste, * pastedFile;
+        PLLineIndex * lineIndex;
+        NSUInteger location;
+        
+        file = [@"" stringByPaddingToLength:2000 * [line length] withString:line startingAtIndex:0];
+        paste = [@"" stringByPaddingToLength:numberOfLines * [line length] withString:line startingAtIndex:0];
+        lineIndex = [[PLLineIndex alloc] init];
+        [lineIndex replaceCharactersInRange:NSMakeRange(0, 0) withString:file inString:@""];
+        location = [lineIndex characterIndexForLineNumber:1000];
+        pastedFile = [file stringByReplacingCharactersInRange:NSMakeRange(location, 0) withString:paste];
+        [self measureBlock:^{
+                [lineIndex replaceCharactersInRange:NSMakeRange(location, 0) withString:paste inString:file];
+                [lineIndex replaceCharactersInRange:NSMakeRange(location, [paste length]) withString:@"" inString:pastedFile];
+        }];
+        XCTAssertEqual([lineIndex numberOfLines], (NSUInteger)2001);
+        [lineIndex release];
+}
+
+/**
+ * \brief Measure drawing the PLLineNumberView while scrolling.
+ *
+ * \details Measure the ruler frames while scrolling through a file with
+ *          100,000 lines. The viewport line cache only lays out the lines
+ *          scrolled into view, so the cost of a frame should not grow with the
+ *          length of the file, which the baseline of the measurement tracks.
+ */
+-(void)testLineNumberViewScrollPerformance
+{
+        measureLineNumberViewScrolling(self, 100000, 200);
+}
+
+/**
+ * \brief Measure the throughput of the native Python tokenizer.
+ *
+ * \details Tokenize about 1 MB of Python source, copying its characters as
+ *          the syntax highlighter does for a pass.
+ */
+-(void)testPythonTokenizerThroughput
+{
+        PLPythonTokenizer * tokenizer = [[PLPythonTokenizer alloc] init];
+        NSString * sample = @"class Parser(object):\n"
+                            @"    \"\"\" Parse a stream of tokens.\n\n    The parser is not thread safe.\n    \"\"\"\n\n"
+                            @"    def __init__(self, stream, limit=1e6):\n"
+                            @"        self.stream = stream  # the token stream\n"
+                            @"        self.values = [0x1F, 3.25, .5, 'value', \"name\"]\n"
+                            @"        if limit is None or len(stream) > limit:\n"
+                            @"            raise ValueError('stream too long: %d' % len(stream))\n\n";
+        NSMutableString * source = [NSMutableString string];
+        while ([source length] < 1000000)
+                [source appendString:sample];
+
+        [self measureBlock:^{
+                unichar * characters = malloc([source length] * sizeof(unichar));
+                [source getCharacters:characters range:NSMakeRange(0, [source length])];
+                [tokenizer tokenizeCharacters:characters length:[source length] lexerState:PLLexerStateDefault lineEnds:NULL lexerStates:NULL count:0];
+                free(characters);
+        }];
+        XCTAssertTrue([tokenizer numberOfTokens] > 0);
+        [tokenizer release];
+}
+
+/**
+ * \brief Measure typing 1000 characters in a text storage.
+ *
+ * \details The measurement is set by environment variables:
+ *          PL_TYPING_BENCHMARK_SIZE is the number of megabytes of the text
+ *          storage (by default 1), PL_TYPING_BENCHMARK_STORE is "rope" or "attributedString"
+ *          (by default "rope"), and PL_TYPING_BENCHMARK_POSITION is "head",
+ *          "middle" or "tail" (by default "middle").
+ */
+-(void)testTypingPerformance
+{
+        NSDictionary * environment = [[NSProcessInfo processInfo] environment];
+        NSString * store = [environment objectForKey:@"PL_TYPING_BENCHMARK_STORE"];
+        NSString * position = [environment objectForKey:@"PL_TYPING_BENCHMARK_POSITION"];
+        NSUInteger megabytes = (NSUInteger)[[environment objectForKey:@"PL_TYPING_BENCHMARK_SIZE"] integerValue];
+        PLTextStorageBackingStore backingStore = PLTextStorageBackingStoreRope;
+        PLTextStorage * textStorage;
+        __block NSUInteger location;
+        if ([store isEqualToString:@"attributedString"])
+                backingStore = PLTextStorageBackingStoreAttributedString;
+        textStorage = [[PLTextStorage alloc] initWithString:typingSourceOfSize(MAX(megabytes, 1)) backingStore:backingStore];
+        if ([position isEqualToString:@"head"])
+                location = 0;
+        else if ([position isEqualToString:@"tail"])
+                location = [textStorage length];
+        else
+                location = [textStorage length] / 2;
+        [self measureBlock:^{
+                for (NSUInteger keystroke = 0; keystroke < 1000; keystroke++)
+                        [textStorage replaceCharactersInRange:NSMakeRange(location++, 0) withString:(keystroke % 10 == 9) ? @"\n" : @"x"];
+        }];
+        XCTAssertEqual([[textStorage string] characterAtIndex:location - 2], (unichar)'x');
+        [textStorage release];
+}
+
 @end